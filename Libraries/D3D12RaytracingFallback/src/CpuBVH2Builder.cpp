@@ -9,6 +9,7 @@
 //
 //*********************************************************
 #include "pch.h"
+#include "WorkStealingPool.h"
 
 namespace FallbackLayer
 {
@@ -40,33 +41,6 @@ namespace FallbackLayer
         return v & 0x00ffffff;
     }
 
-    static
-        void ComputeBox(
-            AABB& overallBox,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& metadata)
-    {
-        if (metadata.empty())
-        {
-            overallBox.max.x = overallBox.min.x = 0;
-            overallBox.max.y = overallBox.min.y = 0;
-            overallBox.max.z = overallBox.min.z = 0;
-            return;
-        }
-
-        overallBox = boxes[metadata[0].PrimitiveIndex];
-
-        const UINT32 numTris = (UINT32)metadata.size();
-        for (UINT32 i = 1; i < numTris; ++i)
-        {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            assert(triId < boxes.size());
-            const AABB& newBox = boxes[triId];
-
-            AddExtentToBox(overallBox, newBox);
-        }
-    }
-
     //
     // Convert a 16-bit float to 32-bit.
     //
@@ -117,15 +91,44 @@ namespace FallbackLayer
     }
 
     static
-        UINT32 BuildBVHAddNode(
-            BVH& bvh,
-            const AABB& box,
-            UINT32 maxDimension)
+        float ComputeBoxSurfaceArea(
+            const AABB& box)
+    {
+        const float dims[3] =
+        {
+            box.max.x - box.min.x,
+            box.max.y - box.min.y,
+            box.max.z - box.min.z
+        };
+
+        return 2 * (dims[0] * dims[1] + dims[0] * dims[2] + dims[1] * dims[2]);
+    }
+
+    static
+        void InitBoxToInverseMax(
+            AABB& box)
     {
-        UNREFERENCED_PARAMETER(maxDimension);
-        assert(maxDimension < 3);
-        const UINT32 nodeIndex = (UINT32)bvh.m_nodes.size();
+        box.max.x = box.max.y = box.max.z = -10e10f;//FLT_MAX;
+        box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
+    }
 
+    static
+        void AddPointToBox(
+            AABB& box,
+            const float point[3])
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            box.minArr[i] = std::min(box.minArr[i], point[i]);
+            box.maxArr[i] = std::max(box.maxArr[i], point[i]);
+        }
+    }
+
+    static
+        void WriteNodeBox(
+            AABBNode& node,
+            const AABB& box)
+    {
         float cX = (box.max.x + box.min.x) * 0.5f;
         float cY = (box.max.y + box.min.y) * 0.5f;
         float cZ = (box.max.z + box.min.z) * 0.5f;
@@ -133,391 +136,602 @@ namespace FallbackLayer
         cY = QuantizeToFp16(cY);
         cZ = QuantizeToFp16(cZ);
 
-        float dX = max(box.max.x - cX, cX - box.min.x);
-        float dY = max(box.max.y - cY, cY - box.min.y);
-        float dZ = max(box.max.z - cZ, cZ - box.min.z);
-
-        AABBNode packedBox;
-        packedBox.center[0] = cX;
-        packedBox.center[1] = cY;
-        packedBox.center[2] = cZ;
-        packedBox.halfDim[0] = dX;
-        packedBox.halfDim[1] = dY;
-        packedBox.halfDim[2] = dZ;
-        packedBox.nodeAllBits = 0;
-
-        bvh.m_nodes.push_back(packedBox);
-
-        assert(bvh.m_nodes.size() - 1 == nodeIndex);
-
-        bvh.m_nodes[nodeIndex].internalNode.separatingAxis = 0;
-
-        return nodeIndex;
+        node.center[0] = cX;
+        node.center[1] = cY;
+        node.center[2] = cZ;
+        node.halfDim[0] = std::max(box.max.x - cX, cX - box.min.x);
+        node.halfDim[1] = std::max(box.max.y - cY, cY - box.min.y);
+        node.halfDim[2] = std::max(box.max.z - cZ, cZ - box.min.z);
+        node.nodeAllBits = 0;
     }
 
-    static
-        UINT32 BuildBVHAddLeaf(
-            BVH& bvh,
-            const AABB& box,
-            const std::vector<PrimitiveMetaData>& metadata)
+    //
+    // Binned SAH builder over a single array of primitive references that is
+    // partitioned in place as the tree is split.
+    //
+    // The node over references [begin, end) owns the node slots
+    // [nodeIndex, nodeIndex + 2 * (end - begin) - 1): the node itself, then the
+    // subtree over the first part of its references, then the subtree over the
+    // rest. That is the "uniform BVH" layout (the right child at parent + 1, the
+    // left child's index stored in the node), and because a subtree's slots are
+    // known before it is built, subtrees are built as independent tasks that
+    // never touch each other's nodes. With one triangle per leaf every slot is
+    // used, bigger leaves leave gaps that are compacted away at the end.
+    //
+    // Leaves reference their range of the final reference array, which is in
+    // the same order as the leaves.
+    //
+    class BinnedSahBuilder
     {
-        const UINT32 nodeIndex = BuildBVHAddNode(bvh, box, 0);
-
-        bvh.m_nodes[nodeIndex].nodeAllBits = 0;
-        bvh.m_nodes[nodeIndex].leaf = true;
-
-        const UINT32 idIndex = (UINT32)bvh.m_metadata.size();
-
-        std::copy(metadata.begin(), metadata.end(), std::back_inserter(bvh.m_metadata));
+    public:
+        BinnedSahBuilder(
+            const std::vector<AABB>& boxes,
+            const std::vector<PrimitiveMetaData>& primitiveMetaData,
+            UINT32 maxTrisInLeaf,
+            WorkStealingPool* pPool) :
+            m_boxes(boxes),
+            m_primitiveMetaData(primitiveMetaData),
+            m_maxTrisInLeaf(std::max(maxTrisInLeaf, 1u)),
+            m_pPool(pPool),
+            m_pNodes(nullptr)
+        {
+        }
 
-        assert(metadata.size() < 128);
-        assert(idIndex < (1 << 24));
+        void Build(BVH& bvh);
 
-        bvh.m_nodes[nodeIndex].leafNode.firstTriangleId = idIndex;
-        bvh.m_nodes[nodeIndex].leafNode.numTriangleIds = (UINT32)metadata.size();
+    private:
+        static const UINT NUM_SAH_BINS = 64;
 
-        return nodeIndex;
-    }
+        // Subtrees with fewer references are built by the thread that split them off
+        static const UINT32 MIN_REFERENCES_PER_TASK = 2048;
 
-    //
-    // Sort min to max by centroid
-    //
+        // Nodes with at least this many references are binned in chunks across the pool
+        static const UINT32 MIN_REFERENCES_FOR_PARALLEL_BINNING = 64 * 1024;
+        static const UINT32 REFERENCES_PER_CHUNK = 16 * 1024;
 
-    static
-        void SortByCentroid(
-            std::vector<PrimitiveMetaData>& metadata,
-            const std::vector<AABB>& boxes,
-            UINT32 maxDimension)
-    {
-        struct TriPosition
+        struct BuildPrimitive
         {
-            float   pos;
-            UINT32  id;
+            AABB    box;
+            float   centroid[3];
         };
 
-        std::vector<TriPosition> sortTris(metadata.size());
-
-        for (UINT32 i = 0; i < metadata.size(); ++i)
+        struct BuildRange
         {
-            const UINT32 triId = metadata[i].PrimitiveIndex;
-            const AABB& box = boxes[triId];
+            UINT32  begin;
+            UINT32  end;
+            UINT32  nodeIndex;
+            AABB    box;
+            AABB    centroidBox;
+        };
 
-            const float boxCenter = (box.maxArr[maxDimension] + box.minArr[maxDimension]) / 2;
+        struct SahBin
+        {
+            AABB    box;
+            AABB    centroidBox;
+            UINT32  numTriangles;
+        };
 
-            sortTris[i].pos = boxCenter;
-            sortTris[i].id = metadata[i].PrimitiveIndex;
-        }
+        struct SahBins
+        {
+            SahBin  bins[3][NUM_SAH_BINS];
+        };
 
-        // Split the list into left and right sublists
-        std::sort(sortTris.begin(), sortTris.end(), [](auto&& a, auto&& b) -> bool { return a.pos < b.pos; });
+        static void InitBin(SahBin& bin);
+        static void AddBinToBin(SahBin& bin, const SahBin& other);
 
-        // Update the output
-        for (UINT32 i = 0; i < metadata.size(); ++i)
+        static UINT BinIndex(float centroid, float rangeMin, float binScale, UINT numBins)
         {
-            metadata[i].PrimitiveIndex = sortTris[i].id;
+            return std::min(numBins - 1, UINT((centroid - rangeMin) * binScale));
         }
-    }
 
+        template<typename Function>
+        void ForEachChunk(UINT32 begin, UINT32 end, Function function);
+
+        void InitReferences();
+        void ComputeBounds(UINT32 begin, UINT32 end, AABB& box, AABB& centroidBox);
+        void BinReferences(UINT32 begin, UINT32 end, const AABB& centroidBox, const float binScale[3], UINT numBins, SahBins& sahBins) const;
+        void Bin(const BuildRange& range, const float binScale[3], UINT numBins, SahBins& sahBins);
+        void Split(const BuildRange& range, BuildRange& first, BuildRange& second);
+        void WriteLeaf(const BuildRange& range);
+        void WriteInternalNode(const BuildRange& range, UINT32 leftNodeIndex);
+        void BuildSubtree(const BuildRange& subtree);
+        void CompactNodes(BVH& bvh) const;
+
+        const std::vector<AABB>& m_boxes;
+        const std::vector<PrimitiveMetaData>& m_primitiveMetaData;
+        const UINT32 m_maxTrisInLeaf;
+        WorkStealingPool* m_pPool;
+
+        std::vector<BuildPrimitive> m_primitives;
+        std::vector<UINT32> m_references;
+        AABBNode* m_pNodes;
+        std::vector<BYTE> m_usedNodes;
+        WorkStealingPool::TaskGroup m_subtreeTasks;
+    };
 
-    static
-        float ComputeBoxSurfaceArea(
-            const AABB& box)
+    void BinnedSahBuilder::InitBin(
+        SahBin& bin)
     {
-        const float dims[3] =
-        {
-            box.max.x - box.min.x,
-            box.max.y - box.min.y,
-            box.max.z - box.min.z
-        };
-
-        return 2 * (dims[0] * dims[1] + dims[0] * dims[2] + dims[1] * dims[2]);
+        InitBoxToInverseMax(bin.box);
+        InitBoxToInverseMax(bin.centroidBox);
+        bin.numTriangles = 0;
     }
 
-    static
-        void InitBoxToInverseMax(
-            AABB& box)
+    void BinnedSahBuilder::AddBinToBin(
+        SahBin& bin,
+        const SahBin& other)
     {
-        box.max.x = box.max.y = box.max.z = -10e10f;//FLT_MAX;
-        box.min.x = box.min.y = box.min.z = 10e10f;//FLT_MAX;
+        AddExtentToBox(bin.box, other.box);
+        AddExtentToBox(bin.centroidBox, other.centroidBox);
+        bin.numTriangles += other.numTriangles;
     }
 
     //
-    // A feeble attempt at a SAH builder
+    // Calls function(chunkIndex, chunkBegin, chunkEnd) over [begin, end) in
+    // REFERENCES_PER_CHUNK pieces, spread across the pool when there is one
     //
-
-    static
-        void SahSplit(
-            std::vector<PrimitiveMetaData>& metadata,
-            UINT32& maxDimension,
-            UINT32& numTrisInLeftNode,
-            const AABB& nodeBox,
-            const std::vector<AABB>& boxes)
+    template<typename Function>
+    void BinnedSahBuilder::ForEachChunk(
+        UINT32 begin,
+        UINT32 end,
+        Function function)
     {
-        static const UINT NUM_SAH_BINS = 64;
+        const UINT32 numChunks = (end - begin + REFERENCES_PER_CHUNK - 1) / REFERENCES_PER_CHUNK;
+        auto chunkBegin = [&](UINT32 chunk) { return begin + chunk * REFERENCES_PER_CHUNK; };
+        auto chunkEnd = [&](UINT32 chunk) { return std::min(end, begin + (chunk + 1) * REFERENCES_PER_CHUNK); };
 
-        struct SahBin
+        if (!m_pPool || numChunks <= 1)
         {
-            AABB    box;
-            UINT    numTriangles;
-        };
-
-        // NOTE: use vector if this blows out the stack?
-        SahBin  sahBins[3][NUM_SAH_BINS];
-
-        // For the score to be meaningful it seems we need to normalize it to something
-        const float normalizeToParent = 1.f / ComputeBoxSurfaceArea(nodeBox);
+            for (UINT32 chunk = 0; chunk < numChunks; ++chunk)
+            {
+                function(chunk, chunkBegin(chunk), chunkEnd(chunk));
+            }
+            return;
+        }
 
-        const UINT numTris = (UINT)metadata.size();
+        WorkStealingPool::TaskGroup chunkTasks;
+        for (UINT32 chunk = 1; chunk < numChunks; ++chunk)
+        {
+            const UINT32 b = chunkBegin(chunk);
+            const UINT32 e = chunkEnd(chunk);
+            m_pPool->Spawn(chunkTasks, [&function, chunk, b, e]() { function(chunk, b, e); });
+        }
+        function(0, chunkBegin(0), chunkEnd(0));
+        m_pPool->Wait(chunkTasks);
+    }
 
-        float bestSah = FLT_MAX;
-        maxDimension = 0;
-        //numTrisInLeftNode = triangleIds.size() / 2;
+    void BinnedSahBuilder::InitReferences()
+    {
+        const UINT32 numReferences = (UINT32)m_primitiveMetaData.size();
+        m_primitives.resize(numReferences);
+        m_references.resize(numReferences);
 
-        // Compute SAH score per axis
-        for (UINT i = 0; i < 3; ++i)
+        ForEachChunk(0, numReferences, [this](UINT32, UINT32 begin, UINT32 end)
         {
-            const float extents = nodeBox.maxArr[i] - nodeBox.minArr[i];
-            if (extents == 0)
-                continue;
+            for (UINT32 i = begin; i < end; ++i)
+            {
+                const UINT32 triId = m_primitiveMetaData[i].PrimitiveIndex;
+                assert(triId < m_boxes.size());
 
-            const float rangeMin = nodeBox.minArr[i];
+                BuildPrimitive& primitive = m_primitives[i];
+                primitive.box = m_boxes[triId];
+                for (UINT k = 0; k < 3; ++k)
+                {
+                    primitive.centroid[k] = (primitive.box.maxArr[k] + primitive.box.minArr[k]) * 0.5f;
+                }
+                m_references[i] = i;
+            }
+        });
+    }
 
-            const float inverseExtents = 1.f / extents;
+    void BinnedSahBuilder::ComputeBounds(
+        UINT32 begin,
+        UINT32 end,
+        AABB& box,
+        AABB& centroidBox)
+    {
+        const UINT32 numChunks = (end - begin + REFERENCES_PER_CHUNK - 1) / REFERENCES_PER_CHUNK;
+        std::vector<SahBin> chunkBounds(numChunks);
 
-            // Init boxes
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+        ForEachChunk(begin, end, [&](UINT32 chunk, UINT32 chunkBegin, UINT32 chunkEnd)
+        {
+            SahBin& bounds = chunkBounds[chunk];
+            InitBin(bounds);
+            for (UINT32 i = chunkBegin; i < chunkEnd; ++i)
             {
-                sahBins[i][j].numTriangles = 0;
-                InitBoxToInverseMax(sahBins[i][j].box);
+                const BuildPrimitive& primitive = m_primitives[m_references[i]];
+                AddExtentToBox(bounds.box, primitive.box);
+                AddPointToBox(bounds.centroidBox, primitive.centroid);
             }
+        });
+
+        SahBin total;
+        InitBin(total);
+        for (const SahBin& bounds : chunkBounds)
+        {
+            AddBinToBin(total, bounds);
+        }
+        box = total.box;
+        centroidBox = total.centroidBox;
+    }
 
-            // Place triangles into the buckets
-            for (UINT j = 0; j < metadata.size(); ++j)
+    //
+    // One pass over the references bins them on all three axes at once
+    //
+    void BinnedSahBuilder::BinReferences(
+        UINT32 begin,
+        UINT32 end,
+        const AABB& centroidBox,
+        const float binScale[3],
+        UINT numBins,
+        SahBins& sahBins) const
+    {
+        for (UINT i = 0; i < 3; ++i)
+        {
+            for (UINT j = 0; j < numBins; ++j)
             {
-                const UINT triId = metadata[j].PrimitiveIndex;
+                InitBin(sahBins.bins[i][j]);
+            }
+        }
 
-                const AABB& triBox = boxes[triId];
+        for (UINT32 r = begin; r < end; ++r)
+        {
+            const BuildPrimitive& primitive = m_primitives[m_references[r]];
+            for (UINT i = 0; i < 3; ++i)
+            {
+                if (binScale[i] == 0)
+                {
+                    continue;
+                }
 
-                const float centroid = (triBox.maxArr[i] + triBox.minArr[i]) * 0.5f;
+                SahBin& bin = sahBins.bins[i][BinIndex(primitive.centroid[i], centroidBox.minArr[i], binScale[i], numBins)];
+                bin.numTriangles++;
+                AddExtentToBox(bin.box, primitive.box);
+                AddPointToBox(bin.centroidBox, primitive.centroid);
+            }
+        }
+    }
 
-                const UINT binIndex = std::min(NUM_SAH_BINS - 1,
-                    UINT(NUM_SAH_BINS * ((centroid - rangeMin) * inverseExtents)));
+    void BinnedSahBuilder::Bin(
+        const BuildRange& range,
+        const float binScale[3],
+        UINT numBins,
+        SahBins& sahBins)
+    {
+        const UINT32 numTris = range.end - range.begin;
+        if (!m_pPool || numTris < MIN_REFERENCES_FOR_PARALLEL_BINNING)
+        {
+            BinReferences(range.begin, range.end, range.centroidBox, binScale, numBins, sahBins);
+            return;
+        }
 
-                sahBins[i][binIndex].numTriangles++;
-                AddExtentToBox(sahBins[i][binIndex].box, triBox);
-            }
+        // Near the root there are too few subtrees to keep the pool busy, so
+        // the binning itself is split up instead
+        const UINT32 numChunks = (numTris + REFERENCES_PER_CHUNK - 1) / REFERENCES_PER_CHUNK;
+        std::vector<SahBins> chunkBins(numChunks);
+        ForEachChunk(range.begin, range.end, [&](UINT32 chunk, UINT32 chunkBegin, UINT32 chunkEnd)
+        {
+            BinReferences(chunkBegin, chunkEnd, range.centroidBox, binScale, numBins, chunkBins[chunk]);
+        });
 
-            // Make sure we caught all of them once
-            UINT testTris = 0;
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+        sahBins = chunkBins[0];
+        for (UINT32 chunk = 1; chunk < numChunks; ++chunk)
+        {
+            for (UINT i = 0; i < 3; ++i)
             {
-                testTris += sahBins[i][j].numTriangles;
+                for (UINT j = 0; j < numBins; ++j)
+                {
+                    AddBinToBin(sahBins.bins[i][j], chunkBins[chunk].bins[i][j]);
+                }
             }
-            assert(testTris == numTris);
+        }
+    }
 
-            // Precompute left and right boxes with counts to be able to test plane positionings
+    //
+    // Picks the cheapest of the planes between bins on any axis and
+    // partitions the range's references around it
+    //
+    void BinnedSahBuilder::Split(
+        const BuildRange& range,
+        BuildRange& first,
+        BuildRange& second)
+    {
+        const UINT32 numTris = range.end - range.begin;
 
-            AABB leftBoxes[NUM_SAH_BINS];
-            AABB rightBoxes[NUM_SAH_BINS];
+        // Most nodes are small, and setting up and sweeping all the bins
+        // would cost them more than binning their few triangles
+        const UINT numBins = std::min(NUM_SAH_BINS, numTris);
 
-            for (UINT j = 0; j < NUM_SAH_BINS; ++j)
+        // Bins span the centroids rather than the boxes, so none of them is wasted on overhang
+        float binScale[3];
+        bool canBin = false;
+        for (UINT i = 0; i < 3; ++i)
+        {
+            const float extents = range.centroidBox.maxArr[i] - range.centroidBox.minArr[i];
+            binScale[i] = extents > 0 ? numBins / extents : 0;
+            if (!_finite(binScale[i]))
             {
-                const UINT rightIdx = NUM_SAH_BINS - j - 1;
-
-                rightBoxes[rightIdx] = sahBins[i][rightIdx].box;
-                leftBoxes[j] = sahBins[i][j].box;
-
-                if (j > 0)
-                {
-                    AddExtentToBox(leftBoxes[j], leftBoxes[j - 1]);
-                    AddExtentToBox(rightBoxes[rightIdx], rightBoxes[rightIdx + 1]);
-                }
+                binScale[i] = 0;
             }
+            canBin |= binScale[i] != 0;
+        }
 
-            UINT numTrianglesOnLeft = 0;
-            UINT numTrianglesOnRight = numTris;
+        float bestSah = FLT_MAX;
+        UINT splitAxis = 0;
+        UINT splitBin = 0;
+        SahBin firstBin;
+        SahBin secondBin;
+        InitBin(firstBin);
+        InitBin(secondBin);
+
+        if (canBin)
+        {
+            SahBins sahBins;
+            Bin(range, binScale, numBins, sahBins);
 
-            // Find the plane with the best score
-            for (UINT j = 0; j < NUM_SAH_BINS - 1; ++j)
+            for (UINT i = 0; i < 3; ++i)
             {
-                if (!sahBins[i][j].numTriangles)
+                if (binScale[i] == 0)
                 {
                     continue;
                 }
 
-                numTrianglesOnLeft += sahBins[i][j].numTriangles;
-                numTrianglesOnRight -= sahBins[i][j].numTriangles;
+                // Precompute right side bounds with counts to be able to test plane positionings
+                SahBin rightBins[NUM_SAH_BINS];
+                rightBins[numBins - 1] = sahBins.bins[i][numBins - 1];
+                for (UINT j = numBins - 1; j > 0; --j)
+                {
+                    rightBins[j - 1] = rightBins[j];
+                    AddBinToBin(rightBins[j - 1], sahBins.bins[i][j - 1]);
+                }
 
-                const float sah = (numTrianglesOnLeft * ComputeBoxSurfaceArea(leftBoxes[j]) +
-                    numTrianglesOnRight * ComputeBoxSurfaceArea(rightBoxes[j + 1])) *
-                    normalizeToParent;
+                SahBin leftBin;
+                InitBin(leftBin);
+                for (UINT j = 0; j < numBins - 1; ++j)
+                {
+                    AddBinToBin(leftBin, sahBins.bins[i][j]);
 
-                assert(!_isnan(sah));
+                    const SahBin& rightBin = rightBins[j + 1];
+                    if (!leftBin.numTriangles || !rightBin.numTriangles)
+                    {
+                        continue;
+                    }
 
-                if (sah < bestSah)
-                {
-                    bestSah = sah;
-                    maxDimension = i;
-                    numTrisInLeftNode = numTrianglesOnLeft;
+                    const float sah = leftBin.numTriangles * ComputeBoxSurfaceArea(leftBin.box) +
+                        rightBin.numTriangles * ComputeBoxSurfaceArea(rightBin.box);
+
+                    assert(!_isnan(sah));
+
+                    if (sah < bestSah)
+                    {
+                        bestSah = sah;
+                        splitAxis = i;
+                        splitBin = j;
+                        firstBin = leftBin;
+                        secondBin = rightBin;
+                    }
                 }
             }
         }
 
-        //
-        // Split the set to try to get a balanced tree
-        //
+        UINT32 numTrisInFirst;
+        if (bestSah < FLT_MAX)
+        {
+            const float rangeMin = range.centroidBox.minArr[splitAxis];
+            const float scale = binScale[splitAxis];
+            UINT32* pReferences = m_references.data();
+            UINT32* pMiddle = std::partition(pReferences + range.begin, pReferences + range.end,
+                [&](UINT32 reference) { return BinIndex(m_primitives[reference].centroid[splitAxis], rangeMin, scale, numBins) <= splitBin; });
+
+            numTrisInFirst = (UINT32)(pMiddle - (pReferences + range.begin));
+            assert(numTrisInFirst == firstBin.numTriangles);
+
+            first.box = firstBin.box;
+            first.centroidBox = firstBin.centroidBox;
+            second.box = secondBin.box;
+            second.centroidBox = secondBin.centroidBox;
+        }
+        else
+        {
+            // Every centroid is in the same spot (or the areas overflowed), so
+            // any split is as good as another: cut the range in half
+            numTrisInFirst = numTris / 2;
+            ComputeBounds(range.begin, range.begin + numTrisInFirst, first.box, first.centroidBox);
+            ComputeBounds(range.begin + numTrisInFirst, range.end, second.box, second.centroidBox);
+        }
+
+        assert(numTrisInFirst > 0 && numTrisInFirst < numTris);
+
+        first.begin = range.begin;
+        first.end = range.begin + numTrisInFirst;
+        first.nodeIndex = range.nodeIndex + 1;
 
-        SortByCentroid(metadata, boxes, maxDimension);
+        second.begin = first.end;
+        second.end = range.end;
+        second.nodeIndex = range.nodeIndex + 2 * numTrisInFirst;
     }
 
-    //
-    // It's a good idea to do a breadth-first build because then nodes from the same level
-    // get adjacent memory locations. It does take a lot of memory though.
-    //
-    // "Uniform BVH"
-    // -- both children are valid for all internal nodes
-    // -- left child's index is +1 of the parent index, right child's index is stored
-    //    in the packed AABB structure.
-    // -- there could be a varaible number of triangles in leaves
-    //
-    static
-        void BuildBVH(
-            BVH& bvh,
-            const std::vector<AABB>& boxes,
-            const std::vector<PrimitiveMetaData>& primitiveMetaData,
-            UINT32 maxTrisInLeaf)
+    void BinnedSahBuilder::WriteLeaf(
+        const BuildRange& range)
     {
-        //
-        // These are huge so use pointers
-        //
-        struct StackItem
-        {
-            std::vector<PrimitiveMetaData> primitiveMetaData;
-            UINT32              parentIndex;
-            UINT                right : 1;
-            UINT                axis : 2;
-        };
+        const UINT32 numTris = range.end - range.begin;
+        assert(numTris < 128);
+        assert(range.begin < (1 << 24));
+
+        AABBNode& node = m_pNodes[range.nodeIndex];
+        WriteNodeBox(node, range.box);
+        node.leaf = true;
+        node.leafNode.firstTriangleId = range.begin;
+        node.leafNode.numTriangleIds = numTris;
+        node.numTriangles = numTris;
+
+        m_usedNodes[range.nodeIndex] = true;
+    }
 
-        std::deque<StackItem*>   fifoLefts;
-        std::deque<StackItem*>   fifoRights;
+    void BinnedSahBuilder::WriteInternalNode(
+        const BuildRange& range,
+        UINT32 leftNodeIndex)
+    {
+        assert(leftNodeIndex < (1 << 24));
 
-        StackItem* temp = new StackItem;
-        temp->parentIndex = (UINT)-1;
-        temp->primitiveMetaData = primitiveMetaData;
-        temp->right = false;
-        temp->axis = 0;
-        fifoRights.push_back(temp);
+        AABBNode& node = m_pNodes[range.nodeIndex];
+        WriteNodeBox(node, range.box);
+        node.internalNode.separatingAxis = 0;
+        node.internalNode.leftNodeIndex = leftNodeIndex;
+        node.rightNodeIndex = range.nodeIndex + 1;
 
-        while (!fifoLefts.empty() || !fifoRights.empty())
+        m_usedNodes[range.nodeIndex] = true;
+    }
+
+    void BinnedSahBuilder::BuildSubtree(
+        const BuildRange& subtree)
+    {
+        // SAH splits can be lopsided, so the tree may be far deeper than
+        // log2 of its size: use an explicit stack rather than recursion
+        std::vector<BuildRange> stack(1, subtree);
+
+        while (!stack.empty())
         {
-            // Uniform BVH pops the first left node
-            StackItem* item = nullptr;
+            const BuildRange range = stack.back();
+            stack.pop_back();
 
-            if (!fifoRights.empty())
+            if (range.end - range.begin <= m_maxTrisInLeaf)
             {
-                item = fifoRights.back();
-                fifoRights.pop_back();
+                WriteLeaf(range);
+                continue;
             }
 
-            if (!item)
+            BuildRange first;
+            BuildRange second;
+            Split(range, first, second);
+            WriteInternalNode(range, second.nodeIndex);
+
+            // This thread goes on with the first part, an idle one can take the rest
+            if (m_pPool && second.end - second.begin >= MIN_REFERENCES_PER_TASK)
             {
-                item = fifoLefts.back();
-                fifoLefts.pop_back();
+                m_pPool->Spawn(m_subtreeTasks, [this, second]() { BuildSubtree(second); });
             }
+            else
+            {
+                stack.push_back(second);
+            }
+            stack.push_back(first);
+        }
+    }
 
-            //
-            // Compute overall bounding box
-            //
-            AABB nodeBox;
-            ComputeBox(nodeBox, boxes, item->primitiveMetaData);
-
-            const UINT32 numTrianglesInNode = (UINT32)item->primitiveMetaData.size();
-            const UINT32 parentIndex = item->parentIndex;
+    void BinnedSahBuilder::CompactNodes(
+        BVH& bvh) const
+    {
+        const UINT32 numSlots = (UINT32)m_usedNodes.size();
+        std::vector<UINT32> newIndices(numSlots);
+        UINT32 numNodes = 0;
+        for (UINT32 i = 0; i < numSlots; ++i)
+        {
+            newIndices[i] = numNodes;
+            numNodes += m_usedNodes[i];
+        }
 
-            UINT32 thisNodeIndex;
+        if (numNodes == numSlots)
+        {
+            return;
+        }
 
-            // Leaf or internal node?
-            if (numTrianglesInNode <= maxTrisInLeaf)
+        // Slots are in tree order, so dropping the unused ones keeps every
+        // right child right after its parent
+        for (UINT32 i = 0; i < numSlots; ++i)
+        {
+            if (!m_usedNodes[i])
             {
-                thisNodeIndex = BuildBVHAddLeaf(bvh, nodeBox, item->primitiveMetaData);
+                continue;
             }
-            else
+
+            AABBNode node = bvh.m_nodes[i];
+            if (!node.leaf)
             {
-                //
-                // Find separating plane. Use Median for speed.
-                // SAH is better but also more expensive to build.
-                //
-
-                UINT splitDimension;
-                UINT leftChildNumNodes;
-
-                SahSplit(item->primitiveMetaData,
-                    splitDimension,
-                    leftChildNumNodes,
-                    nodeBox,
-                    boxes);
-
-                assert(leftChildNumNodes <= item->primitiveMetaData.size());
-
-                // Try to balance by using the median if SAH failed
-                if ((leftChildNumNodes == 0 ||
-                    leftChildNumNodes == item->primitiveMetaData.size()) &&
-                    item->primitiveMetaData.size() > MAX_TRIS_IN_LEAF)
-                {
-                    leftChildNumNodes = (UINT)item->primitiveMetaData.size() / 2;
-                }
+                node.internalNode.leftNodeIndex = newIndices[node.internalNode.leftNodeIndex];
+                node.rightNodeIndex = newIndices[i] + 1;
+            }
+            bvh.m_nodes[newIndices[i]] = node;
+        }
+        bvh.m_nodes.resize(numNodes);
+    }
 
-                const UINT32 rightChildNumNodes = (UINT32)item->primitiveMetaData.size() - leftChildNumNodes;
+    void BinnedSahBuilder::Build(
+        BVH& bvh)
+    {
+        const UINT32 numTris = (UINT32)m_primitiveMetaData.size();
 
+        bvh.m_nodes.clear();
+        bvh.m_metadata.clear();
 
-                //
-                // "Recurse"
-                //
+        if (numTris == 0)
+        {
+            AABB emptyBox;
+            emptyBox.max.x = emptyBox.min.x = 0;
+            emptyBox.max.y = emptyBox.min.y = 0;
+            emptyBox.max.z = emptyBox.min.z = 0;
+
+            AABBNode node = {};
+            WriteNodeBox(node, emptyBox);
+            node.leaf = true;
+            bvh.m_nodes.push_back(node);
+            return;
+        }
 
-                thisNodeIndex = BuildBVHAddNode(bvh, nodeBox, splitDimension);
+        InitReferences();
 
-                StackItem* leftItem = new StackItem;
-                leftItem->parentIndex = thisNodeIndex;
-                leftItem->primitiveMetaData.resize(leftChildNumNodes);
-                leftItem->right = false;
-                leftItem->axis = splitDimension;
-                for (UINT32 i = 0; i < leftChildNumNodes; ++i)
-                {
-                    leftItem->primitiveMetaData[i] = item->primitiveMetaData[i];
-                }
+        BuildRange root;
+        root.begin = 0;
+        root.end = numTris;
+        root.nodeIndex = 0;
+        ComputeBounds(root.begin, root.end, root.box, root.centroidBox);
 
-                StackItem* rightItem = new StackItem;
-                rightItem->parentIndex = thisNodeIndex;
-                rightItem->primitiveMetaData.resize(rightChildNumNodes);
-                rightItem->right = true;
-                rightItem->axis = splitDimension;
-                for (UINT32 i = 0; i < rightChildNumNodes; ++i)
-                {
-                    rightItem->primitiveMetaData[i] = item->primitiveMetaData[i + leftChildNumNodes];
-                }
+        const UINT32 numSlots = 2 * numTris - 1;
+        bvh.m_nodes.resize(numSlots);
+        m_pNodes = bvh.m_nodes.data();
+        m_usedNodes.assign(numSlots, false);
 
-                fifoLefts.push_back(leftItem);
-                fifoRights.push_back(rightItem);
-            }
+        BuildSubtree(root);
+        if (m_pPool)
+        {
+            m_pPool->Wait(m_subtreeTasks);
+        }
 
-            // Update child link of the parent
-            if (parentIndex != -1)
-            {
-                if (!item->right)
-                {
-                    bvh.m_nodes[parentIndex].internalNode.leftNodeIndex = thisNodeIndex;
-                    bvh.m_nodes[parentIndex].rightNodeIndex = parentIndex + 1;
-                }
-            }
+        CompactNodes(bvh);
 
-            // Free the item after use
-            delete item;
+        bvh.m_metadata.resize(numTris);
+        for (UINT32 i = 0; i < numTris; ++i)
+        {
+            bvh.m_metadata[i] = m_primitiveMetaData[m_references[i]];
         }
     }
 
+    //
+    // "Uniform BVH"
+    // -- both children are valid for all internal nodes
+    // -- right child's index is +1 of the parent index, left child's index is stored
+    //    in the packed AABB structure.
+    // -- there could be a varaible number of triangles in leaves
+    //
+    // Nodes are laid out depth-first, so every subtree is contiguous in memory.
+    // Passing a pool builds it on all of the pool's threads.
+    //
+    static
+        void BuildBVH(
+            BVH& bvh,
+            const std::vector<AABB>& boxes,
+            const std::vector<PrimitiveMetaData>& primitiveMetaData,
+            UINT32 maxTrisInLeaf,
+            WorkStealingPool* pPool)
+    {
+        BinnedSahBuilder builder(boxes, primitiveMetaData, maxTrisInLeaf, pPool);
+        builder.Build(bvh);
+    }
+
     void BuildUniformBVH(
         _In_  UINT NumElements,
         _In_reads_opt_(NumElements)  const D3D12_RAYTRACING_GEOMETRY_DESC *pGeometries,
+        UINT threadCount,
         BVH &bvh)
     {
         using namespace DirectX;
@@ -635,7 +849,16 @@ namespace FallbackLayer
         // Create a BVH
         //
 
-        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF);
+        // Starting threads costs more than building small BVHs takes
+        static const UINT MIN_TRIANGLES_FOR_PARALLEL_BUILD = 16 * 1024;
+
+        std::unique_ptr<WorkStealingPool> pPool;
+        if (threadCount > 1 && totalNumberOfTriangles >= MIN_TRIANGLES_FOR_PARALLEL_BUILD)
+        {
+            pPool.reset(new WorkStealingPool(threadCount));
+        }
+
+        BuildBVH(bvh, boxes, primitiveMetaData, MAX_TRIS_IN_LEAF, pPool.get());
 
         //
         // Now copy and compress geometry
@@ -667,10 +890,16 @@ namespace FallbackLayer
 
 void BuildRaytracingAccelerationStructureOnCpu(
     _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData)
+    _Out_ void *pData,
+    UINT threadCount)
 {
+    if (threadCount == 0)
+    {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
     FallbackLayer::BVH bvh;
-    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, bvh);
+    FallbackLayer::BuildUniformBVH(pDesc->Inputs.NumDescs, pDesc->Inputs.pGeometryDescs, threadCount, bvh);
 
     BYTE* outputData = (BYTE*)pData;
     BVHOffsets offsets;
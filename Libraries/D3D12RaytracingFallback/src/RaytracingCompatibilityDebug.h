@@ -19,6 +19,8 @@ void OutputDebugLog(ID3D12RaytracingFallbackDevice *pDevice);
 void VisualizeAccelerationStructureLevel(ID3D12RaytracingFallbackDevice *pDevice, UINT level);
 #endif
 
+// Builds a BVH2 bottom level on threadCount threads, 0 for one per hardware thread
 void BuildRaytracingAccelerationStructureOnCpu(
     _In_  const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC *pDesc,
-    _Out_ void *pData);
+    _Out_ void *pData,
+    UINT threadCount = 0);
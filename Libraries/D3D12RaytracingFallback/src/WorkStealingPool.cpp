@@ -0,0 +1,156 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#include "pch.h"
+#include "WorkStealingPool.h"
+
+namespace FallbackLayer
+{
+    // Which pool the current thread works for and the deque it owns
+    static thread_local const WorkStealingPool *t_pPool = nullptr;
+    static thread_local UINT t_queueIndex = 0;
+
+    WorkStealingPool::WorkStealingPool(UINT threadCount) :
+        m_queuedTasks(0),
+        m_sleepingWorkers(0),
+        m_stopping(false)
+    {
+        threadCount = std::max(threadCount, 1u);
+        for (UINT i = 0; i < threadCount; ++i)
+        {
+            m_queues.emplace_back(new TaskQueue);
+        }
+
+        for (UINT i = 1; i < threadCount; ++i)
+        {
+            m_workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i);
+        }
+    }
+
+    WorkStealingPool::~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    UINT WorkStealingPool::GetQueueIndex() const
+    {
+        // Threads outside the pool go through the creating thread's deque
+        return t_pPool == this ? t_queueIndex : 0;
+    }
+
+    void WorkStealingPool::Spawn(TaskGroup &group, std::function<void()> task)
+    {
+        group.m_pendingTasks++;
+
+        // Counted before it is queued, so a thief can't take the count below zero.
+        // A worker going to sleep counts itself before it checks m_queuedTasks,
+        // so either it sees this task or this sees it sleeping
+        m_queuedTasks++;
+
+        TaskQueue &queue = *m_queues[GetQueueIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.m_lock);
+            queue.m_tasks.emplace_back([&group, task]()
+            {
+                task();
+                group.m_pendingTasks--;
+            });
+        }
+
+        if (m_sleepingWorkers > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_sleepLock);
+            }
+            m_wake.notify_one();
+        }
+    }
+
+    bool WorkStealingPool::TryRunTask(UINT queueIndex)
+    {
+        std::function<void()> task;
+
+        {
+            TaskQueue &queue = *m_queues[queueIndex];
+            std::lock_guard<std::mutex> lock(queue.m_lock);
+            if (!queue.m_tasks.empty())
+            {
+                task = std::move(queue.m_tasks.back());
+                queue.m_tasks.pop_back();
+            }
+        }
+
+        const UINT numQueues = (UINT)m_queues.size();
+        for (UINT i = 1; !task && i < numQueues; ++i)
+        {
+            TaskQueue &victim = *m_queues[(queueIndex + i) % numQueues];
+            std::lock_guard<std::mutex> lock(victim.m_lock);
+            if (!victim.m_tasks.empty())
+            {
+                task = std::move(victim.m_tasks.front());
+                victim.m_tasks.pop_front();
+            }
+        }
+
+        if (!task)
+        {
+            return false;
+        }
+
+        m_queuedTasks--;
+        task();
+        return true;
+    }
+
+    void WorkStealingPool::Wait(TaskGroup &group)
+    {
+        const UINT queueIndex = GetQueueIndex();
+        while (group.m_pendingTasks > 0)
+        {
+            // The tasks left may all be running on other threads
+            if (!TryRunTask(queueIndex))
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void WorkStealingPool::WorkerLoop(UINT queueIndex)
+    {
+        t_pPool = this;
+        t_queueIndex = queueIndex;
+
+        for (;;)
+        {
+            if (TryRunTask(queueIndex))
+            {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_sleepLock);
+            m_sleepingWorkers++;
+            m_wake.wait(lock, [this]() { return m_stopping || m_queuedTasks > 0; });
+            m_sleepingWorkers--;
+            if (m_stopping && m_queuedTasks == 0)
+            {
+                return;
+            }
+        }
+    }
+}
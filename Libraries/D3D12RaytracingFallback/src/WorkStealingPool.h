@@ -0,0 +1,79 @@
+//*********************************************************
+//
+// Copyright (c) Microsoft. All rights reserved.
+// This code is licensed under the MIT License (MIT).
+// THIS CODE IS PROVIDED *AS IS* WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESS OR IMPLIED, INCLUDING ANY
+// IMPLIED WARRANTIES OF FITNESS FOR A PARTICULAR
+// PURPOSE, MERCHANTABILITY, OR NON-INFRINGEMENT.
+//
+//*********************************************************
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace FallbackLayer
+{
+    //
+    // Fork-join pool for the CPU builders. Every thread owns a deque that it
+    // pushes to and pops from at the back, so it keeps working on the task it
+    // split last. Idle threads steal from the front of the other deques,
+    // which holds the oldest and so the biggest pieces of a recursive split.
+    //
+    // The thread that created the pool takes part as well: it owns deque 0 and
+    // runs tasks while it waits on a group.
+    //
+    class WorkStealingPool
+    {
+    public:
+        // Tasks that are waited on together. Tasks may spawn more tasks into
+        // their own group, Wait returns once all of them are done.
+        class TaskGroup
+        {
+        public:
+            TaskGroup() : m_pendingTasks(0) {}
+
+        private:
+            friend class WorkStealingPool;
+            std::atomic<UINT> m_pendingTasks;
+        };
+
+        // threadCount includes the creating thread, so threadCount - 1 workers are started
+        WorkStealingPool(UINT threadCount);
+        ~WorkStealingPool();
+
+        UINT GetThreadCount() const { return (UINT)m_queues.size(); }
+
+        // Tasks must not throw
+        void Spawn(TaskGroup &group, std::function<void()> task);
+
+        // Runs tasks, queued on this thread or stolen, until group has none left
+        void Wait(TaskGroup &group);
+
+    private:
+        struct TaskQueue
+        {
+            std::mutex m_lock;
+            std::deque<std::function<void()>> m_tasks;
+        };
+
+        UINT GetQueueIndex() const;
+        bool TryRunTask(UINT queueIndex);
+        void WorkerLoop(UINT queueIndex);
+
+        std::vector<std::unique_ptr<TaskQueue>> m_queues;
+        std::vector<std::thread> m_workers;
+
+        std::atomic<UINT> m_queuedTasks;
+        std::atomic<UINT> m_sleepingWorkers;
+        std::mutex m_sleepLock;
+        std::condition_variable m_wake;
+        bool m_stopping;
+    };
+}
@@ -10,6 +10,8 @@
 //*********************************************************
 #include "stdafx.h"
 #include "CppUnitTest.h"
+#include <chrono>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace FallbackLayer;
@@ -719,6 +721,101 @@ namespace FallbackLayerUnitTests
                 testCase);
         }
 
+        TEST_METHOD(MultithreadedStressBottomLevelCpuBVHBuilder)
+        {
+            // Big enough for the builder to start its thread pool
+            std::vector<float> gridVertices;
+            std::vector<UINT16> gridIndices;
+            GenerateGrid(92, 0.0f, gridVertices, gridIndices);
+            CpuGeometryDescriptor testCase(gridVertices.data(),
+                (UINT)(gridVertices.size() / 3),
+                gridIndices.data(),
+                (UINT)gridIndices.size(),
+                DXGI_FORMAT_R16_UINT);
+
+            TestCpuBvh2Builder(&testCase, 1, D3D12_ELEMENTS_LAYOUT_ARRAY, 4);
+        }
+
+        TEST_METHOD(CpuBVHBuilderThreadScaling)
+        {
+            // About a million triangles, too many for the validator, so every
+            // build is checked against the single threaded one instead
+            const UINT numGrids = 8;
+            std::vector<float> gridVertices[numGrids];
+            std::vector<UINT16> gridIndices[numGrids];
+            std::vector<CpuGeometryDescriptor> testCases;
+            srand(10);
+            for (UINT i = 0; i < numGrids; i++)
+            {
+                GenerateGrid(256, i * 26.0f, gridVertices[i], gridIndices[i]);
+                testCases.push_back(CpuGeometryDescriptor(gridVertices[i].data(),
+                    (UINT)(gridVertices[i].size() / 3),
+                    gridIndices[i].data(),
+                    (UINT)gridIndices[i].size(),
+                    DXGI_FORMAT_R16_UINT));
+            }
+
+            std::unique_ptr<BYTE[]> pReferenceData;
+            const UINT maxThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+            double singleThreadMs = 0;
+            for (UINT threadCount = 1; ; threadCount = std::min(threadCount * 2, maxThreadCount))
+            {
+                std::unique_ptr<BYTE[]> pData;
+                auto start = std::chrono::high_resolution_clock::now();
+                BuildCpuBvh2(testCases.data(), numGrids, threadCount, pData);
+                const double buildMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+                if (threadCount == 1)
+                {
+                    singleThreadMs = buildMs;
+                    pReferenceData = std::move(pData);
+                }
+                else
+                {
+                    const UINT totalSize = ((BVHOffsets *)pReferenceData.get())->totalSize;
+                    Assert::IsTrue(memcmp(pReferenceData.get(), pData.get(), totalSize) == 0,
+                        L"Multithreaded CPU BVH differs from the single threaded one");
+                }
+
+                std::wstringstream message;
+                message << threadCount << L" threads: " << buildMs << L" ms, " << singleThreadMs / buildMs << L"x\n";
+                Logger::WriteMessage(message.str().c_str());
+
+                if (threadCount == maxThreadCount)
+                {
+                    break;
+                }
+            }
+        }
+
+        // width x width vertices on the XZ plane with a random height, two triangles per cell
+        void GenerateGrid(UINT width, float offsetX, std::vector<float> &vertices, std::vector<UINT16> &indices)
+        {
+            for (UINT z = 0; z < width; z++)
+            {
+                for (UINT x = 0; x < width; x++)
+                {
+                    vertices.push_back(offsetX + x * 0.1f);
+                    vertices.push_back((rand() / (float)RAND_MAX) * 0.6f - 0.3f);
+                    vertices.push_back(z * 0.1f);
+                }
+            }
+
+            for (UINT z = 0; z + 1 < width; z++)
+            {
+                for (UINT x = 0; x + 1 < width; x++)
+                {
+                    const UINT16 corner = (UINT16)(z * width + x);
+                    const UINT16 cellIndices[] =
+                    {
+                        corner, (UINT16)(corner + 1), (UINT16)(corner + width),
+                        (UINT16)(corner + 1), (UINT16)(corner + width + 1), (UINT16)(corner + width)
+                    };
+                    indices.insert(indices.end(), std::begin(cellIndices), std::end(cellIndices));
+                }
+            }
+        }
+
         void GenerateRandomTranformation(float *pMatrix)
         {
             // Identity matrix
@@ -1053,7 +1150,7 @@ namespace FallbackLayerUnitTests
             }
         }
 
-        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY)
+        void BuildCpuBvh2(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, UINT threadCount, std::unique_ptr<BYTE[]> &pData)
         {
             ID3D12Device &device = m_d3d12Context.GetDevice();
             std::unique_ptr<FallbackLayer::IAccelerationStructureBuilder> pBuilder =
@@ -1081,7 +1178,7 @@ namespace FallbackLayerUnitTests
                 numGeoms,
                 geomDescs.data(),
                 &prebuildInfo);
-            std::unique_ptr<BYTE[]> pData = std::unique_ptr<BYTE[]>(new BYTE[prebuildInfo.ResultDataMaxSizeInBytes]);
+            pData = std::unique_ptr<BYTE[]>(new BYTE[prebuildInfo.ResultDataMaxSizeInBytes]);
 
 
             D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc{};
@@ -1090,9 +1187,16 @@ namespace FallbackLayerUnitTests
             desc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
             desc.pGeometryDescs = geomDescs.data();
 
-            BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get());
+            BuildRaytracingAccelerationStructureOnCpu(&desc, pData.get(), threadCount);
+        }
+
+        void TestCpuBvh2Builder(CpuGeometryDescriptor *pGeomDescs, UINT numGeoms, D3D12_ELEMENTS_LAYOUT layoutToTest = D3D12_ELEMENTS_LAYOUT_ARRAY, UINT threadCount = 0)
+        {
+            std::unique_ptr<BYTE[]> pData;
+            BuildCpuBvh2(pGeomDescs, numGeoms, threadCount, pData);
+
             std::wstring errorMessage;
-            auto &validator = FallbackLayer::GetAccelerationStructureValidator(pBuilder->GetAccelerationStructureType());
+            auto &validator = FallbackLayer::GetAccelerationStructureValidator(FallbackLayer::BVH2);
             if (!validator.VerifyBottomLevelOutput(pGeomDescs, numGeoms, pData.get(), errorMessage))
             {
                 Assert::Fail(errorMessage.c_str());
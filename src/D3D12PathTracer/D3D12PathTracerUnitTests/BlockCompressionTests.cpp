@@ -0,0 +1,131 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "BlockCompression.h"
+#include "NormalMapCodec.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // width x height RGBA8 image of a single color
+  AssetLoader::ImageData SolidImage(UINT width, UINT height, const BYTE rgba[4])
+  {
+    AssetLoader::ImageData image;
+    image.desc = TextureLoader::DescribeTexture2D(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+    image.bytes_per_row = width * 4;
+    image.size = image.bytes_per_row * height;
+    image.texels.reset(static_cast<BYTE*>(malloc(image.size)));
+    for (int i = 0; i < image.size; i++)
+    {
+      image.texels.get()[i] = rgba[i % 4];
+    }
+    return image;
+  }
+
+  TEST_CLASS(BlockCompressionTests)
+  {
+  public:
+    TEST_METHOD(ChoosesTheCodecByContent)
+    {
+      const BYTE opaque[4] = { 10, 20, 30, 255 };
+      const BYTE translucent[4] = { 10, 20, 30, 254 };
+      Assert::IsTrue(BlockCompression::ChooseCodec(SolidImage(8, 8, opaque), MipChain::Filter::Srgb) == BlockCompression::Codec::BC1);
+      Assert::IsTrue(BlockCompression::ChooseCodec(SolidImage(8, 8, translucent), MipChain::Filter::Srgb) == BlockCompression::Codec::BC3);
+      Assert::IsTrue(BlockCompression::ChooseCodec(SolidImage(8, 8, opaque), MipChain::Filter::Normal) == BlockCompression::Codec::None,
+                     L"RGBA8 normal maps aren't compressed, their two channel encoding is");
+      Assert::IsTrue(BlockCompression::ChooseCodec(SolidImage(6, 8, opaque), MipChain::Filter::Srgb) == BlockCompression::Codec::None,
+                     L"D3D12 wants whole blocks at level 0");
+
+      const AssetLoader::ImageData normals = NormalMapCodec::Encode(SolidImage(8, 8, opaque), ThreadPool::Shared());
+      Assert::IsTrue(BlockCompression::ChooseCodec(normals, MipChain::Filter::Normal) == BlockCompression::Codec::BC5);
+
+      Assert::ExpectException<std::runtime_error>([&]()
+      {
+        BlockCompression::Compress(SolidImage(8, 8, opaque), BlockCompression::Codec::BC5, ThreadPool::Shared());
+      }, L"BC5 takes the two channel normals only");
+    }
+
+    TEST_METHOD(SolidChainsRoundTripExactly)
+    {
+      //colors 565 holds exactly, every level of the chain down to 1x1 included
+      const BYTE colors[][4] = { { 255, 0, 0, 255 }, { 0, 255, 0, 255 }, { 0, 0, 255, 255 }, { 255, 255, 255, 255 }, { 0, 0, 0, 255 } };
+      for (const BYTE* color : colors)
+      {
+        const AssetLoader::ImageData chain = MipChain::Generate(SolidImage(16, 8, color), MipChain::Filter::Srgb, ThreadPool::Shared());
+        const AssetLoader::ImageData blocks = BlockCompression::Compress(chain, BlockCompression::Codec::BC1, ThreadPool::Shared());
+        Assert::IsTrue(blocks.desc.Format == DXGI_FORMAT_BC1_UNORM);
+        Assert::AreEqual(chain.desc.MipLevels, blocks.desc.MipLevels);
+
+        const AssetLoader::ImageData decoded = BlockCompression::Decompress(blocks);
+        Assert::IsTrue(decoded.desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM);
+        Assert::AreEqual(chain.size, decoded.size, L"the padded small levels come back at their own size");
+        Assert::IsTrue(memcmp(chain.texels.get(), decoded.texels.get(), chain.size) == 0);
+      }
+    }
+
+    TEST_METHOD(Bc3KeepsAlpha)
+    {
+      const BYTE color[4] = { 255, 255, 255, 255 };
+      AssetLoader::ImageData image = SolidImage(8, 8, color);
+      for (int texel = 0; texel < 64; texel++)
+      {
+        image.texels.get()[texel * 4 + 3] = (texel % 3 == 0) ? 0 : 255;
+      }
+      Assert::IsTrue(BlockCompression::ChooseCodec(image, MipChain::Filter::Srgb) == BlockCompression::Codec::BC3);
+
+      BlockCompression::Stats stats;
+      const AssetLoader::ImageData blocks = BlockCompression::Compress(image, BlockCompression::Codec::BC3, ThreadPool::Shared(), &stats);
+      Assert::AreEqual(UINT64(64 * 4), stats.source_bytes);
+      Assert::AreEqual(UINT64(4 * 16), stats.compressed_bytes, L"a byte per texel");
+      const AssetLoader::ImageData decoded = BlockCompression::Decompress(blocks);
+      for (int texel = 0; texel < 64; texel++)
+      {
+        Assert::AreEqual(image.texels.get()[texel * 4 + 3], decoded.texels.get()[texel * 4 + 3], L"the end points of the alpha ramp are exact");
+      }
+    }
+
+    TEST_METHOD(ShippedColorTexturesKeepTheirQuality)
+    {
+      for (const char* path : { "src/scenes/coffee_demo/WoodTexture.jpg", "src/scenes/coffee_demo/CesiumMan.jpg", "src/scenes/coffee_demo/EarthDiffuse.jpg" })
+      {
+        const AssetLoader::ImageData chain = MipChain::Generate(AssetLoader::DecodeImage(path), MipChain::Filter::Srgb, ThreadPool::Shared());
+        const BlockCompression::Codec codec = BlockCompression::ChooseCodec(chain, MipChain::Filter::Srgb);
+        Assert::IsTrue(codec == BlockCompression::Codec::BC1, L"opaque photos go to BC1");
+
+        BlockCompression::Stats stats;
+        const AssetLoader::ImageData blocks = BlockCompression::Compress(chain, codec, ThreadPool::Shared(), &stats);
+        const MipChain::Level source_base = MipChain::Layout(chain.desc)[0];
+        const MipChain::Level block_base = MipChain::Layout(blocks.desc)[0];
+        Assert::AreEqual(source_base.size, block_base.size * 8, L"BC1 is an eighth of RGBA8");
+        Assert::IsTrue(stats.compressed_bytes * 7 < stats.source_bytes, L"padding the smallest levels costs next to nothing");
+        Assert::IsTrue(stats.psnr > 30.0, L"BC1 of a photo should stay above 30 dB");
+
+        //the reference decoder agrees with the stats
+        const AssetLoader::ImageData decoded = BlockCompression::Decompress(blocks);
+        Assert::AreEqual(stats.psnr, BlockCompression::Psnr(chain, decoded, codec), 1e-9);
+      }
+    }
+
+    TEST_METHOD(Bc5NormalMapsStayWithinAFewDegrees)
+    {
+      for (const char* path : { "src/textures/brick_n.JPG", "src/textures/rock_n.JPG", "src/scenes/coffee_demo/EarthNormal.jpg" })
+      {
+        const AssetLoader::ImageData chain = MipChain::Generate(AssetLoader::DecodeImage(path), MipChain::Filter::Normal, ThreadPool::Shared());
+        const AssetLoader::ImageData encoded = NormalMapCodec::Encode(chain, ThreadPool::Shared());
+        Assert::IsTrue(BlockCompression::ChooseCodec(encoded, MipChain::Filter::Normal) == BlockCompression::Codec::BC5);
+
+        const AssetLoader::ImageData blocks = BlockCompression::Compress(encoded, BlockCompression::Codec::BC5, ThreadPool::Shared());
+        Assert::IsTrue(blocks.desc.Format == DXGI_FORMAT_BC5_SNORM);
+        Assert::AreEqual(MipChain::Layout(encoded.desc)[0].size, MipChain::Layout(blocks.desc)[0].size * 2, L"BC5 is half of R8G8");
+
+        const NormalMapCodec::AngularError two_channels = NormalMapCodec::MeasureError(chain, encoded);
+        const NormalMapCodec::AngularError bc5 = NormalMapCodec::MeasureError(chain, BlockCompression::Decompress(blocks));
+        //rock_n is the noisiest of these at 2.5 degrees, the two channel encoding alone stays under 0.3
+        Assert::IsTrue(bc5.mean_degrees < 3.0, L"BC5 normals should stay within a few degrees on average");
+        Assert::IsTrue(bc5.mean_degrees >= two_channels.mean_degrees, L"compression only adds error");
+      }
+    }
+  };
+}
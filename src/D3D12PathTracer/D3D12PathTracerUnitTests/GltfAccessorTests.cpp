@@ -0,0 +1,202 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include "GltfAccessor.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // every triangle primitive of a file, in mesh order
+  std::vector<AssetLoader::ModelData> DecodePrimitives(const std::string& path)
+  {
+    const tinygltf::Model model = AssetLoader::DecodeGltf(path);
+    std::vector<AssetLoader::ModelData> primitives;
+    for (const tinygltf::Mesh& mesh : model.meshes)
+    {
+      for (const tinygltf::Primitive& primitive : mesh.primitives)
+      {
+        AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(model, primitive);
+        if (!data.indices.empty())
+        {
+          primitives.push_back(std::move(data));
+        }
+      }
+    }
+    return primitives;
+  }
+
+  // three vertices interleaved in a 12 byte stride: unsigned short positions, normalized byte
+  // normals, a pad byte and normalized unsigned byte texcoords; byte indices one byte into their view
+  tinygltf::Model MakeInterleavedModel()
+  {
+    tinygltf::Model model;
+    tinygltf::Buffer buffer;
+    const UINT16 positions[3][3] = { { 1, 2, 3 }, { 40000, 0, 7 }, { 0, 65535, 9 } };
+    const INT8 normals[3][3] = { { 0, 0, 127 }, { -128, 0, 0 }, { 0, -127, 0 } };
+    const UINT8 texcoords[3][2] = { { 0, 255 }, { 51, 102 }, { 255, 0 } };
+    buffer.data.resize(3 * 12);
+    for (int i = 0; i < 3; i++)
+    {
+      memcpy(&buffer.data[i * 12], positions[i], 6);
+      memcpy(&buffer.data[i * 12 + 6], normals[i], 3);
+      memcpy(&buffer.data[i * 12 + 10], texcoords[i], 2);
+    }
+    buffer.data.insert(buffer.data.end(), { 0xff, 2, 0, 1 });
+    model.buffers.push_back(buffer);
+
+    tinygltf::BufferView vertices;
+    vertices.buffer = 0;
+    vertices.byteLength = 3 * 12;
+    vertices.byteStride = 12;
+    tinygltf::BufferView indices;
+    indices.buffer = 0;
+    indices.byteOffset = 3 * 12;
+    indices.byteLength = 4;
+    model.bufferViews = { vertices, indices };
+
+    auto add = [&](int view, size_t offset, int component_type, int type, bool normalized)
+    {
+      tinygltf::Accessor accessor;
+      accessor.bufferView = view;
+      accessor.byteOffset = offset;
+      accessor.componentType = component_type;
+      accessor.type = type;
+      accessor.normalized = normalized;
+      accessor.count = 3;
+      model.accessors.push_back(accessor);
+      return static_cast<int>(model.accessors.size()) - 1;
+    };
+    tinygltf::Primitive primitive;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    primitive.attributes["POSITION"] = add(0, 0, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_VEC3, false);
+    primitive.attributes["NORMAL"] = add(0, 6, TINYGLTF_COMPONENT_TYPE_BYTE, TINYGLTF_TYPE_VEC3, true);
+    primitive.attributes["TEXCOORD_0"] = add(0, 10, TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_VEC2, true);
+    primitive.indices = add(1, 1, TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE, TINYGLTF_TYPE_SCALAR, false);
+    tinygltf::Mesh mesh;
+    mesh.primitives.push_back(primitive);
+    model.meshes.push_back(mesh);
+    return model;
+  }
+
+  TEST_CLASS(GltfAccessorTests)
+  {
+  public:
+    TEST_METHOD(ShippedModelsDecode)
+    {
+      const std::vector<std::string> files = AssetLoader::ShippedGltfModels();
+      Assert::IsFalse(files.empty());
+      Assert::IsTrue(std::find(files.begin(), files.end(), "src/gltf/DamagedHelmet/glTF-Binary/DamagedHelmet.glb") != files.end());
+      for (const std::string& file : files)
+      {
+        const std::wstring name(file.begin(), file.end());
+        const tinygltf::Model model = AssetLoader::DecodeGltf(file);
+        size_t triangles = 0;
+        for (const tinygltf::Mesh& mesh : model.meshes)
+        {
+          for (const tinygltf::Primitive& primitive : mesh.primitives)
+          {
+            const AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(model, primitive);
+            if (data.indices.empty())
+            {
+              continue;
+            }
+            const tinygltf::Accessor& accessor = model.accessors[primitive.attributes.at("POSITION")];
+            Assert::AreEqual(accessor.count, data.vertices.size(), name.c_str());
+            Assert::AreEqual(data.vertices.size(), data.tangents.size(), name.c_str());
+            Assert::AreEqual(size_t(0), data.indices.size() % 3, name.c_str());
+            for (Index index : data.indices)
+            {
+              Assert::IsTrue(index < data.vertices.size(), name.c_str());
+            }
+
+            //POSITION has to declare its bounds, the positions read have to stay inside them
+            Assert::AreEqual(size_t(3), accessor.minValues.size(), name.c_str());
+            Assert::AreEqual(size_t(3), accessor.maxValues.size(), name.c_str());
+            for (const Vertex& v : data.vertices)
+            {
+              const float position[3] = { v.position.x, v.position.y, v.position.z };
+              for (int c = 0; c < 3; c++)
+              {
+                const double slack = 1e-5 * std::max<double>(1.0, accessor.maxValues[c] - accessor.minValues[c]);
+                Assert::IsTrue(position[c] >= accessor.minValues[c] - slack && position[c] <= accessor.maxValues[c] + slack, name.c_str());
+              }
+            }
+            triangles += data.indices.size() / 3;
+          }
+        }
+        Assert::IsTrue(triangles > 0, name.c_str());
+      }
+    }
+
+    TEST_METHOD(VariantsDecodeIdentically)
+    {
+      //src/gltf/<model>/... holds the .gltf, .glb, embedded and specular glossiness versions of one model
+      std::map<std::string, std::pair<std::string, std::vector<AssetLoader::ModelData>>> first;
+      size_t compared = 0;
+      for (const std::string& file : AssetLoader::ShippedGltfModels())
+      {
+        const std::string model = std::next(std::filesystem::path(file).begin(), 2)->string();
+        std::vector<AssetLoader::ModelData> primitives = DecodePrimitives(file);
+        auto found = first.find(model);
+        if (found == first.end())
+        {
+          first.emplace(model, std::make_pair(file, std::move(primitives)));
+          continue;
+        }
+
+        const std::wstring name(file.begin(), file.end());
+        const std::vector<AssetLoader::ModelData>& expected = found->second.second;
+        Assert::AreEqual(expected.size(), primitives.size(), name.c_str());
+        for (size_t p = 0; p < primitives.size(); p++)
+        {
+          Assert::AreEqual(expected[p].vertices.size(), primitives[p].vertices.size(), name.c_str());
+          Assert::IsTrue(memcmp(expected[p].vertices.data(), primitives[p].vertices.data(), primitives[p].vertices.size() * sizeof(Vertex)) == 0, name.c_str());
+          Assert::IsTrue(expected[p].indices == primitives[p].indices, name.c_str());
+        }
+        compared++;
+      }
+      Assert::IsTrue(compared > 0);
+    }
+
+    TEST_METHOD(InterleavedIntegerAttributesConvert)
+    {
+      const tinygltf::Model model = MakeInterleavedModel();
+      const AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(model, model.meshes[0].primitives[0]);
+      Assert::AreEqual(size_t(3), data.vertices.size());
+      Assert::IsTrue(data.indices == std::vector<Index>{ 2, 0, 1 });
+
+      //plain integers convert as numbers, normalized ones map to [-1, 1] and [0, 1]
+      Assert::AreEqual(40000.0f, data.vertices[1].position.x);
+      Assert::AreEqual(65535.0f, data.vertices[2].position.y);
+      Assert::AreEqual(9.0f, data.vertices[2].position.z);
+      Assert::AreEqual(1.0f, data.vertices[0].normal.z);
+      Assert::AreEqual(-1.0f, data.vertices[1].normal.x);
+      Assert::AreEqual(-1.0f, data.vertices[2].normal.y);
+      Assert::AreEqual(1.0f, data.vertices[0].texCoord.y);
+      Assert::AreEqual(0.2f, data.vertices[1].texCoord.x, 1e-6f);
+      Assert::AreEqual(0.4f, data.vertices[1].texCoord.y, 1e-6f);
+      Assert::AreEqual(0.0f, data.vertices[2].texCoord.y);
+    }
+
+    TEST_METHOD(UnindexedPrimitivesGetSequentialIndices)
+    {
+      tinygltf::Model model = MakeInterleavedModel();
+      model.meshes[0].primitives[0].indices = -1;
+      const AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(model, model.meshes[0].primitives[0]);
+      Assert::IsTrue(data.indices == std::vector<Index>{ 0, 1, 2 });
+    }
+
+    TEST_METHOD(RejectsAccessorsPastTheirView)
+    {
+      tinygltf::Model model = MakeInterleavedModel();
+      model.accessors[model.meshes[0].primitives[0].attributes["TEXCOORD_0"]].count = 4;
+      Assert::ExpectException<std::runtime_error>([&]() { AssetLoader::DecodeGltfPrimitive(model, model.meshes[0].primitives[0]); });
+
+      model = MakeInterleavedModel();
+      model.buffers[0].data[3 * 12 + 2] = 3;
+      Assert::ExpectException<std::runtime_error>([&]() { AssetLoader::DecodeGltfPrimitive(model, model.meshes[0].primitives[0]); },
+                                                  L"an index past the vertices");
+    }
+  };
+}
@@ -0,0 +1,188 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include <set>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // a tetrahedron mesh and references nodes drawing it below one root node; the root is
+  // the only node of the scene
+  tinygltf::Model MakeInstancedModel(int references)
+  {
+    tinygltf::Model model;
+    tinygltf::Buffer buffer;
+    const float positions[4][3] = { { 0, 0, 0 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+    const UINT16 indices[12] = { 0, 2, 1, 0, 1, 3, 0, 3, 2, 1, 2, 3 };
+    buffer.data.resize(sizeof(positions) + sizeof(indices));
+    memcpy(buffer.data.data(), positions, sizeof(positions));
+    memcpy(buffer.data.data() + sizeof(positions), indices, sizeof(indices));
+    model.buffers.push_back(buffer);
+
+    tinygltf::BufferView position_view;
+    position_view.buffer = 0;
+    position_view.byteLength = sizeof(positions);
+    tinygltf::BufferView index_view;
+    index_view.buffer = 0;
+    index_view.byteOffset = sizeof(positions);
+    index_view.byteLength = sizeof(indices);
+    model.bufferViews = { position_view, index_view };
+
+    //tinygltf leaves the offset and the normalized flag uninitialized
+    tinygltf::Accessor position_accessor;
+    position_accessor.bufferView = 0;
+    position_accessor.byteOffset = 0;
+    position_accessor.normalized = false;
+    position_accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+    position_accessor.type = TINYGLTF_TYPE_VEC3;
+    position_accessor.count = 4;
+    tinygltf::Accessor index_accessor;
+    index_accessor.bufferView = 1;
+    index_accessor.byteOffset = 0;
+    index_accessor.normalized = false;
+    index_accessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT;
+    index_accessor.type = TINYGLTF_TYPE_SCALAR;
+    index_accessor.count = 12;
+    model.accessors = { position_accessor, index_accessor };
+
+    tinygltf::Primitive primitive;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    primitive.attributes["POSITION"] = 0;
+    primitive.indices = 1;
+    tinygltf::Mesh mesh;
+    mesh.primitives.push_back(primitive);
+    model.meshes.push_back(mesh);
+
+    tinygltf::Node root;
+    model.nodes.push_back(root);
+    for (int i = 0; i < references; i++)
+    {
+      tinygltf::Node node;
+      node.mesh = 0;
+      node.translation = { double(i), 0.0, 0.0 };
+      model.nodes.push_back(node);
+      model.nodes[0].children.push_back(i + 1);
+    }
+
+    tinygltf::Scene scene;
+    scene.nodes.push_back(0);
+    model.scenes.push_back(scene);
+    model.defaultScene = 0;
+    return model;
+  }
+
+  TEST_CLASS(GltfInstancesTests)
+  {
+  public:
+    TEST_METHOD(TenThousandReferencesShareOneModel)
+    {
+      const tinygltf::Model model = MakeInstancedModel(10000);
+      const AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+
+      //one model is one BLAS, every reference is a TLAS instance of it
+      Assert::AreEqual(size_t(1), instances.models.size());
+      Assert::AreEqual(size_t(10000), instances.InstanceCount());
+      Assert::IsTrue(instances.node_models[0].empty(), L"the root has no mesh");
+      for (size_t node = 1; node < instances.node_models.size(); node++)
+      {
+        Assert::IsTrue(instances.node_models[node] == std::vector<int>{ 0 });
+      }
+
+      //the geometry is held once, not per reference
+      const AssetLoader::ModelData one = AssetLoader::DecodeGltfPrimitive(model, model.meshes[0].primitives[0]);
+      const size_t one_bytes = one.vertices.size() * sizeof(Vertex) + one.indices.size() * sizeof(Index) + one.tangents.size() * sizeof(XMFLOAT4);
+      Assert::AreEqual(one_bytes, instances.GeometryBytes());
+      Assert::AreEqual(size_t(4), instances.models[0].data.vertices.size());
+      Assert::AreEqual(size_t(12), instances.models[0].data.indices.size());
+    }
+
+    TEST_METHOD(EveryPrimitiveIsItsOwnModel)
+    {
+      tinygltf::Model model = MakeInstancedModel(3);
+      tinygltf::Primitive points = model.meshes[0].primitives[0];
+      points.mode = TINYGLTF_MODE_POINTS;
+      tinygltf::Primitive unindexed = model.meshes[0].primitives[0];
+      unindexed.indices = -1;
+      model.meshes[0].primitives.push_back(points);
+      model.meshes[0].primitives.push_back(unindexed);
+
+      //a second mesh with the same primitive is still a different model
+      model.meshes.push_back(model.meshes[0]);
+      model.nodes[3].mesh = 1;
+
+      const AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+      Assert::AreEqual(size_t(4), instances.models.size());
+      Assert::AreEqual(size_t(6), instances.InstanceCount());
+      Assert::IsTrue(instances.node_models[1] == std::vector<int>{ 0, -1, 1 }, L"points aren't a model");
+      Assert::IsTrue(instances.node_models[2] == std::vector<int>{ 0, -1, 1 });
+      Assert::IsTrue(instances.node_models[3] == std::vector<int>{ 2, -1, 3 });
+      Assert::AreEqual(0, instances.models[1].mesh);
+      Assert::AreEqual(2, instances.models[1].primitive);
+      Assert::AreEqual(size_t(4), instances.models[1].data.indices.size(), L"0..n-1 for the unindexed primitive");
+    }
+
+    TEST_METHOD(SkinnedNodesGetTheirOwnModel)
+    {
+      tinygltf::Model model = MakeInstancedModel(4);
+      tinygltf::Skin skin;
+      skin.joints = { 0 };
+      model.skins.push_back(skin);
+      model.nodes[1].skin = 0;
+      model.nodes[2].skin = 0;
+
+      const AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+      Assert::AreEqual(size_t(3), instances.models.size());
+      Assert::AreEqual(size_t(4), instances.InstanceCount());
+      Assert::AreEqual(1, instances.models[instances.node_models[1][0]].skinned_node);
+      Assert::AreEqual(2, instances.models[instances.node_models[2][0]].skinned_node);
+      Assert::AreEqual(instances.node_models[3][0], instances.node_models[4][0], L"the static nodes share");
+      Assert::AreEqual(-1, instances.models[instances.node_models[3][0]].skinned_node);
+    }
+
+    TEST_METHOD(OnlyTheDefaultSceneIsInstanced)
+    {
+      tinygltf::Model model = MakeInstancedModel(2);
+      tinygltf::Node outside;
+      outside.mesh = 0;
+      model.nodes.push_back(outside);
+      tinygltf::Scene other;
+      other.nodes.push_back(3);
+      model.scenes.push_back(other);
+
+      AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+      Assert::AreEqual(size_t(2), instances.InstanceCount());
+      Assert::IsTrue(instances.node_models[3].empty());
+
+      model.defaultScene = 1;
+      instances = AssetLoader::DecodeGltfInstances(model);
+      Assert::AreEqual(size_t(1), instances.InstanceCount());
+      Assert::IsTrue(instances.node_models[1].empty());
+
+      model.scenes[0].nodes.push_back(int(model.nodes.size()));
+      model.defaultScene = 0;
+      Assert::ExpectException<std::runtime_error>([&]() { AssetLoader::DecodeGltfInstances(model); });
+    }
+
+    TEST_METHOD(ShippedModelsNeverDuplicateGeometry)
+    {
+      for (const std::string& file : AssetLoader::ShippedGltfModels())
+      {
+        const std::wstring name(file.begin(), file.end());
+        const tinygltf::Model model = AssetLoader::DecodeGltf(file);
+        const AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+        Assert::IsTrue(instances.models.size() <= instances.InstanceCount(), name.c_str());
+
+        //a static model is a distinct (mesh, primitive)
+        std::set<std::pair<int, int>> shared;
+        for (const AssetLoader::GltfModel& decoded : instances.models)
+        {
+          if (decoded.skinned_node < 0)
+          {
+            Assert::IsTrue(shared.insert({ decoded.mesh, decoded.primitive }).second, name.c_str());
+          }
+        }
+      }
+    }
+  };
+}
@@ -0,0 +1,241 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "HeapSuballocator.h"
+
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // live allocations of one TLSF range are aligned, inside it and apart
+  void AssertDisjoint(const TlsfAllocator& tlsf)
+  {
+    UINT64 end = 0;
+    UINT64 used = 0;
+    for (const TlsfAllocator::Allocation& allocation : tlsf.Allocations())
+    {
+      Assert::IsTrue(allocation.offset >= end, L"allocations overlap");
+      Assert::AreEqual(UINT64(0), allocation.offset % TlsfAllocator::kGranularity);
+      Assert::AreEqual(UINT64(0), allocation.size % TlsfAllocator::kGranularity);
+      end = allocation.offset + allocation.size;
+      used += allocation.size;
+    }
+    Assert::IsTrue(end <= tlsf.Size());
+    Assert::AreEqual(tlsf.UsedBytes(), used);
+  }
+
+  // pages the callbacks were asked to create and release, as a heap would see them
+  struct PageLog
+  {
+    size_t created = 0;
+    size_t released = 0;
+    UINT64 live_bytes = 0;
+    std::map<std::pair<UINT32, UINT32>, UINT64> live;
+
+    HeapSuballocator::Callbacks Callbacks()
+    {
+      HeapSuballocator::Callbacks callbacks;
+      callbacks.create_page = [this](UINT32 pool, UINT32 page, UINT64 size)
+      {
+        Assert::IsTrue(live.emplace(std::make_pair(pool, page), size).second, L"page made twice");
+        created++;
+        live_bytes += size;
+      };
+      callbacks.release_page = [this](UINT32 pool, UINT32 page)
+      {
+        auto found = live.find(std::make_pair(pool, page));
+        Assert::IsTrue(found != live.end(), L"releasing a page never made");
+        live_bytes -= found->second;
+        live.erase(found);
+        released++;
+      };
+      return callbacks;
+    }
+  };
+
+  TEST_CLASS(HeapSuballocatorTests)
+  {
+  public:
+    TEST_METHOD(TlsfStress)
+    {
+      TlsfAllocator tlsf(64ull << 20);
+      std::mt19937_64 random(7);
+      std::vector<TlsfAllocator::Allocation> live;
+      std::map<UINT32, UINT64> user_of_block;
+      size_t failures = 0;
+      for (int step = 0; step < 20000; step++)
+      {
+        if (live.empty() || random() % 5 < 3)
+        {
+          const UINT64 size = 1 + random() % (1ull << (8 + random() % 13));
+          const UINT64 alignment = 1ull << (8 + random() % 9);
+          const TlsfAllocator::Allocation allocation = tlsf.Allocate(size, alignment, step);
+          if (!allocation.IsValid())
+          {
+            failures++;
+            continue;
+          }
+          Assert::AreEqual(UINT64(0), allocation.offset % alignment);
+          Assert::IsTrue(allocation.size >= size);
+          Assert::AreEqual(UINT64(step), allocation.user);
+          live.push_back(allocation);
+        }
+        else
+        {
+          const size_t index = static_cast<size_t>(random() % live.size());
+          tlsf.Free(live[index]);
+          live[index] = live.back();
+          live.pop_back();
+        }
+        Assert::AreEqual(live.size(), tlsf.AllocationCount());
+        if (step % 500 == 0)
+        {
+          Assert::IsTrue(tlsf.Validate());
+          AssertDisjoint(tlsf);
+        }
+      }
+      Assert::AreEqual(size_t(0), failures, L"a working set well below the range always fits");
+
+      for (const TlsfAllocator::Allocation& allocation : live)
+      {
+        tlsf.Free(allocation);
+      }
+      Assert::IsTrue(tlsf.IsEmpty());
+      Assert::IsTrue(tlsf.Validate());
+      Assert::AreEqual(tlsf.Size(), tlsf.LargestFreeBlock(), L"freed neighbours merge back into one block");
+    }
+
+    TEST_METHOD(TlsfFillsExactlyAndFailsCleanly)
+    {
+      TlsfAllocator tlsf(1 << 20);
+      std::vector<TlsfAllocator::Allocation> live;
+      for (int i = 0; i < 16; i++)
+      {
+        live.push_back(tlsf.Allocate(64 << 10, 64 << 10));
+        Assert::IsTrue(live.back().IsValid());
+      }
+      Assert::AreEqual(UINT64(1 << 20), tlsf.UsedBytes());
+      Assert::IsFalse(tlsf.Allocate(256, 256).IsValid(), L"a full range says so instead of overlapping");
+
+      //every other block freed: plenty of bytes, none in one piece
+      for (int i = 0; i < 16; i += 2)
+      {
+        tlsf.Free(live[i]);
+      }
+      Assert::IsFalse(tlsf.Allocate(128 << 10, 256).IsValid());
+      Assert::IsTrue(tlsf.Allocate(64 << 10, 64 << 10).IsValid());
+      Assert::IsTrue(tlsf.Validate());
+    }
+
+    TEST_METHOD(SuballocatorStress)
+    {
+      PageLog log;
+      {
+        HeapSuballocator heap(2, 4ull << 20, log.Callbacks());
+        std::mt19937_64 random(11);
+        std::vector<HeapSuballocator::Allocation> live;
+        for (int step = 0; step < 20000; step++)
+        {
+          if (live.empty() || random() % 3 < 2)
+          {
+            const UINT32 pool = static_cast<UINT32>(random() % 2);
+            const auto category = static_cast<HeapSuballocator::Category>(random() % static_cast<UINT64>(HeapSuballocator::Category::Count));
+            //now and then something bigger than a page, which gets one of its own
+            const UINT64 size = random() % 200 == 0 ? (5ull << 20) : 1 + random() % (1ull << (8 + random() % 13));
+            const UINT64 alignment = pool == 1 ? 65536 : 256;
+            const HeapSuballocator::Allocation allocation = heap.Allocate(pool, category, size, alignment);
+            Assert::IsTrue(allocation.IsValid());
+            Assert::AreEqual(pool, allocation.pool);
+            Assert::AreEqual(UINT64(0), allocation.range.offset % alignment);
+            live.push_back(allocation);
+          }
+          else
+          {
+            const size_t index = static_cast<size_t>(random() % live.size());
+            heap.Free(live[index]);
+            live[index] = live.back();
+            live.pop_back();
+          }
+          if (step % 1000 == 0)
+          {
+            Assert::IsTrue(heap.Validate());
+            heap.Trim();
+          }
+        }
+
+        size_t allocations = 0;
+        for (UINT32 category = 0; category < static_cast<UINT32>(HeapSuballocator::Category::Count); category++)
+        {
+          allocations += heap.GetStats(static_cast<HeapSuballocator::Category>(category)).allocations;
+        }
+        Assert::AreEqual(live.size(), allocations);
+        UINT64 page_bytes = 0;
+        for (UINT32 pool = 0; pool < heap.PoolCount(); pool++)
+        {
+          page_bytes += heap.GetPoolStats(pool).page_bytes;
+        }
+        Assert::AreEqual(log.live_bytes, page_bytes, L"every page the heap uses was made and not released");
+
+        for (const HeapSuballocator::Allocation& allocation : live)
+        {
+          heap.Free(allocation);
+        }
+        for (UINT32 category = 0; category < static_cast<UINT32>(HeapSuballocator::Category::Count); category++)
+        {
+          const HeapSuballocator::CategoryStats stats = heap.GetStats(static_cast<HeapSuballocator::Category>(category));
+          Assert::AreEqual(size_t(0), stats.allocations);
+          Assert::AreEqual(UINT64(0), stats.reserved_bytes);
+        }
+        Assert::AreEqual(size_t(0), heap.GetPoolStats(0).dedicated_pages + heap.GetPoolStats(1).dedicated_pages,
+                         L"dedicated pages go with their allocation");
+        heap.Trim();
+        Assert::AreEqual(size_t(0), heap.GetPoolStats(0).pages + heap.GetPoolStats(1).pages);
+      }
+      Assert::AreEqual(log.created, log.released);
+      Assert::IsTrue(log.live.empty());
+    }
+
+    TEST_METHOD(DefragmentationEmptiesTheLeastUsedPage)
+    {
+      PageLog log;
+      HeapSuballocator heap(1, 1 << 20, log.Callbacks());
+      std::vector<HeapSuballocator::Allocation> live;
+      for (int i = 0; i < 48; i++)
+      {
+        live.push_back(heap.Allocate(0, HeapSuballocator::Category::Vertices, 64 << 10, 65536));
+      }
+      Assert::AreEqual(size_t(3), heap.GetPoolStats(0).pages);
+
+      //the first two pages half empty, the third down to two allocations
+      for (size_t i = 0; i < live.size();)
+      {
+        const bool keep = live[i].page == 2 ? live[i].range.offset < (128 << 10) : live[i].range.offset % (128 << 10) == 0;
+        if (keep)
+        {
+          i++;
+          continue;
+        }
+        heap.Free(live[i]);
+        live.erase(live.begin() + i);
+      }
+
+      const std::vector<HeapSuballocator::Move> moves = heap.PlanDefragmentation(0, UINT64_MAX);
+      Assert::AreEqual(size_t(2), moves.size());
+      for (const HeapSuballocator::Move& move : moves)
+      {
+        Assert::AreEqual(2u, move.from.page);
+        Assert::AreNotEqual(2u, move.to.page);
+        Assert::AreEqual(move.from.requested, move.to.requested);
+        Assert::AreEqual(UINT64(0), move.to.range.offset % 65536, L"moves keep the alignment");
+        heap.Free(move.from);
+      }
+      heap.Trim();
+      Assert::AreEqual(size_t(2), heap.GetPoolStats(0).pages);
+      Assert::AreEqual(size_t(1), log.released);
+      Assert::IsTrue(heap.Validate());
+
+      Assert::IsTrue(heap.PlanDefragmentation(0, 32 << 10).empty(), L"nothing fits the byte budget");
+    }
+  };
+}
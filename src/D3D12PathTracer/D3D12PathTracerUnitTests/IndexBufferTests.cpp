@@ -0,0 +1,101 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "IndexBuffer.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // LoadTriangleIndices from Raytracing.hlsl, with ByteAddressBuffer loads
+  // that fail past the end of the buffer
+  XMUINT3 ShaderLoadTriangleIndices(const std::vector<BYTE>& buffer, UINT index_size, UINT primitive)
+  {
+    auto load = [&buffer](UINT offset)
+    {
+      Assert::IsTrue(offset % 4 == 0 && offset + 4 <= buffer.size(), L"shader load outside the buffer");
+      UINT32 value;
+      memcpy(&value, buffer.data() + offset, sizeof(value));
+      return value;
+    };
+
+    const UINT offset = primitive * 3 * index_size;
+    if (index_size == 4)
+    {
+      return XMUINT3(load(offset), load(offset + 4), load(offset + 8));
+    }
+
+    const UINT aligned = offset & ~3u;
+    const UINT32 x = load(aligned);
+    const UINT32 y = load(aligned + 4);
+    if (aligned == offset)
+    {
+      return XMUINT3(x & 0xffff, x >> 16, y & 0xffff);
+    }
+    return XMUINT3(x >> 16, y & 0xffff, y >> 16);
+  }
+
+  std::vector<Index> MakeIndices(size_t triangles, Index vertex_count)
+  {
+    std::vector<Index> indices(triangles * 3);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      //spread over the whole range so the high bits are exercised
+      indices[i] = static_cast<Index>((i * 2654435761u) % vertex_count);
+    }
+    return indices;
+  }
+
+  void AssertTrianglesMatch(const std::vector<Index>& indices, DXGI_FORMAT format)
+  {
+    const std::vector<BYTE> packed = IndexBuffer::Pack(indices.data(), indices.size(), format);
+    Assert::AreEqual(size_t(0), packed.size() % 4, L"raw views need a dword multiple");
+    for (size_t t = 0; t < indices.size() / 3; t++)
+    {
+      const XMUINT3 cpu = IndexBuffer::FetchTriangle(packed.data(), format, t);
+      const XMUINT3 gpu = ShaderLoadTriangleIndices(packed, IndexBuffer::FormatSize(format), static_cast<UINT>(t));
+      for (const XMUINT3& fetched : { cpu, gpu })
+      {
+        Assert::AreEqual(indices[t * 3], fetched.x);
+        Assert::AreEqual(indices[t * 3 + 1], fetched.y);
+        Assert::AreEqual(indices[t * 3 + 2], fetched.z);
+      }
+    }
+  }
+
+  TEST_CLASS(IndexBufferTests)
+  {
+  public:
+    TEST_METHOD(ChoosesTheNarrowestFormat)
+    {
+      Assert::IsTrue(IndexBuffer::ChooseFormat(3) == DXGI_FORMAT_R16_UINT);
+      Assert::IsTrue(IndexBuffer::ChooseFormat(65535) == DXGI_FORMAT_R16_UINT);
+      Assert::IsTrue(IndexBuffer::ChooseFormat(65536) == DXGI_FORMAT_R32_UINT);
+      Assert::AreEqual(2u, IndexBuffer::FormatSize(DXGI_FORMAT_R16_UINT));
+      Assert::AreEqual(4u, IndexBuffer::FormatSize(DXGI_FORMAT_R32_UINT));
+    }
+
+    TEST_METHOD(SixteenBitRoundTrips)
+    {
+      //odd and even triangle counts, the odd ones end on a padded dword
+      for (size_t triangles : { size_t(1), size_t(2), size_t(3), size_t(1000), size_t(1001) })
+      {
+        AssertTrianglesMatch(MakeIndices(triangles, 65536), DXGI_FORMAT_R16_UINT);
+      }
+    }
+
+    TEST_METHOD(ThirtyTwoBitRoundTrips)
+    {
+      for (size_t triangles : { size_t(1), size_t(2), size_t(1001) })
+      {
+        AssertTrianglesMatch(MakeIndices(triangles, 1 << 24), DXGI_FORMAT_R32_UINT);
+      }
+    }
+
+    TEST_METHOD(SixteenBitRejectsWideIndices)
+    {
+      const std::vector<Index> indices = { 0, 1, 65536 };
+      Assert::ExpectException<std::runtime_error>([&indices]() { IndexBuffer::Pack(indices.data(), indices.size(), DXGI_FORMAT_R16_UINT); });
+      Assert::ExpectException<std::runtime_error>([&indices]() { IndexBuffer::Pack(indices.data(), indices.size(), DXGI_FORMAT_R8_UINT); });
+    }
+  };
+}
@@ -0,0 +1,137 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+#include <unordered_set>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  struct Mesh
+  {
+    std::vector<Vertex> vertices;
+    std::vector<Index> indices;
+  };
+
+  // n x n quads over the unit square at height z, texcoords follow xy
+  Mesh MakeGrid(int n, float z)
+  {
+    Mesh mesh;
+    for (int y = 0; y <= n; y++)
+    {
+      for (int x = 0; x <= n; x++)
+      {
+        Vertex vertex;
+        vertex.position = XMFLOAT3(float(x) / n, float(y) / n, z);
+        vertex.normal = XMFLOAT3(0.0f, 0.0f, 1.0f);
+        vertex.texCoord = XMFLOAT2(float(x) / n, float(y) / n);
+        mesh.vertices.push_back(vertex);
+      }
+    }
+    for (int y = 0; y < n; y++)
+    {
+      for (int x = 0; x < n; x++)
+      {
+        const Index a = y * (n + 1) + x;
+        const Index b = a + n + 1;
+        mesh.indices.insert(mesh.indices.end(), { a, a + 1, b, b, a + 1, b + 1 });
+      }
+    }
+    return mesh;
+  }
+
+  float Diagonal(const std::vector<Vertex>& vertices)
+  {
+    const VertexPacking::Bounds bounds = VertexPacking::ComputeBounds(vertices.data(), vertices.size());
+    return sqrtf(bounds.extent.x * bounds.extent.x + bounds.extent.y * bounds.extent.y + bounds.extent.z * bounds.extent.z);
+  }
+
+  TEST_CLASS(MeshSimplifierTests)
+  {
+  public:
+    TEST_METHOD(HausdorffOfOffsetPlanesIsTheOffset)
+    {
+      const Mesh lower = MakeGrid(8, 0.0f);
+      const Mesh upper = MakeGrid(8, 0.25f);
+      Assert::AreEqual(0.0f, MeshSimplifier::HausdorffDistance(lower.vertices, lower.indices, lower.vertices, lower.indices), 1e-6f);
+      Assert::AreEqual(0.25f, MeshSimplifier::HausdorffDistance(lower.vertices, lower.indices, upper.vertices, upper.indices), 1e-6f);
+    }
+
+    TEST_METHOD(HausdorffIsTwoSided)
+    {
+      //half the square is inside the square, but the square's far corner is sqrt(2)/2 from the half
+      const Mesh square = MakeGrid(1, 0.0f);
+      const std::vector<Index> half(square.indices.begin(), square.indices.begin() + 3);
+      const float expected = sqrtf(2.0f) / 2.0f;
+      Assert::AreEqual(expected, MeshSimplifier::HausdorffDistance(square.vertices, square.indices, square.vertices, half), 1e-6f);
+      Assert::AreEqual(expected, MeshSimplifier::HausdorffDistance(square.vertices, half, square.vertices, square.indices), 1e-6f);
+    }
+
+    TEST_METHOD(FlatGridSimplifiesWithoutError)
+    {
+      const Mesh grid = MakeGrid(16, 0.0f);
+      const size_t target = grid.indices.size() / 10;
+      const std::vector<Index> simplified = MeshSimplifier::Simplify(grid.vertices, grid.indices, target);
+      Assert::IsTrue(simplified.size() <= target, L"a plane has nothing stopping it from reaching the target");
+      Assert::AreEqual(0.0f, MeshSimplifier::HausdorffDistance(grid.vertices, grid.indices, grid.vertices, simplified), 1e-6f);
+    }
+
+    TEST_METHOD(LoneTriangleIsNotDeleted)
+    {
+      const Mesh square = MakeGrid(1, 0.0f);
+      const std::vector<Index> triangle(square.indices.begin(), square.indices.begin() + 3);
+      Assert::AreEqual(size_t(3), MeshSimplifier::Simplify(square.vertices, triangle, 0).size());
+    }
+
+    TEST_METHOD(LodChainStopsAtTheBound)
+    {
+      //turning the square into a triangle is the only collapse left, and it is half the diagonal off
+      const Mesh square = MakeGrid(1, 0.0f);
+      const std::vector<MeshSimplifier::Level> levels = MeshSimplifier::BuildLodChain(square.vertices, square.indices, { 0.5f, 0.1f });
+      for (const MeshSimplifier::Level& level : levels)
+      {
+        Assert::AreEqual(square.indices.size(), level.indices.size());
+        Assert::AreEqual(0.0f, level.hausdorff_distance, 1e-6f);
+      }
+    }
+
+    TEST_METHOD(ShippedLodChainsStayWithinBound)
+    {
+      for (const std::string& file : ObjParser::ShippedModels())
+      {
+        Mesh source;
+        ObjParser::Mesh parsed = ObjParser::Parse(file, ThreadPool::Shared());
+        source.vertices = std::move(parsed.vertices);
+        source.indices = std::move(parsed.indices);
+        MeshOptimizer::WeldVertices(source.vertices, source.indices);
+
+        std::unordered_set<MeshOptimizer::VertexKey, MeshOptimizer::VertexKeyHasher> source_vertices;
+        for (const Vertex& vertex : source.vertices)
+        {
+          source_vertices.insert(MeshOptimizer::MakeVertexKey(vertex));
+        }
+
+        const float bound = MeshSimplifier::kMaxRelativeError * Diagonal(source.vertices);
+        const std::wstring name(file.begin(), file.end());
+        size_t previous_triangles = source.indices.size() / 3;
+        for (const MeshSimplifier::Level& level : MeshSimplifier::BuildLodChain(source.vertices, source.indices, { 0.5f, 0.25f, 0.1f }))
+        {
+          Assert::IsTrue(level.hausdorff_distance <= bound, (L"level past the bound in " + name).c_str());
+          Assert::AreEqual(level.hausdorff_distance, MeshSimplifier::HausdorffDistance(source.vertices, source.indices, level.vertices, level.indices), bound * 1e-3f);
+          Assert::IsTrue(level.indices.size() / 3 <= previous_triangles, (L"level grew in " + name).c_str());
+          previous_triangles = level.indices.size() / 3;
+
+          //half edge collapses only ever keep source vertices, seams included
+          for (const Vertex& vertex : level.vertices)
+          {
+            Assert::IsTrue(source_vertices.count(MeshOptimizer::MakeVertexKey(vertex)) != 0, (L"level vertex not in the source of " + name).c_str());
+          }
+        }
+      }
+    }
+  };
+}
@@ -0,0 +1,194 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "MipChain.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include <functional>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // width x height RGBA8 image, texel(x, y, rgba) fills each texel
+  AssetLoader::ImageData MakeRgba8(UINT width, UINT height, const std::function<void(UINT, UINT, BYTE*)>& texel)
+  {
+    AssetLoader::ImageData image;
+    image.desc = TextureLoader::DescribeTexture2D(width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
+    image.bytes_per_row = width * 4;
+    image.size = image.bytes_per_row * height;
+    image.texels.reset(static_cast<BYTE*>(malloc(image.size)));
+    for (UINT y = 0; y < height; y++)
+    {
+      for (UINT x = 0; x < width; x++)
+      {
+        texel(x, y, image.texels.get() + y * image.bytes_per_row + x * 4);
+      }
+    }
+    return image;
+  }
+
+  const BYTE* LevelTexel(const AssetLoader::ImageData& chain, size_t level, UINT x, UINT y)
+  {
+    const MipChain::Level& layout = MipChain::Layout(chain.desc)[level];
+    return chain.texels.get() + layout.offset + size_t(y) * layout.bytes_per_row + size_t(x) * 4;
+  }
+
+  // [0, 1] packed normal back to [-1, 1]
+  glm::vec3 UnpackNormal(const BYTE* texel)
+  {
+    return glm::vec3(texel[0], texel[1], texel[2]) / 255.0f * 2.0f - 1.0f;
+  }
+
+  TEST_CLASS(MipChainTests)
+  {
+  public:
+    TEST_METHOD(LevelsArePackedDownToOneTexel)
+    {
+      const AssetLoader::ImageData chain = MipChain::Generate(MakeRgba8(64, 16, [](UINT, UINT, BYTE* texel) { memset(texel, 255, 4); }),
+                                                              MipChain::Filter::Linear, ThreadPool::Shared());
+      Assert::AreEqual(UINT16(7), chain.desc.MipLevels);
+      const std::vector<MipChain::Level> levels = MipChain::Layout(chain.desc);
+      Assert::AreEqual(size_t(7), levels.size());
+      for (size_t i = 1; i < levels.size(); i++)
+      {
+        Assert::AreEqual(levels[i - 1].offset + levels[i - 1].size, levels[i].offset, L"levels follow each other");
+        Assert::AreEqual(std::max<UINT>(levels[i - 1].width / 2, 1), levels[i].width);
+        Assert::AreEqual(std::max<UINT>(levels[i - 1].height / 2, 1), levels[i].height);
+      }
+      Assert::AreEqual(1u, levels.back().width);
+      Assert::AreEqual(1u, levels.back().height);
+      Assert::AreEqual(levels.back().offset + levels.back().size, size_t(chain.size));
+    }
+
+    TEST_METHOD(SrgbCheckerAveragesInLinearLight)
+    {
+      auto checker = [](UINT x, UINT y, BYTE* texel)
+      {
+        const BYTE value = ((x + y) & 1) ? 255 : 0;
+        texel[0] = texel[1] = texel[2] = value;
+        texel[3] = 255;
+      };
+      const AssetLoader::ImageData srgb = MipChain::Generate(MakeRgba8(8, 8, checker), MipChain::Filter::Srgb, ThreadPool::Shared());
+      const AssetLoader::ImageData linear = MipChain::Generate(MakeRgba8(8, 8, checker), MipChain::Filter::Linear, ThreadPool::Shared());
+
+      //half the light is 0.5 linear, 188 once encoded as sRGB; averaging the stored values gives 128
+      for (size_t level = 1; level < srgb.desc.MipLevels; level++)
+      {
+        const BYTE* srgb_texel = LevelTexel(srgb, level, 0, 0);
+        const BYTE* linear_texel = LevelTexel(linear, level, 0, 0);
+        for (int c = 0; c < 3; c++)
+        {
+          Assert::AreEqual(188.0, double(srgb_texel[c]), 1.0);
+          Assert::AreEqual(128.0, double(linear_texel[c]), 1.0);
+        }
+        Assert::AreEqual(BYTE(255), srgb_texel[3]);
+      }
+    }
+
+    TEST_METHOD(TransparentTexelsDontTintColor)
+    {
+      //opaque red next to transparent green: the average is half covered red, not brown
+      const AssetLoader::ImageData chain = MipChain::Generate(MakeRgba8(4, 4, [](UINT x, UINT, BYTE* texel)
+      {
+        const bool red = (x & 1) == 0;
+        texel[0] = red ? 255 : 0;
+        texel[1] = red ? 0 : 255;
+        texel[2] = 0;
+        texel[3] = red ? 255 : 0;
+      }), MipChain::Filter::Srgb, ThreadPool::Shared());
+
+      const BYTE* texel = LevelTexel(chain, 1, 0, 0);
+      Assert::AreEqual(255.0, double(texel[0]), 1.0);
+      Assert::AreEqual(0.0, double(texel[1]), 1.0);
+      Assert::AreEqual(128.0, double(texel[3]), 1.0);
+    }
+
+    TEST_METHOD(NormalMapsAreAveragedAsUnitVectors)
+    {
+      //columns tilted 45 degrees left and right average to straight up, not to a shorter vector
+      const float tilt = 0.5f * std::sqrt(2.0f);
+      const AssetLoader::ImageData chain = MipChain::Generate(MakeRgba8(16, 16, [&](UINT x, UINT, BYTE* texel)
+      {
+        const float nx = (x & 1) ? tilt : -tilt;
+        texel[0] = static_cast<BYTE>((nx * 0.5f + 0.5f) * 255.0f + 0.5f);
+        texel[1] = 128;
+        texel[2] = static_cast<BYTE>((tilt * 0.5f + 0.5f) * 255.0f + 0.5f);
+        texel[3] = 255;
+      }), MipChain::Filter::Normal, ThreadPool::Shared());
+
+      for (size_t level = 1; level < chain.desc.MipLevels; level++)
+      {
+        const glm::vec3 normal = UnpackNormal(LevelTexel(chain, level, 0, 0));
+        Assert::AreEqual(1.0f, glm::length(normal), 0.01f);
+        Assert::IsTrue(normal.z > 0.999f, L"the average should point straight up");
+      }
+    }
+
+    TEST_METHOD(OpposingNormalsFallBackToUp)
+    {
+      const AssetLoader::ImageData chain = MipChain::Generate(MakeRgba8(2, 2, [](UINT x, UINT, BYTE* texel)
+      {
+        //(1, 1, 1) and (-1, -1, -1), which sum to exactly nothing
+        memset(texel, (x & 1) ? 255 : 0, 3);
+        texel[3] = 255;
+      }), MipChain::Filter::Normal, ThreadPool::Shared());
+
+      const glm::vec3 normal = UnpackNormal(LevelTexel(chain, 1, 0, 0));
+      Assert::AreEqual(1.0f, glm::length(normal), 0.01f);
+      Assert::IsTrue(normal.z > 0.999f, L"a zero average should point straight up");
+    }
+
+    TEST_METHOD(FloatImagesKeepTheirAverage)
+    {
+      AssetLoader::ImageData image;
+      image.desc = TextureLoader::DescribeTexture2D(4, 4, DXGI_FORMAT_R32G32B32A32_FLOAT);
+      image.bytes_per_row = 4 * 4 * sizeof(float);
+      image.size = image.bytes_per_row * 4;
+      image.texels.reset(static_cast<BYTE*>(malloc(image.size)));
+      float* values = reinterpret_cast<float*>(image.texels.get());
+      for (int i = 0; i < 4 * 4 * 4; i++)
+      {
+        values[i] = float(i / 4); // hdr values far above 1
+      }
+      const AssetLoader::ImageData chain = MipChain::Generate(std::move(image), MipChain::Filter::Srgb, ThreadPool::Shared());
+      Assert::AreEqual(UINT16(3), chain.desc.MipLevels);
+      const glm::vec4 top = MipChain::Sample(chain, glm::vec2(0.5f), 2.0f);
+      Assert::AreEqual(7.5f, top.x, 0.001f, L"float images are averaged as stored");
+    }
+
+    TEST_METHOD(ConeLodFollowsTheFootprint)
+    {
+      const glm::vec3 positions[3] = { glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f) };
+      const glm::vec2 uvs[3] = { glm::vec2(0.0f), glm::vec2(1.0f, 0.0f), glm::vec2(0.0f, 1.0f) };
+      const glm::vec3 normal(0.0f, 0.0f, 1.0f);
+      const glm::vec3 head_on(0.0f, 0.0f, -1.0f);
+
+      //256 texels per unit: a cone one texel wide reads level 0, every doubling goes a level down
+      Assert::AreEqual(0.0f, MipChain::ConeLod(positions, uvs, 256, 256, 9, 1.0f / 256.0f, head_on, normal), 1e-4f);
+      Assert::AreEqual(2.0f, MipChain::ConeLod(positions, uvs, 256, 256, 9, 4.0f / 256.0f, head_on, normal), 1e-4f);
+      //at 60 degrees the footprint stretches to twice the width
+      const glm::vec3 slanted(std::sqrt(3.0f) / 2.0f, 0.0f, -0.5f);
+      Assert::AreEqual(3.0f, MipChain::ConeLod(positions, uvs, 256, 256, 9, 4.0f / 256.0f, slanted, normal), 1e-4f);
+      //clamped to the chain
+      Assert::AreEqual(8.0f, MipChain::ConeLod(positions, uvs, 256, 256, 9, 100.0f, head_on, normal));
+      Assert::AreEqual(0.0f, MipChain::ConeLod(positions, uvs, 256, 256, 9, 1e-6f, head_on, normal));
+      Assert::AreEqual(0.0f, MipChain::ConeLod(positions, uvs, 256, 256, 1, 100.0f, head_on, normal), L"a single level");
+    }
+
+    TEST_METHOD(SampleBlendsNeighbouringLevels)
+    {
+      const AssetLoader::ImageData chain = MipChain::Generate(MakeRgba8(8, 8, [](UINT x, UINT y, BYTE* texel)
+      {
+        memset(texel, ((x + y) & 1) ? 255 : 0, 4);
+      }), MipChain::Filter::Linear, ThreadPool::Shared());
+
+      //texel (1, 0) is white, the levels below are grey
+      const glm::vec2 uv(1.5f / 8.0f, 0.5f / 8.0f);
+      Assert::AreEqual(1.0f, MipChain::Sample(chain, uv, 0.0f).x, 1e-4f);
+      Assert::AreEqual(128.0f / 255.0f, MipChain::Sample(chain, uv, 1.0f).x, 1e-2f);
+      Assert::AreEqual(0.5f * (1.0f + 128.0f / 255.0f), MipChain::Sample(chain, uv, 0.5f).x, 1e-2f);
+      //uvs wrap like the sampler
+      Assert::AreEqual(1.0f, MipChain::Sample(chain, uv + glm::vec2(3.0f, -2.0f), 0.0f).x, 1e-4f);
+    }
+  };
+}
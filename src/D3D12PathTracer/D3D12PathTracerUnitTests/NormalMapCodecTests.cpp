@@ -0,0 +1,147 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "MipChain.h"
+#include "NormalMapCodec.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  double AngleBetween(const glm::vec3& a, const glm::vec3& b)
+  {
+    return glm::degrees(std::acos(std::min<double>(std::max<double>(glm::dot(glm::normalize(a), glm::normalize(b)), -1.0), 1.0)));
+  }
+
+  // how far the lowest texel of an RGBA8 chain points below the surface, 0 if none does;
+  // no two channel encoding can do better than that
+  double DeepestBelowSurface(const AssetLoader::ImageData& chain)
+  {
+    double deepest = 0.0;
+    for (const MipChain::Level& level : MipChain::Layout(chain.desc))
+    {
+      for (UINT y = 0; y < level.height; y++)
+      {
+        const BYTE* row = chain.texels.get() + level.offset + size_t(y) * level.bytes_per_row;
+        for (UINT x = 0; x < level.width; x++)
+        {
+          const glm::vec3 normal = glm::vec3(row[x * 4], row[x * 4 + 1], row[x * 4 + 2]) / 255.0f * 2.0f - 1.0f;
+          if (normal.z < 0.0f)
+          {
+            deepest = std::max<double>(deepest, AngleBetween(normal, glm::vec3(normal.x, normal.y, 0.0f)));
+          }
+        }
+      }
+    }
+    return deepest;
+  }
+
+  TEST_CLASS(NormalMapCodecTests)
+  {
+  public:
+    TEST_METHOD(HemisphereStaysWithinBound)
+    {
+      double steep = 0.0;
+      double grazing = 0.0;
+      for (int i = 0; i <= 200; i++)
+      {
+        for (int j = 0; j < 200; j++)
+        {
+          const float elevation = glm::radians(90.0f) * i / 200.0f;
+          const float azimuth = glm::radians(360.0f) * j / 200.0f;
+          const glm::vec3 normal(std::cos(elevation) * std::cos(azimuth), std::cos(elevation) * std::sin(azimuth), std::sin(elevation));
+          INT8 encoded[2];
+          NormalMapCodec::EncodeTexel(normal, encoded);
+          const double angle = AngleBetween(normal, NormalMapCodec::DecodeTexel(encoded));
+          double& bound = elevation >= glm::radians(15.0f) ? steep : grazing;
+          bound = std::max<double>(bound, angle);
+        }
+      }
+      //z comes back from sqrt(1 - x^2 - y^2), which loses precision towards the horizon
+      Assert::IsTrue(steep < 1.0, L"within a degree 15 degrees above the surface");
+      Assert::IsTrue(grazing < 4.0, L"within four degrees at the horizon");
+    }
+
+    TEST_METHOD(EveryPairDecodesToAUnitNormalAboveTheSurface)
+    {
+      for (int x = -128; x <= 127; x++)
+      {
+        for (int y = -128; y <= 127; y++)
+        {
+          const INT8 pair[2] = { static_cast<INT8>(x), static_cast<INT8>(y) };
+          const glm::vec3 normal = NormalMapCodec::DecodeTexel(pair);
+          Assert::AreEqual(1.0f, glm::length(normal), 1e-5f);
+          Assert::IsTrue(normal.z >= 0.0f);
+        }
+      }
+      const INT8 up[2] = { 0, 0 };
+      Assert::IsTrue(NormalMapCodec::DecodeTexel(up) == glm::vec3(0.0f, 0.0f, 1.0f));
+    }
+
+    TEST_METHOD(NormalsBelowTheSurfaceGoToTheHorizon)
+    {
+      const glm::vec3 below(0.6f, -0.48f, -0.64f);
+      INT8 encoded[2];
+      NormalMapCodec::EncodeTexel(below, encoded);
+      const glm::vec3 decoded = NormalMapCodec::DecodeTexel(encoded);
+      Assert::IsTrue(AngleBetween(decoded, glm::vec3(0.6f, -0.48f, 0.0f)) < 4.0, L"the horizon in the same direction");
+      Assert::IsTrue(AngleBetween(decoded, below) < AngleBetween(glm::vec3(0.6f, -0.48f, 0.0f), below) + 4.0);
+    }
+
+    TEST_METHOD(ShippedNormalMapsStayWithinBound)
+    {
+      for (const char* path : { "src/textures/brick_n.JPG", "src/textures/cells_n.jpg", "src/textures/concrete_n.jpg",
+                                "src/textures/paint_n.JPG", "src/textures/pinkwood_n.JPG", "src/textures/rock_n.JPG",
+                                "src/textures/snow_n.jpg", "src/textures/tile_n.jpg", "src/textures/whitebrick_n.jpg" })
+      {
+        const AssetLoader::ImageData chain = MipChain::Generate(AssetLoader::DecodeImage(path), MipChain::Filter::Normal, ThreadPool::Shared());
+        Assert::IsTrue(chain.desc.Format == DXGI_FORMAT_R8G8B8A8_UNORM);
+        const NormalMapCodec::AngularError error = NormalMapCodec::MeasureError(chain, NormalMapCodec::Encode(chain, ThreadPool::Shared()));
+        Assert::AreEqual(size_t(chain.size / 4), error.texels, L"every level is measured");
+        Assert::IsTrue(error.mean_degrees < 0.5, L"half a degree on average");
+        //a few maps have texels pointing into the surface, those can only come back on the horizon
+        Assert::IsTrue(error.max_degrees < std::max<double>(1.0, DeepestBelowSurface(chain) + 1.0), L"a degree beyond what can't be helped");
+      }
+    }
+
+    TEST_METHOD(FloatAndBgraSourcesEncodeAlike)
+    {
+      AssetLoader::ImageData rgba;
+      rgba.desc = TextureLoader::DescribeTexture2D(4, 4, DXGI_FORMAT_R8G8B8A8_UNORM);
+      rgba.bytes_per_row = 4 * 4;
+      rgba.size = 4 * 4 * 4;
+      rgba.texels.reset(static_cast<BYTE*>(malloc(rgba.size)));
+      AssetLoader::ImageData bgra;
+      bgra.desc = TextureLoader::DescribeTexture2D(4, 4, DXGI_FORMAT_B8G8R8A8_UNORM);
+      bgra.bytes_per_row = rgba.bytes_per_row;
+      bgra.size = rgba.size;
+      bgra.texels.reset(static_cast<BYTE*>(malloc(bgra.size)));
+      AssetLoader::ImageData floats;
+      floats.desc = TextureLoader::DescribeTexture2D(4, 4, DXGI_FORMAT_R32G32B32A32_FLOAT);
+      floats.bytes_per_row = 4 * 16;
+      floats.size = 4 * 4 * 16;
+      floats.texels.reset(static_cast<BYTE*>(malloc(floats.size)));
+      for (int texel = 0; texel < 16; texel++)
+      {
+        const BYTE stored[4] = { BYTE(60 + texel * 9), BYTE(200 - texel * 7), BYTE(180 + texel * 4), 255 };
+        memcpy(rgba.texels.get() + texel * 4, stored, 4);
+        const BYTE swizzled[4] = { stored[2], stored[1], stored[0], stored[3] };
+        memcpy(bgra.texels.get() + texel * 4, swizzled, 4);
+        const float exact[4] = { stored[0] / 255.0f, stored[1] / 255.0f, stored[2] / 255.0f, 1.0f };
+        memcpy(floats.texels.get() + texel * 16, exact, 16);
+      }
+
+      const AssetLoader::ImageData from_rgba = NormalMapCodec::Encode(rgba, ThreadPool::Shared());
+      Assert::IsTrue(from_rgba.desc.Format == NormalMapCodec::kFormat);
+      Assert::AreEqual(4 * 4 * 2, from_rgba.size);
+      Assert::IsTrue(memcmp(from_rgba.texels.get(), NormalMapCodec::Encode(bgra, ThreadPool::Shared()).texels.get(), from_rgba.size) == 0);
+      Assert::IsTrue(memcmp(from_rgba.texels.get(), NormalMapCodec::Encode(floats, ThreadPool::Shared()).texels.get(), from_rgba.size) == 0);
+
+      Assert::ExpectException<std::runtime_error>([&]()
+      {
+        NormalMapCodec::Encode(from_rgba, ThreadPool::Shared());
+      }, L"already two channels");
+    }
+  };
+}
@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "MipChain.h"
+#include "SceneBundle.h"
+#include "TestAssets.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // a quad and an 8x8 checker with its mip chain
+  struct BundleContents
+  {
+    std::vector<Vertex> vertices;
+    std::vector<Index> indices;
+    AssetLoader::ImageData image;
+  };
+
+  BundleContents MakeContents()
+  {
+    BundleContents contents;
+    for (int i = 0; i < 4; i++)
+    {
+      Vertex vertex;
+      vertex.position = XMFLOAT3(float(i & 1), float(i >> 1), 0.0f);
+      vertex.normal = XMFLOAT3(0.0f, 0.0f, 1.0f);
+      vertex.texCoord = XMFLOAT2(float(i & 1), float(i >> 1));
+      contents.vertices.push_back(vertex);
+    }
+    contents.indices = { 0, 1, 2, 2, 1, 3 };
+
+    AssetLoader::ImageData base;
+    base.desc = TextureLoader::DescribeTexture2D(8, 8, DXGI_FORMAT_R8G8B8A8_UNORM);
+    base.bytes_per_row = 8 * 4;
+    base.size = 8 * 8 * 4;
+    base.texels.reset(static_cast<BYTE*>(malloc(base.size)));
+    for (int i = 0; i < base.size; i++)
+    {
+      base.texels.get()[i] = ((i / 4 + i / 32) & 1) ? 255 : 0;
+    }
+    contents.image = MipChain::Generate(std::move(base), MipChain::Filter::Linear, ThreadPool::Shared());
+    return contents;
+  }
+
+  void AddContents(SceneBundle::Writer& writer, const BundleContents& contents)
+  {
+    writer.AddModel(3, "quad", contents.vertices, contents.indices);
+    writer.AddTexture(false, 5, "checker.png", false, contents.image);
+    writer.AddPlaceholderTexture(true, 0, "", false, TextureLoader::DescribeTexture2D(4, 2, DXGI_FORMAT_R8G8B8A8_UNORM));
+
+    Material material{};
+    material.eta = 1.5f;
+    material.diffuse = XMFLOAT3(0.25f, 0.5f, 0.75f);
+    writer.AddMaterial(7, "glass", true, material);
+
+    SceneBundle::ObjectRecord object{};
+    object.id = 1;
+    object.model_id = 3;
+    object.diffuse_texture_id = 5;
+    object.normal_texture_id = 0;
+    object.material_id = 7;
+    object.translation[1] = 2.0f;
+    object.scale[0] = object.scale[1] = object.scale[2] = 1.0f;
+    object.parent_transform[0][0] = object.parent_transform[1][1] = object.parent_transform[2][2] = 1.0f;
+    writer.AddObject(object, "table");
+
+    SceneBundle::CameraRecord camera{};
+    camera.fov = 45.0f;
+    camera.max_depth = 8;
+    camera.eye[2] = -5.0f;
+    camera.up[1] = 1.0f;
+    writer.SetCamera(camera);
+  }
+
+  std::string WriteBundle(const std::string& name, const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+  {
+    const std::string path = TestAssets::OutputPath(name);
+    SceneBundle::Writer writer;
+    writer.AddModel(0, "model", vertices, indices);
+    Assert::IsTrue(writer.Write(path));
+    return path;
+  }
+
+  TEST_CLASS(SceneBundleTests)
+  {
+  public:
+    TEST_METHOD(RoundTrip)
+    {
+      const BundleContents contents = MakeContents();
+      SceneBundle::Writer writer;
+      AddContents(writer, contents);
+      const std::string path = TestAssets::OutputPath("bundle/round_trip.rtxpack");
+      Assert::IsTrue(writer.Write(path));
+
+      SceneBundle::Reader reader;
+      Assert::IsTrue(reader.Open(path), L"a bundle the writer made should open");
+      const SceneBundle::Header& header = reader.GetHeader();
+      Assert::AreEqual(1u, header.model_count);
+      Assert::AreEqual(1u, header.diffuse_texture_count);
+      Assert::AreEqual(1u, header.normal_texture_count);
+      Assert::AreEqual(1u, header.material_count);
+      Assert::AreEqual(1u, header.object_count);
+
+      const SceneBundle::ModelRecord& model = reader.Models()[0];
+      Assert::AreEqual(3, model.id);
+      Assert::AreEqual(std::string("quad"), reader.String(model.name));
+      Assert::AreEqual(size_t(model.vertex_count), contents.vertices.size());
+      Assert::AreEqual(size_t(model.index_count), contents.indices.size());
+      Assert::IsTrue(memcmp(reader.Vertices(model), contents.vertices.data(), contents.vertices.size() * sizeof(Vertex)) == 0);
+      Assert::IsTrue(memcmp(reader.Indices(model), contents.indices.data(), contents.indices.size() * sizeof(Index)) == 0);
+
+      const SceneBundle::TextureRecord& texture = reader.DiffuseTextures()[0];
+      Assert::AreEqual(5, texture.id);
+      Assert::AreEqual(std::string("checker.png"), reader.String(texture.name));
+      Assert::AreEqual(8u, texture.width);
+      Assert::AreEqual(UINT32(contents.image.desc.MipLevels), texture.mip_levels);
+      Assert::AreEqual(UINT64(contents.image.size), texture.texel_size);
+      Assert::IsTrue(memcmp(reader.Texels(texture), contents.image.texels.get(), contents.image.size) == 0);
+
+      const SceneBundle::TextureRecord& placeholder = reader.NormalTextures()[0];
+      Assert::AreEqual(4u, placeholder.width);
+      Assert::AreEqual(2u, placeholder.height);
+      Assert::AreEqual(UINT64(0), placeholder.texel_size);
+      Assert::AreEqual(16u, placeholder.row_pitch);
+
+      const SceneBundle::MaterialRecord& material = reader.Materials()[0];
+      Assert::AreEqual(std::string("glass"), reader.String(material.name));
+      Assert::AreEqual(1u, material.was_loaded_from_gltf);
+      Assert::AreEqual(1.5f, material.material.eta);
+      Assert::AreEqual(0.5f, material.material.diffuse.y);
+
+      const SceneBundle::ObjectRecord& object = reader.Objects()[0];
+      Assert::AreEqual(std::string("table"), reader.String(object.name));
+      Assert::AreEqual(3, object.model_id);
+      Assert::AreEqual(7, object.material_id);
+      Assert::AreEqual(2.0f, object.translation[1]);
+
+      Assert::AreEqual(45.0f, header.camera.fov);
+      Assert::AreEqual(8, header.camera.max_depth);
+      Assert::AreEqual(-5.0f, header.camera.eye[2]);
+    }
+
+    TEST_METHOD(RejectsIndexPastTheVertices)
+    {
+      BundleContents contents = MakeContents();
+      contents.indices[4] = static_cast<Index>(contents.vertices.size());
+      SceneBundle::Reader reader;
+      Assert::IsFalse(reader.Open(WriteBundle("bundle/bad_index.rtxpack", contents.vertices, contents.indices)));
+
+      contents.indices[4] = static_cast<Index>(contents.vertices.size()) - 1;
+      Assert::IsTrue(reader.Open(WriteBundle("bundle/last_index.rtxpack", contents.vertices, contents.indices)));
+    }
+
+    TEST_METHOD(RejectsEmptyModels)
+    {
+      const BundleContents contents = MakeContents();
+      SceneBundle::Reader reader;
+      Assert::IsFalse(reader.Open(WriteBundle("bundle/no_vertices.rtxpack", {}, contents.indices)), L"indices without vertices");
+      Assert::IsFalse(reader.Open(WriteBundle("bundle/no_indices.rtxpack", contents.vertices, {})), L"vertices without indices");
+      Assert::IsFalse(reader.Open(WriteBundle("bundle/partial_triangle.rtxpack", contents.vertices, { 0, 1 })), L"half a triangle");
+    }
+
+    TEST_METHOD(RejectsTruncatedFiles)
+    {
+      const BundleContents contents = MakeContents();
+      SceneBundle::Writer writer;
+      AddContents(writer, contents);
+      const std::string path = TestAssets::OutputPath("bundle/truncated.rtxpack");
+      Assert::IsTrue(writer.Write(path));
+
+      const UINT64 size = std::filesystem::file_size(path);
+      for (UINT64 cut : { UINT64(1), UINT64(contents.image.size), size - sizeof(SceneBundle::Header) / 2, size - 8 })
+      {
+        std::filesystem::resize_file(path, size - cut);
+        SceneBundle::Reader reader;
+        Assert::IsFalse(reader.Open(path), L"a cut off bundle should not open");
+      }
+    }
+
+    TEST_METHOD(RejectsOtherVersions)
+    {
+      const BundleContents contents = MakeContents();
+      const std::string path = WriteBundle("bundle/version.rtxpack", contents.vertices, contents.indices);
+      {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        const UINT32 version = SceneBundle::kVersion - 1;
+        file.seekp(offsetof(SceneBundle::Header, version));
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+      }
+      SceneBundle::Reader reader;
+      Assert::IsFalse(reader.Open(path));
+    }
+  };
+}
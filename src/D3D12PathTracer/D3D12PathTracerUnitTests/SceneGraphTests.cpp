@@ -0,0 +1,210 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include "SceneGraph.h"
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  void AssertMatricesNear(const glm::mat4& expected, const glm::mat4& actual, float tolerance, const wchar_t* message = L"")
+  {
+    for (int c = 0; c < 4; c++)
+    {
+      for (int r = 0; r < 4; r++)
+      {
+        Assert::AreEqual(expected[c][r], actual[c][r], tolerance, message);
+      }
+    }
+  }
+
+  // world of a glTF node by walking up its parents, the composition the graph has to match
+  glm::mat4 ComposeWorld(const tinygltf::Model& model, const std::vector<int>& parents, int node)
+  {
+    const glm::mat4 local = AssetLoader::GltfNodeTransform(model.nodes[node]);
+    return parents[node] < 0 ? local : ComposeWorld(model, parents, parents[node]) * local;
+  }
+
+  // graph nodes in the parents first order ParseGLTF adds them; graph_nodes maps glTF nodes to them
+  void AddGltfNodes(const tinygltf::Model& model, int node, int parent, SceneGraph& graph, std::vector<int>& graph_nodes,
+                    std::vector<int>& parents)
+  {
+    graph_nodes[node] = graph.AddNode(parent, AssetLoader::GltfNodeTransform(model.nodes[node]));
+    for (int child : model.nodes[node].children)
+    {
+      parents[child] = node;
+      AddGltfNodes(model, child, graph_nodes[node], graph, graph_nodes, parents);
+    }
+  }
+
+  // binary tree of depth levels, every node offset and turned a little from its parent
+  SceneGraph MakeTree(int levels)
+  {
+    SceneGraph graph;
+    std::vector<int> level = { graph.AddNode(SceneGraph::kRoot, glm::translate(glm::mat4(1.0f), glm::vec3(1.0f, 0.0f, 0.0f))) };
+    for (int depth = 1; depth < levels; depth++)
+    {
+      std::vector<int> next;
+      for (int parent : level)
+      {
+        for (int side = 0; side < 2; side++)
+        {
+          glm::mat4 local = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, side ? 1.0f : -1.0f, 0.5f));
+          local = glm::rotate(local, 0.1f * depth, glm::vec3(0.0f, 0.0f, 1.0f));
+          next.push_back(graph.AddNode(parent, glm::scale(local, glm::vec3(0.9f))));
+        }
+      }
+      level = next;
+    }
+    return graph;
+  }
+
+  TEST_CLASS(SceneGraphTests)
+  {
+  public:
+    TEST_METHOD(NodeTransformIsTranslateRotateScale)
+    {
+      tinygltf::Node node;
+      node.translation = { 1.0, 2.0, 3.0 };
+      //90 degrees about z as a quaternion (x, y, z, w), not as Euler angles
+      node.rotation = { 0.0, 0.0, std::sqrt(0.5), std::sqrt(0.5) };
+      node.scale = { 2.0, 2.0, 2.0 };
+      const glm::vec4 moved = AssetLoader::GltfNodeTransform(node) * glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
+      Assert::AreEqual(1.0f, moved.x, 1e-5f);
+      Assert::AreEqual(4.0f, moved.y, 1e-5f);
+      Assert::AreEqual(3.0f, moved.z, 1e-5f);
+
+      //a matrix wins over the TRS properties, it is stored column major
+      node.matrix.assign(16, 0.0);
+      node.matrix[0] = node.matrix[5] = node.matrix[10] = node.matrix[15] = 1.0;
+      node.matrix[12] = 5.0;
+      const glm::vec4 translated = AssetLoader::GltfNodeTransform(node) * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+      Assert::AreEqual(5.0f, translated.x);
+      Assert::AreEqual(0.0f, translated.y);
+    }
+
+    TEST_METHOD(NestedWorldsComposeParentsFirst)
+    {
+      SceneGraph graph = MakeTree(8);
+      Assert::AreEqual(graph.Size(), graph.Update());
+      for (size_t i = 0; i < graph.Size(); i++)
+      {
+        const int node = static_cast<int>(i);
+        const glm::mat4 expected = graph.Parent(node) == SceneGraph::kRoot ? graph.Local(node) : graph.World(graph.Parent(node)) * graph.Local(node);
+        AssertMatricesNear(expected, graph.World(node), 1e-5f);
+      }
+      Assert::IsFalse(graph.IsDirty());
+      Assert::AreEqual(size_t(0), graph.Update(), L"nothing changed");
+    }
+
+    TEST_METHOD(EditRecomputesOnlyItsSubtree)
+    {
+      SceneGraph graph = MakeTree(6);
+      graph.Update();
+      std::vector<UINT32> versions;
+      for (size_t i = 0; i < graph.Size(); i++)
+      {
+        versions.push_back(graph.Version(static_cast<int>(i)));
+      }
+
+      //node 1 heads a subtree of 1 + 2 + 4 + 8 + 16 nodes
+      const int edited = 1;
+      graph.SetLocal(edited, glm::translate(graph.Local(edited), glm::vec3(0.0f, 0.0f, 3.0f)));
+      Assert::AreEqual(size_t(31), graph.Update());
+
+      SceneGraph rebuilt;
+      for (size_t i = 0; i < graph.Size(); i++)
+      {
+        const int node = static_cast<int>(i);
+        rebuilt.AddNode(graph.Parent(node), graph.Local(node));
+      }
+      rebuilt.Update();
+      for (size_t i = 0; i < graph.Size(); i++)
+      {
+        const int node = static_cast<int>(i);
+        bool below = false;
+        for (int parent = node; parent != SceneGraph::kRoot && !below; parent = graph.Parent(parent))
+        {
+          below = parent == edited;
+        }
+        Assert::AreEqual(below, graph.Version(node) != versions[i]);
+        AssertMatricesNear(rebuilt.World(node), graph.World(node), 1e-5f);
+      }
+    }
+
+    TEST_METHOD(RejectsMissingParents)
+    {
+      SceneGraph graph;
+      Assert::ExpectException<std::runtime_error>([&]() { graph.AddNode(0); });
+      const int root = graph.AddNode(SceneGraph::kRoot);
+      Assert::AreEqual(1, graph.AddNode(root));
+      Assert::ExpectException<std::runtime_error>([&]() { graph.AddNode(2); });
+      graph.Clear();
+      Assert::AreEqual(size_t(0), graph.Size());
+    }
+
+    TEST_METHOD(TransformRowsAreTheInstanceLayout)
+    {
+      const glm::mat4 world = glm::scale(glm::translate(glm::mat4(1.0f), glm::vec3(4.0f, 5.0f, 6.0f)), glm::vec3(2.0f, 3.0f, 4.0f));
+      FLOAT transform[3][4];
+      SceneGraph::ToTransform3x4(world, transform);
+      Assert::AreEqual(2.0f, transform[0][0]);
+      Assert::AreEqual(3.0f, transform[1][1]);
+      Assert::AreEqual(4.0f, transform[2][2]);
+      Assert::AreEqual(4.0f, transform[0][3]);
+      Assert::AreEqual(5.0f, transform[1][3]);
+      Assert::AreEqual(6.0f, transform[2][3]);
+      Assert::AreEqual(0.0f, transform[0][1]);
+    }
+
+    TEST_METHOD(ShippedNestedGltfsMatchRecursiveComposition)
+    {
+      size_t nested = 0;
+      for (const std::string& file : AssetLoader::ShippedGltfModels())
+      {
+        const std::wstring name(file.begin(), file.end());
+        const tinygltf::Model model = AssetLoader::DecodeGltf(file);
+        if (model.scenes.empty())
+        {
+          continue;
+        }
+
+        SceneGraph graph;
+        std::vector<int> graph_nodes(model.nodes.size(), -1);
+        std::vector<int> parents(model.nodes.size(), -1);
+        const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+        for (int node : scene.nodes)
+        {
+          AddGltfNodes(model, node, SceneGraph::kRoot, graph, graph_nodes, parents);
+        }
+        graph.Update();
+
+        int depth = 0;
+        for (size_t i = 0; i < model.nodes.size(); i++)
+        {
+          if (graph_nodes[i] < 0)
+          {
+            continue;
+          }
+          const glm::mat4 expected = ComposeWorld(model, parents, static_cast<int>(i));
+          float scale = 1.0f;
+          for (int c = 0; c < 4; c++)
+          {
+            scale = std::max<float>(scale, glm::length(expected[c]));
+          }
+          AssertMatricesNear(expected, graph.World(graph_nodes[i]), 1e-5f * scale, name.c_str());
+
+          int node_depth = 0;
+          for (int parent = parents[i]; parent >= 0; parent = parents[parent])
+          {
+            node_depth++;
+          }
+          depth = std::max<int>(depth, node_depth);
+        }
+        nested += depth >= 2 ? 1 : 0;
+      }
+      Assert::IsTrue(nested > 0, L"some shipped model nests nodes");
+    }
+  };
+}
@@ -0,0 +1,158 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include "ObjParser.h"
+#include "TangentFrames.h"
+
+using namespace DirectX;
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  Vertex MakeVertex(XMFLOAT3 position, XMFLOAT3 normal, XMFLOAT2 texcoord)
+  {
+    Vertex vertex;
+    vertex.position = position;
+    vertex.normal = normal;
+    vertex.texCoord = texcoord;
+    return vertex;
+  }
+
+  // unit tangent perpendicular to the normal, and a bitangent of +-1 handedness
+  void AssertOrthonormal(const Vertex& vertex, const XMFLOAT4& tangent)
+  {
+    const XMVECTOR t = XMLoadFloat4(&tangent);
+    const XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertex.normal));
+    Assert::AreEqual(1.0f, XMVectorGetX(XMVector3Length(t)), 1e-4f, L"tangent should be unit length");
+    Assert::AreEqual(0.0f, XMVectorGetX(XMVector3Dot(t, n)), 1e-4f, L"tangent should lie in the tangent plane");
+    Assert::IsTrue(tangent.w == 1.0f || tangent.w == -1.0f, L"handedness should be +-1");
+  }
+
+  // the xy unit square facing +z, u along +x (or -x when mirrored) and v down the image (-y)
+  std::vector<Vertex> MakeQuad(bool mirrored)
+  {
+    std::vector<Vertex> vertices;
+    for (int i = 0; i < 4; i++)
+    {
+      const float x = float(i & 1);
+      const float y = float(i >> 1);
+      vertices.push_back(MakeVertex(XMFLOAT3(x, y, 0.0f), XMFLOAT3(0.0f, 0.0f, 1.0f), XMFLOAT2(mirrored ? 1.0f - x : x, 1.0f - y)));
+    }
+    return vertices;
+  }
+
+  TEST_CLASS(TangentFramesTests)
+  {
+  public:
+    TEST_METHOD(QuadTangentFollowsU)
+    {
+      const std::vector<Index> indices = { 0, 1, 2, 2, 1, 3 };
+      for (bool mirrored : { false, true })
+      {
+        const std::vector<Vertex> vertices = MakeQuad(mirrored);
+        const std::vector<XMFLOAT4> tangents = TangentFrames::Generate(vertices, indices);
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+          AssertOrthonormal(vertices[i], tangents[i]);
+          Assert::AreEqual(mirrored ? -1.0f : 1.0f, tangents[i].x, 1e-5f, L"tangent should point along +u");
+          //the bitangent cross(n, t) * w points up the image, +y, either way
+          const XMVECTOR bitangent = XMVectorScale(XMVector3Cross(XMLoadFloat3(&vertices[i].normal), XMLoadFloat4(&tangents[i])), tangents[i].w);
+          Assert::AreEqual(1.0f, XMVectorGetY(bitangent), 1e-5f, L"bitangent should point up the image");
+          Assert::AreEqual(mirrored ? -1.0f : 1.0f, tangents[i].w);
+        }
+      }
+    }
+
+    TEST_METHOD(SphereTangentFollowsLongitude)
+    {
+      //latitude/longitude sphere, u = phi / 2pi around +y and v = theta / pi from the top
+      const int rings = 32;
+      const int segments = 64;
+      std::vector<Vertex> vertices;
+      for (int r = 0; r <= rings; r++)
+      {
+        for (int s = 0; s <= segments; s++)
+        {
+          const float theta = XM_PI * r / rings;
+          const float phi = XM_2PI * s / segments;
+          const XMFLOAT3 position(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+          vertices.push_back(MakeVertex(position, position, XMFLOAT2(float(s) / segments, float(r) / rings)));
+        }
+      }
+      std::vector<Index> indices;
+      for (int r = 0; r < rings; r++)
+      {
+        for (int s = 0; s < segments; s++)
+        {
+          const Index a = r * (segments + 1) + s;
+          const Index b = a + segments + 1;
+          indices.insert(indices.end(), { a, b, a + 1, a + 1, b, b + 1 });
+        }
+      }
+
+      //vertices on the u seam only see the triangles on one side, whose chords
+      //turn away from the true tangent by up to half a segment
+      const float min_tangent_cos = cosf(XM_PI / segments) - 1e-4f;
+      const float min_bitangent_cos = cosf(XM_PI / rings) - 1e-4f;
+      const std::vector<XMFLOAT4> tangents = TangentFrames::Generate(vertices, indices);
+      for (int r = 1; r < rings; r++)
+      {
+        for (int s = 0; s <= segments; s++)
+        {
+          const size_t i = r * (segments + 1) + s;
+          AssertOrthonormal(vertices[i], tangents[i]);
+
+          //dP/dphi and -dP/dtheta, the directions of increasing u and decreasing v
+          const float theta = XM_PI * r / rings;
+          const float phi = XM_2PI * s / segments;
+          const XMVECTOR expected_tangent = XMVectorSet(-sinf(phi), 0.0f, cosf(phi), 0.0f);
+          const XMVECTOR expected_bitangent = XMVectorSet(-cosf(theta) * cosf(phi), sinf(theta), -cosf(theta) * sinf(phi), 0.0f);
+          Assert::IsTrue(XMVectorGetX(XMVector3Dot(XMLoadFloat4(&tangents[i]), expected_tangent)) > min_tangent_cos, L"tangent should follow the longitude");
+
+          const XMVECTOR bitangent = XMVectorScale(XMVector3Cross(XMLoadFloat3(&vertices[i].normal), XMLoadFloat4(&tangents[i])), tangents[i].w);
+          Assert::IsTrue(XMVectorGetX(XMVector3Dot(bitangent, expected_bitangent)) > min_bitangent_cos, L"bitangent should point to the top");
+        }
+      }
+    }
+
+    TEST_METHOD(DegenerateTexcoordsStillGiveAFrame)
+    {
+      //every corner shares one texcoord, so there is no texture space to follow
+      std::vector<Vertex> vertices = MakeQuad(false);
+      for (Vertex& vertex : vertices)
+      {
+        vertex.texCoord = XMFLOAT2(0.5f, 0.5f);
+      }
+      vertices.push_back(MakeVertex(XMFLOAT3(5.0f, 5.0f, 5.0f), XMFLOAT3(0.0f, 1.0f, 0.0f), XMFLOAT2(0.0f, 0.0f)));
+      const std::vector<XMFLOAT4> tangents = TangentFrames::Generate(vertices, { 0, 1, 2, 2, 1, 3 });
+      Assert::AreEqual(vertices.size(), tangents.size());
+      for (size_t i = 0; i < vertices.size(); i++)
+      {
+        AssertOrthonormal(vertices[i], tangents[i]);
+      }
+    }
+
+    TEST_METHOD(RejectsIndicesPastTheVertices)
+    {
+      const std::vector<Vertex> vertices = MakeQuad(false);
+      Assert::ExpectException<std::runtime_error>([&vertices]() { TangentFrames::Generate(vertices, { 0, 1, 4 }); });
+    }
+
+    TEST_METHOD(ShippedObjModelsGetOrthonormalFrames)
+    {
+      for (const std::string& file : ObjParser::ShippedModels())
+      {
+        const AssetLoader::ModelData data = AssetLoader::DecodeObj(file);
+        Assert::AreEqual(data.vertices.size(), data.tangents.size());
+        for (size_t i = 0; i < data.vertices.size(); i++)
+        {
+          //vertices without a normal have no tangent plane to check against
+          if (!XMVector3Equal(XMLoadFloat3(&data.vertices[i].normal), XMVectorZero()))
+          {
+            AssertOrthonormal(data.vertices[i], data.tangents[i]);
+          }
+        }
+      }
+    }
+  };
+}
@@ -0,0 +1,16 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "TestAssets.h"
+
+TEST_MODULE_INITIALIZE(UseProjectDirectory)
+{
+  //built with full paths, so this is D3D12PathTracer/D3D12PathTracerUnitTests/TestAssets.cpp
+  std::filesystem::current_path(std::filesystem::path(__FILE__).parent_path().parent_path());
+}
+
+std::string TestAssets::OutputPath(const std::string& name)
+{
+  const std::filesystem::path path = std::filesystem::path("cache/tests") / name;
+  std::filesystem::create_directories(path.parent_path());
+  return path.string();
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// The tests run with the app's project directory as the working directory,
+// like the app itself, so assets are found at the paths the scene files use
+// (src/objects/..., src/scenes/...).
+namespace TestAssets {
+// path for a file a test writes, below cache/tests; the directory is created
+std::string OutputPath(const std::string& name);
+} // namespace TestAssets
@@ -0,0 +1,143 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "TestAssets.h"
+#include "TextureCache.h"
+#include "include/json.hpp"
+#include <fstream>
+#include <iterator>
+#include <set>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // (image, filter) of every base color and normal texture a material of the glTF at path references
+  std::vector<std::pair<std::string, MipChain::Filter>> MaterialImages(const std::string& path)
+  {
+    std::ifstream file(path);
+    const nlohmann::json gltf = nlohmann::json::parse(file);
+    auto image = [&](const nlohmann::json& texture_info)
+    {
+      const int texture = texture_info["index"].get<int>();
+      const int source = gltf["textures"][texture]["source"].get<int>();
+      return gltf["images"][source]["uri"].get<std::string>();
+    };
+
+    std::vector<std::pair<std::string, MipChain::Filter>> images;
+    for (const nlohmann::json& material : gltf["materials"])
+    {
+      auto pbr = material.find("pbrMetallicRoughness");
+      if (pbr != material.end() && pbr->count("baseColorTexture"))
+      {
+        images.emplace_back(image((*pbr)["baseColorTexture"]), MipChain::Filter::Srgb);
+      }
+      if (material.count("normalTexture"))
+      {
+        images.emplace_back(image(material["normalTexture"]), MipChain::Filter::Normal);
+      }
+    }
+    return images;
+  }
+
+  TEST_CLASS(TextureCacheTests)
+  {
+  public:
+    TEST_METHOD(SponzaDecodesEachImageOnce)
+    {
+      //Sponza.bin isn't shipped, so the references come from the materials; src/gltf/Sponza
+      //holds byte identical copies of the images under the same names
+      const std::vector<std::pair<std::string, MipChain::Filter>> images = MaterialImages("src/gltf/Sponza/glTF/Sponza.gltf");
+      Assert::IsTrue(images.size() > 40, L"Sponza's materials should reference its images");
+      std::set<std::pair<std::string, MipChain::Filter>> distinct(images.begin(), images.end());
+      //a few of the images are the same bytes under another name
+      std::set<std::pair<std::string, MipChain::Filter>> distinct_contents;
+      for (const auto& image : distinct)
+      {
+        std::ifstream file("src/gltf/Sponza/glTF/" + image.first, std::ios::binary);
+        distinct_contents.emplace(std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()), image.second);
+      }
+
+      TextureCache cache;
+      std::vector<TextureCache::Handle> handles;
+      for (const char* directory : { "src/gltf/Sponza/glTF/", "src/gltf/Sponza/glTF/", "src/gltf/Sponza/" })
+      {
+        for (const auto& image : images)
+        {
+          bool miss = false;
+          handles.push_back(cache.Acquire(directory + image.first, TextureCache::Recipe(image.second, false), &miss));
+          if (miss)
+          {
+            cache.SetImage(handles.back(), std::make_shared<const AssetLoader::ImageData>());
+          }
+        }
+      }
+
+      const TextureCache::Stats& stats = cache.GetStats();
+      Assert::AreEqual(distinct_contents.size(), stats.misses, L"one decode per image and filter");
+      Assert::AreEqual(distinct_contents.size(), cache.Size());
+      Assert::AreEqual(images.size() * 3 - distinct.size() * 2, stats.path_hits, L"the second load and repeated references");
+      Assert::AreEqual(distinct.size() * 2 - distinct_contents.size(), stats.content_hits, L"duplicates and the copies are found by content");
+
+      for (TextureCache::Handle handle : handles)
+      {
+        cache.Release(handle);
+      }
+      Assert::AreEqual(size_t(0), cache.Size());
+    }
+
+    TEST_METHOD(RecipesGetTheirOwnEntries)
+    {
+      const std::string path = "src/gltf/Sponza/glTF/" + MaterialImages("src/gltf/Sponza/glTF/Sponza.gltf")[0].first;
+      TextureCache cache;
+      bool miss = false;
+      const TextureCache::Handle diffuse = cache.Acquire(path, TextureCache::Recipe(MipChain::Filter::Srgb, false), &miss);
+      Assert::IsTrue(miss);
+      const size_t bytes_hashed = cache.GetStats().bytes_hashed;
+
+      const TextureCache::Handle normal = cache.Acquire(path, TextureCache::Recipe(MipChain::Filter::Normal, false), &miss);
+      Assert::IsTrue(miss, L"a normal map of the file is filtered differently");
+      Assert::AreNotEqual(diffuse, normal);
+      const TextureCache::Handle compressed = cache.Acquire(path, TextureCache::Recipe(MipChain::Filter::Srgb, true), &miss);
+      Assert::IsTrue(miss, L"compressed texels are another entry");
+      Assert::AreEqual(bytes_hashed, cache.GetStats().bytes_hashed, L"a known path isn't hashed again");
+      Assert::AreEqual(cache.Get(diffuse).content_hash, cache.Get(normal).content_hash);
+
+      Assert::AreEqual(diffuse, cache.Acquire(path, TextureCache::Recipe(MipChain::Filter::Srgb, false), &miss));
+      Assert::IsFalse(miss);
+      Assert::AreEqual(size_t(3), cache.Size());
+
+      //dropping one recipe leaves the others findable
+      cache.Release(normal);
+      Assert::AreEqual(size_t(2), cache.Size());
+      Assert::AreEqual(compressed, cache.Acquire(path, TextureCache::Recipe(MipChain::Filter::Srgb, true), &miss));
+      Assert::IsFalse(miss);
+    }
+
+    TEST_METHOD(CopiesMatchOnlyTheirRecipe)
+    {
+      const std::string name = MaterialImages("src/gltf/Sponza/glTF/Sponza.gltf")[0].first;
+      const std::string copy = TestAssets::OutputPath("texture_cache/copy.jpg");
+      std::filesystem::copy_file("src/gltf/Sponza/glTF/" + name, copy, std::filesystem::copy_options::overwrite_existing);
+
+      TextureCache cache;
+      bool miss = false;
+      const TextureCache::Handle original = cache.Acquire("src/gltf/Sponza/glTF/" + name, TextureCache::Recipe(MipChain::Filter::Srgb, false), &miss);
+      cache.Acquire(copy, TextureCache::Recipe(MipChain::Filter::Normal, false), &miss);
+      Assert::IsTrue(miss, L"same bytes, other recipe");
+      Assert::AreEqual(original, cache.Acquire(copy, TextureCache::Recipe(MipChain::Filter::Srgb, false), &miss));
+      Assert::IsFalse(miss);
+      Assert::AreEqual(size_t(1), cache.GetStats().content_hits);
+    }
+
+    TEST_METHOD(MissingFilesThrowWithoutAnEntry)
+    {
+      TextureCache cache;
+      Assert::ExpectException<std::runtime_error>([&]()
+      {
+        cache.Acquire("src/gltf/Sponza/glTF/missing.jpg", TextureCache::Recipe(MipChain::Filter::Srgb, false));
+      });
+      Assert::AreEqual(size_t(0), cache.Size());
+      Assert::ExpectException<std::runtime_error>([&]() { cache.Release(0); }, L"nothing to release");
+    }
+  };
+}
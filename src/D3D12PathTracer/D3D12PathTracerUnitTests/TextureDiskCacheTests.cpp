@@ -0,0 +1,162 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "ImageDecoder.h"
+#include "MipChain.h"
+#include "TestAssets.h"
+#include "TextureCache.h"
+#include "TextureDiskCache.h"
+#include "ThreadPool.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // copy of a shipped texture the test can edit
+  std::string WriteSource(const std::string& name)
+  {
+    const std::string path = TestAssets::OutputPath("disk_cache/" + name);
+    std::filesystem::copy_file("src/textures/cells_n.jpg", path, std::filesystem::copy_options::overwrite_existing);
+    return path;
+  }
+
+  // empty cache directory, Store creates it
+  std::string FreshDiskCache()
+  {
+    const std::string directory = TestAssets::OutputPath("disk_cache/entries");
+    std::filesystem::remove_all(directory);
+    return directory;
+  }
+
+  void AssertSameImage(const AssetLoader::ImageData& expected, const AssetLoader::ImageData& actual)
+  {
+    Assert::AreEqual(expected.desc.Width, actual.desc.Width);
+    Assert::AreEqual(expected.desc.Height, actual.desc.Height);
+    Assert::AreEqual(expected.desc.MipLevels, actual.desc.MipLevels);
+    Assert::IsTrue(expected.desc.Format == actual.desc.Format);
+    Assert::AreEqual(expected.bytes_per_row, actual.bytes_per_row);
+    Assert::AreEqual(expected.size, actual.size);
+    Assert::IsTrue(memcmp(expected.texels.get(), actual.texels.get(), expected.size) == 0);
+  }
+
+  TEST_CLASS(TextureDiskCacheTests)
+  {
+  public:
+    TEST_METHOD(StoredEntriesLoadBack)
+    {
+      const std::string path = WriteSource("load_back.jpg");
+      TextureDiskCache cache(FreshDiskCache());
+      const UINT32 recipe = TextureCache::Recipe(MipChain::Filter::Srgb, false);
+      const AssetLoader::ImageData chain = MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Srgb, ThreadPool::Shared());
+
+      AssetLoader::ImageData loaded;
+      Assert::IsFalse(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded));
+      Assert::IsTrue(cache.Store(TextureDiskCache::MakeKey(path, recipe), chain));
+      Assert::IsTrue(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded), L"an untouched source hits");
+      AssertSameImage(chain, loaded);
+
+      const TextureDiskCache::Stats stats = cache.GetStats();
+      Assert::AreEqual(size_t(1), stats.misses);
+      Assert::AreEqual(size_t(1), stats.writes);
+      Assert::AreEqual(size_t(1), stats.hits);
+      Assert::AreEqual(size_t(0), stats.stale);
+    }
+
+    TEST_METHOD(EditedSourcesAreStale)
+    {
+      const std::string path = WriteSource("edited.jpg");
+      TextureDiskCache cache(FreshDiskCache());
+      const UINT32 recipe = TextureCache::Recipe(MipChain::Filter::Normal, false);
+      const AssetLoader::ImageData chain = MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Normal, ThreadPool::Shared());
+      Assert::IsTrue(cache.Store(TextureDiskCache::MakeKey(path, recipe), chain));
+      const std::filesystem::file_time_type stored_time = std::filesystem::last_write_time(path);
+      AssetLoader::ImageData loaded;
+
+      //touched: same bytes, newer time
+      std::filesystem::last_write_time(path, stored_time + std::chrono::seconds(5));
+      Assert::IsFalse(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded), L"a newer write time is stale");
+      std::filesystem::last_write_time(path, stored_time);
+      Assert::IsTrue(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded));
+
+      //edited in place: same size and time, other bytes; only the content hash tells
+      {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        const std::streamoff middle = std::filesystem::file_size(path) / 2;
+        file.seekg(middle);
+        const char flipped = ~char(file.get());
+        file.seekp(middle);
+        file.put(flipped);
+      }
+      std::filesystem::last_write_time(path, stored_time);
+      Assert::IsFalse(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded), L"other content is stale");
+
+      //grown
+      {
+        std::ofstream file(path, std::ios::binary | std::ios::app);
+        file.put('\0');
+      }
+      std::filesystem::last_write_time(path, stored_time);
+      Assert::IsFalse(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded), L"another size is stale");
+      Assert::AreEqual(size_t(3), cache.GetStats().stale);
+
+      //the next Store replaces the stale entry
+      Assert::IsTrue(cache.Store(TextureDiskCache::MakeKey(path, recipe), chain));
+      Assert::IsTrue(cache.Load(TextureDiskCache::MakeKey(path, recipe), &loaded));
+      AssertSameImage(chain, loaded);
+    }
+
+    TEST_METHOD(RecipesHaveTheirOwnEntries)
+    {
+      const std::string path = WriteSource("recipes.jpg");
+      TextureDiskCache cache(FreshDiskCache());
+      const TextureDiskCache::Key srgb = TextureDiskCache::MakeKey(path, TextureCache::Recipe(MipChain::Filter::Srgb, false));
+      const TextureDiskCache::Key normal = TextureDiskCache::MakeKey(path, TextureCache::Recipe(MipChain::Filter::Normal, false));
+      Assert::AreNotEqual(cache.EntryPath(srgb), cache.EntryPath(normal));
+
+      const AssetLoader::ImageData srgb_chain = MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Srgb, ThreadPool::Shared());
+      const AssetLoader::ImageData normal_chain = MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Normal, ThreadPool::Shared());
+      Assert::IsTrue(cache.Store(srgb, srgb_chain));
+      AssetLoader::ImageData loaded;
+      Assert::IsFalse(cache.Load(normal, &loaded), L"other recipe, no entry");
+      Assert::IsTrue(cache.Store(normal, normal_chain));
+
+      Assert::IsTrue(cache.Load(srgb, &loaded));
+      AssertSameImage(srgb_chain, loaded);
+      Assert::IsTrue(cache.Load(normal, &loaded));
+      AssertSameImage(normal_chain, loaded);
+    }
+
+    TEST_METHOD(DamagedEntriesAreStale)
+    {
+      const std::string path = WriteSource("damaged.jpg");
+      TextureDiskCache cache(FreshDiskCache());
+      const TextureDiskCache::Key key = TextureDiskCache::MakeKey(path, TextureCache::Recipe(MipChain::Filter::Srgb, false));
+      const AssetLoader::ImageData chain = MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Srgb, ThreadPool::Shared());
+      Assert::IsTrue(cache.Store(key, chain));
+      const std::string entry = cache.EntryPath(key);
+      const UINT64 entry_size = std::filesystem::file_size(entry);
+      AssetLoader::ImageData loaded;
+
+      std::filesystem::resize_file(entry, entry_size - 1);
+      Assert::IsFalse(cache.Load(key, &loaded), L"a cut off entry");
+      std::filesystem::resize_file(entry, 16);
+      Assert::IsFalse(cache.Load(key, &loaded), L"a cut off header");
+
+      Assert::IsTrue(cache.Store(key, chain));
+      {
+        std::fstream file(entry, std::ios::in | std::ios::out | std::ios::binary);
+        file.put('x');
+      }
+      Assert::IsFalse(cache.Load(key, &loaded), L"a foreign file");
+      Assert::AreEqual(size_t(3), cache.GetStats().stale);
+      Assert::AreEqual(size_t(0), cache.GetStats().hits);
+    }
+
+    TEST_METHOD(MissingSourcesThrow)
+    {
+      Assert::ExpectException<std::runtime_error>([]()
+      {
+        TextureDiskCache::MakeKey("src/textures/missing.jpg", 0);
+      });
+    }
+  };
+}
@@ -0,0 +1,149 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "UploadRing.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  // ring over plain memory, backend is the ring's for inspecting it
+  std::unique_ptr<UploadRing> MakeRing(UINT64 capacity, MemoryUploadBackend** backend)
+  {
+    auto memory = std::make_unique<MemoryUploadBackend>(capacity);
+    *backend = memory.get();
+    return std::make_unique<UploadRing>(std::move(memory));
+  }
+
+  TEST_CLASS(UploadRingTests)
+  {
+  public:
+    TEST_METHOD(UploadsShareOneSubmission)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(1 << 20, &backend);
+      ring->Begin();
+      UINT64 end = 0;
+      for (int i = 0; i < 100; i++)
+      {
+        const UploadRing::Allocation allocation = ring->Allocate(1000, 256);
+        Assert::AreEqual(UINT64(0), allocation.offset % 256);
+        Assert::IsTrue(allocation.offset >= end, L"allocations don't overlap");
+        Assert::IsTrue(allocation.cpu == backend->Data() + allocation.offset);
+        memset(allocation.cpu, i, static_cast<size_t>(allocation.size));
+        end = allocation.offset + allocation.size;
+      }
+      Assert::AreEqual(UINT64(1), ring->Submit());
+
+      const UploadRing::Stats stats = ring->GetStats();
+      Assert::AreEqual(size_t(1), stats.submissions);
+      Assert::AreEqual(size_t(0), stats.stalls);
+      Assert::AreEqual(size_t(0), backend->Waits());
+      Assert::AreEqual(UINT64(100 * 1000), stats.bytes_allocated);
+      Assert::AreEqual(UINT64(99 * 1024 + 1000), ring->Used(), L"alignment padding counts as used");
+    }
+
+    TEST_METHOD(WrapsOnceTheOldestBatchRetires)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(4096, &backend);
+      ring->Begin();
+      Assert::AreEqual(UINT64(0), ring->Allocate(1000, 256).offset);
+      const UINT64 first = ring->Submit();
+      ring->Begin();
+      Assert::AreEqual(UINT64(1024), ring->Allocate(2100, 256).offset);
+      ring->Submit();
+
+      //the GPU is done with the first batch only: 768 aligned bytes at the end, 1000 at the start
+      backend->Complete(first);
+      ring->Begin();
+      const UploadRing::Allocation wrapped = ring->Allocate(900, 256);
+      Assert::AreEqual(UINT64(0), wrapped.offset);
+      Assert::AreEqual(size_t(1), ring->GetStats().wraps);
+      Assert::AreEqual(size_t(0), ring->GetStats().stalls);
+      Assert::AreEqual(UINT64(24 + 2100 + (4096 - 3124) + 900), ring->Used(), L"padding and the skipped end are used until their batches retire");
+
+      //nothing left without the second batch
+      ring->Allocate(256, 256);
+      Assert::AreEqual(size_t(1), ring->GetStats().stalls);
+      Assert::AreEqual(size_t(1), backend->Waits());
+      Assert::AreEqual(UINT64(2), backend->CompletedFence());
+      ring->Submit();
+      ring->WaitIdle();
+      Assert::AreEqual(UINT64(0), ring->Used());
+    }
+
+    TEST_METHOD(KeepsUpWithAGpuOneBatchBehind)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(8192, &backend);
+      UINT64 previous = 0;
+      for (int batch = 0; batch < 200; batch++)
+      {
+        ring->Begin();
+        for (int upload = 0; upload < 3; upload++)
+        {
+          ring->Allocate(300 + (batch * 37 + upload * 101) % 700, 256);
+        }
+        const UINT64 fence = ring->Submit();
+        backend->Complete(previous);
+        previous = fence;
+      }
+      const UploadRing::Stats stats = ring->GetStats();
+      Assert::AreEqual(size_t(200), stats.submissions);
+      Assert::AreEqual(size_t(0), stats.stalls, L"two batches always fit");
+      Assert::IsTrue(stats.wraps > 0);
+      Assert::IsTrue(stats.peak_used <= 8192);
+    }
+
+    TEST_METHOD(ABatchFillingTheRingSubmitsItself)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(4096, &backend);
+      ring->Begin();
+      ring->Allocate(3000, 256);
+      const UploadRing::Allocation second = ring->Allocate(3000, 256);
+      Assert::AreEqual(UINT64(0), second.offset, L"after the first half went to the GPU and came back");
+      Assert::AreEqual(UINT64(1), backend->SubmittedFence());
+      Assert::AreEqual(size_t(1), backend->Waits());
+      Assert::IsTrue(ring->IsOpen(), L"the batch is open again for the caller to submit");
+      Assert::AreEqual(UINT64(2), ring->Submit());
+    }
+
+    TEST_METHOD(HeldObjectsLiveUntilTheirBatchRetires)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(4096, &backend);
+      auto buffer = std::make_shared<std::vector<BYTE>>(8192);
+      std::weak_ptr<std::vector<BYTE>> watch = buffer;
+      ring->Begin();
+      ring->HoldUntilRetired(std::move(buffer));
+      const UINT64 fence = ring->Submit();
+
+      ring->Begin();
+      ring->Allocate(256, 256);
+      Assert::IsFalse(watch.expired(), L"the GPU may still copy from it");
+      ring->Submit();
+
+      backend->Complete(fence);
+      ring->Begin();
+      ring->Allocate(256, 256);
+      Assert::IsTrue(watch.expired());
+      ring->Submit();
+    }
+
+    TEST_METHOD(RejectsMisuse)
+    {
+      MemoryUploadBackend* backend;
+      std::unique_ptr<UploadRing> ring = MakeRing(4096, &backend);
+      Assert::ExpectException<std::logic_error>([&]() { ring->Allocate(16, 16); }, L"outside a batch");
+      Assert::ExpectException<std::logic_error>([&]() { ring->Submit(); }, L"nothing open");
+      ring->Begin();
+      Assert::ExpectException<std::logic_error>([&]() { ring->Begin(); }, L"opened twice");
+      Assert::IsTrue(ring->Fits(4096));
+      Assert::IsFalse(ring->Fits(4097));
+      Assert::ExpectException<std::runtime_error>([&]() { ring->Allocate(4097, 16); }, L"bigger than the ring");
+      ring->Submit();
+      Assert::ExpectException<std::logic_error>([&]() { backend->WaitForFence(2); }, L"a fence never submitted would hang");
+    }
+  };
+}
@@ -0,0 +1,101 @@
+﻿#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "AssetLoader.h"
+#include "ObjParser.h"
+#include "VertexPacking.h"
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace D3D12PathTracerUnitTests
+{
+  void AssertWithinBound(const std::vector<Vertex>& vertices, const std::string& name)
+  {
+    const VertexPacking::BenchmarkResult result = VertexPacking::Benchmark(vertices);
+    const std::wstring message(name.begin(), name.end());
+    Assert::IsTrue(result.error.position <= result.bound.position, (L"position of " + message).c_str());
+    Assert::IsTrue(result.error.normal_degrees <= result.bound.normal_degrees, (L"normal of " + message).c_str());
+    Assert::IsTrue(result.error.texcoord <= result.bound.texcoord, (L"texcoord of " + message).c_str());
+    Assert::AreEqual(result.bytes_before, 2 * result.bytes_after);
+  }
+
+  TEST_CLASS(VertexPackingTests)
+  {
+  public:
+    TEST_METHOD(ShippedObjModelsStayWithinBound)
+    {
+      const std::vector<std::string> files = ObjParser::ShippedModels();
+      Assert::IsFalse(files.empty());
+      for (const std::string& file : files)
+      {
+        AssertWithinBound(AssetLoader::DecodeObj(file, MeshOptimizer::TriangleOrder::File).vertices, file);
+      }
+    }
+
+    TEST_METHOD(ShippedGltfModelsStayWithinBound)
+    {
+      const std::vector<std::string> files = AssetLoader::ShippedGltfModels();
+      Assert::IsFalse(files.empty());
+      for (const std::string& file : files)
+      {
+        const tinygltf::Model gltf = AssetLoader::DecodeGltf(file);
+        for (const tinygltf::Mesh& mesh : gltf.meshes)
+        {
+          for (const tinygltf::Primitive& primitive : mesh.primitives)
+          {
+            AssertWithinBound(AssetLoader::DecodeGltfPrimitive(gltf, primitive).vertices, file + " " + mesh.name);
+          }
+        }
+      }
+    }
+
+    TEST_METHOD(NormalsInEveryOctantStayWithinBound)
+    {
+      std::vector<Vertex> vertices;
+      auto add = [&vertices](float x, float y, float z)
+      {
+        Vertex vertex{};
+        const float length = sqrtf(x * x + y * y + z * z);
+        vertex.normal = XMFLOAT3(x / length, y / length, z / length);
+        vertices.push_back(vertex);
+      };
+      //the axes land on the octahedron's corners and folds
+      for (int axis = 0; axis < 3; axis++)
+      {
+        for (float sign : { 1.0f, -1.0f })
+        {
+          add(axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f);
+        }
+      }
+      std::mt19937 rng(7);
+      std::normal_distribution<float> gaussian;
+      for (int i = 0; i < 100000; i++)
+      {
+        add(gaussian(rng), gaussian(rng), gaussian(rng));
+      }
+      AssertWithinBound(vertices, "random normals");
+    }
+
+    TEST_METHOD(FlatAxisDecodesExactly)
+    {
+      std::vector<Vertex> vertices(3);
+      vertices[0].position = XMFLOAT3(-1.0f, 0.0f, 2.5f);
+      vertices[1].position = XMFLOAT3(3.0f, 0.0f, 2.5f);
+      vertices[2].position = XMFLOAT3(0.25f, 7.0f, 2.5f);
+      const VertexPacking::Bounds bounds = VertexPacking::ComputeBounds(vertices.data(), vertices.size());
+      Assert::AreEqual(0.0f, bounds.extent.z);
+
+      std::vector<VertexPacking::PackedVertex> packed(vertices.size());
+      VertexPacking::Encode(vertices.data(), vertices.size(), bounds, packed.data());
+      std::vector<Vertex> decoded(vertices.size());
+      VertexPacking::Decode(packed.data(), packed.size(), bounds, decoded.data());
+      for (size_t i = 0; i < vertices.size(); i++)
+      {
+        Assert::AreEqual(2.5f, decoded[i].position.z);
+      }
+      //the corners of the bounds are exact as well
+      Assert::AreEqual(-1.0f, decoded[0].position.x);
+      Assert::AreEqual(7.0f, decoded[2].position.y);
+    }
+  };
+}
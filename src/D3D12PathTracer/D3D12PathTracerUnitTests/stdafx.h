@@ -0,0 +1,5 @@
+// stdafx.h : the tests include the app's headers through its precompiled header
+
+#pragma once
+
+#include "../src/stdafx.h"
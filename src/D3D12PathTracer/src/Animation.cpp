@@ -0,0 +1,221 @@
+#include "stdafx.h"
+#include "Animation.h"
+#include "GltfAccessor.h"
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+  Animation::Interpolation ParseInterpolation(const std::string& name)
+  {
+    if (name == "STEP")
+    {
+      return Animation::Interpolation::Step;
+    }
+    if (name == "CUBICSPLINE")
+    {
+      return Animation::Interpolation::CubicSpline;
+    }
+    return Animation::Interpolation::Linear;
+  }
+
+  //index of the last key at or before time, and how far time is towards the next one
+  void FindKey(const std::vector<float>& times, float time, size_t& key, float& t)
+  {
+    if (time <= times.front())
+    {
+      key = 0;
+      t = 0.0f;
+      return;
+    }
+    if (time >= times.back())
+    {
+      key = times.size() - 1;
+      t = 0.0f;
+      return;
+    }
+
+    key = std::upper_bound(times.begin(), times.end(), time) - times.begin() - 1;
+    const float span = times[key + 1] - times[key];
+    t = span > 0.0f ? (time - times[key]) / span : 0.0f;
+  }
+
+  glm::vec4 Hermite(const glm::vec4& p0, const glm::vec4& m0, const glm::vec4& p1, const glm::vec4& m1, float t)
+  {
+    const float t2 = t * t;
+    const float t3 = t2 * t;
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * p0 + (t3 - 2.0f * t2 + t) * m0 +
+           (-2.0f * t3 + 3.0f * t2) * p1 + (t3 - t2) * m1;
+  }
+
+  glm::vec4 SampleChannel(const Animation::Channel& channel, float time)
+  {
+    size_t key;
+    float t;
+    FindKey(channel.times, time, key, t);
+
+    if (channel.interpolation == Animation::Interpolation::CubicSpline)
+    {
+      const glm::vec4& value = channel.values[key * 3 + 1];
+      if (key + 1 >= channel.times.size())
+      {
+        return value;
+      }
+      //tangents are scaled by the key span
+      const float span = channel.times[key + 1] - channel.times[key];
+      const glm::vec4& out_tangent = channel.values[key * 3 + 2];
+      const glm::vec4& next_in_tangent = channel.values[(key + 1) * 3];
+      const glm::vec4& next_value = channel.values[(key + 1) * 3 + 1];
+      return Hermite(value, out_tangent * span, next_value, next_in_tangent * span, t);
+    }
+
+    const glm::vec4& value = channel.values[key];
+    if (channel.interpolation == Animation::Interpolation::Step || key + 1 >= channel.times.size())
+    {
+      return value;
+    }
+
+    const glm::vec4& next_value = channel.values[key + 1];
+    if (channel.path == Animation::Path::Rotation)
+    {
+      const glm::quat a(value.w, value.x, value.y, value.z);
+      const glm::quat b(next_value.w, next_value.x, next_value.y, next_value.z);
+      const glm::quat q = glm::slerp(a, b, t);
+      return glm::vec4(q.x, q.y, q.z, q.w);
+    }
+    return glm::mix(value, next_value, t);
+  }
+}
+
+glm::mat4 Animation::Pose::Matrix() const
+{
+  glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation);
+  transform = transform * glm::mat4_cast(rotation);
+  return glm::scale(transform, scale);
+}
+
+std::vector<Animation::Clip> Animation::LoadClips(const tinygltf::Model& model)
+{
+  std::vector<Clip> clips;
+  clips.reserve(model.animations.size());
+
+  for (const tinygltf::Animation& animation : model.animations)
+  {
+    Clip clip;
+    clip.name = animation.name;
+
+    for (const tinygltf::AnimationChannel& gltf_channel : animation.channels)
+    {
+      if (gltf_channel.target_node < 0 || gltf_channel.target_node >= static_cast<int>(model.nodes.size()))
+      {
+        continue;
+      }
+
+      Channel channel;
+      channel.node = gltf_channel.target_node;
+      if (gltf_channel.target_path == "translation")
+      {
+        channel.path = Path::Translation;
+      }
+      else if (gltf_channel.target_path == "rotation")
+      {
+        channel.path = Path::Rotation;
+      }
+      else if (gltf_channel.target_path == "scale")
+      {
+        channel.path = Path::Scale;
+      }
+      else
+      {
+        //morph target weights
+        continue;
+      }
+
+      if (gltf_channel.sampler < 0 || gltf_channel.sampler >= static_cast<int>(animation.samplers.size()))
+      {
+        throw std::runtime_error("glTF animation channel references a missing sampler");
+      }
+      const tinygltf::AnimationSampler& sampler = animation.samplers[gltf_channel.sampler];
+      channel.interpolation = ParseInterpolation(sampler.interpolation);
+
+      const GltfAccessor::View input(model, sampler.input);
+      const GltfAccessor::View output(model, sampler.output);
+      const size_t values_per_key = channel.interpolation == Interpolation::CubicSpline ? 3 : 1;
+      if (input.Empty() || output.Count() != input.Count() * values_per_key)
+      {
+        throw std::runtime_error("glTF animation sampler input and output don't match");
+      }
+
+      channel.times.resize(input.Count());
+      for (size_t i = 0; i < channel.times.size(); i++)
+      {
+        channel.times[i] = input.Component(i, 0);
+      }
+      channel.values.resize(output.Count());
+      for (size_t i = 0; i < channel.values.size(); i++)
+      {
+        channel.values[i] = glm::vec4(output.Component(i, 0), output.Component(i, 1), output.Component(i, 2), output.Component(i, 3));
+      }
+
+      clip.duration = std::max<float>(clip.duration, channel.times.back());
+      clip.channels.push_back(std::move(channel));
+    }
+
+    clips.push_back(std::move(clip));
+  }
+  return clips;
+}
+
+Animation::Pose Animation::RestPose(const tinygltf::Node& node)
+{
+  Pose pose;
+  if (node.translation.size() == 3)
+  {
+    pose.translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+  }
+  if (node.rotation.size() == 4)
+  {
+    //stored x, y, z, w
+    pose.rotation = glm::normalize(glm::quat(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+                                             static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2])));
+  }
+  if (node.scale.size() == 3)
+  {
+    pose.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+  }
+  return pose;
+}
+
+void Animation::Sample(const Clip& clip, float time, std::vector<Pose>& poses)
+{
+  if (clip.duration > 0.0f)
+  {
+    time = std::fmod(time, clip.duration);
+    if (time < 0.0f)
+    {
+      time += clip.duration;
+    }
+  }
+
+  for (const Channel& channel : clip.channels)
+  {
+    if (channel.node >= static_cast<int>(poses.size()))
+    {
+      continue;
+    }
+
+    const glm::vec4 value = SampleChannel(channel, time);
+    Pose& pose = poses[channel.node];
+    switch (channel.path)
+    {
+    case Path::Translation:
+      pose.translation = glm::vec3(value);
+      break;
+    case Path::Rotation:
+      pose.rotation = glm::normalize(glm::quat(value.w, value.x, value.y, value.z));
+      break;
+    case Path::Scale:
+      pose.scale = glm::vec3(value);
+      break;
+    }
+  }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+#include <glm/glm/gtc/quaternion.hpp>
+
+// glTF keyframe animation. Clips are read once from the model's animations
+// and sampled into per-node local poses (translation, rotation, scale), which
+// the caller turns into local matrices of its scene graph. Weights (morph
+// target) channels are skipped. Time wraps around the clip duration.
+namespace Animation {
+
+enum class Path { Translation, Rotation, Scale };
+enum class Interpolation { Step, Linear, CubicSpline };
+
+struct Channel {
+  int node;
+  Path path;
+  Interpolation interpolation;
+  std::vector<float> times;
+  // one value per key (xyz or quaternion xyzw), cubic splines store
+  // in-tangent, value, out-tangent for every key
+  std::vector<glm::vec4> values;
+};
+
+struct Clip {
+  std::string name;
+  float duration = 0.0f;
+  std::vector<Channel> channels;
+};
+
+struct Pose {
+  glm::vec3 translation{ 0.0f };
+  glm::quat rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+  glm::vec3 scale{ 1.0f };
+
+  glm::mat4 Matrix() const;
+};
+
+// throws if a channel's sampler doesn't fit its accessors
+std::vector<Clip> LoadClips(const tinygltf::Model& model);
+
+// the node's own TRS, identity for nodes given by a matrix
+Pose RestPose(const tinygltf::Node& node);
+
+// overwrites the animated parts of poses (indexed by glTF node) for clip time
+void Sample(const Clip& clip, float time, std::vector<Pose>& poses);
+} // namespace Animation
@@ -0,0 +1,464 @@
+#include "stdafx.h"
+#include "AssetLoader.h"
+#include "GltfAccessor.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "NormalMapCodec.h"
+#include "ObjParser.h"
+#include "SceneReader.h"
+#include "TangentFrames.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <tuple>
+#include <glm/glm/gtc/matrix_transform.hpp>
+#include <glm/glm/gtc/quaternion.hpp>
+#include "include/json.hpp"
+
+AssetLoader::ModelData AssetLoader::DecodeObj(const std::string& path, MeshOptimizer::TriangleOrder order, ThreadPool* pool)
+{
+  ObjParser::Stats stats;
+  ObjParser::Mesh mesh = ObjParser::Parse(path, pool != nullptr ? *pool : ThreadPool::Shared(), &stats);
+
+  std::wstringstream wstr;
+  const double seconds = std::max<double>(stats.milliseconds, 0.001) / 1000.0;
+  wstr << L"Parsed " << path.c_str() << L" (" << stats.chunks << L" chunks) in " << stats.milliseconds << L" ms, "
+       << stats.bytes / (1024.0 * 1024.0) / seconds << L" MB/s, " << stats.triangles / seconds << L" triangles/s\n";
+  OutputDebugStringW(wstr.str().c_str());
+
+  ModelData data;
+  data.vertices = std::move(mesh.vertices);
+  data.indices = std::move(mesh.indices);
+
+  //every face corner got its own vertex, share the identical ones
+  data.weld_stats = MeshOptimizer::WeldVertices(data.vertices, data.indices);
+
+  //lay triangles and vertices out so neighbouring hits fetch neighbouring memory
+  data.triangle_order = order;
+  data.cache_before = MeshOptimizer::SimulateCache(data.vertices, data.indices);
+  MeshOptimizer::OptimizeTriangleOrder(order, data.vertices, data.indices);
+  data.cache_after = MeshOptimizer::SimulateCache(data.vertices, data.indices);
+
+  //after reordering, the tangents follow the final vertex order
+  data.tangents = TangentFrames::Generate(data.vertices, data.indices);
+
+  return data;
+}
+
+AssetLoader::ImageData AssetLoader::DecodeImage(const std::string& path)
+{
+  return ImageDecoder::Decode(path);
+}
+
+tinygltf::Model AssetLoader::DecodeGltf(const std::string& path)
+{
+  tinygltf::Model model;
+  tinygltf::TinyGLTF loader;
+  std::string err;
+  std::string warn;
+
+  //textures are loaded from their uri by the texture path, don't decode them here as well
+  loader.SetImageLoader([](tinygltf::Image*, std::string*, std::string*, int, int, const unsigned char*, int, void*) { return true; }, nullptr);
+
+  bool ret = false;
+  if (std::filesystem::path(path).extension() == ".glb")
+  {
+    //the container is parsed in place, only the BIN chunk is copied into the model's buffer
+    MappedFile file;
+    if (!file.Open(path))
+    {
+      throw std::runtime_error("failed to open glTF " + path);
+    }
+    ret = loader.LoadBinaryFromMemory(&model, &err, &warn, reinterpret_cast<const unsigned char*>(file.Data()),
+                                      static_cast<unsigned int>(file.Size()), std::filesystem::path(path).parent_path().string());
+  }
+  else
+  {
+    ret = loader.LoadASCIIFromFile(&model, &err, &warn, path);
+  }
+  if (!warn.empty())
+  {
+    printf("Warn: %s\n", warn.c_str());
+  }
+
+  if (!err.empty())
+  {
+    printf("Err: %s\n", err.c_str());
+  }
+
+  if (!ret)
+  {
+    throw std::runtime_error("failed to parse glTF " + path);
+  }
+
+  return model;
+}
+
+AssetLoader::ModelData AssetLoader::DecodeGltfPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive)
+{
+  ModelData data;
+  if (primitive.mode != TINYGLTF_MODE_TRIANGLES)
+  {
+    return data;
+  }
+
+  const GltfAccessor::View positions = GltfAccessor::FindAttribute(model, primitive, "POSITION");
+  const GltfAccessor::View normals = GltfAccessor::FindAttribute(model, primitive, "NORMAL");
+  const GltfAccessor::View texcoords = GltfAccessor::FindAttribute(model, primitive, "TEXCOORD_0");
+
+  data.vertices.resize(positions.Count());
+  for (size_t i = 0; i < data.vertices.size(); i++)
+  {
+    Vertex& v = data.vertices[i];
+    v.position = positions.Float3(i);
+    v.normal = i < normals.Count() ? normals.Float3(i) : XMFLOAT3(0.0f, 0.0f, 0.0f);
+    v.texCoord = i < texcoords.Count() ? texcoords.Float2(i) : XMFLOAT2(0.0f, 0.0f);
+  }
+
+  data.indices = GltfAccessor::ReadIndices(model, primitive);
+  for (Index index : data.indices)
+  {
+    if (index >= data.vertices.size())
+    {
+      throw std::runtime_error("glTF primitive references a vertex that doesn't exist");
+    }
+  }
+
+  data.tangents = TangentFrames::Generate(data.vertices, data.indices);
+  return data;
+}
+
+AssetLoader::GltfInstances AssetLoader::DecodeGltfInstances(const tinygltf::Model& model)
+{
+  GltfInstances instances;
+  instances.node_models.resize(model.nodes.size());
+  if (model.scenes.empty())
+  {
+    return instances;
+  }
+
+  std::map<std::tuple<int, int, int>, int> models;
+  std::function<void(int)> visit = [&](int node_index)
+  {
+    if (node_index < 0 || node_index >= static_cast<int>(model.nodes.size()))
+    {
+      throw std::runtime_error("glTF node index out of range");
+    }
+    const tinygltf::Node& node = model.nodes[node_index];
+    if (node.mesh >= 0 && node.mesh < static_cast<int>(model.meshes.size()))
+    {
+      const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+      const bool skinned = node.skin >= 0 && node.skin < static_cast<int>(model.skins.size());
+      std::vector<int>& node_models = instances.node_models[node_index];
+      node_models.assign(mesh.primitives.size(), -1);
+      for (int i = 0; i < static_cast<int>(mesh.primitives.size()); i++)
+      {
+        const auto key = std::make_tuple(node.mesh, i, skinned ? node_index : -1);
+        auto found = models.find(key);
+        if (found == models.end())
+        {
+          GltfModel decoded;
+          decoded.mesh = node.mesh;
+          decoded.primitive = i;
+          decoded.skinned_node = skinned ? node_index : -1;
+          decoded.data = DecodeGltfPrimitive(model, mesh.primitives[i]);
+          const int index = decoded.data.indices.empty() ? -1 : static_cast<int>(instances.models.size());
+          if (index >= 0)
+          {
+            instances.models.push_back(std::move(decoded));
+          }
+          found = models.emplace(key, index).first;
+        }
+        node_models[i] = found->second;
+      }
+    }
+    for (int child : node.children)
+    {
+      visit(child);
+    }
+  };
+
+  const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+  for (int node : scene.nodes)
+  {
+    visit(node);
+  }
+  return instances;
+}
+
+size_t AssetLoader::GltfInstances::InstanceCount() const
+{
+  size_t count = 0;
+  for (const std::vector<int>& primitives : node_models)
+  {
+    count += std::count_if(primitives.begin(), primitives.end(), [](int model) { return model >= 0; });
+  }
+  return count;
+}
+
+size_t AssetLoader::GltfInstances::GeometryBytes() const
+{
+  size_t bytes = 0;
+  for (const GltfModel& model : models)
+  {
+    bytes += model.data.vertices.size() * sizeof(Vertex) + model.data.indices.size() * sizeof(Index) +
+             model.data.tangents.size() * sizeof(XMFLOAT4);
+  }
+  return bytes;
+}
+
+glm::mat4 AssetLoader::GltfNodeTransform(const tinygltf::Node& node)
+{
+  if (node.matrix.size() == 16)
+  {
+    //column major, like glm
+    glm::mat4 matrix;
+    for (int i = 0; i < 16; i++)
+    {
+      matrix[i / 4][i % 4] = static_cast<float>(node.matrix[i]);
+    }
+    return matrix;
+  }
+
+  glm::mat4 transform(1.0f);
+  if (node.translation.size() == 3)
+  {
+    transform = glm::translate(transform, glm::vec3(node.translation[0], node.translation[1], node.translation[2]));
+  }
+  if (node.rotation.size() == 4)
+  {
+    //stored x, y, z, w
+    glm::quat rotation(static_cast<float>(node.rotation[3]), static_cast<float>(node.rotation[0]),
+                       static_cast<float>(node.rotation[1]), static_cast<float>(node.rotation[2]));
+    transform = transform * glm::mat4_cast(glm::normalize(rotation));
+  }
+  if (node.scale.size() == 3)
+  {
+    transform = glm::scale(transform, glm::vec3(node.scale[0], node.scale[1], node.scale[2]));
+  }
+  return transform;
+}
+
+bool AssetLoader::IsGltfPath(const std::string& path)
+{
+  return path.find(".gltf") != std::string::npos || path.find(".glb") != std::string::npos;
+}
+
+std::vector<std::string> AssetLoader::ShippedGltfModels()
+{
+  std::vector<std::string> files;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator("src/gltf"))
+  {
+    const std::filesystem::path& path = entry.path();
+    if (!entry.is_regular_file() || path.parent_path().filename() == "glTF-Draco")
+    {
+      continue;
+    }
+    if (path.extension() == ".glb")
+    {
+      files.push_back(path.generic_string());
+      continue;
+    }
+    if (path.extension() != ".gltf")
+    {
+      continue;
+    }
+
+    //only the buffer uris are needed, data: uris are embedded
+    std::ifstream file(path);
+    const nlohmann::json json = nlohmann::json::parse(file, nullptr, false);
+    bool buffers_present = !json.is_discarded();
+    if (buffers_present && json.count("buffers"))
+    {
+      for (const nlohmann::json& buffer : json["buffers"])
+      {
+        const std::string uri = buffer.value("uri", std::string());
+        if (uri.compare(0, 5, "data:") != 0 && !std::filesystem::exists(path.parent_path() / uri))
+        {
+          buffers_present = false;
+        }
+      }
+    }
+    if (buffers_present)
+    {
+      files.push_back(path.generic_string());
+    }
+  }
+  return files;
+}
+
+AssetLoader::SceneAssets AssetLoader::CollectSceneAssets(const std::string& scene_path)
+{
+  SceneReader reader;
+  if (!reader.Open(scene_path))
+  {
+    throw std::runtime_error("failed to open scene " + scene_path);
+  }
+
+  SceneAssets assets;
+  auto add = [](std::vector<std::string>& paths, std::string_view path)
+  {
+    if (std::find(paths.begin(), paths.end(), path) == paths.end())
+    {
+      paths.emplace_back(path);
+    }
+  };
+
+  //a MODEL or *_TEXTURE line declares an asset when a path line follows, inside
+  //an OBJECT block it only references one. A few shipped scenes end lines with
+  //\r\r\n, which reads as a blank line after every line, so blank lines are skipped.
+  std::vector<std::string_view> tokens;
+  bool have_line = reader.NextLine(tokens);
+  while (have_line)
+  {
+    std::vector<std::string>* paths = nullptr;
+    if (!tokens.empty())
+    {
+      if (tokens[0] == "GLTF" && tokens.size() > 1)
+      {
+        add(assets.gltfs, tokens[1]);
+      }
+      paths = tokens[0] == "MODEL" ? &assets.models :
+              tokens[0] == "DIFFUSE_TEXTURE" ? &assets.diffuse_textures :
+              tokens[0] == "NORMAL_TEXTURE" ? &assets.normal_textures : nullptr;
+    }
+    if (paths == nullptr)
+    {
+      have_line = reader.NextLine(tokens);
+      continue;
+    }
+
+    while ((have_line = reader.NextLine(tokens)) && tokens.empty())
+    {
+    }
+    if (have_line && tokens[0] == "path" && tokens.size() > 1)
+    {
+      add(*paths, tokens[1]);
+      have_line = reader.NextLine(tokens);
+    }
+  }
+  return assets;
+}
+
+AssetLoader::DecodedAssets AssetLoader::DecodeSceneAssets(const SceneAssets& assets, ThreadPool& pool)
+{
+  std::vector<std::future<ModelData>> models;
+  for (const std::string& path : assets.models)
+  {
+    models.emplace_back(pool.Submit([path, &pool]() { return DecodeObj(path, MeshOptimizer::TriangleOrder::Morton, &pool); }));
+  }
+
+  auto submit_images = [&pool](const std::vector<std::string>& paths, MipChain::Filter filter)
+  {
+    std::vector<std::future<ImageData>> images;
+    for (const std::string& path : paths)
+    {
+      images.emplace_back(pool.Submit([path, filter, &pool]()
+      {
+        ImageData chain = MipChain::Generate(DecodeImage(path), filter, pool);
+        return filter == MipChain::Filter::Normal ? NormalMapCodec::Encode(chain, pool) : std::move(chain);
+      }));
+    }
+    return images;
+  };
+  std::vector<std::future<ImageData>> diffuse_textures = submit_images(assets.diffuse_textures, MipChain::Filter::Srgb);
+  std::vector<std::future<ImageData>> normal_textures = submit_images(assets.normal_textures, MipChain::Filter::Normal);
+
+  std::vector<std::future<tinygltf::Model>> gltfs;
+  for (const std::string& path : assets.gltfs)
+  {
+    gltfs.emplace_back(pool.Submit([path]() { return DecodeGltf(path); }));
+  }
+
+  DecodedAssets decoded;
+  for (auto& model : models)
+  {
+    decoded.models.push_back(model.get());
+  }
+  for (auto& image : diffuse_textures)
+  {
+    decoded.diffuse_textures.push_back(image.get());
+  }
+  for (auto& image : normal_textures)
+  {
+    decoded.normal_textures.push_back(image.get());
+  }
+  for (auto& gltf : gltfs)
+  {
+    decoded.gltfs.push_back(gltf.get());
+  }
+  return decoded;
+}
+
+std::vector<AssetLoader::ScalingRun> AssetLoader::Benchmark(const std::string& scene_path, const std::vector<size_t>& thread_counts)
+{
+  SceneAssets assets = CollectSceneAssets(scene_path);
+
+  //some scenes reference models that aren't in the repo, like coffee_demo's dragon
+  size_t missing_files = 0;
+  for (std::vector<std::string>* paths : { &assets.models, &assets.diffuse_textures, &assets.normal_textures, &assets.gltfs })
+  {
+    const size_t count = paths->size();
+    paths->erase(std::remove_if(paths->begin(), paths->end(), [](const std::string& path) { return !std::filesystem::exists(path); }), paths->end());
+    missing_files += count - paths->size();
+  }
+
+  //first pass untimed, so no run pays for reading the files from disk
+  DecodeSceneAssets(assets, ThreadPool::Shared());
+
+  std::vector<ScalingRun> runs;
+  for (size_t threads : thread_counts)
+  {
+    ThreadPool pool(threads);
+    auto start = std::chrono::high_resolution_clock::now();
+    const DecodedAssets decoded = DecodeSceneAssets(assets, pool);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    ScalingRun run;
+    run.threads = threads;
+    run.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    run.missing_files = missing_files;
+    run.files = assets.models.size() + assets.diffuse_textures.size() + assets.normal_textures.size() + assets.gltfs.size();
+    for (const ModelData& model : decoded.models)
+    {
+      run.bytes += model.vertices.size() * sizeof(Vertex) + model.indices.size() * sizeof(Index) + model.tangents.size() * sizeof(XMFLOAT4);
+    }
+    for (const std::vector<ImageData>* images : { &decoded.diffuse_textures, &decoded.normal_textures })
+    {
+      for (const ImageData& image : *images)
+      {
+        run.bytes += image.size;
+      }
+    }
+    runs.push_back(run);
+  }
+  return runs;
+}
+
+int AssetLoader::RunBenchmark(const std::string& scene_path)
+{
+  const std::string scene = scene_path.empty() ? "src/scenes/coffee_demo/coffee_demo.txt" : scene_path;
+
+  std::vector<size_t> thread_counts;
+  for (size_t threads = 1; threads < ThreadPool::DefaultThreadCount(); threads *= 2)
+  {
+    thread_counts.push_back(threads);
+  }
+  thread_counts.push_back(ThreadPool::DefaultThreadCount());
+
+  const std::vector<ScalingRun> runs = Benchmark(scene, thread_counts);
+  std::wstringstream wstr;
+  wstr << L"loadbench: " << scene.c_str() << L", " << runs.front().files << L" files, "
+       << runs.front().bytes / (1024.0 * 1024.0) << L" MB decoded, " << runs.front().missing_files << L" missing files skipped\n";
+  for (const ScalingRun& run : runs)
+  {
+    wstr << L"  " << run.threads << L" threads: " << run.milliseconds << L" ms, speedup "
+         << runs.front().milliseconds / run.milliseconds << L"x, efficiency "
+         << 100.0 * runs.front().milliseconds / run.milliseconds / run.threads << L"%\n";
+  }
+  utilityCore::report(wstr.str());
+  return 0;
+}
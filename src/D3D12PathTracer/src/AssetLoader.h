@@ -0,0 +1,133 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+
+#include "MeshOptimizer.h"
+#include "TexelPool.h"
+#include "shaders/RayTracingHlslCompat.h"
+
+class ThreadPool;
+
+// CPU half of asset loading. Nothing here touches the device, so every
+// function can run on a worker thread (or headless) and hand its result to
+// the upload step afterwards. Failures are reported by throwing.
+namespace AssetLoader {
+
+// Triangulated model, ready to be copied into vertex/index buffers
+struct ModelData
+{
+  std::vector<Vertex> vertices;
+  std::vector<Index> indices;
+  std::vector<XMFLOAT4> tangents;
+  MeshOptimizer::WeldStats weld_stats;
+  MeshOptimizer::TriangleOrder triangle_order = MeshOptimizer::TriangleOrder::File;
+  MeshOptimizer::CacheStats cache_before; // in file order, after welding
+  MeshOptimizer::CacheStats cache_after;
+};
+
+// Texels live in a TexelPool block, or were malloc'd by the WIC fallback when pool is null
+struct TexelDeleter
+{
+  TexelPool* pool = nullptr;
+  void operator()(BYTE* data) const
+  {
+    if (pool != nullptr)
+    {
+      pool->Free(data);
+    }
+    else
+    {
+      ::free(data);
+    }
+  }
+};
+
+// Decoded image in the layout TextureLoader produces
+struct ImageData
+{
+  std::unique_ptr<BYTE, TexelDeleter> texels;
+  int size = 0;
+  int bytes_per_row = 0;
+  D3D12_RESOURCE_DESC desc{};
+};
+
+// the file's chunks are parsed on pool, ThreadPool::Shared() when null
+ModelData DecodeObj(const std::string& path, MeshOptimizer::TriangleOrder order = MeshOptimizer::TriangleOrder::Morton, ThreadPool* pool = nullptr);
+// stb_image through ImageDecoder, WIC for what stb_image can't read
+ImageData DecodeImage(const std::string& path);
+// .gltf with external or embedded buffers, or .glb read from a mapped file
+tinygltf::Model DecodeGltf(const std::string& path);
+// Triangle primitive read through GltfAccessor views, empty for other modes
+ModelData DecodeGltfPrimitive(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+// Models of a glTF's default scene with every (mesh, primitive) decoded once,
+// however many nodes reference it; each reference becomes an instance of the
+// shared model, so one BLAS serves all of them. Skinned nodes deform their mesh
+// on their own and get a model per (mesh, primitive, node).
+struct GltfModel
+{
+  int mesh = -1;
+  int primitive = -1;
+  int skinned_node = -1; // the node that deforms it, -1 when shared
+  ModelData data;
+};
+struct GltfInstances
+{
+  std::vector<GltfModel> models;
+  // per glTF node, the model each primitive of its mesh is an instance of; -1 for
+  // primitives that aren't triangle lists, empty for nodes without a mesh or outside the scene
+  std::vector<std::vector<int>> node_models;
+
+  size_t InstanceCount() const;
+  // vertices, indices and tangents of all models
+  size_t GeometryBytes() const;
+};
+GltfInstances DecodeGltfInstances(const tinygltf::Model& model);
+// node.matrix if present, else translation * rotation (quaternion) * scale
+glm::mat4 GltfNodeTransform(const tinygltf::Node& node);
+// also true for the "mesh:path" names of objects that came from a glTF
+bool IsGltfPath(const std::string& path);
+// Every .gltf/.glb below src/gltf that DecodeGltf can read. The glTF-Draco
+// variants need KHR_draco_mesh_compression and files whose external buffers
+// aren't in the tree (Sponza.bin) are left out.
+std::vector<std::string> ShippedGltfModels();
+
+// The files a .txt scene references, each path once, in the order ParseScene
+// queues them. Only the scene text is read.
+struct SceneAssets
+{
+  std::vector<std::string> models;
+  std::vector<std::string> diffuse_textures;
+  std::vector<std::string> normal_textures;
+  std::vector<std::string> gltfs;
+};
+SceneAssets CollectSceneAssets(const std::string& scene_path);
+
+struct DecodedAssets
+{
+  std::vector<ModelData> models;
+  std::vector<ImageData> diffuse_textures; // with their mip chains
+  std::vector<ImageData> normal_textures; // mip chains in the two channel normal map format
+  std::vector<tinygltf::Model> gltfs;
+};
+// Everything LoadPendingAssets does on the CPU before its upload batch, without
+// the texture caches: all decodes are queued on pool before any is waited on
+DecodedAssets DecodeSceneAssets(const SceneAssets& assets, ThreadPool& pool);
+
+struct ScalingRun
+{
+  size_t threads = 0;
+  double milliseconds = 0.0;
+  size_t files = 0;
+  size_t missing_files = 0; // referenced by the scene but not on disk, skipped
+  UINT64 bytes = 0; // vertices, indices, tangents and texels produced
+};
+// DecodeSceneAssets on a pool of each size, after one untimed pass to warm the file cache
+std::vector<ScalingRun> Benchmark(const std::string& scene_path, const std::vector<size_t>& thread_counts);
+// -loadbench [scene]: runs Benchmark on 1, 2, 4, ... up to the hardware threads and prints
+// the speedups, coffee_demo by default; no window or device is created
+int RunBenchmark(const std::string& scene_path);
+} // namespace AssetLoader
@@ -0,0 +1,422 @@
+#include "stdafx.h"
+#include "BlockCompression.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+//the header's own fallback passes memset a single argument
+#define STBD_MEMSET memset
+#define STB_DXT_IMPLEMENTATION
+#define STB_DXT_STATIC
+#include "include/stb-master/stb_dxt.h"
+
+namespace {
+constexpr UINT kBlockSize = 4;
+
+BlockCompression::Codec CodecOf(DXGI_FORMAT format)
+{
+  switch (format)
+  {
+  case DXGI_FORMAT_BC1_UNORM: return BlockCompression::Codec::BC1;
+  case DXGI_FORMAT_BC3_UNORM: return BlockCompression::Codec::BC3;
+  case DXGI_FORMAT_BC5_SNORM: return BlockCompression::Codec::BC5;
+  default: return BlockCompression::Codec::None;
+  }
+}
+
+// BC5 takes the two channel normal maps of NormalMapCodec, the others RGBA8 color
+DXGI_FORMAT SourceFormat(BlockCompression::Codec codec)
+{
+  return codec == BlockCompression::Codec::BC5 ? DXGI_FORMAT_R8G8_SNORM : DXGI_FORMAT_R8G8B8A8_UNORM;
+}
+
+UINT TexelBytes(BlockCompression::Codec codec)
+{
+  return codec == BlockCompression::Codec::BC5 ? 2 : 4;
+}
+
+UINT BlocksAcross(UINT texels)
+{
+  return (texels + kBlockSize - 1) / kBlockSize;
+}
+
+// 4x4 texels of a block, clamped to the level so small levels repeat their edges
+void GatherBlock(const BYTE* texels, const MipChain::Level& level, UINT texel_bytes, UINT block_x, UINT block_y, BYTE block[16 * 4])
+{
+  for (UINT y = 0; y < kBlockSize; y++)
+  {
+    const UINT source_y = std::min<UINT>(block_y * kBlockSize + y, level.height - 1);
+    const BYTE* row = texels + level.offset + size_t(source_y) * level.bytes_per_row;
+    for (UINT x = 0; x < kBlockSize; x++)
+    {
+      const UINT source_x = std::min<UINT>(block_x * kBlockSize + x, level.width - 1);
+      memcpy(block + (y * kBlockSize + x) * texel_bytes, row + size_t(source_x) * texel_bytes, texel_bytes);
+    }
+  }
+}
+
+// stb_dxt fills its lookup tables on the first block it encodes, guarded by a
+// plain static; that first block is encoded here once before any pool work
+void InitEncoder()
+{
+  static std::once_flag once;
+  std::call_once(once, []()
+  {
+    const BYTE rgba[16 * 4] = {};
+    BYTE out[8];
+    stb_compress_dxt_block(out, rgba, 0, STB_DXT_NORMAL);
+  });
+}
+
+// Signed BC5 channels interpolate like unsigned ones offset by 128, -128 and
+// 127 standing in for 0 and 255. stb_dxt only encodes unsigned channels, so
+// texels and endpoints are moved across by flipping the top bit.
+constexpr BYTE kSignFlip = 0x80;
+
+void EncodeBlock(const BYTE texels[16 * 4], BlockCompression::Codec codec, BYTE* out)
+{
+  if (codec == BlockCompression::Codec::BC5)
+  {
+    BYTE rg[16 * 2];
+    for (int i = 0; i < 16 * 2; i++)
+    {
+      rg[i] = texels[i] ^ kSignFlip;
+    }
+    stb_compress_bc5_block(out, rg);
+    out[0] ^= kSignFlip;
+    out[1] ^= kSignFlip;
+    out[8] ^= kSignFlip;
+    out[9] ^= kSignFlip;
+    return;
+  }
+  stb_compress_dxt_block(out, texels, codec == BlockCompression::Codec::BC3 ? 1 : 0, STB_DXT_HIGHQUAL);
+}
+
+void Expand565(UINT16 color, BYTE out[4])
+{
+  const UINT r = (color >> 11) & 31;
+  const UINT g = (color >> 5) & 63;
+  const UINT b = color & 31;
+  out[0] = static_cast<BYTE>((r << 3) | (r >> 2));
+  out[1] = static_cast<BYTE>((g << 2) | (g >> 4));
+  out[2] = static_cast<BYTE>((b << 3) | (b >> 2));
+  out[3] = 255;
+}
+
+// BC1 color endpoints and 2 bit indices. BC3 always uses the four color mode.
+void DecodeColorBlock(const BYTE* block, bool allow_three_colors, BYTE out[16 * 4])
+{
+  const UINT16 color0 = static_cast<UINT16>(block[0] | (block[1] << 8));
+  const UINT16 color1 = static_cast<UINT16>(block[2] | (block[3] << 8));
+  BYTE palette[4][4];
+  Expand565(color0, palette[0]);
+  Expand565(color1, palette[1]);
+  for (int c = 0; c < 3; c++)
+  {
+    if (color0 > color1 || !allow_three_colors)
+    {
+      palette[2][c] = static_cast<BYTE>((2 * palette[0][c] + palette[1][c]) / 3);
+      palette[3][c] = static_cast<BYTE>((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+    else
+    {
+      palette[2][c] = static_cast<BYTE>((palette[0][c] + palette[1][c]) / 2);
+      palette[3][c] = 0;
+    }
+  }
+  palette[2][3] = 255;
+  palette[3][3] = (color0 > color1 || !allow_three_colors) ? 255 : 0;
+
+  const UINT32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | (UINT32(block[7]) << 24);
+  for (int i = 0; i < 16; i++)
+  {
+    memcpy(out + i * 4, palette[(indices >> (i * 2)) & 3], 4);
+  }
+}
+
+// BC4 style channel: two endpoints and 3 bit indices, written to every stride-th byte
+void DecodeChannelBlock(const BYTE* block, BYTE* out, int stride)
+{
+  const UINT endpoint0 = block[0];
+  const UINT endpoint1 = block[1];
+  BYTE palette[8] = { static_cast<BYTE>(endpoint0), static_cast<BYTE>(endpoint1) };
+  if (endpoint0 > endpoint1)
+  {
+    for (UINT i = 1; i < 7; i++)
+    {
+      palette[i + 1] = static_cast<BYTE>(((7 - i) * endpoint0 + i * endpoint1) / 7);
+    }
+  }
+  else
+  {
+    for (UINT i = 1; i < 5; i++)
+    {
+      palette[i + 1] = static_cast<BYTE>(((5 - i) * endpoint0 + i * endpoint1) / 5);
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+
+  UINT64 indices = 0;
+  for (int i = 0; i < 6; i++)
+  {
+    indices |= UINT64(block[2 + i]) << (i * 8);
+  }
+  for (int i = 0; i < 16; i++)
+  {
+    out[i * stride] = palette[(indices >> (i * 3)) & 7];
+  }
+}
+
+void DecodeBlock(const BYTE* block, BlockCompression::Codec codec, BYTE out[16 * 4])
+{
+  switch (codec)
+  {
+  case BlockCompression::Codec::BC1:
+    DecodeColorBlock(block, true, out);
+    break;
+  case BlockCompression::Codec::BC3:
+    DecodeColorBlock(block + 8, false, out);
+    DecodeChannelBlock(block, out + 3, 4);
+    break;
+  case BlockCompression::Codec::BC5:
+  {
+    BYTE unsigned_block[16];
+    memcpy(unsigned_block, block, sizeof(unsigned_block));
+    unsigned_block[0] ^= kSignFlip;
+    unsigned_block[1] ^= kSignFlip;
+    unsigned_block[8] ^= kSignFlip;
+    unsigned_block[9] ^= kSignFlip;
+    DecodeChannelBlock(unsigned_block, out, 2);
+    DecodeChannelBlock(unsigned_block + 8, out + 1, 2);
+    for (int i = 0; i < 16 * 2; i++)
+    {
+      out[i] ^= kSignFlip;
+    }
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// one row of blocks of a level into texels of the codec's source format, dropping the padding
+void DecodeBlockRow(const BYTE* blocks, const MipChain::Level& block_level, BlockCompression::Codec codec, UINT block_y,
+                    BYTE* texels, const MipChain::Level& texel_level)
+{
+  const UINT block_bytes = BlockCompression::BlockBytes(BlockCompression::FormatOf(codec));
+  const UINT texel_bytes = TexelBytes(codec);
+  BYTE decoded[16 * 4];
+  for (UINT block_x = 0; block_x < BlocksAcross(block_level.width); block_x++)
+  {
+    DecodeBlock(blocks + block_level.offset + size_t(block_y) * block_level.bytes_per_row + size_t(block_x) * block_bytes, codec, decoded);
+    for (UINT y = 0; y < kBlockSize && block_y * kBlockSize + y < texel_level.height; y++)
+    {
+      BYTE* row = texels + texel_level.offset + size_t(block_y * kBlockSize + y) * texel_level.bytes_per_row;
+      for (UINT x = 0; x < kBlockSize && block_x * kBlockSize + x < texel_level.width; x++)
+      {
+        memcpy(row + size_t(block_x * kBlockSize + x) * texel_bytes, decoded + (y * kBlockSize + x) * texel_bytes, texel_bytes);
+      }
+    }
+  }
+}
+
+double LevelPsnr(const BYTE* reference, const BYTE* decoded, const MipChain::Level& level, BlockCompression::Codec codec)
+{
+  const int channels = codec == BlockCompression::Codec::BC5 ? 2 : (codec == BlockCompression::Codec::BC1 ? 3 : 4);
+  const UINT texel_bytes = TexelBytes(codec);
+  //signed channels compare as their offset values, the differences are the same
+  const BYTE flip = codec == BlockCompression::Codec::BC5 ? kSignFlip : 0;
+  double squared_error = 0.0;
+  for (UINT y = 0; y < level.height; y++)
+  {
+    const BYTE* a = reference + level.offset + size_t(y) * level.bytes_per_row;
+    const BYTE* b = decoded + level.offset + size_t(y) * level.bytes_per_row;
+    for (UINT x = 0; x < level.width; x++)
+    {
+      for (int c = 0; c < channels; c++)
+      {
+        const double difference = double(a[x * texel_bytes + c] ^ flip) - double(b[x * texel_bytes + c] ^ flip);
+        squared_error += difference * difference;
+      }
+    }
+  }
+
+  const double mean = squared_error / (double(level.width) * level.height * channels);
+  if (mean == 0.0)
+  {
+    return std::numeric_limits<double>::infinity();
+  }
+  return 10.0 * std::log10(255.0 * 255.0 / mean);
+}
+
+AssetLoader::ImageData AllocateImage(const D3D12_RESOURCE_DESC& desc, const std::vector<MipChain::Level>& levels)
+{
+  const size_t total_size = levels.back().offset + levels.back().size;
+  AssetLoader::ImageData image;
+  image.texels = std::unique_ptr<BYTE, AssetLoader::TexelDeleter>(static_cast<BYTE*>(TexelPool::Shared().Allocate(total_size)),
+                                                                  AssetLoader::TexelDeleter{ &TexelPool::Shared() });
+  if (!image.texels)
+  {
+    throw std::bad_alloc();
+  }
+  image.size = static_cast<int>(total_size);
+  image.bytes_per_row = levels[0].bytes_per_row;
+  image.desc = desc;
+  return image;
+}
+} // namespace
+
+const wchar_t* BlockCompression::Name(Codec codec)
+{
+  switch (codec)
+  {
+  case Codec::BC1: return L"BC1";
+  case Codec::BC3: return L"BC3";
+  case Codec::BC5: return L"BC5";
+  default: return L"uncompressed";
+  }
+}
+
+DXGI_FORMAT BlockCompression::FormatOf(Codec codec)
+{
+  switch (codec)
+  {
+  case Codec::BC1: return DXGI_FORMAT_BC1_UNORM;
+  case Codec::BC3: return DXGI_FORMAT_BC3_UNORM;
+  case Codec::BC5: return DXGI_FORMAT_BC5_SNORM;
+  default: return DXGI_FORMAT_UNKNOWN;
+  }
+}
+
+UINT BlockCompression::BlockBytes(DXGI_FORMAT format)
+{
+  switch (CodecOf(format))
+  {
+  case Codec::BC1: return 8;
+  case Codec::BC3:
+  case Codec::BC5: return 16;
+  default: return 0;
+  }
+}
+
+BlockCompression::Codec BlockCompression::ChooseCodec(const AssetLoader::ImageData& image, MipChain::Filter filter)
+{
+  if (image.desc.Width % kBlockSize != 0 || image.desc.Height % kBlockSize != 0)
+  {
+    return Codec::None;
+  }
+  if (image.desc.Format == SourceFormat(Codec::BC5))
+  {
+    return Codec::BC5;
+  }
+  if (image.desc.Format != DXGI_FORMAT_R8G8B8A8_UNORM || filter == MipChain::Filter::Normal)
+  {
+    return Codec::None;
+  }
+
+  const MipChain::Level base = MipChain::Layout(image.desc)[0];
+  for (UINT y = 0; y < base.height; y++)
+  {
+    const BYTE* row = image.texels.get() + size_t(y) * base.bytes_per_row;
+    for (UINT x = 0; x < base.width; x++)
+    {
+      if (row[x * 4 + 3] != 255)
+      {
+        return Codec::BC3;
+      }
+    }
+  }
+  return Codec::BC1;
+}
+
+AssetLoader::ImageData BlockCompression::Compress(const AssetLoader::ImageData& chain, Codec codec, ThreadPool& pool, Stats* stats)
+{
+  if (codec == Codec::None || chain.desc.Format != SourceFormat(codec))
+  {
+    throw std::runtime_error("block compression takes RGBA8 color or R8G8_SNORM normal maps");
+  }
+
+  InitEncoder();
+  const std::vector<MipChain::Level> source_levels = MipChain::Layout(chain.desc);
+  D3D12_RESOURCE_DESC desc = chain.desc;
+  desc.Format = FormatOf(codec);
+  const std::vector<MipChain::Level> block_levels = MipChain::Layout(desc);
+  AssetLoader::ImageData compressed = AllocateImage(desc, block_levels);
+
+  //one flat range over the block rows of every level, so the small levels don't each pay for a ParallelFor
+  std::vector<size_t> first_row(block_levels.size() + 1, 0);
+  for (size_t i = 0; i < block_levels.size(); i++)
+  {
+    first_row[i + 1] = first_row[i] + BlocksAcross(block_levels[i].height);
+  }
+  const UINT block_bytes = BlockBytes(desc.Format);
+  BYTE* blocks = compressed.texels.get();
+  pool.ParallelFor(first_row.back(), [&](size_t row)
+  {
+    const size_t level_index = std::upper_bound(first_row.begin(), first_row.end(), row) - first_row.begin() - 1;
+    const MipChain::Level& source = source_levels[level_index];
+    const MipChain::Level& target = block_levels[level_index];
+    const UINT block_y = static_cast<UINT>(row - first_row[level_index]);
+
+    BYTE texels[16 * 4];
+    BYTE* out = blocks + target.offset + size_t(block_y) * target.bytes_per_row;
+    for (UINT block_x = 0; block_x < BlocksAcross(target.width); block_x++, out += block_bytes)
+    {
+      GatherBlock(chain.texels.get(), source, TexelBytes(codec), block_x, block_y, texels);
+      EncodeBlock(texels, codec, out);
+    }
+  });
+
+  if (stats != nullptr)
+  {
+    stats->codec = codec;
+    stats->source_bytes = chain.size;
+    stats->compressed_bytes = compressed.size;
+
+    const MipChain::Level& base = source_levels[0];
+    std::vector<BYTE> decoded(base.size);
+    pool.ParallelFor(BlocksAcross(base.height), [&](size_t block_y)
+    {
+      DecodeBlockRow(blocks, block_levels[0], codec, static_cast<UINT>(block_y), decoded.data(), base);
+    });
+    stats->psnr = LevelPsnr(chain.texels.get(), decoded.data(), base, codec);
+  }
+  return compressed;
+}
+
+AssetLoader::ImageData BlockCompression::Decompress(const AssetLoader::ImageData& blocks)
+{
+  const Codec codec = CodecOf(blocks.desc.Format);
+  if (codec == Codec::None)
+  {
+    throw std::runtime_error("image isn't block compressed");
+  }
+
+  const std::vector<MipChain::Level> block_levels = MipChain::Layout(blocks.desc);
+  D3D12_RESOURCE_DESC desc = blocks.desc;
+  desc.Format = SourceFormat(codec);
+  const std::vector<MipChain::Level> texel_levels = MipChain::Layout(desc);
+  AssetLoader::ImageData texels = AllocateImage(desc, texel_levels);
+
+  for (size_t i = 0; i < block_levels.size(); i++)
+  {
+    for (UINT block_y = 0; block_y < BlocksAcross(block_levels[i].height); block_y++)
+    {
+      DecodeBlockRow(blocks.texels.get(), block_levels[i], codec, block_y, texels.texels.get(), texel_levels[i]);
+    }
+  }
+  return texels;
+}
+
+double BlockCompression::Psnr(const AssetLoader::ImageData& reference, const AssetLoader::ImageData& decoded, Codec codec)
+{
+  if (reference.desc.Format != SourceFormat(codec) || decoded.desc.Format != SourceFormat(codec) ||
+      reference.desc.Width != decoded.desc.Width || reference.desc.Height != decoded.desc.Height)
+  {
+    throw std::runtime_error("PSNR needs two images of the codec's source format and the same size");
+  }
+  return LevelPsnr(reference.texels.get(), decoded.texels.get(), MipChain::Layout(reference.desc)[0], codec);
+}
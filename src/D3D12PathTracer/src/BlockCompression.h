@@ -0,0 +1,52 @@
+#pragma once
+
+#include "AssetLoader.h"
+#include "MipChain.h"
+
+class ThreadPool;
+
+// Optional load time BC compression of mip chains with stb_dxt, plus a
+// reference decoder to measure what it costs. Color comes in as RGBA8, normal
+// maps as NormalMapCodec's R8G8_SNORM. Compressed chains keep the
+// MipChain layout: levels packed one after the other, each a grid of 4x4
+// blocks, bytes_per_row being one row of blocks.
+namespace BlockCompression {
+
+enum class Codec {
+  None, // left as decoded
+  BC1, // opaque color, 4 bits per texel
+  BC3, // color with alpha, 8 bits per texel
+  BC5 // normal maps: the two signed channels of NormalMapCodec
+};
+
+struct Stats {
+  Codec codec = Codec::None;
+  UINT64 source_bytes = 0;
+  UINT64 compressed_bytes = 0;
+  double psnr = 0.0; // dB over level 0, see Psnr
+};
+
+const wchar_t* Name(Codec codec);
+DXGI_FORMAT FormatOf(Codec codec);
+// bytes per 4x4 block of a BC format, 0 for every other format
+UINT BlockBytes(DXGI_FORMAT format);
+
+// BC5 for R8G8_SNORM normal maps; for RGBA8 color BC3 when any texel isn't
+// opaque, BC1 otherwise. None for other formats (RGBA8 normal maps included)
+// and when level 0 isn't a whole number of blocks, which D3D12 requires of BC
+// textures.
+Codec ChooseCodec(const AssetLoader::ImageData& image, MipChain::Filter filter);
+
+// Every level of chain as codec blocks, rows of blocks split across the pool.
+// Levels smaller than a block are padded by repeating their edge texels.
+// stats, when given, gets the sizes and the PSNR of level 0.
+AssetLoader::ImageData Compress(const AssetLoader::ImageData& chain, Codec codec, ThreadPool& pool, Stats* stats = nullptr);
+// Reference decoder, back to a chain of the source format (RGBA8, or
+// R8G8_SNORM for BC5) with the same levels.
+AssetLoader::ImageData Decompress(const AssetLoader::ImageData& blocks);
+// Peak signal to noise ratio of level 0 over the channels codec keeps (rgb for
+// BC1, rgba for BC3, rg for BC5), both in the codec's source format; infinity
+// when the images match.
+double Psnr(const AssetLoader::ImageData& reference, const AssetLoader::ImageData& decoded, Codec codec);
+
+} // namespace BlockCompression
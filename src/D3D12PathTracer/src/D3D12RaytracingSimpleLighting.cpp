@@ -14,6 +14,7 @@
 #include "DirectXRaytracingHelper.h"
 #include "CompiledShaders\Raytracing.hlsl.h"
 #include "TextureLoader.h"
+#include "D3D12SceneUpdateBackend.h"
 #include <iostream>
 #include <algorithm>
 #include "stb_image_write.h"
@@ -32,6 +33,8 @@ const unsigned int D3D12RaytracingSimpleLighting::c_maxIteration = 6000;
 D3D12RaytracingSimpleLighting::D3D12RaytracingSimpleLighting(UINT width, UINT height, std::wstring name) :
     DXSample(width, height, name),
     m_raytracingOutputResourceUAVDescriptorHeapIndex(UINT_MAX),
+    m_sceneLoaded(nullptr),
+    m_uploadBackend(nullptr),
     m_isDxrSupported(false)
 {
     m_forceComputeFallback = false;
@@ -216,6 +219,11 @@ void D3D12RaytracingSimpleLighting::CreateDeviceDependentResources()
     // Create raytracing interfaces: raytracing device and commandlist.
     CreateRaytracingInterfaces();
 
+    auto uploadBackend = std::make_unique<D3D12UploadBackend>(m_deviceResources.get(), UploadRingSize);
+    m_uploadBackend = uploadBackend.get();
+    m_uploadRing = std::make_unique<UploadRing>(std::move(uploadBackend));
+    m_placedResources = std::make_unique<PlacedResourceAllocator>(m_deviceResources->GetD3DDevice());
+
     m_sceneLoaded = new Scene(p_sceneFileName, this); // this will load everything in the argument text file
 
     // Create root signatures for the shaders.
@@ -270,27 +278,18 @@ void D3D12RaytracingSimpleLighting::CreateRootSignatures()
     // Global Root Signature
     // This is a root signature that is shared across all raytracing shaders invoked during a DispatchRays() call.
     {
-        auto num_models = m_sceneLoaded->modelMap.size();
-        auto num_objects = m_sceneLoaded->objects.size();
-        auto num_diffuse_textures = m_sceneLoaded->diffuseTextureMap.size();
-        auto num_normal_textures = m_sceneLoaded->normalTextureMap.size();
-        auto num_materials = m_sceneLoaded->materialMap.size();
-
-        //ensure that the models, textures and materials are not zero or else bad things will happen :)
-        assert(num_models != 0);
-        assert(num_objects != 0);
-        assert(num_diffuse_textures != 0);
-        assert(num_normal_textures != 0);
-        assert(num_materials != 0);
+        //every array spans its whole descriptor range, the scene only decides which slots hold something
+        const UINT capacity = SceneDescriptorCapacity;
 
-        CD3DX12_DESCRIPTOR_RANGE ranges[7]; // Perfomance TIP: Order from most frequent to least frequent.
+        CD3DX12_DESCRIPTOR_RANGE ranges[8]; // Perfomance TIP: Order from most frequent to least frequent.
         ranges[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 0);  // 1 output texture
-        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, num_models, 0, 1);  // array of vertices
-        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, num_models, 0, 2);  // array of indices
-        ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, num_objects, 0, 3);  // array of infos for each object
-	ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, num_materials, 0, 4);  // array of materials
-	ranges[5].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, num_diffuse_textures, 0, 5);  // array of textures
-	ranges[6].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, num_normal_textures, 0, 6);  // array of normal textures
+        ranges[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, capacity, 0, 1);  // array of vertices
+        ranges[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, capacity, 0, 2);  // array of indices
+        ranges[3].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, capacity, 0, 3);  // array of infos for each object
+	ranges[4].Init(D3D12_DESCRIPTOR_RANGE_TYPE_CBV, capacity, 0, 4);  // array of materials
+	ranges[5].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, capacity, 0, 5);  // array of textures
+	ranges[6].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, capacity, 0, 6);  // array of normal textures
+        ranges[7].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, capacity, 0, 7);  // array of tangents
 
         CD3DX12_ROOT_PARAMETER rootParameters[GlobalRootSignatureParams::Count];
         rootParameters[GlobalRootSignatureParams::AccelerationStructureSlot].InitAsShaderResourceView(0);
@@ -302,11 +301,13 @@ void D3D12RaytracingSimpleLighting::CreateRootSignatures()
 	rootParameters[GlobalRootSignatureParams::MaterialBuffersSlot].InitAsDescriptorTable(1, &ranges[4]);
         rootParameters[GlobalRootSignatureParams::TextureSlot].InitAsDescriptorTable(1, &ranges[5]);
 	rootParameters[GlobalRootSignatureParams::NormalTextureSlot].InitAsDescriptorTable(1, &ranges[6]);
+        rootParameters[GlobalRootSignatureParams::TangentBuffersSlot].InitAsDescriptorTable(1, &ranges[7]);
 
 	// LOOKAT
 	// create a static sampler
 	D3D12_STATIC_SAMPLER_DESC sampler[2] = {};
-	sampler[0].Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
+	// point within a level, blended between the two levels the ray cone picks
+	sampler[0].Filter = D3D12_FILTER_MIN_MAG_POINT_MIP_LINEAR;
 	sampler[0].AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 	sampler[0].AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
 	sampler[0].AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
@@ -315,12 +316,12 @@ void D3D12RaytracingSimpleLighting::CreateRootSignatures()
 	sampler[0].ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
 	sampler[0].BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
 	sampler[0].MinLOD = 0.0f;
-	sampler[0].MaxLOD = 1.0f;
+	sampler[0].MaxLOD = D3D12_FLOAT32_MAX;
 	sampler[0].ShaderRegister = 0;
 	sampler[0].RegisterSpace = 0;
 	sampler[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
 
-        sampler[1].Filter = D3D12_FILTER_MIN_MAG_MIP_POINT;
+        sampler[1].Filter = D3D12_FILTER_MIN_MAG_POINT_MIP_LINEAR;
         sampler[1].AddressU = D3D12_TEXTURE_ADDRESS_MODE_MIRROR;
         sampler[1].AddressV = D3D12_TEXTURE_ADDRESS_MODE_MIRROR;
         sampler[1].AddressW = D3D12_TEXTURE_ADDRESS_MODE_MIRROR;
@@ -329,7 +330,7 @@ void D3D12RaytracingSimpleLighting::CreateRootSignatures()
         sampler[1].ComparisonFunc = D3D12_COMPARISON_FUNC_NEVER;
         sampler[1].BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
         sampler[1].MinLOD = 0.0f;
-        sampler[1].MaxLOD = 1.0f;
+        sampler[1].MaxLOD = D3D12_FLOAT32_MAX;
         sampler[1].ShaderRegister = 1;
         sampler[1].RegisterSpace = 0;
         sampler[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
@@ -432,7 +433,7 @@ void D3D12RaytracingSimpleLighting::CreateRaytracingPipelineStateObject()
     // Shader config
     // Defines the maximum sizes in bytes for the ray payload and attribute structure.
     auto shaderConfig = raytracingPipeline.CreateSubobject<CD3D12_RAYTRACING_SHADER_CONFIG_SUBOBJECT>();
-	UINT payloadSize = sizeof(XMFLOAT4) + sizeof(XMFLOAT3) * 2;    // float4 pixelColor
+	UINT payloadSize = sizeof(XMFLOAT4) + sizeof(XMFLOAT3) * 2 + sizeof(float) * 2;    // float4 pixelColor, ray, cone
     UINT attributeSize = sizeof(XMFLOAT2);  // float2 barycentrics
     shaderConfig->Config(payloadSize, attributeSize);
 
@@ -511,14 +512,17 @@ void D3D12RaytracingSimpleLighting::CreateDescriptorHeap()
 {
     auto device = m_deviceResources->GetD3DDevice();
 
+    // One fixed range per DescriptorCategory:
+    // 2 - raytracing output and accumulation UAVs
+    // acceleration structure fallback wrapped pointer UAVs, a bottom level per model and the top level
+    // 3 per model - vertex, index and tangent SRVs
+    // 1 per object, material and texture
+    const UINT32 capacity = SceneDescriptorCapacity;
+    m_descriptorAllocator = std::make_unique<DescriptorAllocator>(std::vector<DescriptorAllocator::Category>{
+        { 1, 2 }, { capacity + 1, 1 }, { capacity, 3 }, { capacity, 1 }, { capacity, 1 }, { capacity, 1 }, { capacity, 1 } });
+
     D3D12_DESCRIPTOR_HEAP_DESC descriptorHeapDesc = {};
-    // Allocate a heap for 5 descriptors:
-    // 2 - vertex and index buffer SRVs
-	// 1 - tex
-	// 1 - norm tex
-    // 1 - raytracing output texture SRV
-    // 2 - bottom and top level acceleration structure fallback wrapped pointer UAVs
-    descriptorHeapDesc.NumDescriptors = HEAP_DESCRIPTOR_SIZE; 
+    descriptorHeapDesc.NumDescriptors = m_descriptorAllocator->TotalDescriptors();
     descriptorHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
     descriptorHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
     descriptorHeapDesc.NodeMask = 0;
@@ -526,6 +530,96 @@ void D3D12RaytracingSimpleLighting::CreateDescriptorHeap()
     NAME_D3D12_OBJECT(m_descriptorHeap);
 
     m_descriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+
+    ClearSceneDescriptors();
+    m_raytracingOutputResourceUAVDescriptorHeapIndex = m_descriptorAllocator->Index(m_descriptorAllocator->Allocate(OutputDescriptors));
+}
+
+// Writes a null descriptor of the kind the category's tables hold, the shader
+// may index any slot of a table.
+void D3D12RaytracingSimpleLighting::WriteNullDescriptor(UINT32 category, UINT index)
+{
+    auto device = m_deviceResources->GetD3DDevice();
+
+    if (category == ObjectDescriptors || category == MaterialDescriptors)
+    {
+        device->CreateConstantBufferView(nullptr, GetCpuDescriptor(index));
+        return;
+    }
+
+    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+    if (category == DiffuseTextureDescriptors || category == NormalTextureDescriptors)
+    {
+        srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MipLevels = 1;
+    }
+    else
+    {
+        srvDesc.Format = DXGI_FORMAT_R32_UINT;
+        srvDesc.ViewDimension = D3D12_SRV_DIMENSION_BUFFER;
+    }
+    device->CreateShaderResourceView(nullptr, &srvDesc, GetCpuDescriptor(index));
+}
+
+// Frees every scene slot and nulls the descriptors behind them.
+void D3D12RaytracingSimpleLighting::ClearSceneDescriptors()
+{
+    for (UINT32 category = ModelDescriptors; category < DescriptorCategoryCount; category++)
+    {
+        m_descriptorAllocator->ReleaseAll(category);
+        const UINT32 tables = category == ModelDescriptors ? 3 : 1;
+        for (UINT32 table = 0; table < tables; table++)
+        {
+            const UINT start = m_descriptorAllocator->TableStart(category, table);
+            for (UINT slot = 0; slot < m_descriptorAllocator->Capacity(category); slot++)
+            {
+                WriteNullDescriptor(category, start + slot);
+            }
+        }
+    }
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE D3D12RaytracingSimpleLighting::GetCpuDescriptor(UINT index)
+{
+    return CD3DX12_CPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetCPUDescriptorHandleForHeapStart(), index, m_descriptorSize);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE D3D12RaytracingSimpleLighting::GetGpuDescriptor(UINT index)
+{
+    return CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), index, m_descriptorSize);
+}
+
+void D3D12RaytracingSimpleLighting::ReleaseSceneDescriptor(DescriptorAllocator::Handle& handle, ComPtr<ID3D12Resource> resource)
+{
+    //the frame being recorded is the last that may read them
+    const UINT64 fence = m_deviceResources->GetFrameFenceValue();
+    if (resource)
+    {
+        m_retiringResources.emplace_back(fence, std::move(resource));
+    }
+    if (m_descriptorAllocator->IsLive(handle))
+    {
+        m_descriptorAllocator->ReleaseAfter(handle, fence);
+    }
+    handle = DescriptorAllocator::Handle();
+}
+
+void D3D12RaytracingSimpleLighting::RetireSceneResources()
+{
+    const UINT64 completed = m_deviceResources->GetCompletedFenceValue();
+    m_descriptorAllocator->Retire(completed, [this](const DescriptorAllocator::Handle& handle)
+    {
+        const UINT32 tables = handle.category == ModelDescriptors ? 3 : 1;
+        for (UINT32 table = 0; table < tables; table++)
+        {
+            WriteNullDescriptor(handle.category, m_descriptorAllocator->Index(handle, table));
+        }
+    });
+    m_retiringResources.erase(std::remove_if(m_retiringResources.begin(), m_retiringResources.end(),
+        [completed](const std::pair<UINT64, ComPtr<ID3D12Resource>>& retiring) { return retiring.first <= completed; }),
+        m_retiringResources.end());
 }
 
 // Build geometry used in the sample.
@@ -751,6 +845,11 @@ void D3D12RaytracingSimpleLighting::OnUpdate()
   {
     m_sceneCB[frameIndex].iteration += 1;
   }
+
+  if (play_animations)
+  {
+    animation_time += elapsedTime * animation_speed;
+  }
 }
 
 
@@ -799,20 +898,20 @@ void D3D12RaytracingSimpleLighting::DoRaytracing()
 
     auto SetCommonPipelineState = [&](auto* descriptorSetCommandList)
     {
-      ModelLoading::SceneObject& objectInScene = m_sceneLoaded->objects[0];
-      ModelLoading::Texture& diffuse_texture = m_sceneLoaded->diffuseTextureMap[0];
-      ModelLoading::Texture& normal_texture = m_sceneLoaded->normalTextureMap[0];
-      ModelLoading::MaterialResource& material = m_sceneLoaded->materialMap[0];
-      ModelLoading::Model& model = m_sceneLoaded->modelMap[0];
+      //the tables start at the first slot of their range, whatever the scene holds
+      auto TableStart = [&](UINT32 category, UINT32 table) {
+        return GetGpuDescriptor(m_descriptorAllocator->TableStart(category, table));
+      };
       descriptorSetCommandList->SetDescriptorHeaps(1, m_descriptorHeap.GetAddressOf());
       // Set index and successive vertex buffer decriptor tables
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::VertexBuffersSlot, model.vertices.gpuDescriptorHandle);
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::IndexBuffersSlot, model.indices.gpuDescriptorHandle);
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::InfoBuffersSlot, objectInScene.info_resource.d3d12_resource.gpuDescriptorHandle);
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::VertexBuffersSlot, TableStart(ModelDescriptors, VertexTable));
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::IndexBuffersSlot, TableStart(ModelDescriptors, IndexTable));
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::TangentBuffersSlot, TableStart(ModelDescriptors, TangentTable));
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::InfoBuffersSlot, TableStart(ObjectDescriptors, 0));
       commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::OutputViewSlot, m_raytracingOutputResourceUAVGpuDescriptor);
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::TextureSlot, diffuse_texture.texBuffer.gpuDescriptorHandle);
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::NormalTextureSlot, normal_texture.texBuffer.gpuDescriptorHandle);
-      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::MaterialBuffersSlot, material.d3d12_material_resource.gpuDescriptorHandle);
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::TextureSlot, TableStart(DiffuseTextureDescriptors, 0));
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::NormalTextureSlot, TableStart(NormalTextureDescriptors, 0));
+      commandList->SetComputeRootDescriptorTable(GlobalRootSignatureParams::MaterialBuffersSlot, TableStart(MaterialDescriptors, 0));
     };
 
     commandList->SetComputeRootSignature(m_raytracingGlobalRootSignature.Get());
@@ -836,7 +935,7 @@ void D3D12RaytracingSimpleLighting::DoRaytracing()
     else // DirectX Raytracing
     {
         SetCommonPipelineState(commandList);
-        commandList->SetComputeRootShaderResourceView(GlobalRootSignatureParams::AccelerationStructureSlot, m_topLevelAccelerationStructure->GetGPUVirtualAddress());
+        commandList->SetComputeRootShaderResourceView(GlobalRootSignatureParams::AccelerationStructureSlot, m_sceneLoaded->m_topLevelAccelerationStructure->GetGPUVirtualAddress());
         if (enable_rendering)
         {
           DispatchRays(m_dxrCommandList.Get(), m_dxrStateObject.Get(), &dispatchDesc);
@@ -913,8 +1012,17 @@ void D3D12RaytracingSimpleLighting::ReleaseDeviceDependentResources()
     m_dxrCommandList.Reset();
     m_dxrStateObject.Reset();
 
+    // the scene's resources go before the heaps they are placed in
+    delete m_sceneLoaded;
+    m_sceneLoaded = nullptr;
+    m_retiringResources.clear();
+    m_placedResources.reset();
+
+    m_uploadRing.reset();
+    m_uploadBackend = nullptr;
+
     m_descriptorHeap.Reset();
-    m_descriptorsAllocated = 0;
+    m_descriptorAllocator.reset();
     m_raytracingOutputResourceUAVDescriptorHeapIndex = UINT_MAX;
     m_indexBuffer.resource.Reset();
     m_vertexBuffer.resource.Reset();
@@ -956,19 +1064,33 @@ void D3D12RaytracingSimpleLighting::OnRender()
     auto device = m_deviceResources->GetD3DDevice();
     auto commandList = m_deviceResources->GetCommandList();
 
+    RetireSceneResources();
+
     //Draw ImGUI
     StartFrameImGUI();
 
-    //if rebuild scene
-    if (rebuild_scene)
+    //scene edits made by the UI or picked LODs
+    if (m_sceneUpdates.HasChanges())
     {
-      m_deviceResources->WaitForGpu();
-      RebuildScene();
-      rebuild_scene = false;
+      ApplySceneUpdates();
+    }
+
+    //skinning writes this frame's buffers, the GPU is done with them since MoveToNextFrame waited on the frame's fence
+    const bool animate = play_animations && m_sceneLoaded->HasAnimations();
+    const UINT frame = m_deviceResources->GetCurrentFrameIndex();
+    if (animate)
+    {
+      m_sceneLoaded->UpdateAnimations(animation_time, frame);
     }
 
     m_deviceResources->Prepare();
 
+    if (animate)
+    {
+      m_sceneLoaded->RecordAnimationRefits(frame, m_raytracingAPI == RaytracingAPI::FallbackLayer, m_fallbackDevice, m_dxrDevice, m_fallbackCommandList, m_dxrCommandList);
+      m_camChanged = true;
+    }
+
     commandList->RSSetViewports(1, &m_deviceResources->GetScreenViewport());
     commandList->RSSetScissorRects(1, &m_deviceResources->GetScissorRect());
     commandList->OMSetRenderTargets(1, &m_deviceResources->GetRenderTargetView(), FALSE, nullptr);
@@ -979,6 +1101,14 @@ void D3D12RaytracingSimpleLighting::OnRender()
 
     if (m_camChanged)
     {
+      //distance picked LODs apply from the next frame
+      std::vector<size_t> lod_changes;
+      m_sceneLoaded->SelectLods(m_sceneLoaded->camera.eye, &lod_changes);
+      for (size_t object : lod_changes)
+      {
+        m_sceneUpdates.ModelChanged(object, true, m_sceneLoaded->objects[object].model->id);
+      }
+
       //reset iterations
       for (int i = 0; i < FrameCount; i++)
       {
@@ -1096,7 +1226,7 @@ void D3D12RaytracingSimpleLighting::OnSizeChanged(UINT width, UINT height, bool
 }
 
 // Create a wrapped pointer for the Fallback Layer path.
-WRAPPED_GPU_POINTER D3D12RaytracingSimpleLighting::CreateFallbackWrappedPointer(ID3D12Resource* resource, UINT bufferNumElements)
+WRAPPED_GPU_POINTER D3D12RaytracingSimpleLighting::CreateFallbackWrappedPointer(ID3D12Resource* resource, UINT bufferNumElements, UINT* descriptorIndex)
 {
     auto device = m_deviceResources->GetD3DDevice();
 
@@ -1112,8 +1242,12 @@ WRAPPED_GPU_POINTER D3D12RaytracingSimpleLighting::CreateFallbackWrappedPointer(
     UINT descriptorHeapIndex = 0;
     if (!m_fallbackDevice->UsingRaytracingDriver())
     {
-        descriptorHeapIndex = AllocateDescriptor(&bottomLevelDescriptor);
+        descriptorHeapIndex = AllocateDescriptor(&bottomLevelDescriptor, descriptorIndex != nullptr ? *descriptorIndex : UINT_MAX);
         device->CreateUnorderedAccessView(resource, nullptr, &rawBufferUavDesc, bottomLevelDescriptor);
+        if (descriptorIndex != nullptr)
+        {
+            *descriptorIndex = descriptorHeapIndex;
+        }
     }
     return m_fallbackDevice->GetWrappedPointerSimple(descriptorHeapIndex, resource->GetGPUVirtualAddress());
 }
@@ -1122,17 +1256,16 @@ WRAPPED_GPU_POINTER D3D12RaytracingSimpleLighting::CreateFallbackWrappedPointer(
 // If the passed descriptorIndexToUse is valid, it will be used instead of allocating a new one.
 UINT D3D12RaytracingSimpleLighting::AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse)
 {
-    auto descriptorHeapCpuBase = m_descriptorHeap->GetCPUDescriptorHandleForHeapStart();
     if (descriptorIndexToUse >= m_descriptorHeap->GetDesc().NumDescriptors)
     {
-        descriptorIndexToUse = m_descriptorsAllocated++;
+        descriptorIndexToUse = m_descriptorAllocator->Index(m_descriptorAllocator->Allocate(AccelerationStructureDescriptors));
     }
-    *cpuDescriptor = CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptorHeapCpuBase, descriptorIndexToUse, m_descriptorSize);
+    *cpuDescriptor = GetCpuDescriptor(descriptorIndexToUse);
     return descriptorIndexToUse;
 }
 
-// Create SRV for a buffer.
-UINT D3D12RaytracingSimpleLighting::CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize)
+// Create SRV for a buffer at descriptorIndex.
+void D3D12RaytracingSimpleLighting::CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize, UINT descriptorIndex)
 {
     auto device = m_deviceResources->GetD3DDevice();
 
@@ -1153,10 +1286,9 @@ UINT D3D12RaytracingSimpleLighting::CreateBufferSRV(D3DBuffer* buffer, UINT numE
         srvDesc.Buffer.Flags = D3D12_BUFFER_SRV_FLAG_NONE;
         srvDesc.Buffer.StructureByteStride = elementSize;
     }
-    UINT descriptorIndex = AllocateDescriptor(&buffer->cpuDescriptorHandle);
+    buffer->cpuDescriptorHandle = GetCpuDescriptor(descriptorIndex);
     device->CreateShaderResourceView(buffer->resource.Get(), &srvDesc, buffer->cpuDescriptorHandle);
-    buffer->gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(m_descriptorHeap->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, m_descriptorSize);
-    return descriptorIndex;
+    buffer->gpuDescriptorHandle = GetGpuDescriptor(descriptorIndex);
 }
 
 void D3D12RaytracingSimpleLighting::OnKeyDown(UINT8 key)
@@ -1366,15 +1498,10 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
     return std::make_pair(cpu_handle, gpu_handle);
   };
 
-  auto UpdateObject = [&](const ModelLoading::SceneObject& object)
+  //edits are recorded against the object's index and applied before the next frame
+  auto ObjectIndex = [&](const ModelLoading::SceneObject& object)
   {
-    //update the resource info
-    void* mapped_data;
-    object.info_resource.d3d12_resource.resource->Map(0, nullptr, &mapped_data);
-    memcpy(mapped_data, &object.info_resource.info, sizeof(Info));
-    object.info_resource.d3d12_resource.resource->Unmap(0, nullptr);
-
-    ResetPathTracing();
+    return static_cast<size_t>(&object - m_sceneLoaded->objects.data());
   };
 
   static ImGuiFs::Dialog dlg; // one per dialog (and must be static)
@@ -1405,6 +1532,8 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
 
         int end = model.vertex_line + line_offset;
         end = end >= model.vertices_vec.size() ? model.vertices_vec.size() - 1 : end;
+        //models streamed from a scene bundle keep no cpu copy
+        end = end >= begin ? end : begin;
 
         //header
         ImGui::Text("Index");
@@ -1469,6 +1598,8 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
 
         int end = model.indices_line + line_offset;
         end = end >= model.indices_vec.size() ? model.indices_vec.size() - 1 : end;
+        //models streamed from a scene bundle keep no cpu copy
+        end = end >= begin ? end : begin;
 
         //header
         ImGui::Text("Index");
@@ -1568,8 +1699,7 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
             if (ImGui::Selectable(samplers[i].data()))
             {
               diffuse_texture.sampler_offset = i;
-              object->info_resource.info.diffuse_sampler_offset = diffuse_texture.sampler_offset;
-              UpdateObject(*object);
+              m_sceneUpdates.TextureChanged(ObjectIndex(*object));
             }
           }
 
@@ -1655,8 +1785,7 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
             if (ImGui::Selectable(samplers[i].data()))
             {
               normal_texture.sampler_offset = i;
-              object->info_resource.info.texture_normal_offset = normal_texture.sampler_offset;
-              UpdateObject(*object);
+              m_sceneUpdates.TextureChanged(ObjectIndex(*object));
             }
           }
 
@@ -1726,9 +1855,15 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
       {
         if (ImGui::TreeNode(FormatIdAndName("Object", object).c_str()))
         {
-          ImGui::DragFloat3("Translation", &object.translation.x, 0.01f, 0, 0, "%.3f", 20.0f);
-          ImGui::DragFloat3("Rotation", &object.rotation.x, 0.05f, 0, 0, "%.3f", 200.0f);
-          ImGui::DragFloat3("Scale", &object.scale.x, 0.01f, 0, 0, "%.3f", 20.0f);
+          //only edited objects (and whatever hangs below them) get their world transform recomputed
+          bool transform_edited = ImGui::DragFloat3("Translation", &object.translation.x, 0.01f, 0, 0, "%.3f", 20.0f);
+          transform_edited |= ImGui::DragFloat3("Rotation", &object.rotation.x, 0.05f, 0, 0, "%.3f", 200.0f);
+          transform_edited |= ImGui::DragFloat3("Scale", &object.scale.x, 0.01f, 0, 0, "%.3f", 20.0f);
+          if (transform_edited)
+          {
+            object.transformBuilt = false;
+            m_sceneUpdates.TransformChanged(ObjectIndex(object));
+          }
 
           if (object.model != nullptr)
           {
@@ -1771,19 +1906,17 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
             {
               if (ImGui::Selectable(model_names[i].first.data()))
               {
+                const bool had_model = object.model != nullptr;
                 if (i != 0)
                 {
                   object.model = model_names[i].second;
-                  object.info_resource.info.model_offset = object.model->id;
                 }
                 else
                 {
                   object.model = nullptr;
-                  object.info_resource.info.model_offset = -1;
                 }
 
-                //update the model
-                rebuild_scene = true;
+                m_sceneUpdates.ModelChanged(ObjectIndex(object), had_model, object.model ? object.model->id : -1);
               }
             }
 
@@ -1816,22 +1949,14 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
                   if (!m_sceneLoaded->materialMap[i - 1].was_loaded_from_gltf)
                   {
                     object.material = material_names[i].second;
-                    object.info_resource.info.material_offset = object.material->id;
                   }
                 }
                 else
                 {
                   object.material = nullptr;
-                  object.info_resource.info.material_offset = -1;
                 }
 
-                //update the resource info
-                void* mapped_data;
-                object.info_resource.d3d12_resource.resource->Map(0, nullptr, &mapped_data);
-                memcpy(mapped_data, &object.info_resource.info, sizeof(Info));
-                object.info_resource.d3d12_resource.resource->Unmap(0, nullptr);
-
-                ResetPathTracing();
+                m_sceneUpdates.MaterialChanged(ObjectIndex(object));
               }
             }
 
@@ -1864,22 +1989,14 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
                   if (!m_sceneLoaded->diffuseTextureMap[i - 1].was_loaded_from_gltf)
                   {
                     object.textures.albedoTex = diffuse_texture_names[i].second;
-                    object.info_resource.info.texture_offset = object.textures.albedoTex->id;
                   }
                 }
                 else
                 {
                   object.textures.albedoTex = nullptr;
-                  object.info_resource.info.texture_offset = -1;
                 }
 
-                //update the resource info
-                void* mapped_data;
-                object.info_resource.d3d12_resource.resource->Map(0, nullptr, &mapped_data);
-                memcpy(mapped_data, &object.info_resource.info, sizeof(Info));
-                object.info_resource.d3d12_resource.resource->Unmap(0, nullptr);
-
-                ResetPathTracing();
+                m_sceneUpdates.TextureChanged(ObjectIndex(object));
               }
             }
 
@@ -1912,23 +2029,15 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
                   if (!m_sceneLoaded->normalTextureMap[i - 1].was_loaded_from_gltf)
                   {
                     object.textures.normalTex = normal_texture_names[i].second;
-                    object.info_resource.info.texture_normal_offset = object.textures.normalTex->id;
                   }
                 }
                 else
                 {
                   object.textures.normalTex = nullptr;
-                  object.info_resource.info.texture_normal_offset = -1;
                 }
-              }
 
-              //update the resource info
-              void* mapped_data;
-              object.info_resource.d3d12_resource.resource->Map(0, nullptr, &mapped_data);
-              memcpy(mapped_data, &object.info_resource.info, sizeof(Info));
-              object.info_resource.d3d12_resource.resource->Unmap(0, nullptr);
-
-              ResetPathTracing();
+                m_sceneUpdates.TextureChanged(ObjectIndex(object));
+              }
             }
 
             ImGui::EndPopup();
@@ -1936,7 +2045,7 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
 
           if (ImGui::Button("Update"))
           {
-            rebuild_scene = true;
+            m_sceneUpdates.TransformChanged(ObjectIndex(object));
           }
 
           ImGui::TreePop();
@@ -1962,13 +2071,15 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
         {
           if (ImGui::Selectable(m_sceneLoaded->objects[i].name.data()))
           {
+            //the rest keep their info slots, so their InstanceIDs stay put
+            m_sceneUpdates.ObjectRemoved(i, m_sceneLoaded->objects[i].model != nullptr);
+            ReleaseSceneDescriptor(m_sceneLoaded->objects[i].info_resource.descriptor, m_sceneLoaded->objects[i].info_resource.d3d12_resource.resource);
             for(std::size_t j = i + 1; j < m_sceneLoaded->objects.size(); j++)
             {
               m_sceneLoaded->objects[j].id--;
             }
             std::move(std::begin(m_sceneLoaded->objects) + i + 1, std::end(m_sceneLoaded->objects), std::begin(m_sceneLoaded->objects) + i);
             m_sceneLoaded->objects.erase(std::end(m_sceneLoaded->objects) - 1);
-            rebuild_scene = true;
           }
         }
 
@@ -2008,6 +2119,7 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
     {  
       ImGui::Checkbox("Anti-Aliasing", &enable_anti_aliasing);
       ImGui::Checkbox("Depth Of Field", &enable_depth_of_field);
+      ImGui::Checkbox("Compress Textures (BC1/BC3/BC5)", &compress_textures);
 
       ImGui::DragInt("Iteration depth", reinterpret_cast<int*>(&feature_depth));
 
@@ -2093,27 +2205,19 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
             {
               auto& material_map = m_sceneLoaded->materialMap;
 
-              //update object if id changed
+              //the id each object will point at once the ids after i move down
+              std::vector<int> object_material_ids;
               for (auto& object : m_sceneLoaded->objects)
               {
-                if (object.material != nullptr)
-                {
-                  if (object.material->id == i)
-                  {
-                    object.material = nullptr;
-                    object.info_resource.info.material_offset = -1;
-                  }
-                  else if(object.material->id > i)
-                  {
-                    object.info_resource.info.material_offset--;
-                  }
-                }
+                int id = object.material != nullptr ? object.material->id : -1;
+                object_material_ids.push_back(id == i ? -1 : (id > static_cast<int>(i) ? id - 1 : id));
               }
 
               //find and erase material i
               auto found_material = material_map.find(i);
               if (found_material != std::end(material_map))
               {
+                ReleaseSceneDescriptor(found_material->second.descriptor, found_material->second.d3d12_material_resource.resource);
                 material_map.erase(found_material);
               }
 
@@ -2131,15 +2235,12 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
               material_map = std::map<int, ModelLoading::MaterialResource>(std::make_move_iterator(std::begin(material_vector)), std::make_move_iterator(std::end(material_vector)));
 
               //update every object if id changed
-              for (auto& object : m_sceneLoaded->objects)
+              for (std::size_t j = 0; j < m_sceneLoaded->objects.size(); j++)
               {
-                if(object.material != nullptr)
-                {
-                  object.material = &material_map[object.info_resource.info.material_offset];
-                }
+                m_sceneLoaded->objects[j].material = object_material_ids[j] >= 0 ? &material_map[object_material_ids[j]] : nullptr;
               }
 
-              rebuild_scene = true;
+              m_sceneUpdates.ResourcesChanged();
             }
           }
         }
@@ -2198,26 +2299,19 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
               auto& diffuse_texture_map = m_sceneLoaded->diffuseTextureMap;
               auto found_diffuse_texture = diffuse_texture_map.find(i);
 
-              //update object if id changed
+              //the id each object will point at once the ids after i move down
+              std::vector<int> object_texture_ids;
               for (auto& object : m_sceneLoaded->objects)
               {
-                if (object.textures.albedoTex != nullptr)
-                {
-                  if (object.textures.albedoTex->id == i)
-                  {
-                    object.textures.albedoTex = nullptr;
-                    object.info_resource.info.texture_offset = -1;
-                  }
-                  else if (object.textures.albedoTex->id > i)
-                  {
-                    object.info_resource.info.texture_offset--;
-                  }
-                }
+                int id = object.textures.albedoTex != nullptr ? object.textures.albedoTex->id : -1;
+                object_texture_ids.push_back(id == i ? -1 : (id > static_cast<int>(i) ? id - 1 : id));
               }
 
               //find and erase i
               if (found_diffuse_texture != std::end(diffuse_texture_map))
               {
+                ReleaseSceneDescriptor(found_diffuse_texture->second.descriptor, found_diffuse_texture->second.texBuffer.resource);
+                m_sceneLoaded->texture_cache.Release(found_diffuse_texture->second.cache_handle);
                 diffuse_texture_map.erase(found_diffuse_texture);
               }
 
@@ -2235,16 +2329,13 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
               diffuse_texture_map = std::map<int, ModelLoading::Texture>(std::make_move_iterator(std::begin(diffuse_texture_vector)), std::make_move_iterator(std::end(diffuse_texture_vector)));
 
               //update every object if id changed
-              for (auto& object : m_sceneLoaded->objects)
+              for (std::size_t j = 0; j < m_sceneLoaded->objects.size(); j++)
               {
-                if (object.textures.albedoTex != nullptr)
-                {
-                  object.textures.albedoTex = &diffuse_texture_map[object.info_resource.info.texture_offset];
-                }
+                m_sceneLoaded->objects[j].textures.albedoTex = object_texture_ids[j] >= 0 ? &diffuse_texture_map[object_texture_ids[j]] : nullptr;
               }
-            }
 
-            rebuild_scene = true;
+              m_sceneUpdates.ResourcesChanged();
+            }
           }
         }
 
@@ -2300,26 +2391,19 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
               auto& normal_texture_map = m_sceneLoaded->normalTextureMap;
               auto found_normal_texture = normal_texture_map.find(i);
 
-              //update object if id changed
+              //the id each object will point at once the ids after i move down
+              std::vector<int> object_texture_ids;
               for (auto& object : m_sceneLoaded->objects)
               {
-                if (object.textures.normalTex != nullptr)
-                {
-                  if (object.textures.normalTex->id == i)
-                  {
-                    object.textures.normalTex = nullptr;
-                    object.info_resource.info.texture_offset = -1;
-                  }
-                  else if (object.textures.normalTex->id > i)
-                  {
-                    object.info_resource.info.texture_offset--;
-                  }
-                }
+                int id = object.textures.normalTex != nullptr ? object.textures.normalTex->id : -1;
+                object_texture_ids.push_back(id == i ? -1 : (id > static_cast<int>(i) ? id - 1 : id));
               }
 
               //find and erase i
               if (found_normal_texture != std::end(normal_texture_map))
               {
+                ReleaseSceneDescriptor(found_normal_texture->second.descriptor, found_normal_texture->second.texBuffer.resource);
+                m_sceneLoaded->texture_cache.Release(found_normal_texture->second.cache_handle);
                 normal_texture_map.erase(found_normal_texture);
               }
 
@@ -2337,16 +2421,13 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
               normal_texture_map = std::map<int, ModelLoading::Texture>(std::make_move_iterator(std::begin(normal_texture_vector)), std::make_move_iterator(std::end(normal_texture_vector)));
 
               //update every object if id changed
-              for (auto& object : m_sceneLoaded->objects)
+              for (std::size_t j = 0; j < m_sceneLoaded->objects.size(); j++)
               {
-                if (object.textures.normalTex != nullptr)
-                {
-                  object.textures.normalTex = &normal_texture_map[object.info_resource.info.texture_normal_offset];
-                }
+                m_sceneLoaded->objects[j].textures.normalTex = object_texture_ids[j] >= 0 ? &normal_texture_map[object_texture_ids[j]] : nullptr;
               }
-            }
 
-            rebuild_scene = true;
+              m_sceneUpdates.ResourcesChanged();
+            }
           }
         }
 
@@ -2382,15 +2463,8 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
         //set scale
         new_object.scale = glm::vec3(1.0f);
 
-        new_object.info_resource.info.model_offset = new_model_id;
-        new_object.info_resource.info.texture_offset = -1;
-        new_object.info_resource.info.material_offset = -1;
-        new_object.info_resource.info.texture_normal_offset = -1;
-        new_object.info_resource.info.diffuse_sampler_offset = 0;
-        new_object.info_resource.info.normal_sampler_offset = 0;
-        
-
-        rebuild_scene = true;
+        //the update writes its info and builds the model's acceleration structure
+        m_sceneUpdates.ModelChanged(m_sceneLoaded->objects.size() - 1, false, new_object.model->id);
       }
       else if (browseButtonPressed)
       {
@@ -2405,17 +2479,37 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
     {
       const bool browseButtonPressed = ImGui::Button("Upload GLTF file");
       static ImGuiFs::Dialog dlg; // one per dialog (and must be static)
-      const char* chosen_path = dlg.chooseFileDialog(browseButtonPressed, nullptr, ".gltf");
+      const char* chosen_path = dlg.chooseFileDialog(browseButtonPressed, nullptr, ".gltf;.glb");
 
       if (strlen(chosen_path) > 0)
       {
+        const size_t first_new_object = m_sceneLoaded->objects.size();
         m_sceneLoaded->ParseGLTF(chosen_path, false);
-        rebuild_scene = true;
+        m_sceneUpdates.ResourcesChanged();
+        for (size_t i = first_new_object; i < m_sceneLoaded->objects.size(); i++)
+        {
+          const auto* model = m_sceneLoaded->objects[i].model;
+          m_sceneUpdates.ObjectAdded(i, model ? model->id : -1);
+        }
       }
       else if (browseButtonPressed)
       {
         ImGui::Text("Invalid path");
       }
+
+      if (m_sceneLoaded->HasAnimations())
+      {
+        ImGui::Checkbox("Play animations", &play_animations);
+        ImGui::DragFloat("Animation speed", &animation_speed, 0.05f, 0.0f, 10.0f);
+        ImGui::DragFloat("Animation time", &animation_time, 0.01f);
+        for (auto& animated : m_sceneLoaded->animated_gltfs)
+        {
+          ImGui::PushID(&animated);
+          ImGui::Text("%s", animated.name.c_str());
+          ImGui::SliderInt("Clip", &animated.clip, -1, static_cast<int>(animated.clips.size()) - 1);
+          ImGui::PopID();
+        }
+      }
     }
   };
 
@@ -2437,16 +2531,36 @@ void D3D12RaytracingSimpleLighting::StartFrameImGUI()
         }
       }
 
+      {
+        bool compile_button_pressed = ImGui::Button("Compile scene bundle");
+        static ImGuiFs::Dialog dlg; // one per dialog (and must be static)
+        const char* save_path = dlg.saveFileDialog(compile_button_pressed, nullptr, "scene.rtxpack", ".rtxpack");
+        if (strlen(save_path) > 0)
+        {
+          m_sceneLoaded->UpdateTransforms();
+          if (!SceneBundle::Write(*m_sceneLoaded, save_path))
+          {
+            std::wstringstream wstr;
+            wstr << L"Failed to write scene bundle " << save_path << L"\n";
+            OutputDebugStringW(wstr.str().c_str());
+          }
+        }
+        else if (compile_button_pressed)
+        {
+          ImGui::Text("Invalid path");
+        }
+      }
+
       {
         bool load_button_pressed = ImGui::Button("Load scene");
         static ImGuiFs::Dialog dlg; // one per dialog (and must be static)
-        const char* load_path = dlg.chooseFileDialog(load_button_pressed, nullptr, ".txt");
+        const char* load_path = dlg.chooseFileDialog(load_button_pressed, nullptr, ".txt;.rtxpack");
         if (strlen(load_path) > 0)
         {
           p_sceneFileName = load_path;
           //load scene, basically restart
           rebuild_all_resources = true;
-          rebuild_scene = true;
+          m_sceneUpdates.EverythingChanged();
         }
         else if (load_button_pressed)
         {
@@ -2615,14 +2729,58 @@ void D3D12RaytracingSimpleLighting::ShutdownImGUI()
   ImGui::DestroyContext();
 }
 
+void D3D12RaytracingSimpleLighting::ApplySceneUpdates()
+{
+  m_deviceResources->WaitForGpu();
+  auto start = std::chrono::high_resolution_clock::now();
+
+  //objects hanging below an edited one in the scene graph move with it
+  std::vector<UINT32> versions(m_sceneLoaded->objects.size());
+  for (size_t i = 0; i < versions.size(); i++)
+  {
+    versions[i] = m_sceneLoaded->objects[i].transform_version;
+  }
+  m_sceneLoaded->UpdateTransforms();
+  for (size_t i = 0; i < versions.size(); i++)
+  {
+    if (m_sceneLoaded->objects[i].transform_version != versions[i])
+    {
+      m_sceneUpdates.TransformChanged(i);
+    }
+  }
+
+  D3D12SceneUpdateBackend backend(this);
+  const SceneUpdatePlan plan = m_sceneUpdates.Plan(backend);
+  SceneChangeTracker::Apply(plan, backend);
+
+  //transform drags apply every frame, only the bigger updates are worth a line
+  if (plan.rebuild_all || plan.descriptors || plan.instances || !plan.bottom_levels.empty())
+  {
+    auto end = std::chrono::high_resolution_clock::now();
+    std::wstringstream wstr;
+    wstr << L"Scene update:";
+    for (UINT32 change = 0; change < static_cast<UINT32>(SceneChangeTracker::Change::Count); change++)
+    {
+      const size_t count = m_sceneUpdates.Count(static_cast<SceneChangeTracker::Change>(change));
+      if (count > 0)
+      {
+        wstr << L" " << count << L" " << SceneChangeTracker::Name(static_cast<SceneChangeTracker::Change>(change));
+      }
+    }
+    wstr << L" -> " << plan.Describe() << L" in " << std::chrono::duration<double, std::milli>(end - start).count() << L" ms\n";
+    OuputAndReset(wstr);
+  }
+
+  m_sceneUpdates.Clear();
+  m_camChanged = true;
+}
+
 void D3D12RaytracingSimpleLighting::RebuildScene()
 {
   // Create raytracing interfaces: raytracing device and commandlist.
   m_raytracingGlobalRootSignature.Reset();
   m_raytracingLocalRootSignature.Reset();
 
-  m_descriptorsAllocated = 0;
-  m_raytracingOutputResourceUAVDescriptorHeapIndex = UINT_MAX;
   m_indexBuffer.resource.Reset();
   m_vertexBuffer.resource.Reset();
   m_textureBuffer.resource.Reset();
@@ -2639,7 +2797,10 @@ void D3D12RaytracingSimpleLighting::RebuildScene()
 
   if (rebuild_all_resources)
   {
-    free(m_sceneLoaded);
+    delete m_sceneLoaded;
+    m_retiringResources.clear();
+    m_placedResources->Reset();
+    ClearSceneDescriptors();
     m_sceneLoaded = new Scene(p_sceneFileName, this); // this will load everything in the argument text file
     rebuild_all_resources = false;
   }
@@ -2654,16 +2815,11 @@ void D3D12RaytracingSimpleLighting::RebuildScene()
     model.second.scratchResource.Reset();
   }
 
-  m_sceneLoaded->top_level_build_desc_allocated = false;
-  m_sceneLoaded->top_level_prebuild_info_allocated = false;
-  m_sceneLoaded->scratchResource.Reset();
-  m_sceneLoaded->m_topLevelAccelerationStructure.Reset();
-  m_sceneLoaded->instanceDescs.Reset();
+  // the wrapped pointers are made again with the acceleration structures
+  m_descriptorAllocator->ReleaseAll(AccelerationStructureDescriptors);
+  m_sceneLoaded->top_level_descriptor_index = UINT_MAX;
 
-  for (auto& object : m_sceneLoaded->objects)
-  {
-    object.transformBuilt = false;
-  }
+  m_sceneLoaded->ResetTopLevel();
 
   // Create root signatures for the shaders.
   CreateRootSignatures();
@@ -2671,9 +2827,6 @@ void D3D12RaytracingSimpleLighting::RebuildScene()
   // Create a raytracing pipeline state object which defines the binding of shaders, state and resources to be used during raytracing.
   CreateRaytracingPipelineStateObject();
 
-  // Create a heap for descriptors.
-  CreateDescriptorHeap();
-
   // Build geometry to be used in the sample.
   m_sceneLoaded->AllocateResourcesInDescriptorHeap();
 
@@ -2698,7 +2851,8 @@ bool D3D12RaytracingSimpleLighting::LoadModel(std::string model_path) {
     model.name = model_path;
     int new_id = (--std::end(m_sceneLoaded->modelMap))->first + 1;
     m_sceneLoaded->LoadModelHelper(model_path, new_id, model);
-    rebuild_scene = true;
+    //its acceleration structure is built once an object uses it
+    m_sceneUpdates.ResourcesChanged();
   }
   return false;
 }
@@ -2713,7 +2867,7 @@ bool D3D12RaytracingSimpleLighting::LoadDiffuseTexture(std::string diffuse_textu
     new_texture.name = diffuse_texture_path;
     int new_id = (--std::end(m_sceneLoaded->diffuseTextureMap))->first + 1;
     m_sceneLoaded->LoadDiffuseTextureHelper(diffuse_texture_path, new_id, new_texture);
-    rebuild_scene = true;
+    m_sceneUpdates.ResourcesChanged();
   }
   return false;
 }
@@ -2728,7 +2882,7 @@ bool D3D12RaytracingSimpleLighting::LoadNormalTexture(std::string normal_texture
     new_texture.name = normal_texture_path;
     int new_id = (--std::end(m_sceneLoaded->normalTextureMap))->first + 1;
     m_sceneLoaded->LoadNormalTextureHelper(normal_texture_path, new_id, new_texture);
-    rebuild_scene = true;
+    m_sceneUpdates.ResourcesChanged();
   }
   return false;
 }
@@ -2740,7 +2894,7 @@ bool D3D12RaytracingSimpleLighting::MakeEmptyMaterial()
   material_resource.id = new_id;
   material_resource.name = "Empty Material";
   m_sceneLoaded->materialMap.insert({ new_id, std::move(material_resource)});
-  rebuild_scene = true;
+  m_sceneUpdates.ResourcesChanged();
   return true;
 }
 
@@ -2751,7 +2905,7 @@ bool D3D12RaytracingSimpleLighting::MakeEmptyObject()
   object.name = "Empty Object";
   object.scale = glm::vec3(1.0f);
   m_sceneLoaded->objects.emplace_back(std::move(object));
-  rebuild_scene = true;
+  m_sceneUpdates.ObjectAdded(m_sceneLoaded->objects.size() - 1, -1);
   return true;
 }
 
@@ -3054,6 +3208,24 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
     std::map<int, int> normal_texture_id_map;
     std::map<int, int> material_id_map;
 
+    if (m_sceneLoaded->pack_cpu_vertices)
+    {
+      file << LINE_END("PACK_VERTICES");
+      file << LINE_ENDINGS;
+    }
+
+    bool uses_lod = std::any_of(m_sceneLoaded->objects.begin(), m_sceneLoaded->objects.end(),
+                                [](const ModelLoading::SceneObject& object) { return object.UsesLod(); });
+    if (uses_lod)
+    {
+      file << "LOD_CHAIN";
+      for (float ratio : m_sceneLoaded->lod_ratios)
+      {
+        file << " " << ratio;
+      }
+      file << LINE_ENDINGS << LINE_ENDINGS;
+    }
+
     file << LINE_END("+++++ MODELS +++++");
 
     //models
@@ -3063,9 +3235,15 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
       int original_model_id = pair.first;
       auto& model = pair.second;
 
+      //generated LOD levels are rebuilt on load
+      if (model.lod_base >= 0)
+      {
+        continue;
+      }
+
       model_id_map.insert({ original_model_id, model_id });
 
-      if(model.name.find(".gltf") == std::string::npos)
+      if(!AssetLoader::IsGltfPath(model.name))
       {
         file << "MODEL " << model_id++ << LINE_ENDINGS;
         file << "path " << model.name << LINE_ENDINGS;
@@ -3144,7 +3322,7 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
     int object_id = 0;
     for (const auto& object : m_sceneLoaded->objects)
     {
-      if (object.name.find(".gltf") == std::string::npos)
+      if (!AssetLoader::IsGltfPath(object.name))
       {
         file << FORMAT_LEFT << "OBJECT" << object_id++ << " " << object.name << LINE_ENDINGS;
 
@@ -3154,7 +3332,8 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
         }
         else
         {
-          file << FORMAT_LEFT << "MODEL" << model_id_map[object.model->id] << LINE_ENDINGS;
+          int base_id = object.model->lod_base >= 0 ? object.model->lod_base : object.model->id;
+          file << FORMAT_LEFT << "MODEL" << model_id_map[base_id] << LINE_ENDINGS;
         }
 
         if (object.textures.albedoTex == nullptr)
@@ -3188,6 +3367,14 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
         file << FORMAT_LEFT << "trans" << object.translation.x << " " << object.translation.y << " " << object.translation.z << LINE_ENDINGS;
         file << FORMAT_LEFT << "rotat" << object.rotation.x << " " << object.rotation.y << " " << object.rotation.z << LINE_ENDINGS;
         file << FORMAT_LEFT << "scale" << object.scale.x << " " << object.scale.y << " " << object.scale.z << LINE_ENDINGS;
+        if (object.lod_distance > 0.0f)
+        {
+          file << FORMAT_LEFT << "lod" << "auto " << object.lod_distance << LINE_ENDINGS;
+        }
+        else if (object.lod_level > 0)
+        {
+          file << FORMAT_LEFT << "lod" << object.lod_level << LINE_ENDINGS;
+        }
 
         file << LINE_ENDINGS;
       }
@@ -3199,7 +3386,7 @@ void D3D12RaytracingSimpleLighting::SerializeToTxt(std::string path)
     {
       auto& model = pair.second;
 
-      if (model.name.find(".gltf") != std::string::npos)
+      if (model.lod_base < 0 && AssetLoader::IsGltfPath(model.name))
       {
         file << "GLTF " << model.name << LINE_ENDINGS;
         file << LINE_ENDINGS;
@@ -3536,80 +3723,3 @@ void D3D12RaytracingSimpleLighting::LoadSplitImage()
     }
   }
 }
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForVertices()
-{
-  return vertex_offset++;
-}
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForIndices()
-{
-  return indices_offset++;
-}
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForObjects()
-{
-  return objects_offset++;
-}
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForMaterials()
-{
-  return materials_offset++;
-}
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForDiffuseTextures()
-{
-  return diffuse_textures_offset++;
-}
-
-int D3D12RaytracingSimpleLighting::GetHeapOffsetForNormalTextures()
-{
-  return normal_textures_offset++;
-}
-
-void D3D12RaytracingSimpleLighting::ResetHeapOffsets()
-{
-  vertex_offset = VERTEX_HEAP_OFFSET;
-  indices_offset = INDICIES_HEAP_OFFSET;
-  objects_offset = OBJECTS_HEAP_OFFSET;
-  materials_offset = MATERIALS_HEAP_OFFSET;
-  diffuse_textures_offset = DIFFUSE_TEXTURES_HEAP_OFFSET;
-  normal_textures_offset = NORMAL_TEXTURES_HEAP_OFFSET;
-}
-
-int D3D12RaytracingSimpleLighting::AllocateHeapDescriptorType(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse, HeapDescriptorOffsetType offset_type)
-{
-  switch (offset_type)
-  {
-  case HeapDescriptorOffsetType::NONE:
-    {
-      return AllocateDescriptor(cpuDescriptor, descriptorIndexToUse);
-    }
-  case HeapDescriptorOffsetType::VERTEX:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForVertices());
-    }
-  case HeapDescriptorOffsetType::INDICES:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForIndices());
-    }
-  case HeapDescriptorOffsetType::OBJECTS:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForObjects());
-    }
-  case HeapDescriptorOffsetType::MATERIALS:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForMaterials());
-    }
-  case HeapDescriptorOffsetType::DIFFUSE_TEXTURES:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForDiffuseTextures());
-    }
-  case HeapDescriptorOffsetType::NORMAL_TEXTURES:
-    {
-      return AllocateDescriptor(cpuDescriptor, GetHeapOffsetForNormalTextures());
-    }
-  default: return AllocateDescriptor(cpuDescriptor, descriptorIndexToUse);
-  }
-}
-
@@ -15,6 +15,10 @@
 #include "StepTimer.h"
 #include "shaders/RaytracingHlslCompat.h"
 #include "Scene.h"
+#include "D3D12UploadBackend.h"
+#include "PlacedResourceAllocator.h"
+#include "DescriptorAllocator.h"
+#include "SceneUpdates.h"
 
 
 namespace GlobalRootSignatureParams {
@@ -28,6 +32,7 @@ namespace GlobalRootSignatureParams {
         IndexBuffersSlot,
         MaterialBuffersSlot,
         InfoBuffersSlot,
+        TangentBuffersSlot,
         Count 
     };
 }
@@ -47,6 +52,9 @@ namespace LocalRootSignatureParams {
 // Developers aiming for a wider HW support should target Fallback Layer.
 class D3D12RaytracingSimpleLighting : public DXSample
 {
+    // applies scene edits to the acceleration structures and descriptors
+    friend class D3D12SceneUpdateBackend;
+
     enum class RaytracingAPI {
         FallbackLayer,
         DirectXRaytracing,
@@ -71,12 +79,50 @@ public:
 	// Public variables
 	std::string p_sceneFileName;
 
-	UINT CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize);
-
+	// Ranges of the shader visible descriptor heap. Each scene range is one of
+	// the shader's descriptor arrays, always bound whole, so elements come and
+	// go without touching the root signature; free slots hold null descriptors.
+	enum DescriptorCategory : UINT32 {
+		OutputDescriptors, // output and accumulation UAVs, one slot in two tables
+		AccelerationStructureDescriptors, // fallback wrapped pointers, redone with every acceleration structure build
+		ModelDescriptors, // VertexTable, IndexTable, TangentTable
+		ObjectDescriptors,
+		MaterialDescriptors,
+		DiffuseTextureDescriptors,
+		NormalTextureDescriptors,
+		DescriptorCategoryCount
+	};
+	enum ModelDescriptorTable : UINT32 { VertexTable, IndexTable, TangentTable };
+	// models, objects, materials and textures each
+	static const UINT32 SceneDescriptorCapacity = 1000;
+
+	void CreateBufferSRV(D3DBuffer* buffer, UINT numElements, UINT elementSize, UINT descriptorIndex);
+
+	// descriptor at descriptorIndexToUse, or a new acceleration structure descriptor when it isn't valid
 	UINT AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse = UINT_MAX);
 
-	ID3D12Resource* GetTextureBufferUploadHeap() {
-		return textureBufferUploadHeap;
+	DescriptorAllocator& GetDescriptorAllocator() {
+		return *m_descriptorAllocator;
+	}
+	D3D12_CPU_DESCRIPTOR_HANDLE GetCpuDescriptor(UINT index);
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGpuDescriptor(UINT index);
+	// Frees the slot of a removed scene element and nulls its descriptors once
+	// the frames in flight, which may still read them, are done. resource (the
+	// element's buffer or texture) is kept alive until then as well.
+	void ReleaseSceneDescriptor(DescriptorAllocator::Handle& handle, ComPtr<ID3D12Resource> resource = nullptr);
+
+	// staging memory shared by every upload of the scene, see UploadRing
+	UploadRing& GetUploadRing() {
+		return *m_uploadRing;
+	}
+
+	ID3D12Resource* GetUploadRingResource() {
+		return m_uploadBackend->Resource();
+	}
+
+	// heaps the scene's buffers and textures are placed in, emptied with the scene
+	PlacedResourceAllocator& GetPlacedResources() {
+		return *m_placedResources;
 	}
 
 	ComPtr<ID3D12DescriptorHeap> GetDescriptorHeap() {
@@ -87,11 +133,14 @@ public:
 		return &m_descriptorSize;
 	}
 
-      WRAPPED_GPU_POINTER CreateFallbackWrappedPointer(ID3D12Resource* resource, UINT bufferNumElements);
+      // descriptorIndex, when given, is the descriptor to reuse if valid and gets the one used
+      WRAPPED_GPU_POINTER CreateFallbackWrappedPointer(ID3D12Resource* resource, UINT bufferNumElements, UINT* descriptorIndex = nullptr);
       void UpdateCameraMatrices();
 
 private:
 	static const UINT FrameCount = 3;
+	// bigger uploads get a buffer of their own
+	static const UINT64 UploadRingSize = 64ull << 20;
 
     // We'll allocate space for several of these and they will need to be padded for alignment.
     static_assert(sizeof(SceneConstantBuffer) < D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT, "Checking the size here.");
@@ -122,8 +171,15 @@ private:
 
     // Descriptors
     ComPtr<ID3D12DescriptorHeap> m_descriptorHeap;
-    UINT m_descriptorsAllocated;
+    std::unique_ptr<DescriptorAllocator> m_descriptorAllocator;
     UINT m_descriptorSize;
+    // null views in every slot of the scene categories, so whole arrays can be bound
+    void ClearSceneDescriptors();
+    void WriteNullDescriptor(UINT32 category, UINT index);
+    // resources of removed scene elements with the frame fence they wait on
+    std::vector<std::pair<UINT64, ComPtr<ID3D12Resource>>> m_retiringResources;
+    // frees what ReleaseSceneDescriptor deferred once the GPU is past its fence, once a frame
+    void RetireSceneResources();
     
     // Raytracing scene
 	Scene* m_sceneLoaded;
@@ -136,7 +192,11 @@ private:
 
 	D3DBuffer m_textureBuffer;
 	D3DBuffer m_normalTextureBuffer;
-	ID3D12Resource* textureBufferUploadHeap;
+
+	// Uploads
+	D3D12UploadBackend* m_uploadBackend; // owned by m_uploadRing
+	std::unique_ptr<UploadRing> m_uploadRing;
+	std::unique_ptr<PlacedResourceAllocator> m_placedResources;
 
     // Acceleration structure
     ComPtr<ID3D12Resource> m_bottomLevelAccelerationStructure;
@@ -215,8 +275,9 @@ private:
     //reload all resources
     bool rebuild_all_resources = false;
 
-    //cache the resources still
-    bool rebuild_scene = false;
+    //edits since the last frame, applied before it is rendered; EverythingChanged for a RebuildScene
+    SceneChangeTracker m_sceneUpdates;
+    void ApplySceneUpdates();
 
     void RebuildScene();
     bool LoadModel(std::string model_path);
@@ -230,6 +291,8 @@ private:
     bool enable_anti_aliasing = true;
     bool enable_depth_of_field = false;
     UINT feature_depth = 5;
+    //BC compress textures at load, takes effect when the scene is rebuilt
+    bool compress_textures = false;
 
     //image loading/saving
     bool save_image = false;
@@ -256,39 +319,8 @@ private:
     //stop/resume rendering
     bool enable_rendering = true;
 
-#define VERTEX_HEAP_OFFSET (1000)
-#define INDICIES_HEAP_OFFSET (2000)
-#define OBJECTS_HEAP_OFFSET (3000)
-#define MATERIALS_HEAP_OFFSET (4000)
-#define DIFFUSE_TEXTURES_HEAP_OFFSET (5000)
-#define NORMAL_TEXTURES_HEAP_OFFSET (6000)
-
-    int vertex_offset = VERTEX_HEAP_OFFSET;
-    int indices_offset = INDICIES_HEAP_OFFSET;
-    int objects_offset = OBJECTS_HEAP_OFFSET;
-    int materials_offset = MATERIALS_HEAP_OFFSET;
-    int diffuse_textures_offset = DIFFUSE_TEXTURES_HEAP_OFFSET;
-    int normal_textures_offset = NORMAL_TEXTURES_HEAP_OFFSET;
-
-public:
-    int GetHeapOffsetForVertices();
-    int GetHeapOffsetForIndices();
-    int GetHeapOffsetForObjects();
-    int GetHeapOffsetForMaterials();
-    int GetHeapOffsetForDiffuseTextures();
-    int GetHeapOffsetForNormalTextures();
-    void ResetHeapOffsets();
-
-    enum class HeapDescriptorOffsetType
-    {
-      NONE,
-      VERTEX,
-      INDICES,
-      OBJECTS,
-      MATERIALS,
-      DIFFUSE_TEXTURES,
-      NORMAL_TEXTURES
-    };
-
-    int AllocateHeapDescriptorType(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor, UINT descriptorIndexToUse, HeapDescriptorOffsetType offset_type);
+    //glTF animation playback, every played frame restarts the accumulation
+    bool play_animations = true;
+    float animation_speed = 1.0f;
+    float animation_time = 0.0f;
 };
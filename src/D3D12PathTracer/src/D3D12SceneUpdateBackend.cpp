@@ -0,0 +1,90 @@
+#include "stdafx.h"
+#include "D3D12SceneUpdateBackend.h"
+
+D3D12SceneUpdateBackend::D3D12SceneUpdateBackend(D3D12RaytracingSimpleLighting* program_state)
+  : program_state(program_state)
+{
+}
+
+bool D3D12SceneUpdateBackend::IsFallback() const
+{
+  return program_state->m_raytracingAPI == D3D12RaytracingSimpleLighting::RaytracingAPI::FallbackLayer;
+}
+
+bool D3D12SceneUpdateBackend::HasBottomLevel(int model) const
+{
+  const auto& model_map = program_state->m_sceneLoaded->modelMap;
+  auto found = model_map.find(model);
+  return found != model_map.end() && found->second.is_m_bottomLevelAccelerationStructure_allocated;
+}
+
+void D3D12SceneUpdateBackend::RebuildAll()
+{
+  program_state->RebuildScene();
+}
+
+void D3D12SceneUpdateBackend::Begin()
+{
+  auto device_resources = program_state->GetDeviceResources();
+  program_state->m_sceneLoaded->UpdateTransforms();
+
+  ThrowIfFailed(device_resources->GetCommandList()->Reset(device_resources->GetCommandAllocator(), nullptr));
+  if (IsFallback())
+  {
+    ID3D12DescriptorHeap* pDescriptorHeaps[] = { program_state->GetDescriptorHeap().Get() };
+    program_state->m_fallbackCommandList->SetDescriptorHeaps(ARRAYSIZE(pDescriptorHeaps), pDescriptorHeaps);
+  }
+}
+
+void D3D12SceneUpdateBackend::Submit()
+{
+  program_state->GetDeviceResources()->ExecuteCommandList();
+  program_state->GetDeviceResources()->WaitForGpu();
+}
+
+void D3D12SceneUpdateBackend::UpdateDescriptors()
+{
+  program_state->m_sceneLoaded->AllocateResourcesInDescriptorHeap();
+}
+
+void D3D12SceneUpdateBackend::BuildBottomLevel(int model)
+{
+  program_state->m_sceneLoaded->RecordBottomLevelBuild(program_state->m_sceneLoaded->modelMap[model], IsFallback(),
+                                                       program_state->m_fallbackDevice, program_state->m_dxrDevice,
+                                                       program_state->m_fallbackCommandList, program_state->m_dxrCommandList);
+}
+
+void D3D12SceneUpdateBackend::RebuildInstances()
+{
+  Scene& scene = *program_state->m_sceneLoaded;
+  auto device = program_state->GetDeviceResources()->GetD3DDevice();
+  const bool is_fallback = IsFallback();
+
+  //the top level half of BuildAccelerationStructures, sized for the objects as they are now
+  scene.ResetTopLevel();
+  scene.GetTopLevelDesc();
+  scene.GetTopLevelPrebuildInfo(is_fallback, program_state->m_fallbackDevice, program_state->m_dxrDevice);
+  scene.GetTopLevelScratchAS(is_fallback, device, program_state->m_fallbackDevice, program_state->m_dxrDevice);
+  scene.GetTopAS(is_fallback, device, program_state->m_fallbackDevice, program_state->m_dxrDevice);
+  scene.GetInstanceDescriptors(is_fallback, program_state->m_fallbackDevice, program_state->m_dxrDevice);
+  program_state->m_fallbackTopLevelAccelerationStructurePointer =
+      scene.GetWrappedGPUPointer(is_fallback, program_state->m_fallbackDevice, program_state->m_dxrDevice);
+  scene.FinalizeTopLevel();
+
+  scene.RecordTopLevelBuild(is_fallback, program_state->m_fallbackCommandList, program_state->m_dxrCommandList);
+}
+
+void D3D12SceneUpdateBackend::WriteInstanceDesc(size_t object)
+{
+  program_state->m_sceneLoaded->WriteInstanceDesc(object, IsFallback(), program_state->m_fallbackDevice, program_state->m_dxrDevice);
+}
+
+void D3D12SceneUpdateBackend::UpdateTopLevel()
+{
+  program_state->m_sceneLoaded->RecordTopLevelBuild(IsFallback(), program_state->m_fallbackCommandList, program_state->m_dxrCommandList);
+}
+
+void D3D12SceneUpdateBackend::WriteObjectInfo(size_t object)
+{
+  program_state->m_sceneLoaded->WriteObjectInfo(program_state->m_sceneLoaded->objects[object]);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "SceneUpdates.h"
+
+class D3D12RaytracingSimpleLighting;
+
+// SceneUpdateBackend on the program's scene and raytracing API. A batch is
+// the device's command list reset onto the frame's allocator, so it runs
+// between frames, once the GPU is done with the last one; Submit executes it
+// and waits, as BuildAccelerationStructures does.
+class D3D12SceneUpdateBackend : public SceneUpdateBackend {
+public:
+  explicit D3D12SceneUpdateBackend(D3D12RaytracingSimpleLighting* program_state);
+
+  bool HasBottomLevel(int model) const override;
+  void RebuildAll() override;
+  // also moves the world transforms up to date
+  void Begin() override;
+  void Submit() override;
+  void UpdateDescriptors() override;
+  void BuildBottomLevel(int model) override;
+  void RebuildInstances() override;
+  void WriteInstanceDesc(size_t object) override;
+  void UpdateTopLevel() override;
+  void WriteObjectInfo(size_t object) override;
+
+private:
+  bool IsFallback() const;
+
+  D3D12RaytracingSimpleLighting* program_state;
+};
@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "D3D12UploadBackend.h"
+
+D3D12UploadBackend::D3D12UploadBackend(DX::DeviceResources* device_resources, UINT64 capacity)
+  : device_resources(device_resources), capacity(capacity)
+{
+  auto device = device_resources->GetD3DDevice();
+
+  ThrowIfFailed(device->CreateCommittedResource(
+    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+    D3D12_HEAP_FLAG_NONE,
+    &CD3DX12_RESOURCE_DESC::Buffer(capacity),
+    D3D12_RESOURCE_STATE_GENERIC_READ,
+    nullptr,
+    IID_PPV_ARGS(&buffer)));
+  buffer->SetName(L"Upload Ring");
+
+  // written by the CPU only, mapped until the ring goes away
+  CD3DX12_RANGE readRange(0, 0);
+  ThrowIfFailed(buffer->Map(0, &readRange, reinterpret_cast<void**>(&mapped)));
+
+  ThrowIfFailed(device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&allocator)));
+  allocator->SetName(L"Upload Ring Allocator");
+
+  ThrowIfFailed(device->CreateFence(fence_value, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&fence)));
+  fence_event.Attach(CreateEvent(nullptr, FALSE, FALSE, nullptr));
+  if (!fence_event.IsValid())
+  {
+    ThrowIfFailed(E_FAIL, L"CreateEvent failed.\n");
+  }
+}
+
+D3D12UploadBackend::~D3D12UploadBackend()
+{
+  buffer->Unmap(0, nullptr);
+}
+
+void D3D12UploadBackend::Begin()
+{
+  //the allocator's memory can only be reused once the GPU is past every batch recorded with it
+  if (fence->GetCompletedValue() == fence_value)
+  {
+    ThrowIfFailed(allocator->Reset());
+  }
+  ThrowIfFailed(device_resources->GetCommandList()->Reset(allocator.Get(), nullptr));
+}
+
+UINT64 D3D12UploadBackend::Submit()
+{
+  device_resources->ExecuteCommandList();
+  ThrowIfFailed(device_resources->GetCommandQueue()->Signal(fence.Get(), ++fence_value));
+  return fence_value;
+}
+
+UINT64 D3D12UploadBackend::CompletedFence()
+{
+  return fence->GetCompletedValue();
+}
+
+void D3D12UploadBackend::WaitForFence(UINT64 value)
+{
+  if (fence->GetCompletedValue() < value)
+  {
+    ThrowIfFailed(fence->SetEventOnCompletion(value, fence_event.Get()));
+    WaitForSingleObjectEx(fence_event.Get(), INFINITE, FALSE);
+  }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "UploadRing.h"
+
+// UploadRing backend on the device's command list and queue: one upload heap
+// buffer mapped for its whole life, and a fence of its own signalled after
+// each batch. Batches record with an allocator of their own, so the frame's
+// allocators can be reset without waiting on uploads still in flight.
+class D3D12UploadBackend : public UploadBackend {
+public:
+  D3D12UploadBackend(DX::DeviceResources* device_resources, UINT64 capacity);
+  ~D3D12UploadBackend() override;
+
+  UINT64 Capacity() const override { return capacity; }
+  BYTE* Data() override { return mapped; }
+  // resets the device's command list onto the upload allocator, copies go into it
+  void Begin() override;
+  UINT64 Submit() override;
+  UINT64 CompletedFence() override;
+  void WaitForFence(UINT64 value) override;
+
+  // the buffer allocation offsets point into, source of the copies
+  ID3D12Resource* Resource() const { return buffer.Get(); }
+
+private:
+  DX::DeviceResources* device_resources;
+  UINT64 capacity;
+  ComPtr<ID3D12Resource> buffer;
+  BYTE* mapped = nullptr;
+  ComPtr<ID3D12CommandAllocator> allocator;
+  ComPtr<ID3D12Fence> fence;
+  UINT64 fence_value = 0;
+  Microsoft::WRL::Wrappers::Event fence_event;
+};
@@ -0,0 +1,160 @@
+#include "stdafx.h"
+#include "DescriptorAllocator.h"
+
+#include <algorithm>
+
+DescriptorAllocator::DescriptorAllocator(std::vector<Category> categories)
+  : categories(std::move(categories))
+{
+  const size_t count = this->categories.size();
+  starts.resize(count);
+  used.resize(count);
+  free_slots.resize(count);
+  generations.resize(count);
+  live.resize(count);
+  for (size_t category = 0; category < count; category++)
+  {
+    const Category& layout = this->categories[category];
+    if (layout.tables == 0)
+    {
+      throw std::invalid_argument("descriptor category without tables");
+    }
+    starts[category] = total_descriptors;
+    total_descriptors += layout.capacity * layout.tables;
+    generations[category].assign(layout.capacity, 0);
+  }
+  Reset();
+}
+
+DescriptorAllocator::Handle DescriptorAllocator::Allocate(UINT32 category)
+{
+  if (category >= categories.size())
+  {
+    throw std::invalid_argument("no such descriptor category");
+  }
+  std::vector<UINT32>& free_list = free_slots[category];
+  if (free_list.empty())
+  {
+    throw std::runtime_error("descriptor category is full");
+  }
+
+  Handle handle;
+  handle.category = category;
+  handle.slot = free_list.back();
+  handle.generation = generations[category][handle.slot];
+  free_list.pop_back();
+  live[category][handle.slot] = true;
+  used[category]++;
+  return handle;
+}
+
+void DescriptorAllocator::Release(const Handle& handle)
+{
+  if (!IsLive(handle))
+  {
+    throw std::logic_error("releasing a descriptor slot that isn't held");
+  }
+  live[handle.category][handle.slot] = false;
+  generations[handle.category][handle.slot]++;
+  free_slots[handle.category].push_back(handle.slot);
+  used[handle.category]--;
+}
+
+void DescriptorAllocator::ReleaseAfter(const Handle& handle, UINT64 fence)
+{
+  if (!IsLive(handle))
+  {
+    throw std::logic_error("releasing a descriptor slot that isn't held");
+  }
+  for (const PendingRelease& release : pending)
+  {
+    if (release.handle.category == handle.category && release.handle.slot == handle.slot)
+    {
+      throw std::logic_error("descriptor slot released twice");
+    }
+  }
+  pending.push_back({ handle, fence });
+}
+
+size_t DescriptorAllocator::Retire(UINT64 completed, const std::function<void(const Handle&)>& retired)
+{
+  //fences are per frame and may come out of order, so every entry is looked at
+  size_t count = 0;
+  size_t kept = 0;
+  for (size_t i = 0; i < pending.size(); i++)
+  {
+    if (pending[i].fence <= completed)
+    {
+      if (retired)
+      {
+        retired(pending[i].handle);
+      }
+      Release(pending[i].handle);
+      count++;
+    }
+    else
+    {
+      pending[kept++] = pending[i];
+    }
+  }
+  pending.resize(kept);
+  return count;
+}
+
+void DescriptorAllocator::ReleaseAll(UINT32 category)
+{
+  pending.erase(std::remove_if(pending.begin(), pending.end(), [category](const PendingRelease& release)
+  {
+    return release.handle.category == category;
+  }), pending.end());
+
+  const UINT32 capacity = categories[category].capacity;
+  free_slots[category].clear();
+  //highest first so the lowest slot is at the back, handed out next
+  for (UINT32 slot = capacity; slot-- > 0;)
+  {
+    if (live[category][slot])
+    {
+      generations[category][slot]++;
+    }
+    free_slots[category].push_back(slot);
+  }
+  live[category].assign(capacity, false);
+  used[category] = 0;
+}
+
+void DescriptorAllocator::Reset()
+{
+  for (UINT32 category = 0; category < categories.size(); category++)
+  {
+    if (live[category].size() != categories[category].capacity)
+    {
+      live[category].assign(categories[category].capacity, false);
+    }
+    ReleaseAll(category);
+  }
+}
+
+bool DescriptorAllocator::IsLive(const Handle& handle) const
+{
+  return handle.category < categories.size() && handle.slot < categories[handle.category].capacity &&
+         live[handle.category][handle.slot] && generations[handle.category][handle.slot] == handle.generation;
+}
+
+UINT32 DescriptorAllocator::Index(const Handle& handle, UINT32 table) const
+{
+  if (!IsLive(handle))
+  {
+    throw std::logic_error("stale or unallocated descriptor handle");
+  }
+  return TableStart(handle.category, table) + handle.slot;
+}
+
+UINT32 DescriptorAllocator::TableStart(UINT32 category, UINT32 table) const
+{
+  if (category >= categories.size() || table >= categories[category].tables)
+  {
+    throw std::invalid_argument("no such descriptor table");
+  }
+  return starts[category] + table * categories[category].capacity;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// Hands out slots of a descriptor heap split into fixed ranges, one per
+// category. A category can span several parallel tables (a model's vertex,
+// index and tangent views sit at the same slot of three tables), so the shader
+// indexes each table with the one slot number. Freed slots go on the
+// category's free list and are handed out again; a slot keeps its index while
+// it is held. Every slot has a generation that moves on when it is freed, so a
+// stale handle is caught instead of silently pointing at someone else's
+// descriptor. Slots the GPU may still read can be released against a fence
+// and come back once Retire sees it complete. Indices only, writing
+// descriptors is the caller's job. Not thread safe.
+class DescriptorAllocator {
+public:
+  static constexpr UINT32 kNoSlot = 0xffffffff;
+
+  struct Category {
+    UINT32 capacity = 0; // slots
+    UINT32 tables = 1; // descriptors per slot, capacity apart
+  };
+
+  struct Handle {
+    UINT32 category = kNoSlot;
+    UINT32 slot = kNoSlot; // within the category, what the shader indexes
+    UINT32 generation = 0;
+
+    bool IsValid() const { return slot != kNoSlot; }
+  };
+
+  // categories are laid out one after another from the heap's start
+  explicit DescriptorAllocator(std::vector<Category> categories);
+
+  // lowest free slot of the category at first, most recently freed ones after
+  // that; throws when the category is full
+  Handle Allocate(UINT32 category);
+  // throws for a handle that isn't live
+  void Release(const Handle& handle);
+  // Release once fence completes: the slot stays held, and its descriptors
+  // are left alone, for the frames in flight. Throws for a handle that isn't
+  // live or is already waiting.
+  void ReleaseAfter(const Handle& handle, UINT64 fence);
+  // releases the slots waiting on a fence up to completed, calling retired
+  // on each just before (to null its descriptors, say); returns how many
+  size_t Retire(UINT64 completed, const std::function<void(const Handle&)>& retired = nullptr);
+  size_t PendingReleases() const { return pending.size(); }
+  // frees every slot of the category, for ones rebuilt as a whole, waiting or not
+  void ReleaseAll(UINT32 category);
+  void Reset();
+
+  // whether handle still holds its slot
+  bool IsLive(const Handle& handle) const;
+  // heap index of handle's descriptor in table
+  UINT32 Index(const Handle& handle, UINT32 table = 0) const;
+  // heap index of the first slot of the category's table, what a descriptor table points at
+  UINT32 TableStart(UINT32 category, UINT32 table = 0) const;
+
+  UINT32 CategoryCount() const { return static_cast<UINT32>(categories.size()); }
+  UINT32 Capacity(UINT32 category) const { return categories[category].capacity; }
+  UINT32 Used(UINT32 category) const { return used[category]; }
+  // descriptors every category takes up together
+  UINT32 TotalDescriptors() const { return total_descriptors; }
+
+private:
+  std::vector<Category> categories;
+  std::vector<UINT32> starts; // heap index of each category's first table
+  std::vector<UINT32> used;
+  std::vector<std::vector<UINT32>> free_slots; // per category, next one at the back
+  std::vector<std::vector<UINT32>> generations; // per category and slot
+  std::vector<std::vector<bool>> live;
+  struct PendingRelease {
+    Handle handle;
+    UINT64 fence;
+  };
+  std::vector<PendingRelease> pending; // in the order they were released
+  UINT32 total_descriptors = 0;
+};
@@ -69,6 +69,10 @@ namespace DX
         void Present(D3D12_RESOURCE_STATES beforeState = D3D12_RESOURCE_STATE_RENDER_TARGET);
         void ExecuteCommandList();
         void WaitForGpu() noexcept;
+        // Fence value the queue signals once the frame being recorded is done, so
+        // everything submitted so far is done by then too; compare with the completed value.
+        UINT64 GetFrameFenceValue() const { return m_fenceValues[m_backBufferIndex]; }
+        UINT64 GetCompletedFenceValue() const { return m_fence->GetCompletedValue(); }
 
         // Device Accessors.
         RECT GetOutputSize() const { return m_outputSize; }
@@ -0,0 +1,363 @@
+#include "stdafx.h"
+#include "GltfAccessor.h"
+#include "AssetLoader.h"
+#include "TangentFrames.h"
+#include "Utilities.h"
+#include <chrono>
+#include <filesystem>
+#include "include/stb_image.h"
+
+namespace
+{
+  template <typename T>
+  inline T Load(const BYTE* address)
+  {
+    //strides and offsets only have to be component aligned
+    T value;
+    memcpy(&value, address, sizeof(T));
+    return value;
+  }
+
+  // the buffer view of an accessor copied out of its buffer, as ParseGLTF did before the views
+  std::vector<unsigned char> CopyBufferView(const tinygltf::Model& model, const tinygltf::Accessor& accessor, size_t& stride)
+  {
+    const tinygltf::BufferView& buffer_view = model.bufferViews.at(accessor.bufferView);
+    const tinygltf::Buffer& buffer = model.buffers.at(buffer_view.buffer);
+    stride = static_cast<size_t>(accessor.ByteStride(buffer_view));
+    return std::vector<unsigned char>(buffer.data.begin() + buffer_view.byteOffset,
+                                      buffer.data.begin() + buffer_view.byteOffset + buffer_view.byteLength);
+  }
+
+  // the copying path kept for -gltfbench, with the accessor offsets and the index buffer view
+  // lookup fixed so it reads the same triangles; only float attributes are read, like before
+  size_t DecodeCopying(const std::string& path)
+  {
+    tinygltf::Model model;
+    tinygltf::TinyGLTF loader;
+    std::string err;
+    std::string warn;
+
+    //decodes every image to rgba8 like tinygltf's own loader, which frees the texels with free()
+    //while ImageDecoder routes stb's allocations through the TexelPool
+    loader.SetImageLoader([](tinygltf::Image* image, std::string*, std::string*, int, int, const unsigned char* bytes, int size, void*)
+    {
+      int width = 0;
+      int height = 0;
+      int components = 0;
+      unsigned char* texels = stbi_load_from_memory(bytes, size, &width, &height, &components, STBI_rgb_alpha);
+      if (texels == nullptr)
+      {
+        return false;
+      }
+      image->width = width;
+      image->height = height;
+      image->component = STBI_rgb_alpha;
+      image->image.assign(texels, texels + static_cast<size_t>(width) * height * STBI_rgb_alpha);
+      stbi_image_free(texels);
+      return true;
+    }, nullptr);
+
+    if (!loader.LoadASCIIFromFile(&model, &err, &warn, path))
+    {
+      throw std::runtime_error("failed to parse glTF " + path);
+    }
+
+    size_t triangles = 0;
+    for (const tinygltf::Mesh& mesh : model.meshes)
+    {
+      for (const tinygltf::Primitive& primitive : mesh.primitives)
+      {
+        if (primitive.mode != TINYGLTF_MODE_TRIANGLES || primitive.indices < 0)
+        {
+          continue;
+        }
+
+        const tinygltf::Accessor& index_accessor = model.accessors.at(primitive.indices);
+        size_t index_stride = 0;
+        const std::vector<unsigned char> index_data = CopyBufferView(model, index_accessor, index_stride);
+
+        std::vector<Vertex> vertices;
+        for (const auto& attribute : primitive.attributes)
+        {
+          const tinygltf::Accessor& accessor = model.accessors.at(attribute.second);
+          if (attribute.first != "POSITION" && attribute.first != "NORMAL" && attribute.first != "TEXCOORD_0")
+          {
+            continue;
+          }
+          size_t stride = 0;
+          const std::vector<unsigned char> data = CopyBufferView(model, accessor, stride);
+          vertices.resize(std::max<size_t>(vertices.size(), accessor.count));
+          for (size_t i = 0; i < accessor.count; i++)
+          {
+            const unsigned char* element = data.data() + accessor.byteOffset + i * stride;
+            Vertex& v = vertices[i];
+            if (attribute.first == "POSITION")
+            {
+              memcpy(&v.position, element, sizeof(v.position));
+            }
+            else if (attribute.first == "NORMAL")
+            {
+              memcpy(&v.normal, element, sizeof(v.normal));
+            }
+            else
+            {
+              memcpy(&v.texCoord, element, sizeof(v.texCoord));
+            }
+          }
+        }
+
+        std::vector<Index> indices(index_accessor.count);
+        const size_t index_size = static_cast<size_t>(tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(index_accessor.componentType)));
+        for (size_t i = 0; i < indices.size(); i++)
+        {
+          Index index{};
+          memcpy(&index, index_data.data() + index_accessor.byteOffset + i * index_stride, index_size);
+          indices[i] = index;
+        }
+
+        TangentFrames::Generate(vertices, indices);
+        triangles += indices.size() / 3;
+      }
+    }
+    return triangles;
+  }
+}
+
+GltfAccessor::View::View(const tinygltf::Model& model, int accessor_index)
+{
+  if (accessor_index < 0 || accessor_index >= static_cast<int>(model.accessors.size()))
+  {
+    throw std::runtime_error("glTF accessor index out of range");
+  }
+
+  const tinygltf::Accessor& accessor = model.accessors[accessor_index];
+  const int component_size = tinygltf::GetComponentSizeInBytes(static_cast<uint32_t>(accessor.componentType));
+  components = tinygltf::GetTypeSizeInBytes(static_cast<uint32_t>(accessor.type));
+  if (component_size <= 0 || components <= 0)
+  {
+    throw std::runtime_error("glTF accessor has an unknown type");
+  }
+
+  component_type = accessor.componentType;
+  normalized = accessor.normalized;
+  count = accessor.count;
+
+  //without a buffer view the accessor is all zeros
+  if (accessor.bufferView < 0)
+  {
+    return;
+  }
+  if (accessor.bufferView >= static_cast<int>(model.bufferViews.size()))
+  {
+    throw std::runtime_error("glTF accessor references a missing buffer view");
+  }
+
+  const tinygltf::BufferView& buffer_view = model.bufferViews[accessor.bufferView];
+  if (buffer_view.buffer < 0 || buffer_view.buffer >= static_cast<int>(model.buffers.size()))
+  {
+    throw std::runtime_error("glTF buffer view references a missing buffer");
+  }
+  const tinygltf::Buffer& buffer = model.buffers[buffer_view.buffer];
+
+  const int byte_stride = accessor.ByteStride(buffer_view);
+  if (byte_stride <= 0)
+  {
+    throw std::runtime_error("glTF accessor has an invalid byte stride");
+  }
+  stride = static_cast<size_t>(byte_stride);
+
+  const size_t element_size = static_cast<size_t>(component_size) * components;
+  const size_t view_bytes = count == 0 ? 0 : accessor.byteOffset + stride * (count - 1) + element_size;
+  if (view_bytes > buffer_view.byteLength || buffer_view.byteOffset + buffer_view.byteLength > buffer.data.size())
+  {
+    throw std::runtime_error("glTF accessor reads past the end of its buffer");
+  }
+
+  data = buffer.data.data() + buffer_view.byteOffset + accessor.byteOffset;
+}
+
+float GltfAccessor::View::Component(size_t element, int component) const
+{
+  if (data == nullptr || component >= components)
+  {
+    return 0.0f;
+  }
+
+  const BYTE* address = data + element * stride;
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_FLOAT:
+    return Load<float>(address + component * sizeof(float));
+  case TINYGLTF_COMPONENT_TYPE_DOUBLE:
+    return static_cast<float>(Load<double>(address + component * sizeof(double)));
+  case TINYGLTF_COMPONENT_TYPE_BYTE:
+  {
+    const float value = Load<INT8>(address + component);
+    return normalized ? std::max<float>(value / 127.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+  {
+    const float value = Load<UINT8>(address + component);
+    return normalized ? value / 255.0f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_SHORT:
+  {
+    const float value = Load<INT16>(address + component * sizeof(INT16));
+    return normalized ? std::max<float>(value / 32767.0f, -1.0f) : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+  {
+    const float value = Load<UINT16>(address + component * sizeof(UINT16));
+    return normalized ? value / 65535.0f : value;
+  }
+  case TINYGLTF_COMPONENT_TYPE_INT:
+    return static_cast<float>(Load<INT32>(address + component * sizeof(INT32)));
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return static_cast<float>(Load<UINT32>(address + component * sizeof(UINT32)));
+  default:
+    return 0.0f;
+  }
+}
+
+XMFLOAT2 GltfAccessor::View::Float2(size_t element) const
+{
+  return XMFLOAT2(Component(element, 0), Component(element, 1));
+}
+
+XMFLOAT3 GltfAccessor::View::Float3(size_t element) const
+{
+  return XMFLOAT3(Component(element, 0), Component(element, 1), Component(element, 2));
+}
+
+UINT32 GltfAccessor::View::Index(size_t element) const
+{
+  if (data == nullptr)
+  {
+    return 0;
+  }
+
+  const BYTE* address = data + element * stride;
+  switch (component_type)
+  {
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+    return Load<UINT8>(address);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT:
+    return Load<UINT16>(address);
+  case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT:
+    return Load<UINT32>(address);
+  default:
+    throw std::runtime_error("glTF index accessor must be an unsigned integer type");
+  }
+}
+
+std::vector<Index> GltfAccessor::ReadIndices(const tinygltf::Model& model, const tinygltf::Primitive& primitive)
+{
+  std::vector<Index> indices;
+  if (primitive.indices < 0)
+  {
+    const View positions = FindAttribute(model, primitive, "POSITION");
+    indices.resize(positions.Count());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      indices[i] = static_cast<Index>(i);
+    }
+    return indices;
+  }
+
+  const View view(model, primitive.indices);
+  indices.resize(view.Count());
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    indices[i] = view.Index(i);
+  }
+  return indices;
+}
+
+GltfAccessor::View GltfAccessor::FindAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const std::string& semantic)
+{
+  auto attribute = primitive.attributes.find(semantic);
+  if (attribute == primitive.attributes.end())
+  {
+    return View();
+  }
+  return View(model, attribute->second);
+}
+
+GltfAccessor::BenchmarkResult GltfAccessor::Benchmark(const std::string& path)
+{
+  BenchmarkResult result;
+  auto decode = [&]()
+  {
+    result.primitives = result.vertices = result.triangles = 0;
+    const tinygltf::Model model = AssetLoader::DecodeGltf(path);
+    for (const tinygltf::Mesh& mesh : model.meshes)
+    {
+      for (const tinygltf::Primitive& primitive : mesh.primitives)
+      {
+        const AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(model, primitive);
+        result.primitives += data.indices.empty() ? 0 : 1;
+        result.vertices += data.vertices.size();
+        result.triangles += data.indices.size() / 3;
+      }
+    }
+  };
+  decode();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  decode();
+  result.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+  //ParseGLTF only ever called LoadASCIIFromFile
+  result.copying_supported = std::filesystem::path(path).extension() == ".gltf";
+  if (result.copying_supported)
+  {
+    start = std::chrono::high_resolution_clock::now();
+    result.copying_triangles = DecodeCopying(path);
+    result.copying_milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  }
+  return result;
+}
+
+int GltfAccessor::RunBenchmark(const std::vector<std::string>& paths)
+{
+  const std::vector<std::string> files = paths.empty() ? AssetLoader::ShippedGltfModels() : paths;
+
+  std::wstringstream wstr;
+  size_t failed = 0;
+  double milliseconds = 0.0;
+  double copying_milliseconds = 0.0;
+  double compared_milliseconds = 0.0;
+  for (const std::string& file : files)
+  {
+    BenchmarkResult result;
+    try
+    {
+      result = Benchmark(file);
+    }
+    catch (const std::exception& e)
+    {
+      wstr << L"gltfbench: " << file.c_str() << L" failed: " << e.what() << L"\n";
+      failed++;
+      continue;
+    }
+
+    wstr << L"gltfbench: " << file.c_str() << L", " << result.primitives << L" primitives, " << result.vertices << L" vertices, "
+         << result.triangles << L" triangles, views " << result.milliseconds << L" ms";
+    if (result.copying_supported)
+    {
+      wstr << L", copying " << result.copying_milliseconds << L" ms";
+      if (result.copying_triangles != result.triangles)
+      {
+        wstr << L" (" << result.copying_triangles << L" triangles)";
+      }
+      compared_milliseconds += result.milliseconds;
+      copying_milliseconds += result.copying_milliseconds;
+    }
+    wstr << L"\n";
+    milliseconds += result.milliseconds;
+  }
+  wstr << L"gltfbench: " << files.size() << L" files in " << milliseconds << L" ms, the .gltf files take " << compared_milliseconds
+       << L" ms with views and " << copying_milliseconds << L" ms with the copying path, " << failed << L" failed\n";
+  utilityCore::report(wstr.str());
+  return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+// Typed, strided reads straight out of a glTF buffer. A View resolves an
+// accessor once (buffer view, both byte offsets, stride, component type)
+// and converts single elements on the fly, so attributes never have to be
+// copied out of the loaded buffer first. Normalized integer components are
+// mapped to [0, 1] / [-1, 1] as the spec describes, other integer
+// components are converted as plain numbers (quantized positions).
+namespace GltfAccessor {
+
+class View {
+public:
+  View() = default;
+  // throws if the accessor doesn't fit its buffer view and buffer
+  View(const tinygltf::Model& model, int accessor_index);
+
+  size_t Count() const { return count; }
+  int Components() const { return components; }
+  bool Empty() const { return count == 0; }
+
+  // missing components read as 0, an accessor without a buffer view reads all zeros
+  float Component(size_t element, int component) const;
+  XMFLOAT2 Float2(size_t element) const;
+  XMFLOAT3 Float3(size_t element) const;
+  // element of an unsigned integer scalar accessor
+  UINT32 Index(size_t element) const;
+
+private:
+  const BYTE* data = nullptr;
+  size_t count = 0;
+  size_t stride = 0;
+  int component_type = TINYGLTF_COMPONENT_TYPE_FLOAT;
+  int components = 0;
+  bool normalized = false;
+};
+
+// Index list of a triangle primitive, 0..n-1 when the primitive isn't indexed
+std::vector<Index> ReadIndices(const tinygltf::Model& model, const tinygltf::Primitive& primitive);
+
+// Attribute view by semantic (POSITION, NORMAL, TEXCOORD_0, ...), empty if absent
+View FindAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const std::string& semantic);
+
+struct BenchmarkResult
+{
+  size_t primitives = 0;
+  size_t vertices = 0;
+  size_t triangles = 0;
+  double milliseconds = 0.0; // AssetLoader::DecodeGltf and DecodeGltfPrimitive on every primitive
+  // the copying path ParseGLTF used before the views: tinygltf decodes the images and
+  // every attribute's buffer view is copied out before reading; .glb files it couldn't open are skipped
+  bool copying_supported = false;
+  double copying_milliseconds = 0.0;
+  size_t copying_triangles = 0;
+};
+// Times both paths on path after one untimed decode to warm the file cache
+BenchmarkResult Benchmark(const std::string& path);
+// -gltfbench [files...]: runs Benchmark on the files, AssetLoader::ShippedGltfModels() by default, and prints
+// the load times of both paths; no window or device is created. Returns 1 if a file fails to decode
+int RunBenchmark(const std::vector<std::string>& paths);
+} // namespace GltfAccessor
@@ -0,0 +1,378 @@
+#include "stdafx.h"
+#include "HeapSuballocator.h"
+#include "Utilities.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+
+namespace {
+// what TlsfAllocator keeps per block for us: category, log2 of the alignment, requested size
+UINT64 PackUser(HeapSuballocator::Category category, UINT64 alignment, UINT64 requested)
+{
+  UINT64 alignment_log = 0;
+  while ((1ull << alignment_log) < alignment)
+  {
+    alignment_log++;
+  }
+  return static_cast<UINT64>(category) | (alignment_log << 8) | (requested << 16);
+}
+
+HeapSuballocator::Category UserCategory(UINT64 user)
+{
+  return static_cast<HeapSuballocator::Category>(user & 0xff);
+}
+
+UINT64 UserAlignment(UINT64 user)
+{
+  return 1ull << ((user >> 8) & 0xff);
+}
+
+UINT64 UserRequested(UINT64 user)
+{
+  return user >> 16;
+}
+} // namespace
+
+const wchar_t* HeapSuballocator::Name(Category category)
+{
+  switch (category)
+  {
+  case Category::Vertices: return L"vertices";
+  case Category::Indices: return L"indices";
+  case Category::Textures: return L"textures";
+  case Category::Materials: return L"materials";
+  case Category::Infos: return L"infos";
+  default: return L"?";
+  }
+}
+
+HeapSuballocator::HeapSuballocator(UINT32 pool_count, UINT64 page_size, Callbacks callbacks)
+  : page_size(page_size), callbacks(std::move(callbacks)), pools(pool_count)
+{
+}
+
+HeapSuballocator::~HeapSuballocator()
+{
+  Reset();
+}
+
+UINT32 HeapSuballocator::AddPage(UINT32 pool, UINT64 size, bool dedicated)
+{
+  std::vector<std::unique_ptr<Page>>& pages = pools[pool];
+  const UINT32 index = static_cast<UINT32>(std::find(pages.begin(), pages.end(), nullptr) - pages.begin());
+  if (callbacks.create_page)
+  {
+    callbacks.create_page(pool, index, size);
+  }
+  if (index == pages.size())
+  {
+    pages.emplace_back();
+  }
+  pages[index] = std::make_unique<Page>(size, dedicated);
+  return index;
+}
+
+void HeapSuballocator::ReleasePage(UINT32 pool, UINT32 page)
+{
+  pools[pool][page].reset();
+  if (callbacks.release_page)
+  {
+    callbacks.release_page(pool, page);
+  }
+}
+
+HeapSuballocator::Allocation HeapSuballocator::Place(UINT32 pool, UINT32 page, Category category, UINT64 size, UINT64 alignment)
+{
+  Allocation allocation;
+  allocation.range = pools[pool][page]->tlsf.Allocate(size, alignment, PackUser(category, alignment, size));
+  if (!allocation.IsValid())
+  {
+    return allocation;
+  }
+  allocation.pool = pool;
+  allocation.page = page;
+  allocation.category = category;
+  allocation.requested = size;
+
+  CategoryStats& stats = category_stats[static_cast<size_t>(category)];
+  stats.allocations++;
+  stats.total_allocations++;
+  stats.requested_bytes += size;
+  stats.reserved_bytes += allocation.range.size;
+  stats.peak_allocations = std::max<size_t>(stats.peak_allocations, stats.allocations);
+  stats.peak_reserved_bytes = std::max<UINT64>(stats.peak_reserved_bytes, stats.reserved_bytes);
+  return allocation;
+}
+
+HeapSuballocator::Allocation HeapSuballocator::Allocate(UINT32 pool, Category category, UINT64 size, UINT64 alignment)
+{
+  if (pool >= pools.size() || alignment == 0 || (alignment & (alignment - 1)) != 0)
+  {
+    throw std::invalid_argument("bad heap pool or alignment");
+  }
+  alignment = std::max<UINT64>(alignment, TlsfAllocator::kGranularity);
+
+  if (size > page_size)
+  {
+    const UINT64 dedicated_size = (size + alignment - 1) & ~(alignment - 1);
+    return Place(pool, AddPage(pool, dedicated_size, true), category, size, alignment);
+  }
+
+  std::vector<std::unique_ptr<Page>>& pages = pools[pool];
+  for (UINT32 page = 0; page < pages.size(); page++)
+  {
+    //pages without that many free bytes in total can't have it in one piece
+    if (pages[page] && !pages[page]->dedicated && pages[page]->tlsf.Size() - pages[page]->tlsf.UsedBytes() >= size)
+    {
+      const Allocation allocation = Place(pool, page, category, size, alignment);
+      if (allocation.IsValid())
+      {
+        return allocation;
+      }
+    }
+  }
+
+  const Allocation allocation = Place(pool, AddPage(pool, page_size, false), category, size, alignment);
+  if (!allocation.IsValid())
+  {
+    throw std::logic_error("allocation doesn't fit an empty heap page");
+  }
+  return allocation;
+}
+
+void HeapSuballocator::Free(const Allocation& allocation)
+{
+  if (!allocation.IsValid() || allocation.pool >= pools.size() || allocation.page >= pools[allocation.pool].size() ||
+      !pools[allocation.pool][allocation.page])
+  {
+    throw std::logic_error("freeing a heap allocation that doesn't exist");
+  }
+  Page& page = *pools[allocation.pool][allocation.page];
+  page.tlsf.Free(allocation.range);
+
+  CategoryStats& stats = category_stats[static_cast<size_t>(allocation.category)];
+  stats.allocations--;
+  stats.requested_bytes -= allocation.requested;
+  stats.reserved_bytes -= allocation.range.size;
+
+  if (page.dedicated)
+  {
+    ReleasePage(allocation.pool, allocation.page);
+  }
+}
+
+void HeapSuballocator::Trim()
+{
+  for (UINT32 pool = 0; pool < pools.size(); pool++)
+  {
+    for (UINT32 page = 0; page < pools[pool].size(); page++)
+    {
+      if (pools[pool][page] && pools[pool][page]->tlsf.IsEmpty())
+      {
+        ReleasePage(pool, page);
+      }
+    }
+  }
+}
+
+void HeapSuballocator::Reset()
+{
+  for (UINT32 pool = 0; pool < pools.size(); pool++)
+  {
+    for (UINT32 page = 0; page < pools[pool].size(); page++)
+    {
+      if (pools[pool][page])
+      {
+        ReleasePage(pool, page);
+      }
+    }
+    pools[pool].clear();
+  }
+  for (CategoryStats& stats : category_stats)
+  {
+    stats.allocations = 0;
+    stats.requested_bytes = 0;
+    stats.reserved_bytes = 0;
+  }
+}
+
+std::vector<HeapSuballocator::Move> HeapSuballocator::PlanDefragmentation(UINT32 pool, UINT64 max_bytes)
+{
+  std::vector<Move> moves;
+  if (pool >= pools.size())
+  {
+    return moves;
+  }
+  std::vector<std::unique_ptr<Page>>& pages = pools[pool];
+
+  //the least used page is the cheapest to empty
+  UINT32 source = TlsfAllocator::kNoBlock;
+  size_t regular_pages = 0;
+  for (UINT32 page = 0; page < pages.size(); page++)
+  {
+    if (!pages[page] || pages[page]->dedicated)
+    {
+      continue;
+    }
+    regular_pages++;
+    if (!pages[page]->tlsf.IsEmpty() &&
+        (source == TlsfAllocator::kNoBlock || pages[page]->tlsf.UsedBytes() < pages[source]->tlsf.UsedBytes()))
+    {
+      source = page;
+    }
+  }
+  if (source == TlsfAllocator::kNoBlock || regular_pages < 2)
+  {
+    return moves;
+  }
+
+  UINT64 moved_bytes = 0;
+  for (const TlsfAllocator::Allocation& range : pages[source]->tlsf.Allocations())
+  {
+    if (moved_bytes + range.size > max_bytes)
+    {
+      break;
+    }
+
+    Move move;
+    move.from.pool = pool;
+    move.from.page = source;
+    move.from.category = UserCategory(range.user);
+    move.from.requested = UserRequested(range.user);
+    move.from.range = range;
+    for (UINT32 page = 0; page < pages.size() && !move.to.IsValid(); page++)
+    {
+      if (page != source && pages[page] && !pages[page]->dedicated)
+      {
+        move.to = Place(pool, page, move.from.category, move.from.requested, UserAlignment(range.user));
+      }
+    }
+    if (!move.to.IsValid())
+    {
+      break;
+    }
+    moved_bytes += range.size;
+    moves.push_back(move);
+  }
+  return moves;
+}
+
+HeapSuballocator::PoolStats HeapSuballocator::GetPoolStats(UINT32 pool) const
+{
+  PoolStats stats;
+  for (const std::unique_ptr<Page>& page : pools[pool])
+  {
+    if (page)
+    {
+      stats.pages++;
+      stats.dedicated_pages += page->dedicated ? 1 : 0;
+      stats.page_bytes += page->tlsf.Size();
+      stats.used_bytes += page->tlsf.UsedBytes();
+      stats.largest_free_block = std::max<UINT64>(stats.largest_free_block, page->tlsf.LargestFreeBlock());
+    }
+  }
+  return stats;
+}
+
+bool HeapSuballocator::Validate() const
+{
+  for (const auto& pages : pools)
+  {
+    for (const std::unique_ptr<Page>& page : pages)
+    {
+      if (page && !page->tlsf.Validate())
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+HeapSuballocator::BenchmarkResult HeapSuballocator::Benchmark(size_t allocations)
+{
+  //sizes of a typical scene: small buffers at 64KB alignment, textures at 4KB or 64KB
+  struct Request {
+    UINT32 pool;
+    UINT64 size;
+    UINT64 alignment;
+    size_t free_slot; // live allocation to free after this one, SIZE_MAX for none
+  };
+  std::mt19937_64 random(1234);
+  std::vector<Request> requests(allocations);
+  size_t live = 0;
+  for (Request& request : requests)
+  {
+    const bool texture = random() % 4 == 0;
+    request.pool = texture ? 1 : 0;
+    request.size = texture ? (4096ull << (random() % 12)) : (256 + random() % (1 << (8 + random() % 14)));
+    request.alignment = texture && request.size <= 65536 ? 4096 : 65536;
+    live++;
+    //past a working set of a few thousand every allocation also frees one
+    request.free_slot = live > 4096 || random() % 3 == 0 ? static_cast<size_t>(random() % live--) : SIZE_MAX;
+  }
+
+  BenchmarkResult result;
+  result.operations = allocations;
+  {
+    HeapSuballocator heap(2, 64ull << 20);
+    std::vector<Allocation> live_allocations;
+    live_allocations.reserve(allocations);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const Request& request : requests)
+    {
+      live_allocations.push_back(heap.Allocate(request.pool, Category::Vertices, request.size, request.alignment));
+      if (request.free_slot != SIZE_MAX)
+      {
+        heap.Free(live_allocations[request.free_slot]);
+        live_allocations[request.free_slot] = live_allocations.back();
+        live_allocations.pop_back();
+        result.operations++;
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    for (UINT32 pool = 0; pool < heap.PoolCount(); pool++)
+    {
+      result.pages += heap.GetPoolStats(pool).pages;
+      result.live_bytes += heap.GetPoolStats(pool).used_bytes;
+    }
+  }
+  {
+    std::vector<void*> live_blocks;
+    live_blocks.reserve(allocations);
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const Request& request : requests)
+    {
+      live_blocks.push_back(malloc(static_cast<size_t>(request.size)));
+      if (request.free_slot != SIZE_MAX)
+      {
+        free(live_blocks[request.free_slot]);
+        live_blocks[request.free_slot] = live_blocks.back();
+        live_blocks.pop_back();
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    result.malloc_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    for (void* block : live_blocks)
+    {
+      free(block);
+    }
+  }
+  return result;
+}
+
+int HeapSuballocator::RunBenchmark()
+{
+  std::wstringstream wstr;
+  for (size_t allocations : { 10000, 100000, 1000000 })
+  {
+    const BenchmarkResult result = Benchmark(allocations);
+    wstr << L"heapbench: " << result.operations << L" operations in " << result.milliseconds << L" ms, "
+         << result.operations / (result.milliseconds / 1000.0) / 1e6 << L" M/s (malloc " << result.malloc_milliseconds
+         << L" ms), " << result.pages << L" pages for " << result.live_bytes / (1024.0 * 1024.0) << L" MB live\n";
+  }
+  utilityCore::report(wstr.str());
+  return 0;
+}
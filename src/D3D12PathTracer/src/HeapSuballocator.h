@@ -0,0 +1,127 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "TlsfAllocator.h"
+
+// Carves large pages into allocations, the CPU side of placing resources in a
+// few big D3D12 heaps instead of one committed heap each. Pools keep apart
+// what can't share a heap (buffers and textures, default and upload memory);
+// each pool is a list of fixed size pages with a TlsfAllocator over every
+// one, plus a dedicated page for anything bigger than a page. The callbacks
+// create and release whatever backs a page. Statistics are kept per category
+// of resource. Not thread safe.
+class HeapSuballocator {
+public:
+  enum class Category {
+    Vertices, // vertex and tangent streams
+    Indices,
+    Textures,
+    Materials,
+    Infos, // per object constants
+    Count
+  };
+  static const wchar_t* Name(Category category);
+
+  struct Allocation {
+    UINT32 pool = 0;
+    UINT32 page = 0;
+    Category category = Category::Vertices;
+    UINT64 requested = 0; // size asked for, range.size is what it takes up
+    TlsfAllocator::Allocation range;
+
+    bool IsValid() const { return range.IsValid(); }
+  };
+
+  struct CategoryStats {
+    size_t allocations = 0;
+    size_t peak_allocations = 0;
+    size_t total_allocations = 0; // ever made
+    UINT64 requested_bytes = 0;
+    UINT64 reserved_bytes = 0; // requested_bytes plus rounding
+    UINT64 peak_reserved_bytes = 0;
+  };
+
+  struct PoolStats {
+    size_t pages = 0;
+    size_t dedicated_pages = 0;
+    UINT64 page_bytes = 0; // every page's size
+    UINT64 used_bytes = 0;
+    UINT64 largest_free_block = 0;
+  };
+
+  struct Callbacks {
+    // a page of pool came to be, back it with size bytes; throw to fail the allocation
+    std::function<void(UINT32 pool, UINT32 page, UINT64 size)> create_page;
+    std::function<void(UINT32 pool, UINT32 page)> release_page;
+  };
+
+  HeapSuballocator(UINT32 pool_count, UINT64 page_size, Callbacks callbacks = Callbacks());
+  ~HeapSuballocator();
+
+  HeapSuballocator(const HeapSuballocator&) = delete;
+  HeapSuballocator& operator=(const HeapSuballocator&) = delete;
+
+  // size bytes at a multiple of alignment in the first page of pool with room,
+  // a new page when none has. Throws if the page can't be created.
+  Allocation Allocate(UINT32 pool, Category category, UINT64 size, UINT64 alignment);
+  // a dedicated page goes away with its allocation, regular pages wait for Trim
+  void Free(const Allocation& allocation);
+  // releases the pages with nothing in them
+  void Trim();
+  // forgets every allocation and releases every page at once, for when all
+  // the resources in them are gone
+  void Reset();
+
+  // Defragmentation hook. A move of one allocation to another page.
+  struct Move {
+    Allocation from;
+    Allocation to; // already allocated
+  };
+  // Plans emptying the least used regular page of pool into free space in the
+  // other pages, up to max_bytes and without making new pages. Every to is
+  // allocated already: the owner recreates its resource there and copies it,
+  // then frees from once the GPU is done with it (or frees to to back out).
+  // Once all moves are done Trim releases the emptied page.
+  std::vector<Move> PlanDefragmentation(UINT32 pool, UINT64 max_bytes);
+
+  UINT64 PageSize() const { return page_size; }
+  UINT32 PoolCount() const { return static_cast<UINT32>(pools.size()); }
+  CategoryStats GetStats(Category category) const { return category_stats[static_cast<size_t>(category)]; }
+  PoolStats GetPoolStats(UINT32 pool) const;
+  // every page agrees with its TlsfAllocator; for tests
+  bool Validate() const;
+
+  struct BenchmarkResult {
+    size_t operations = 0; // allocations and frees
+    double milliseconds = 0.0;
+    double malloc_milliseconds = 0.0; // the same sequence through malloc and free
+    size_t pages = 0;
+    UINT64 live_bytes = 0; // in use at the end
+  };
+  // Throughput over a scene load like mix: a stream of allocations of
+  // buffer and texture sizes, a third of them freed again in random order
+  // until some 4096 are live, then one freed for every one made
+  static BenchmarkResult Benchmark(size_t allocations);
+  // -heapbench: runs Benchmark and prints the throughput, no window or device is created
+  static int RunBenchmark();
+
+private:
+  struct Page {
+    explicit Page(UINT64 size, bool dedicated) : tlsf(size), dedicated(dedicated) {}
+    TlsfAllocator tlsf;
+    bool dedicated;
+  };
+
+  UINT32 AddPage(UINT32 pool, UINT64 size, bool dedicated);
+  void ReleasePage(UINT32 pool, UINT32 page);
+  Allocation Place(UINT32 pool, UINT32 page, Category category, UINT64 size, UINT64 alignment);
+
+  UINT64 page_size;
+  Callbacks callbacks;
+  // released pages leave a hole so page numbers stay valid
+  std::vector<std::vector<std::unique_ptr<Page>>> pools;
+  CategoryStats category_stats[static_cast<size_t>(Category::Count)];
+};
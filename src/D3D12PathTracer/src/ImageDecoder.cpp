@@ -0,0 +1,235 @@
+#include "stdafx.h"
+#include "ImageDecoder.h"
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "TextureDiskCache.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include <cctype>
+#include <chrono>
+#include <future>
+
+//stb_image is compiled here so every buffer it allocates comes from TexelPool,
+//tinygltf links against this copy. The failure string is a shared global, so
+//it's left out to keep concurrent decodes from writing it.
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_NO_FAILURE_STRINGS
+#define STBI_MALLOC(size) TexelPool::Shared().Allocate(size)
+#define STBI_REALLOC(block, size) TexelPool::Shared().Reallocate(block, size)
+#define STBI_FREE(block) TexelPool::Shared().Free(block)
+#include "include/stb_image.h"
+
+namespace {
+AssetLoader::ImageData DecodeWithWic(const std::string& path)
+{
+  AssetLoader::ImageData image;
+  BYTE* texels = nullptr;
+
+  std::wstring wpath = utilityCore::string2wstring(path);
+  image.size = TextureLoader::LoadImageDataFromFile(&texels, image.desc, wpath.c_str(), image.bytes_per_row);
+  image.texels.reset(texels);
+
+  // make sure we have data
+  if (image.size <= 0)
+  {
+    throw std::runtime_error("failed to decode image " + path);
+  }
+
+  return image;
+}
+} // namespace
+
+AssetLoader::ImageData ImageDecoder::Decode(const std::string& path)
+{
+  MappedFile file(path);
+  if (!file.IsOpen())
+  {
+    throw std::runtime_error("can't open image " + path);
+  }
+  if (file.Size() > static_cast<size_t>(INT_MAX))
+  {
+    return DecodeWithWic(path);
+  }
+
+  const stbi_uc* bytes = reinterpret_cast<const stbi_uc*>(file.Data());
+  const int length = static_cast<int>(file.Size());
+
+  int width = 0;
+  int height = 0;
+  int components = 0;
+  void* texels = nullptr;
+  DXGI_FORMAT format;
+  //always four channels, the shaders read rgb and gray images shouldn't come out red
+  if (stbi_is_hdr_from_memory(bytes, length))
+  {
+    texels = stbi_loadf_from_memory(bytes, length, &width, &height, &components, 4);
+    format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+  }
+  else
+  {
+    texels = stbi_load_from_memory(bytes, length, &width, &height, &components, 4);
+    format = DXGI_FORMAT_R8G8B8A8_UNORM;
+  }
+  if (texels == nullptr)
+  {
+    return DecodeWithWic(path);
+  }
+
+  AssetLoader::ImageData image;
+  image.texels = std::unique_ptr<BYTE, AssetLoader::TexelDeleter>(static_cast<BYTE*>(texels), AssetLoader::TexelDeleter{ &TexelPool::Shared() });
+  image.bytes_per_row = width * TextureLoader::GetBitsPerPixel(format) / 8;
+  image.size = image.bytes_per_row * height;
+  image.desc = TextureLoader::DescribeTexture2D(width, height, format);
+  return image;
+}
+
+std::vector<AssetLoader::ImageData> ImageDecoder::DecodeAll(const std::vector<std::string>& paths, ThreadPool& pool)
+{
+  std::vector<std::future<AssetLoader::ImageData>> futures;
+  futures.reserve(paths.size());
+  for (const std::string& path : paths)
+  {
+    futures.emplace_back(pool.Submit([path]() { return Decode(path); }));
+  }
+
+  std::vector<AssetLoader::ImageData> images;
+  images.reserve(paths.size());
+  for (auto& future : futures)
+  {
+    images.push_back(future.get());
+  }
+  return images;
+}
+
+bool ImageDecoder::IsImagePath(const std::string& path)
+{
+  std::string extension = std::filesystem::path(path).extension().string();
+  for (char& c : extension)
+  {
+    c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+  }
+  return extension == ".jpg" || extension == ".jpeg" || extension == ".png" || extension == ".bmp" ||
+         extension == ".tga" || extension == ".hdr" || extension == ".psd" || extension == ".gif" ||
+         extension == ".pic" || extension == ".ppm" || extension == ".pgm";
+}
+
+std::vector<std::string> ImageDecoder::FindImages(const std::vector<std::string>& directories)
+{
+  std::vector<std::string> paths;
+  for (const std::string& directory : directories)
+  {
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+      if (it->is_regular_file() && IsImagePath(it->path().string()))
+      {
+        paths.push_back(it->path().string());
+      }
+    }
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+std::vector<ImageDecoder::BenchmarkRun> ImageDecoder::Benchmark(const std::vector<std::string>& directories, const std::vector<size_t>& thread_counts)
+{
+  const std::vector<std::string> paths = FindImages(directories);
+
+  //first pass untimed, so no run pays for reading the files from disk
+  DecodeAll(paths, ThreadPool::Shared());
+
+  std::vector<BenchmarkRun> runs;
+  for (size_t threads : thread_counts)
+  {
+    ThreadPool pool(threads);
+    const size_t reuses_before = TexelPool::Shared().GetStats().reuses;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<AssetLoader::ImageData> images = DecodeAll(paths, pool);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    BenchmarkRun run;
+    run.threads = threads;
+    run.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    run.images = images.size();
+    for (const AssetLoader::ImageData& image : images)
+    {
+      run.texel_bytes += image.size;
+    }
+    run.pool_reuses = TexelPool::Shared().GetStats().reuses - reuses_before;
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<std::future<AssetLoader::ImageData>> chains;
+    for (AssetLoader::ImageData& image : images)
+    {
+      chains.emplace_back(pool.Submit([&image, &pool]() { return MipChain::Generate(std::move(image), MipChain::Filter::Srgb, pool); }));
+    }
+    std::vector<AssetLoader::ImageData> mipped;
+    for (auto& chain : chains)
+    {
+      mipped.push_back(chain.get());
+      run.chain_bytes += mipped.back().size;
+    }
+    end = std::chrono::high_resolution_clock::now();
+    run.mip_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+    start = std::chrono::high_resolution_clock::now();
+    std::vector<std::future<UINT64>> compressed;
+    for (const AssetLoader::ImageData& chain : mipped)
+    {
+      compressed.emplace_back(pool.Submit([&chain, &pool]()
+      {
+        const BlockCompression::Codec codec = BlockCompression::ChooseCodec(chain, MipChain::Filter::Srgb);
+        return codec == BlockCompression::Codec::None ? UINT64(chain.size) : UINT64(BlockCompression::Compress(chain, codec, pool).size);
+      }));
+    }
+    for (auto& size : compressed)
+    {
+      run.compressed_bytes += size.get();
+    }
+    end = std::chrono::high_resolution_clock::now();
+    run.compress_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+    runs.push_back(run);
+  }
+  return runs;
+}
+
+int ImageDecoder::RunBenchmark(const std::vector<std::string>& directories)
+{
+  const std::vector<std::string> searched = directories.empty() ?
+    std::vector<std::string>{ "textures", "scenes/coffee_demo" } : directories;
+  const std::vector<BenchmarkRun> runs = Benchmark(searched, { 1, 4, 16 });
+
+  std::wstringstream wstr;
+  if (runs.empty() || runs.front().images == 0)
+  {
+    wstr << L"decodebench: no images found\n";
+    utilityCore::report(wstr.str());
+    return 1;
+  }
+
+  wstr << L"decodebench: " << runs.front().images << L" images, "
+       << runs.front().texel_bytes / (1024.0 * 1024.0) << L" MB of texels, "
+       << ThreadPool::DefaultThreadCount() << L" hardware threads\n";
+  for (const BenchmarkRun& run : runs)
+  {
+    wstr << L"  " << run.threads << L" threads: " << run.milliseconds << L" ms, "
+         << run.images / (run.milliseconds / 1000.0) << L" images/s, speedup "
+         << runs.front().milliseconds / run.milliseconds << L"x, "
+         << run.pool_reuses << L" pooled allocations reused, mips " << run.mip_milliseconds << L" ms for "
+         << run.chain_bytes / (1024.0 * 1024.0) << L" MB, BC " << run.compress_milliseconds << L" ms to "
+         << run.compressed_bytes / (1024.0 * 1024.0) << L" MB\n";
+  }
+
+  //startup with and without the texels already on disk, in a scratch cache
+  const TextureDiskCache::BenchmarkResult startup = TextureDiskCache::Benchmark(FindImages(searched), "cache/bench");
+  wstr << L"  disk cache on " << ThreadPool::Shared().Size() << L" threads: cold " << startup.cold_milliseconds
+       << L" ms (decode, mips, store), warm " << startup.warm_milliseconds << L" ms (load "
+       << startup.entry_bytes / (1024.0 * 1024.0) << L" MB), speedup "
+       << startup.cold_milliseconds / startup.warm_milliseconds << L"x\n";
+  utilityCore::report(wstr.str());
+  return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "AssetLoader.h"
+
+class ThreadPool;
+
+// stb_image in place of WIC for texture files. Files are read through a mapping
+// and decoded straight into TexelPool blocks: 8 bit images come out as
+// R8G8B8A8_UNORM, .hdr as R32G32B32A32_FLOAT, rows tightly packed. What
+// stb_image can't read (tiff, 12 bit jpeg, ...) still goes through
+// TextureLoader. Everything here can run on any thread.
+namespace ImageDecoder {
+
+// throws if the file can't be read or decoded
+AssetLoader::ImageData Decode(const std::string& path);
+// every path across the pool, results in path order; the first failure is rethrown
+std::vector<AssetLoader::ImageData> DecodeAll(const std::vector<std::string>& paths, ThreadPool& pool);
+
+// extensions stb_image reads
+bool IsImagePath(const std::string& path);
+// image files below the directories, sorted
+std::vector<std::string> FindImages(const std::vector<std::string>& directories);
+
+struct BenchmarkRun {
+  size_t threads = 0;
+  double milliseconds = 0.0;
+  size_t images = 0;
+  UINT64 texel_bytes = 0;
+  size_t pool_reuses = 0; // TexelPool allocations served without the heap
+  double mip_milliseconds = 0.0; // MipChain::Generate over the decoded images
+  UINT64 chain_bytes = 0; // texels with every mip level
+  double compress_milliseconds = 0.0; // BlockCompression::Compress over the chains that can be
+  UINT64 compressed_bytes = 0; // those chains once compressed, the others as they are
+};
+// Decodes every image below the directories once per thread count, each on a
+// pool of that size, after one untimed pass to warm the file cache. The decoded
+// images then get their mip chains and BC blocks on the same pool, one task per image.
+std::vector<BenchmarkRun> Benchmark(const std::vector<std::string>& directories, const std::vector<size_t>& thread_counts);
+// -decodebench [dirs...]: runs Benchmark and TextureDiskCache::Benchmark on the
+// texture folders and prints the times, no window or device is created
+int RunBenchmark(const std::vector<std::string>& directories);
+
+} // namespace ImageDecoder
@@ -0,0 +1,61 @@
+#include "stdafx.h"
+#include "IndexBuffer.h"
+
+DXGI_FORMAT IndexBuffer::ChooseFormat(size_t vertex_count)
+{
+  return vertex_count < 65536 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
+}
+
+UINT IndexBuffer::FormatSize(DXGI_FORMAT format)
+{
+  switch (format)
+  {
+  case DXGI_FORMAT_R16_UINT:
+    return sizeof(UINT16);
+  case DXGI_FORMAT_R32_UINT:
+    return sizeof(UINT32);
+  default:
+    throw std::runtime_error("unsupported index format");
+  }
+}
+
+std::vector<BYTE> IndexBuffer::Pack(const Index* indices, size_t count, DXGI_FORMAT format)
+{
+  std::vector<BYTE> packed;
+  if (format == DXGI_FORMAT_R32_UINT)
+  {
+    packed.resize(count * sizeof(UINT32));
+    memcpy(packed.data(), indices, packed.size());
+    return packed;
+  }
+
+  if (format != DXGI_FORMAT_R16_UINT)
+  {
+    throw std::runtime_error("unsupported index format");
+  }
+
+  //round up to an even count, the padding index is never fetched
+  packed.resize(((count + 1) & ~size_t(1)) * sizeof(UINT16), 0);
+  UINT16* out = reinterpret_cast<UINT16*>(packed.data());
+  for (size_t i = 0; i < count; i++)
+  {
+    if (indices[i] > 0xFFFF)
+    {
+      throw std::runtime_error("index doesn't fit in a 16 bit index buffer");
+    }
+    out[i] = static_cast<UINT16>(indices[i]);
+  }
+  return packed;
+}
+
+XMUINT3 IndexBuffer::FetchTriangle(const void* data, DXGI_FORMAT format, size_t triangle)
+{
+  if (format == DXGI_FORMAT_R16_UINT)
+  {
+    const UINT16* indices = static_cast<const UINT16*>(data) + triangle * 3;
+    return XMUINT3(indices[0], indices[1], indices[2]);
+  }
+
+  const UINT32* indices = static_cast<const UINT32*>(data) + triangle * 3;
+  return XMUINT3(indices[0], indices[1], indices[2]);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+
+#include <dxgiformat.h>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+// Index buffers are stored in the narrowest format that can address every
+// vertex of the model: 16 bit below 65,536 vertices, 32 bit otherwise.
+// The CPU side copy stays in Index (32 bit), only the GPU buffer is narrowed.
+namespace IndexBuffer {
+
+DXGI_FORMAT ChooseFormat(size_t vertex_count);
+
+// bytes per index, 2 or 4
+UINT FormatSize(DXGI_FORMAT format);
+
+// Indices converted to format. 16 bit buffers are padded with a zero index
+// to a multiple of 4 bytes so they can be bound as a raw (ByteAddressBuffer) view.
+std::vector<BYTE> Pack(const Index* indices, size_t count, DXGI_FORMAT format);
+
+// the three vertex indices of a triangle in a buffer of the given format
+XMUINT3 FetchTriangle(const void* data, DXGI_FORMAT format, size_t triangle);
+} // namespace IndexBuffer
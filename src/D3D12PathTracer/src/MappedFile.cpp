@@ -0,0 +1,95 @@
+#include "stdafx.h"
+#include "MappedFile.h"
+#include "Utilities.h"
+
+MappedFile::MappedFile(const std::string& path)
+{
+  Open(path);
+}
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if (this != &other)
+  {
+    Close();
+    std::swap(file, other.file);
+    std::swap(mapping, other.mapping);
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+  }
+  return *this;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+  Close();
+
+  std::wstring wpath = utilityCore::string2wstring(path);
+  file = CreateFileW(wpath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                     FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(file, &file_size))
+  {
+    Close();
+    return false;
+  }
+
+  size = static_cast<size_t>(file_size.QuadPart);
+
+  //an empty file can't be mapped, but it is still a valid (empty) file
+  if (size == 0)
+  {
+    return true;
+  }
+
+  mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr)
+  {
+    Close();
+    return false;
+  }
+
+  data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (data == nullptr)
+  {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void MappedFile::Close()
+{
+  if (data != nullptr)
+  {
+    UnmapViewOfFile(data);
+    data = nullptr;
+  }
+  if (mapping != nullptr)
+  {
+    CloseHandle(mapping);
+    mapping = nullptr;
+  }
+  if (file != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(file);
+    file = INVALID_HANDLE_VALUE;
+  }
+  size = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+// Read-only view of a whole file mapped into the address space
+class MappedFile {
+public:
+  MappedFile() = default;
+  explicit MappedFile(const std::string& path);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  bool Open(const std::string& path);
+  void Close();
+
+  bool IsOpen() const { return file != INVALID_HANDLE_VALUE; }
+  const char* Data() const { return data; }
+  size_t Size() const { return size; }
+
+private:
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+  const char* data = nullptr;
+  size_t size = 0;
+};
@@ -1,5 +1,6 @@
 ﻿#include "stdafx.h"
 #include "MeshLoader.h"
+#include "MeshOptimizer.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION 
 #include "include/tiny_obj_loader.h"
@@ -41,8 +42,16 @@ std::vector<Mesh> MeshLoader::load_obj(std::string base_path, std::string object
 
 		for (auto j = 0; j < obj_mesh.Indices.size(); j++)
 		{
-			mesh.vertex_indices.emplace_back(j);
+			mesh.vertex_indices.emplace_back(static_cast<Index>(obj_mesh.Indices[j]));
 		}
+
+		//share identical face corners
+		MeshOptimizer::WeldStats weld = MeshOptimizer::WeldVertices(mesh.vertices, mesh.vertex_indices);
+
+		std::wstringstream wstr;
+		wstr << L"Mesh " << convert_to_wide(mesh.name) << L" welded " << weld.vertices_before << L" -> " << weld.vertices_after
+			<< L" vertices, " << weld.bytes_before << L" -> " << weld.bytes_after << L" bytes\n";
+		OutputDebugStringW(wstr.str().c_str());
 		if (!obj_mesh.MeshMaterial.name.empty())
 		{
 			Material material{ 0, obj_mesh.MeshMaterial };
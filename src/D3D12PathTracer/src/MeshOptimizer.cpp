@@ -0,0 +1,461 @@
+#include "stdafx.h"
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include <chrono>
+
+size_t MeshOptimizer::VertexKeyHasher::operator()(const VertexKey& key) const
+{
+  //FNV-1a over the 32 bit words, then a final mix so the low bits are usable as a bucket index
+  UINT64 hash = 14695981039346656037ull;
+  for (UINT32 word : key.bits)
+  {
+    hash ^= word;
+    hash *= 1099511628211ull;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return static_cast<size_t>(hash);
+}
+
+MeshOptimizer::VertexKey MeshOptimizer::MakeVertexKey(const float (&values)[8])
+{
+  VertexKey key;
+  for (int i = 0; i < 8; i++)
+  {
+    //so that -0.0 and 0.0 weld together
+    const float value = values[i] == 0.0f ? 0.0f : values[i];
+    memcpy(&key.bits[i], &value, sizeof(UINT32));
+  }
+  return key;
+}
+
+namespace
+{
+  // spreads the low 10 bits of value so there are two zero bits between each
+  UINT32 Part1By2(UINT32 value)
+  {
+    value &= 0x000003ff;
+    value = (value ^ (value << 16)) & 0xff0000ff;
+    value = (value ^ (value << 8)) & 0x0300f00f;
+    value = (value ^ (value << 4)) & 0x030c30c3;
+    value = (value ^ (value << 2)) & 0x09249249;
+    return value;
+  }
+
+  // 30 bit Morton code of each triangle's centroid within the mesh bounds
+  std::vector<UINT32> TriangleMortonCodes(const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+  {
+    const size_t triangle_count = indices.size() / 3;
+
+    std::vector<XMFLOAT3> centroids(triangle_count);
+    XMFLOAT3 lower(FLT_MAX, FLT_MAX, FLT_MAX);
+    XMFLOAT3 upper(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t t = 0; t < triangle_count; t++)
+    {
+      const XMFLOAT3& a = vertices[indices[t * 3]].position;
+      const XMFLOAT3& b = vertices[indices[t * 3 + 1]].position;
+      const XMFLOAT3& c = vertices[indices[t * 3 + 2]].position;
+      XMFLOAT3& centroid = centroids[t];
+      centroid = XMFLOAT3((a.x + b.x + c.x) / 3.0f, (a.y + b.y + c.y) / 3.0f, (a.z + b.z + c.z) / 3.0f);
+
+      lower = XMFLOAT3(std::min<float>(lower.x, centroid.x), std::min<float>(lower.y, centroid.y), std::min<float>(lower.z, centroid.z));
+      upper = XMFLOAT3(std::max<float>(upper.x, centroid.x), std::max<float>(upper.y, centroid.y), std::max<float>(upper.z, centroid.z));
+    }
+
+    auto quantize = [](float value, float low, float high)
+    {
+      const float extent = high - low;
+      const float normalized = extent > 0.0f ? (value - low) / extent : 0.0f;
+      return static_cast<UINT32>(std::min<float>(std::max<float>(normalized * 1024.0f, 0.0f), 1023.0f));
+    };
+
+    std::vector<UINT32> codes(triangle_count);
+    for (size_t t = 0; t < triangle_count; t++)
+    {
+      const XMFLOAT3& centroid = centroids[t];
+      codes[t] = (Part1By2(quantize(centroid.x, lower.x, upper.x)) << 2) |
+                 (Part1By2(quantize(centroid.y, lower.y, upper.y)) << 1) |
+                 Part1By2(quantize(centroid.z, lower.z, upper.z));
+    }
+    return codes;
+  }
+
+  std::vector<UINT32> MortonTriangleOrder(const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+  {
+    std::vector<UINT32> codes = TriangleMortonCodes(vertices, indices);
+    std::vector<UINT32> order(codes.size());
+    for (UINT32 t = 0; t < order.size(); t++)
+    {
+      order[t] = t;
+    }
+    //stable so triangles in the same cell keep their file order
+    std::stable_sort(order.begin(), order.end(), [&codes](UINT32 a, UINT32 b) { return codes[a] < codes[b]; });
+    return order;
+  }
+
+  // set associative LRU cache of 64 byte lines, 64 sets x 8 ways = 32KB
+  class LineCache
+  {
+  public:
+    // true on a miss
+    bool Access(UINT64 address)
+    {
+      const UINT64 line = address / kLineSize;
+      UINT64* set = &tags[(line % kSets) * kWays];
+
+      for (int way = 0; way < kWays; way++)
+      {
+        if (set[way] == line + 1)
+        {
+          //move to front
+          std::rotate(set, set + way, set + way + 1);
+          return false;
+        }
+      }
+
+      //evict the least recently used line (the last way)
+      std::rotate(set, set + kWays - 1, set + kWays);
+      set[0] = line + 1;
+      return true;
+    }
+
+  private:
+    static constexpr UINT64 kLineSize = 64;
+    static constexpr int kSets = 64;
+    static constexpr int kWays = 8;
+
+    UINT64 tags[kSets * kWays] = {}; // line + 1, 0 is empty
+  };
+
+  constexpr size_t kVertexCacheSize = 32;
+
+  // Forsyth's scoring, see "Linear-Speed Vertex Cache Optimisation"
+  float VertexScore(int cache_position, UINT32 remaining_triangles)
+  {
+    if (remaining_triangles == 0)
+    {
+      return -1.0f;
+    }
+
+    float score = 0.0f;
+    if (cache_position >= 0)
+    {
+      if (cache_position < 3)
+      {
+        //the last triangle's vertices, deliberately not the highest score
+        score = 0.75f;
+      }
+      else
+      {
+        const float scaler = 1.0f / (kVertexCacheSize - 3);
+        score = powf(1.0f - (cache_position - 3) * scaler, 1.5f);
+      }
+    }
+
+    //bonus for vertices with few triangles left, so they get finished off
+    score += 2.0f * powf(static_cast<float>(remaining_triangles), -0.5f);
+    return score;
+  }
+}
+
+const wchar_t* MeshOptimizer::ToString(TriangleOrder order)
+{
+  switch (order)
+  {
+  case TriangleOrder::File: return L"file";
+  case TriangleOrder::Morton: return L"morton";
+  case TriangleOrder::VertexCache: return L"vertex cache";
+  }
+  return L"unknown";
+}
+
+MeshOptimizer::CacheStats MeshOptimizer::SimulateCache(const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+{
+  CacheStats stats;
+  const size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+  {
+    return stats;
+  }
+
+  //post transform FIFO in buffer order
+  std::vector<size_t> fifo_stamp(vertices.size(), 0);
+  size_t transforms = 0;
+  for (Index index : indices)
+  {
+    //a vertex is still cached if fewer than kVertexCacheSize transforms happened since it went in
+    if (fifo_stamp[index] == 0 || transforms - fifo_stamp[index] + 1 > kVertexCacheSize)
+    {
+      fifo_stamp[index] = ++transforms;
+    }
+  }
+  stats.acmr = static_cast<double>(transforms) / triangle_count;
+
+  //attribute fetch in spatial order
+  LineCache cache;
+  size_t index_misses = 0;
+  size_t vertex_misses = 0;
+  for (UINT32 t : MortonTriangleOrder(vertices, indices))
+  {
+    const UINT64 index_address = UINT64(t) * 3 * sizeof(Index);
+    //a triangle's indices can straddle two lines
+    index_misses += cache.Access(index_address);
+    if ((index_address + 3 * sizeof(Index) - 1) / 64 != index_address / 64)
+    {
+      index_misses += cache.Access(index_address + 3 * sizeof(Index) - 1);
+    }
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+      //separate address range for the vertex buffer
+      const UINT64 vertex_address = (UINT64(1) << 40) + UINT64(indices[t * 3 + corner]) * sizeof(Vertex);
+      vertex_misses += cache.Access(vertex_address);
+    }
+  }
+  stats.index_line_misses = static_cast<double>(index_misses) / triangle_count;
+  stats.vertex_line_misses = static_cast<double>(vertex_misses) / triangle_count;
+  return stats;
+}
+
+void MeshOptimizer::SortTrianglesMorton(const std::vector<Vertex>& vertices, std::vector<Index>& indices)
+{
+  std::vector<UINT32> order = MortonTriangleOrder(vertices, indices);
+
+  std::vector<Index> sorted(indices.size());
+  for (size_t t = 0; t < order.size(); t++)
+  {
+    memcpy(&sorted[t * 3], &indices[order[t] * 3], 3 * sizeof(Index));
+  }
+  indices = std::move(sorted);
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<Index>& indices, size_t vertex_count)
+{
+  const size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0)
+  {
+    return;
+  }
+
+  //triangles using each vertex, as offsets into one shared array
+  std::vector<UINT32> remaining(vertex_count, 0);
+  for (Index index : indices)
+  {
+    remaining[index]++;
+  }
+  std::vector<UINT32> first_triangle(vertex_count + 1, 0);
+  for (size_t v = 0; v < vertex_count; v++)
+  {
+    first_triangle[v + 1] = first_triangle[v] + remaining[v];
+  }
+  std::vector<UINT32> vertex_triangles(indices.size());
+  {
+    std::vector<UINT32> fill(first_triangle.begin(), first_triangle.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      vertex_triangles[fill[indices[i]]++] = static_cast<UINT32>(i / 3);
+    }
+  }
+
+  std::vector<int> cache_position(vertex_count, -1);
+  std::vector<float> vertex_score(vertex_count);
+  for (size_t v = 0; v < vertex_count; v++)
+  {
+    vertex_score[v] = VertexScore(-1, remaining[v]);
+  }
+
+  std::vector<bool> emitted(triangle_count, false);
+
+  std::vector<Index> output;
+  output.reserve(indices.size());
+
+  std::vector<Index> cache;
+  std::vector<Index> new_cache;
+  size_t scan_cursor = 0;
+  int best_triangle = -1;
+
+  for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++)
+  {
+    if (best_triangle < 0)
+    {
+      //nothing useful in the cache, take the next triangle that's left
+      while (emitted[scan_cursor])
+      {
+        scan_cursor++;
+      }
+      best_triangle = static_cast<int>(scan_cursor);
+    }
+
+    const Index* triangle = &indices[best_triangle * 3];
+    output.insert(output.end(), triangle, triangle + 3);
+    emitted[best_triangle] = true;
+
+    //the emitted triangle's vertices go to the front of the cache
+    new_cache.assign(triangle, triangle + 3);
+    for (Index index : cache)
+    {
+      if (index != triangle[0] && index != triangle[1] && index != triangle[2])
+      {
+        new_cache.push_back(index);
+      }
+    }
+
+    for (int corner = 0; corner < 3; corner++)
+    {
+      const Index v = triangle[corner];
+      UINT32* begin = &vertex_triangles[first_triangle[v]];
+      UINT32* end = begin + remaining[v];
+      std::remove(begin, end, static_cast<UINT32>(best_triangle));
+      remaining[v]--;
+    }
+
+    for (size_t i = 0; i < new_cache.size(); i++)
+    {
+      const Index v = new_cache[i];
+      cache_position[v] = i < kVertexCacheSize ? static_cast<int>(i) : -1;
+      vertex_score[v] = VertexScore(cache_position[v], remaining[v]);
+    }
+    if (new_cache.size() > kVertexCacheSize)
+    {
+      new_cache.resize(kVertexCacheSize);
+    }
+    std::swap(cache, new_cache);
+
+    //only triangles touching the cache changed score
+    best_triangle = -1;
+    float best_score = -1.0f;
+    for (Index v : cache)
+    {
+      for (UINT32 i = 0; i < remaining[v]; i++)
+      {
+        const UINT32 t = vertex_triangles[first_triangle[v] + i];
+        const float score = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+        if (score > best_score)
+        {
+          best_score = score;
+          best_triangle = static_cast<int>(t);
+        }
+      }
+    }
+  }
+
+  indices = std::move(output);
+}
+
+void MeshOptimizer::ReorderVerticesFirstUse(std::vector<Vertex>& vertices, std::vector<Index>& indices)
+{
+  const Index unassigned = (std::numeric_limits<Index>::max)();
+  std::vector<Index> remap(vertices.size(), unassigned);
+
+  std::vector<Vertex> reordered;
+  reordered.reserve(vertices.size());
+  for (Index& index : indices)
+  {
+    if (remap[index] == unassigned)
+    {
+      remap[index] = static_cast<Index>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices = std::move(reordered);
+}
+
+void MeshOptimizer::OptimizeTriangleOrder(TriangleOrder order, std::vector<Vertex>& vertices, std::vector<Index>& indices)
+{
+  switch (order)
+  {
+  case TriangleOrder::File:
+    return;
+  case TriangleOrder::Morton:
+    SortTrianglesMorton(vertices, indices);
+    break;
+  case TriangleOrder::VertexCache:
+    OptimizeVertexCache(indices, vertices.size());
+    break;
+  }
+  ReorderVerticesFirstUse(vertices, indices);
+}
+
+MeshOptimizer::BenchmarkResult MeshOptimizer::Benchmark(const std::string& path, ThreadPool& pool)
+{
+  ObjParser::Mesh mesh = ObjParser::Parse(path, pool);
+  WeldVertices(mesh.vertices, mesh.indices);
+
+  BenchmarkResult result;
+  result.triangles = mesh.indices.size() / 3;
+  result.file_order = SimulateCache(mesh.vertices, mesh.indices);
+  for (TriangleOrder order : { TriangleOrder::Morton, TriangleOrder::VertexCache })
+  {
+    std::vector<Vertex> vertices = mesh.vertices;
+    std::vector<Index> indices = mesh.indices;
+    ModeResult mode;
+    mode.order = order;
+    auto start = std::chrono::high_resolution_clock::now();
+    OptimizeTriangleOrder(order, vertices, indices);
+    auto end = std::chrono::high_resolution_clock::now();
+    mode.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+    mode.cache = SimulateCache(vertices, indices);
+    result.modes.push_back(mode);
+  }
+  return result;
+}
+
+int MeshOptimizer::RunBenchmark(const std::vector<std::string>& paths)
+{
+  const std::vector<std::string> files = paths.empty() ? ObjParser::ShippedModels() : paths;
+
+  std::wstringstream wstr;
+  auto print = [&wstr](const wchar_t* name, const CacheStats& cache, size_t triangles)
+  {
+    const double scale = 1.0 / std::max<size_t>(triangles, 1);
+    wstr << L"  " << name << L": acmr " << cache.acmr * scale << L", index misses/tri " << cache.index_line_misses * scale
+         << L", vertex misses/tri " << cache.vertex_line_misses * scale;
+  };
+
+  //per triangle stats weighted by triangle count, divided back out when printed
+  size_t total_triangles = 0;
+  CacheStats total_file_order;
+  std::vector<ModeResult> total_modes;
+  auto accumulate = [](CacheStats& total, const CacheStats& cache, size_t triangles)
+  {
+    total.acmr += cache.acmr * triangles;
+    total.index_line_misses += cache.index_line_misses * triangles;
+    total.vertex_line_misses += cache.vertex_line_misses * triangles;
+  };
+
+  for (const std::string& file : files)
+  {
+    const BenchmarkResult result = Benchmark(file, ThreadPool::Shared());
+    wstr << L"meshbench: " << file.c_str() << L", " << result.triangles << L" triangles\n";
+    print(ToString(TriangleOrder::File), result.file_order, 1);
+    wstr << L"\n";
+    total_triangles += result.triangles;
+    accumulate(total_file_order, result.file_order, result.triangles);
+    total_modes.resize(result.modes.size());
+    for (size_t i = 0; i < result.modes.size(); i++)
+    {
+      const ModeResult& mode = result.modes[i];
+      print(ToString(mode.order), mode.cache, 1);
+      wstr << L" in " << mode.milliseconds << L" ms\n";
+      total_modes[i].order = mode.order;
+      total_modes[i].milliseconds += mode.milliseconds;
+      accumulate(total_modes[i].cache, mode.cache, result.triangles);
+    }
+  }
+
+  wstr << L"meshbench: " << files.size() << L" files, " << total_triangles << L" triangles\n";
+  print(ToString(TriangleOrder::File), total_file_order, total_triangles);
+  wstr << L"\n";
+  for (const ModeResult& mode : total_modes)
+  {
+    print(ToString(mode.order), mode.cache, total_triangles);
+    wstr << L" in " << mode.milliseconds << L" ms\n";
+  }
+  utilityCore::report(wstr.str());
+  return 0;
+}
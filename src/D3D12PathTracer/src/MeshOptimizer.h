@@ -0,0 +1,147 @@
+#pragma once
+
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+class ThreadPool;
+
+// CPU side mesh passes run on imported geometry before it is uploaded.
+// Welding is templated on the vertex/index types so Model::Mesh can use it
+// too (vertices need position, normal and texCoord); the ordering passes work
+// on the scene's Vertex/Index.
+namespace MeshOptimizer {
+
+struct WeldStats
+{
+  size_t vertices_before = 0;
+  size_t vertices_after = 0;
+  size_t bytes_before = 0; // vertex + index buffer
+  size_t bytes_after = 0;
+};
+
+// Bit pattern of (position, normal, texcoord), -0.0 is folded into 0.0
+struct VertexKey
+{
+  UINT32 bits[8];
+
+  bool operator==(const VertexKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct VertexKeyHasher
+{
+  size_t operator()(const VertexKey& key) const;
+};
+
+VertexKey MakeVertexKey(const float (&values)[8]);
+
+template<typename VertexType>
+VertexKey MakeVertexKey(const VertexType& vertex)
+{
+  const float values[8] = {
+    vertex.position.x, vertex.position.y, vertex.position.z,
+    vertex.normal.x, vertex.normal.y, vertex.normal.z,
+    vertex.texCoord.x, vertex.texCoord.y
+  };
+  return MakeVertexKey(values);
+}
+
+// Collapses identical vertices into one shared entry and rewrites the
+// indices to point at it. Vertex order is kept (first occurrence wins).
+template<typename VertexType, typename IndexType>
+WeldStats WeldVertices(std::vector<VertexType>& vertices, std::vector<IndexType>& indices)
+{
+  WeldStats stats;
+  stats.vertices_before = vertices.size();
+  stats.bytes_before = vertices.size() * sizeof(VertexType) + indices.size() * sizeof(IndexType);
+
+  std::unordered_map<VertexKey, size_t, VertexKeyHasher> unique_vertices;
+  unique_vertices.reserve(vertices.size());
+
+  std::vector<size_t> remap(vertices.size());
+  size_t unique_count = 0;
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    auto inserted = unique_vertices.emplace(MakeVertexKey(vertices[i]), unique_count);
+    if (inserted.second)
+    {
+      //compacting in place is safe, the write position never passes the read position
+      vertices[unique_count++] = vertices[i];
+    }
+    remap[i] = inserted.first->second;
+  }
+
+  if (unique_count > 0 && unique_count - 1 > (std::numeric_limits<IndexType>::max)())
+  {
+    throw std::runtime_error("welded mesh has too many vertices for its index type");
+  }
+
+  vertices.resize(unique_count);
+  vertices.shrink_to_fit();
+  for (IndexType& index : indices)
+  {
+    index = static_cast<IndexType>(remap[index]);
+  }
+
+  stats.vertices_after = vertices.size();
+  stats.bytes_after = vertices.size() * sizeof(VertexType) + indices.size() * sizeof(IndexType);
+  return stats;
+}
+
+// Triangle orders the import path can produce. Both reorder modes finish by
+// renumbering vertices in first-use order.
+enum class TriangleOrder
+{
+  File, // as written in the source file
+  Morton, // sorted by the Morton code of the triangle centroids
+  VertexCache // Forsyth's linear-speed vertex cache optimisation
+};
+
+const wchar_t* ToString(TriangleOrder order);
+
+// Result of a cache simulation over one mesh
+struct CacheStats
+{
+  double acmr = 0.0; // vertex transforms per triangle through a FIFO post-transform cache
+  double index_line_misses = 0.0; // index buffer cache line misses per triangle
+  double vertex_line_misses = 0.0; // vertex buffer cache line misses per triangle
+};
+
+// acmr walks the triangles in buffer order. The cache line misses walk them in
+// spatial (centroid Morton) order, which is roughly how coherent rays visit them
+// during closest hit attribute fetch, through a 32KB 8-way LRU cache of 64B lines.
+CacheStats SimulateCache(const std::vector<Vertex>& vertices, const std::vector<Index>& indices);
+
+void SortTrianglesMorton(const std::vector<Vertex>& vertices, std::vector<Index>& indices);
+void OptimizeVertexCache(std::vector<Index>& indices, size_t vertex_count);
+
+// Renumbers vertices in the order the index buffer first references them,
+// vertices that are never referenced are dropped
+void ReorderVerticesFirstUse(std::vector<Vertex>& vertices, std::vector<Index>& indices);
+
+void OptimizeTriangleOrder(TriangleOrder order, std::vector<Vertex>& vertices, std::vector<Index>& indices);
+
+struct ModeResult
+{
+  TriangleOrder order = TriangleOrder::File;
+  CacheStats cache;
+  double milliseconds = 0.0; // OptimizeTriangleOrder alone
+};
+
+struct BenchmarkResult
+{
+  size_t triangles = 0;
+  CacheStats file_order; // welded, as DecodeObj sees the mesh before reordering
+  std::vector<ModeResult> modes; // Morton and VertexCache
+};
+// Parses and welds an OBJ like DecodeObj, then simulates the cache in file
+// order and after each reorder mode
+BenchmarkResult Benchmark(const std::string& path, ThreadPool& pool);
+// -meshbench [files...]: runs Benchmark on the files, every shipped OBJ by default,
+// and prints the cache stats before and after each mode plus triangle weighted
+// totals; no window or device is created
+int RunBenchmark(const std::vector<std::string>& paths);
+} // namespace MeshOptimizer
@@ -0,0 +1,854 @@
+#include "stdafx.h"
+#include "MeshSimplifier.h"
+#include "MeshOptimizer.h"
+#include "ThreadPool.h"
+#include "VertexPacking.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
+
+namespace
+{
+  struct Vec3
+  {
+    double x, y, z;
+  };
+
+  inline Vec3 ToVec3(const XMFLOAT3& v) { return { v.x, v.y, v.z }; }
+  inline Vec3 operator+(Vec3 a, Vec3 b) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+  inline Vec3 operator-(Vec3 a, Vec3 b) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+  inline Vec3 operator*(Vec3 a, double s) { return { a.x * s, a.y * s, a.z * s }; }
+  inline double Dot(Vec3 a, Vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+  inline Vec3 Cross(Vec3 a, Vec3 b) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+  inline double Length(Vec3 a) { return std::sqrt(Dot(a, a)); }
+
+  // sum of weighted squared distances to a set of planes, as a symmetric 4x4 matrix
+  struct Quadric
+  {
+    double a2 = 0.0, ab = 0.0, ac = 0.0, ad = 0.0;
+    double b2 = 0.0, bc = 0.0, bd = 0.0;
+    double c2 = 0.0, cd = 0.0;
+    double d2 = 0.0;
+    double weight = 0.0; // sum of the plane weights
+
+    // normal has to be unit length
+    void AddPlane(Vec3 normal, double d, double weight)
+    {
+      a2 += weight * normal.x * normal.x; ab += weight * normal.x * normal.y; ac += weight * normal.x * normal.z; ad += weight * normal.x * d;
+      b2 += weight * normal.y * normal.y; bc += weight * normal.y * normal.z; bd += weight * normal.y * d;
+      c2 += weight * normal.z * normal.z; cd += weight * normal.z * d;
+      d2 += weight * d * d;
+      this->weight += weight;
+    }
+
+    void Add(const Quadric& other)
+    {
+      a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad;
+      b2 += other.b2; bc += other.bc; bd += other.bd;
+      c2 += other.c2; cd += other.cd;
+      d2 += other.d2;
+      weight += other.weight;
+    }
+
+    double Evaluate(Vec3 p) const
+    {
+      return a2 * p.x * p.x + 2.0 * ab * p.x * p.y + 2.0 * ac * p.x * p.z + 2.0 * ad * p.x +
+             b2 * p.y * p.y + 2.0 * bc * p.y * p.z + 2.0 * bd * p.y +
+             c2 * p.z * p.z + 2.0 * cd * p.z +
+             d2;
+    }
+
+    // weighted mean squared distance to the planes, in mesh units squared
+    double MeanSquaredDistance(Vec3 p) const
+    {
+      return weight > 0.0 ? Evaluate(p) / weight : 0.0;
+    }
+  };
+
+  // times a chain level is simplified with a tighter collapse limit before
+  // the previous level is reused
+  constexpr int kMaxLevelAttempts = 4;
+
+  // border and seam planes are weighted up against the area weighted face planes
+  constexpr double kBoundaryWeight = 10.0;
+
+  enum : UINT8
+  {
+    kEdgeBorder = 1,
+    kEdgeSeam = 2
+  };
+
+  inline UINT64 EdgeKey(UINT32 a, UINT32 b)
+  {
+    return a < b ? (UINT64(a) << 32) | b : (UINT64(b) << 32) | a;
+  }
+
+  struct Collapse
+  {
+    double cost;
+    UINT32 from;
+    UINT32 to;
+    UINT32 from_version;
+    UINT32 to_version;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+  };
+
+  class Simplifier
+  {
+  public:
+    Simplifier(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, float max_error);
+
+    std::vector<Index> Run(size_t target_index_count);
+
+  private:
+    UINT32 CornerPosition(UINT32 triangle, int corner) const { return position_of[triangles[triangle * 3 + corner]]; }
+    Vec3 CornerPoint(UINT32 triangle, int corner) const { return positions[CornerPosition(triangle, corner)]; }
+    bool HasPosition(UINT32 triangle, UINT32 position) const;
+    int FindCorner(UINT32 triangle, UINT32 position) const;
+
+    void GatherNeighbours(UINT32 position, std::vector<UINT32>& neighbours) const;
+    void Push(UINT32 from, UINT32 to);
+    void PushNeighbours(UINT32 position);
+    bool TryCollapse(UINT32 from, UINT32 to);
+
+    std::vector<Index> triangles; // working copy of the index buffer
+    std::vector<bool> triangle_alive;
+    size_t alive_count = 0;
+
+    std::vector<UINT32> position_of; // vertex -> welded position
+    std::vector<Vec3> positions;
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<UINT32>> position_triangles; // can still hold removed triangles
+    std::vector<UINT32> versions; // bumped when a position's quadric changes
+    std::vector<bool> locked;
+    std::vector<bool> removed;
+    std::vector<UINT8> boundary_edge_count; // border + seam edges per position
+    double max_squared_error;
+    std::unordered_map<UINT64, UINT8> boundary_edges;
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+    // scratch for TryCollapse
+    std::vector<UINT32> from_neighbours;
+    std::vector<UINT32> to_neighbours;
+    std::vector<std::pair<Index, Index>> wedge_map;
+  };
+
+  Simplifier::Simplifier(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, float max_error)
+    : max_squared_error(double(max_error) * max_error)
+  {
+    //weld by position only, the wedges (vertices) of a position differ in normal/texcoord
+    std::unordered_map<MeshOptimizer::VertexKey, UINT32, MeshOptimizer::VertexKeyHasher> position_ids;
+    position_ids.reserve(vertices.size());
+    position_of.resize(vertices.size());
+    for (size_t i = 0; i < vertices.size(); i++)
+    {
+      const XMFLOAT3& p = vertices[i].position;
+      const float values[8] = { p.x, p.y, p.z, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+      auto inserted = position_ids.emplace(MeshOptimizer::MakeVertexKey(values), static_cast<UINT32>(positions.size()));
+      if (inserted.second)
+      {
+        positions.push_back(ToVec3(p));
+      }
+      position_of[i] = inserted.first->second;
+    }
+
+    const size_t position_count = positions.size();
+    quadrics.resize(position_count);
+    position_triangles.resize(position_count);
+    versions.resize(position_count, 0);
+    locked.resize(position_count, false);
+    removed.resize(position_count, false);
+    boundary_edge_count.resize(position_count, 0);
+
+    const size_t triangle_count = indices.size() / 3;
+    triangles.assign(indices.begin(), indices.begin() + triangle_count * 3);
+    triangle_alive.resize(triangle_count, false);
+    for (UINT32 t = 0; t < triangle_count; t++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        if (triangles[t * 3 + k] >= vertices.size())
+        {
+          throw std::runtime_error("triangle references a vertex that doesn't exist");
+        }
+      }
+
+      const UINT32 a = CornerPosition(t, 0);
+      const UINT32 b = CornerPosition(t, 1);
+      const UINT32 c = CornerPosition(t, 2);
+      if (a == b || b == c || a == c)
+      {
+        //no area, dropping it doesn't change the surface
+        continue;
+      }
+
+      triangle_alive[t] = true;
+      alive_count++;
+      position_triangles[a].push_back(t);
+      position_triangles[b].push_back(t);
+      position_triangles[c].push_back(t);
+
+      const Vec3 normal = Cross(positions[b] - positions[a], positions[c] - positions[a]);
+      const double length = Length(normal);
+      if (length > 0.0)
+      {
+        const Vec3 unit = normal * (1.0 / length);
+        const double d = -Dot(unit, positions[a]);
+        for (UINT32 position : { a, b, c })
+        {
+          quadrics[position].AddPlane(unit, d, length * 0.5);
+        }
+      }
+    }
+
+    //classify the edges: an edge of one triangle is a border, an edge whose two
+    //triangles use different wedges is a seam, more than two is non-manifold
+    struct EdgeRecord
+    {
+      UINT32 count;
+      Index low_wedge;
+      Index high_wedge;
+      bool seam;
+      UINT32 triangle;
+    };
+    std::unordered_map<UINT64, EdgeRecord> edges;
+    edges.reserve(alive_count * 2);
+    for (UINT32 t = 0; t < triangle_count; t++)
+    {
+      if (!triangle_alive[t])
+      {
+        continue;
+      }
+
+      for (int k = 0; k < 3; k++)
+      {
+        const Index wedge_a = triangles[t * 3 + k];
+        const Index wedge_b = triangles[t * 3 + (k + 1) % 3];
+        const UINT32 a = position_of[wedge_a];
+        const UINT32 b = position_of[wedge_b];
+        const Index low_wedge = a < b ? wedge_a : wedge_b;
+        const Index high_wedge = a < b ? wedge_b : wedge_a;
+
+        auto inserted = edges.emplace(EdgeKey(a, b), EdgeRecord{ 1, low_wedge, high_wedge, false, t });
+        if (!inserted.second)
+        {
+          EdgeRecord& record = inserted.first->second;
+          record.count++;
+          record.seam |= record.low_wedge != low_wedge || record.high_wedge != high_wedge;
+        }
+      }
+    }
+
+    std::vector<UINT8> boundary_kinds(position_count, 0);
+    for (const auto& pair : edges)
+    {
+      const UINT32 a = static_cast<UINT32>(pair.first >> 32);
+      const UINT32 b = static_cast<UINT32>(pair.first & 0xffffffff);
+      const EdgeRecord& record = pair.second;
+
+      if (record.count > 2)
+      {
+        locked[a] = true;
+        locked[b] = true;
+        continue;
+      }
+
+      const UINT8 kind = record.count == 1 ? kEdgeBorder : record.seam ? kEdgeSeam : 0;
+      if (kind == 0)
+      {
+        continue;
+      }
+
+      boundary_edges.emplace(pair.first, kind);
+      boundary_edge_count[a]++;
+      boundary_edge_count[b]++;
+      boundary_kinds[a] |= kind;
+      boundary_kinds[b] |= kind;
+
+      //plane through the edge, perpendicular to the face, keeps the boundary from moving sideways
+      const UINT32 t = record.triangle;
+      const Vec3 face_normal = Cross(CornerPoint(t, 1) - CornerPoint(t, 0), CornerPoint(t, 2) - CornerPoint(t, 0));
+      const Vec3 edge = positions[b] - positions[a];
+      const Vec3 normal = Cross(edge, face_normal);
+      const double length = Length(normal);
+      if (length > 0.0)
+      {
+        const Vec3 unit = normal * (1.0 / length);
+        const double d = -Dot(unit, positions[a]);
+        const double weight = Dot(edge, edge) * kBoundaryWeight;
+        quadrics[a].AddPlane(unit, d, weight);
+        quadrics[b].AddPlane(unit, d, weight);
+      }
+    }
+
+    //a boundary vertex can only slide along a single boundary line
+    for (size_t i = 0; i < position_count; i++)
+    {
+      if (boundary_edge_count[i] != 0 && (boundary_edge_count[i] != 2 || boundary_kinds[i] == (kEdgeBorder | kEdgeSeam)))
+      {
+        locked[i] = true;
+      }
+    }
+
+    for (const auto& pair : edges)
+    {
+      const UINT32 a = static_cast<UINT32>(pair.first >> 32);
+      const UINT32 b = static_cast<UINT32>(pair.first & 0xffffffff);
+      Push(a, b);
+      Push(b, a);
+    }
+  }
+
+  bool Simplifier::HasPosition(UINT32 triangle, UINT32 position) const
+  {
+    return FindCorner(triangle, position) >= 0;
+  }
+
+  int Simplifier::FindCorner(UINT32 triangle, UINT32 position) const
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      if (CornerPosition(triangle, k) == position)
+      {
+        return k;
+      }
+    }
+    return -1;
+  }
+
+  void Simplifier::GatherNeighbours(UINT32 position, std::vector<UINT32>& neighbours) const
+  {
+    neighbours.clear();
+    for (UINT32 t : position_triangles[position])
+    {
+      if (!triangle_alive[t])
+      {
+        continue;
+      }
+      for (int k = 0; k < 3; k++)
+      {
+        const UINT32 corner = CornerPosition(t, k);
+        if (corner != position)
+        {
+          neighbours.push_back(corner);
+        }
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+  }
+
+  void Simplifier::Push(UINT32 from, UINT32 to)
+  {
+    if (locked[from] || removed[from] || removed[to])
+    {
+      return;
+    }
+
+    if (boundary_edge_count[from] != 0 && boundary_edges.find(EdgeKey(from, to)) == boundary_edges.end())
+    {
+      return;
+    }
+
+    Quadric quadric = quadrics[from];
+    quadric.Add(quadrics[to]);
+    if (quadric.MeanSquaredDistance(positions[to]) > max_squared_error)
+    {
+      return;
+    }
+    queue.push({ quadric.Evaluate(positions[to]), from, to, versions[from], versions[to] });
+  }
+
+  void Simplifier::PushNeighbours(UINT32 position)
+  {
+    GatherNeighbours(position, to_neighbours);
+    for (UINT32 neighbour : to_neighbours)
+    {
+      Push(position, neighbour);
+      Push(neighbour, position);
+    }
+  }
+
+  bool Simplifier::TryCollapse(UINT32 from, UINT32 to)
+  {
+    //boundary edges move around as their neighbours collapse
+    if (boundary_edge_count[from] != 0 && boundary_edges.find(EdgeKey(from, to)) == boundary_edges.end())
+    {
+      return false;
+    }
+
+    //every wedge of from has to land on the wedge of to it shares a triangle with,
+    //and no two wedges may land on the same one (that would merge across a seam)
+    wedge_map.clear();
+    size_t shared_triangles = 0;
+    for (UINT32 t : position_triangles[from])
+    {
+      if (!triangle_alive[t] || !HasPosition(t, to))
+      {
+        continue;
+      }
+      shared_triangles++;
+
+      const Index from_wedge = triangles[t * 3 + FindCorner(t, from)];
+      const Index to_wedge = triangles[t * 3 + FindCorner(t, to)];
+      bool found = false;
+      for (const auto& mapping : wedge_map)
+      {
+        if (mapping.first == from_wedge && mapping.second != to_wedge)
+        {
+          return false;
+        }
+        if (mapping.first != from_wedge && mapping.second == to_wedge)
+        {
+          return false;
+        }
+        found |= mapping.first == from_wedge;
+      }
+      if (!found)
+      {
+        wedge_map.emplace_back(from_wedge, to_wedge);
+      }
+    }
+
+    if (shared_triangles == 0)
+    {
+      return false;
+    }
+
+    //when every triangle around both ends goes away, the collapse deletes what is
+    //left of a component (a lone triangle) instead of simplifying it
+    auto survives = [this, from, to](UINT32 t) { return triangle_alive[t] && !(HasPosition(t, from) && HasPosition(t, to)); };
+    if (std::none_of(position_triangles[from].begin(), position_triangles[from].end(), survives) &&
+        std::none_of(position_triangles[to].begin(), position_triangles[to].end(), survives))
+    {
+      return false;
+    }
+
+    const Vec3 target = positions[to];
+    for (UINT32 t : position_triangles[from])
+    {
+      if (!triangle_alive[t] || HasPosition(t, to))
+      {
+        continue;
+      }
+
+      const int corner = FindCorner(t, from);
+      const Index wedge = triangles[t * 3 + corner];
+      if (std::none_of(wedge_map.begin(), wedge_map.end(), [wedge](const auto& mapping) { return mapping.first == wedge; }))
+      {
+        return false;
+      }
+
+      //reject collapses that flip (or flatten) a remaining triangle
+      Vec3 points[3] = { CornerPoint(t, 0), CornerPoint(t, 1), CornerPoint(t, 2) };
+      const Vec3 old_normal = Cross(points[1] - points[0], points[2] - points[0]);
+      points[corner] = target;
+      const Vec3 new_normal = Cross(points[1] - points[0], points[2] - points[0]);
+      if (Dot(old_normal, new_normal) <= 0.0)
+      {
+        return false;
+      }
+    }
+
+    //link condition: the only shared neighbours are the ones across the removed triangles,
+    //anything else would pinch the surface
+    GatherNeighbours(from, from_neighbours);
+    GatherNeighbours(to, to_neighbours);
+    size_t common = 0;
+    for (size_t i = 0, j = 0; i < from_neighbours.size() && j < to_neighbours.size();)
+    {
+      if (from_neighbours[i] < to_neighbours[j]) i++;
+      else if (to_neighbours[j] < from_neighbours[i]) j++;
+      else { common++; i++; j++; }
+    }
+    if (common != shared_triangles)
+    {
+      return false;
+    }
+
+    //the other boundary edge of from moves over to to
+    UINT64 moved_edge = 0;
+    UINT8 moved_kind = 0;
+    if (boundary_edge_count[from] != 0)
+    {
+      for (UINT32 neighbour : from_neighbours)
+      {
+        auto found = neighbour != to ? boundary_edges.find(EdgeKey(from, neighbour)) : boundary_edges.end();
+        if (found != boundary_edges.end())
+        {
+          if (boundary_edges.count(EdgeKey(to, neighbour)) != 0)
+          {
+            return false;
+          }
+          moved_edge = found->first;
+          moved_kind = found->second;
+          boundary_edges.emplace(EdgeKey(to, neighbour), moved_kind);
+        }
+      }
+      boundary_edges.erase(EdgeKey(from, to));
+      if (moved_kind != 0)
+      {
+        boundary_edges.erase(moved_edge);
+      }
+    }
+
+    for (UINT32 t : position_triangles[from])
+    {
+      if (!triangle_alive[t])
+      {
+        continue;
+      }
+
+      if (HasPosition(t, to))
+      {
+        triangle_alive[t] = false;
+        alive_count--;
+        continue;
+      }
+
+      Index& wedge = triangles[t * 3 + FindCorner(t, from)];
+      for (const auto& mapping : wedge_map)
+      {
+        if (mapping.first == wedge)
+        {
+          wedge = mapping.second;
+          break;
+        }
+      }
+      position_triangles[to].push_back(t);
+    }
+
+    std::vector<UINT32>& to_triangles = position_triangles[to];
+    to_triangles.erase(std::remove_if(to_triangles.begin(), to_triangles.end(), [this](UINT32 t) { return !triangle_alive[t]; }), to_triangles.end());
+    position_triangles[from].clear();
+    position_triangles[from].shrink_to_fit();
+
+    quadrics[to].Add(quadrics[from]);
+    removed[from] = true;
+    versions[to]++;
+    return true;
+  }
+
+  std::vector<Index> Simplifier::Run(size_t target_index_count)
+  {
+    const size_t target_triangles = target_index_count / 3;
+    while (alive_count > target_triangles && !queue.empty())
+    {
+      const Collapse collapse = queue.top();
+      queue.pop();
+
+      if (removed[collapse.from] || removed[collapse.to] ||
+          versions[collapse.from] != collapse.from_version || versions[collapse.to] != collapse.to_version)
+      {
+        continue;
+      }
+
+      if (TryCollapse(collapse.from, collapse.to))
+      {
+        PushNeighbours(collapse.to);
+      }
+    }
+
+    std::vector<Index> result;
+    result.reserve(alive_count * 3);
+    for (size_t t = 0; t < triangle_alive.size(); t++)
+    {
+      if (triangle_alive[t])
+      {
+        result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+      }
+    }
+    return result;
+  }
+
+  // closest point to p on triangle abc, from Ericson's Real-Time Collision Detection 5.1.5
+  Vec3 ClosestPointOnTriangle(Vec3 p, Vec3 a, Vec3 b, Vec3 c)
+  {
+    const Vec3 ab = b - a;
+    const Vec3 ac = c - a;
+    const Vec3 ap = p - a;
+    const double d1 = Dot(ab, ap);
+    const double d2 = Dot(ac, ap);
+    if (d1 <= 0.0 && d2 <= 0.0) return a;
+
+    const Vec3 bp = p - b;
+    const double d3 = Dot(ab, bp);
+    const double d4 = Dot(ac, bp);
+    if (d3 >= 0.0 && d4 <= d3) return b;
+
+    const double vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0) return a + ab * (d1 / (d1 - d3));
+
+    const Vec3 cp = p - c;
+    const double d5 = Dot(ab, cp);
+    const double d6 = Dot(ac, cp);
+    if (d6 >= 0.0 && d5 <= d6) return c;
+
+    const double vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0) return a + ac * (d2 / (d2 - d6));
+
+    const double va = d3 * d6 - d5 * d4;
+    if (va <= 0.0 && (d4 - d3) >= 0.0 && (d5 - d6) >= 0.0) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+
+    const double sum = va + vb + vc;
+    if (!(sum > 0.0))
+    {
+      return a;
+    }
+    return a + ab * (vb / sum) + ac * (vc / sum);
+  }
+
+  // bounding volume hierarchy over a mesh's triangles for closest surface point queries
+  class TriangleTree
+  {
+  public:
+    TriangleTree(const std::vector<Vertex>& vertices, const std::vector<Index>& indices);
+
+    // distance from point to the closest triangle, 0 for a mesh without triangles
+    double Distance(Vec3 point) const;
+
+  private:
+    // leaves hold count triangles from first in order, inner nodes have count 0,
+    // their left child right after them and the right one at first
+    struct Node
+    {
+      Vec3 lower;
+      Vec3 upper;
+      UINT32 first;
+      UINT32 count;
+    };
+
+    static constexpr UINT32 kLeafSize = 4;
+
+    UINT32 Build(UINT32 begin, UINT32 end);
+    Vec3 Corner(UINT32 triangle, int corner) const { return ToVec3(vertices[indices[triangle * 3 + corner]].position); }
+
+    const std::vector<Vertex>& vertices;
+    const std::vector<Index>& indices;
+    std::vector<Node> nodes;
+    std::vector<UINT32> order; // triangles, grouped by leaf
+    std::vector<Vec3> centroids;
+  };
+
+  TriangleTree::TriangleTree(const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+    : vertices(vertices), indices(indices)
+  {
+    const UINT32 triangle_count = static_cast<UINT32>(indices.size() / 3);
+    if (triangle_count == 0)
+    {
+      return;
+    }
+
+    order.resize(triangle_count);
+    centroids.resize(triangle_count);
+    for (UINT32 t = 0; t < triangle_count; t++)
+    {
+      order[t] = t;
+      centroids[t] = (Corner(t, 0) + Corner(t, 1) + Corner(t, 2)) * (1.0 / 3.0);
+    }
+
+    nodes.reserve(triangle_count / kLeafSize * 2 + 1);
+    Build(0, triangle_count);
+  }
+
+  UINT32 TriangleTree::Build(UINT32 begin, UINT32 end)
+  {
+    const UINT32 node_index = static_cast<UINT32>(nodes.size());
+    nodes.push_back({});
+
+    Vec3 lower = Corner(order[begin], 0);
+    Vec3 upper = lower;
+    Vec3 centroid_lower = centroids[order[begin]];
+    Vec3 centroid_upper = centroid_lower;
+    for (UINT32 i = begin; i < end; i++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        const Vec3 p = Corner(order[i], k);
+        lower = { std::min<double>(lower.x, p.x), std::min<double>(lower.y, p.y), std::min<double>(lower.z, p.z) };
+        upper = { std::max<double>(upper.x, p.x), std::max<double>(upper.y, p.y), std::max<double>(upper.z, p.z) };
+      }
+      const Vec3& c = centroids[order[i]];
+      centroid_lower = { std::min<double>(centroid_lower.x, c.x), std::min<double>(centroid_lower.y, c.y), std::min<double>(centroid_lower.z, c.z) };
+      centroid_upper = { std::max<double>(centroid_upper.x, c.x), std::max<double>(centroid_upper.y, c.y), std::max<double>(centroid_upper.z, c.z) };
+    }
+    nodes[node_index].lower = lower;
+    nodes[node_index].upper = upper;
+
+    if (end - begin <= kLeafSize)
+    {
+      nodes[node_index].first = begin;
+      nodes[node_index].count = end - begin;
+      return node_index;
+    }
+
+    //median split along the longest axis of the centroids
+    const Vec3 extent = centroid_upper - centroid_lower;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    auto key = [this, axis](UINT32 t) { return axis == 0 ? centroids[t].x : axis == 1 ? centroids[t].y : centroids[t].z; };
+    const UINT32 middle = begin + (end - begin) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end,
+                     [&key](UINT32 a, UINT32 b) { return key(a) < key(b); });
+
+    Build(begin, middle);
+    const UINT32 right = Build(middle, end);
+    nodes[node_index].first = right;
+    nodes[node_index].count = 0;
+    return node_index;
+  }
+
+  double TriangleTree::Distance(Vec3 point) const
+  {
+    if (nodes.empty())
+    {
+      return 0.0;
+    }
+
+    auto box_distance_squared = [&point](const Node& node)
+    {
+      const double dx = std::max<double>(std::max<double>(node.lower.x - point.x, point.x - node.upper.x), 0.0);
+      const double dy = std::max<double>(std::max<double>(node.lower.y - point.y, point.y - node.upper.y), 0.0);
+      const double dz = std::max<double>(std::max<double>(node.lower.z - point.z, point.z - node.upper.z), 0.0);
+      return dx * dx + dy * dy + dz * dz;
+    };
+
+    double best = DBL_MAX; // squared
+    UINT32 stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0)
+    {
+      const Node& node = nodes[stack[--stack_size]];
+      if (box_distance_squared(node) >= best)
+      {
+        continue;
+      }
+
+      if (node.count > 0)
+      {
+        for (UINT32 i = node.first; i < node.first + node.count; i++)
+        {
+          const UINT32 t = order[i];
+          const Vec3 offset = point - ClosestPointOnTriangle(point, Corner(t, 0), Corner(t, 1), Corner(t, 2));
+          best = std::min<double>(best, Dot(offset, offset));
+        }
+        continue;
+      }
+
+      //visit the nearer child first
+      const UINT32 left = static_cast<UINT32>(&node - nodes.data()) + 1;
+      const UINT32 right = node.first;
+      const bool left_first = box_distance_squared(nodes[left]) <= box_distance_squared(nodes[right]);
+      stack[stack_size++] = left_first ? right : left;
+      stack[stack_size++] = left_first ? left : right;
+    }
+    return std::sqrt(best);
+  }
+
+  // largest distance from the sample points of mesh a to the surface of mesh b
+  double OneSidedHausdorff(const std::vector<Vertex>& vertices_a, const std::vector<Index>& indices_a, const TriangleTree& tree_b)
+  {
+    const size_t triangle_count = indices_a.size() / 3;
+    ThreadPool& pool = ThreadPool::Shared();
+    const size_t task_count = std::max<size_t>(1, std::min<size_t>(pool.Size() * 4, triangle_count / 1024));
+
+    std::vector<double> task_max(task_count, 0.0);
+    pool.ParallelFor(task_count, [&](size_t task)
+    {
+      const size_t begin = triangle_count * task / task_count;
+      const size_t end = triangle_count * (task + 1) / task_count;
+      double local_max = 0.0;
+      for (size_t t = begin; t < end; t++)
+      {
+        const Vec3 a = ToVec3(vertices_a[indices_a[t * 3]].position);
+        const Vec3 b = ToVec3(vertices_a[indices_a[t * 3 + 1]].position);
+        const Vec3 c = ToVec3(vertices_a[indices_a[t * 3 + 2]].position);
+        const Vec3 samples[7] = {
+          a, b, c,
+          (a + b) * 0.5, (b + c) * 0.5, (c + a) * 0.5,
+          (a + b + c) * (1.0 / 3.0)
+        };
+        for (const Vec3& sample : samples)
+        {
+          local_max = std::max<double>(local_max, tree_b.Distance(sample));
+        }
+      }
+      task_max[task] = local_max;
+    });
+
+    return *std::max_element(task_max.begin(), task_max.end());
+  }
+
+  float MeasureHausdorff(const std::vector<Vertex>& vertices_a, const std::vector<Index>& indices_a, const TriangleTree& tree_a,
+                          const std::vector<Vertex>& vertices_b, const std::vector<Index>& indices_b)
+  {
+    const TriangleTree tree_b(vertices_b, indices_b);
+    const double a_to_b = OneSidedHausdorff(vertices_a, indices_a, tree_b);
+    const double b_to_a = OneSidedHausdorff(vertices_b, indices_b, tree_a);
+    return static_cast<float>(std::max<double>(a_to_b, b_to_a));
+  }
+}
+
+std::vector<Index> MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, size_t target_index_count, float max_error)
+{
+  Simplifier simplifier(vertices, indices, max_error);
+  return simplifier.Run(target_index_count);
+}
+
+float MeshSimplifier::HausdorffDistance(const std::vector<Vertex>& vertices_a, const std::vector<Index>& indices_a,
+                                        const std::vector<Vertex>& vertices_b, const std::vector<Index>& indices_b)
+{
+  const TriangleTree tree_a(vertices_a, indices_a);
+  return MeasureHausdorff(vertices_a, indices_a, tree_a, vertices_b, indices_b);
+}
+
+std::vector<MeshSimplifier::Level> MeshSimplifier::BuildLodChain(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, const std::vector<float>& triangle_ratios, float max_relative_error)
+{
+  std::vector<Level> levels;
+  levels.reserve(triangle_ratios.size());
+  const std::vector<Vertex>* previous_vertices = &vertices;
+  const std::vector<Index>* previous_indices = &indices;
+
+  //every level is measured against the source
+  const TriangleTree source_tree(vertices, indices);
+  const VertexPacking::Bounds bounds = VertexPacking::ComputeBounds(vertices.data(), vertices.size());
+  const float max_distance = max_relative_error * sqrtf(bounds.extent.x * bounds.extent.x + bounds.extent.y * bounds.extent.y + bounds.extent.z * bounds.extent.z);
+
+  for (float ratio : triangle_ratios)
+  {
+    Level level;
+    level.triangle_ratio = ratio;
+
+    //the quadric limit is an average over planes, so a level can still end up past
+    //the bound; tighten it a few times before falling back to the previous level
+    const size_t target_triangles = static_cast<size_t>(indices.size() / 3 * std::min<double>(std::max<double>(ratio, 0.0), 1.0));
+    float collapse_limit = max_distance;
+    for (int attempt = 0; attempt < kMaxLevelAttempts; attempt++, collapse_limit *= 0.5f)
+    {
+      level.indices = Simplify(*previous_vertices, *previous_indices, target_triangles * 3, collapse_limit);
+      level.vertices = *previous_vertices;
+      MeshOptimizer::ReorderVerticesFirstUse(level.vertices, level.indices);
+      level.hausdorff_distance = MeasureHausdorff(vertices, indices, source_tree, level.vertices, level.indices);
+      if (level.hausdorff_distance <= max_distance)
+      {
+        break;
+      }
+    }
+    if (level.hausdorff_distance > max_distance)
+    {
+      level.vertices = *previous_vertices;
+      level.indices = *previous_indices;
+      level.hausdorff_distance = levels.empty() ? 0.0f : levels.back().hausdorff_distance;
+    }
+
+    levels.push_back(std::move(level));
+    previous_vertices = &levels.back().vertices;
+    previous_indices = &levels.back().indices;
+  }
+  return levels;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <limits>
+#include <vector>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+// Quadric error metric simplification for generating model LODs.
+// Edges are collapsed onto one of their endpoints (half-edge collapse), so a
+// simplified mesh only references vertices of the source mesh and every
+// attribute stays exact. UV/normal seams and open borders may only collapse
+// along themselves, and are held in place by extra boundary quadrics; vertices
+// where three or more of them meet, or non-manifold ones, never move.
+namespace MeshSimplifier {
+
+// Indices of the simplified mesh (into the same vertices), with at most
+// target_index_count indices unless no further collapse is valid. Collapses
+// whose quadric error, as an RMS distance to the merged planes, is past
+// max_error (mesh units) are never made.
+std::vector<Index> Simplify(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, size_t target_index_count,
+                            float max_error = (std::numeric_limits<float>::max)());
+
+// Two sided Hausdorff distance between two meshes, estimated on the triangle
+// vertices, edge midpoints and centroids of each against the other's surface.
+float HausdorffDistance(const std::vector<Vertex>& vertices_a, const std::vector<Index>& indices_a,
+                        const std::vector<Vertex>& vertices_b, const std::vector<Index>& indices_b);
+
+struct Level
+{
+  std::vector<Vertex> vertices; // only the ones the level uses
+  std::vector<Index> indices;
+  float triangle_ratio = 1.0f; // requested fraction of the source triangles
+  float hausdorff_distance = 0.0f; // against the source mesh
+};
+
+// Default bound on a LOD level's Hausdorff distance from the source, as a
+// fraction of the source's bounds diagonal
+constexpr float kMaxRelativeError = 0.02f;
+
+// One level per ratio (e.g. 0.5, 0.25, 0.1), each simplified from the
+// previous one. Levels keep the source's triangle order. Every level is
+// within max_relative_error of the source: a level stops short of its ratio
+// rather than go past it, and repeats the previous level if it can't.
+std::vector<Level> BuildLodChain(const std::vector<Vertex>& vertices, const std::vector<Index>& indices, const std::vector<float>& triangle_ratios,
+                                 float max_relative_error = kMaxRelativeError);
+} // namespace MeshSimplifier
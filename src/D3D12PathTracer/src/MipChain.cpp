@@ -0,0 +1,246 @@
+#include "stdafx.h"
+#include "MipChain.h"
+#include "BlockCompression.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+
+//stb_image_resize makes one scratch allocation per call, it comes from the texel pool as well
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#define STBIR_MALLOC(size, context) ((void)(context), TexelPool::Shared().Allocate(size))
+#define STBIR_FREE(block, context) ((void)(context), TexelPool::Shared().Free(block))
+#include "include/stb-master/stb_image_resize.h"
+
+namespace {
+// every resize call has its own setup, so a level is split into one band per
+// worker at most and bands don't get smaller than this
+constexpr UINT kMinBandRows = 64;
+// grazing hits would otherwise ask for an infinite footprint
+constexpr float kMinConeCosine = 0.01f;
+
+MipChain::Level FloatLevel(const MipChain::Level& level)
+{
+  MipChain::Level unpacked = level;
+  unpacked.bytes_per_row = static_cast<int>(level.width * 4 * sizeof(float));
+  unpacked.size = size_t(unpacked.bytes_per_row) * level.height;
+  return unpacked;
+}
+
+// target from source, four channels, rows in bands across the pool
+void ResizeLevel(const void* source_texels, const MipChain::Level& source, void* target_texels, const MipChain::Level& target,
+                 stbir_datatype type, stbir_colorspace space, int alpha_channel, ThreadPool& pool)
+{
+  const float x_scale = static_cast<float>(target.width) / source.width;
+  const float y_scale = static_cast<float>(target.height) / source.height;
+  const UINT pool_size = static_cast<UINT>(pool.Size());
+  const UINT band_rows = std::max<UINT>(kMinBandRows, (target.height + pool_size - 1) / pool_size);
+  const size_t bands = (target.height + band_rows - 1) / band_rows;
+
+  pool.ParallelFor(bands, [&](size_t band)
+  {
+    const UINT first_row = static_cast<UINT>(band) * band_rows;
+    const UINT rows = std::min<UINT>(band_rows, target.height - first_row);
+    //shifted by the band's first row, every band samples where a whole level resize would
+    if (!stbir_resize_subpixel(source_texels, source.width, source.height, source.bytes_per_row,
+                               static_cast<BYTE*>(target_texels) + size_t(first_row) * target.bytes_per_row,
+                               target.width, rows, target.bytes_per_row, type, 4, alpha_channel, 0,
+                               STBIR_EDGE_WRAP, STBIR_EDGE_WRAP, STBIR_FILTER_BOX, STBIR_FILTER_BOX, space, nullptr,
+                               x_scale, y_scale, 0.0f, static_cast<float>(first_row)))
+    {
+      throw std::runtime_error("mip level resize failed");
+    }
+  });
+}
+
+// Normal maps are averaged as vectors: unpacked to [-1, 1] floats, filtered,
+// renormalized and packed again. Each level is filtered from the renormalized
+// floats of the one above, so quantization doesn't add up down the chain.
+void GenerateNormalLevels(BYTE* texels, const std::vector<MipChain::Level>& levels, ThreadPool& pool)
+{
+  const MipChain::Level& base = levels[0];
+  std::vector<float> above(size_t(base.width) * base.height * 4);
+  pool.ParallelFor(base.height, [&](size_t y)
+  {
+    const BYTE* row = texels + base.offset + y * base.bytes_per_row;
+    float* unpacked = above.data() + y * base.width * 4;
+    for (UINT x = 0; x < base.width * 4; x++)
+    {
+      unpacked[x] = (x % 4 == 3) ? row[x] / 255.0f : row[x] / 255.0f * 2.0f - 1.0f;
+    }
+  });
+
+  for (size_t i = 1; i < levels.size(); i++)
+  {
+    const MipChain::Level& level = levels[i];
+    std::vector<float> current(size_t(level.width) * level.height * 4);
+    ResizeLevel(above.data(), FloatLevel(levels[i - 1]), current.data(), FloatLevel(level),
+                STBIR_TYPE_FLOAT, STBIR_COLORSPACE_LINEAR, STBIR_ALPHA_CHANNEL_NONE, pool);
+
+    pool.ParallelFor(level.height, [&](size_t y)
+    {
+      BYTE* row = texels + level.offset + y * level.bytes_per_row;
+      float* normal = current.data() + y * level.width * 4;
+      for (UINT x = 0; x < level.width; x++, normal += 4)
+      {
+        //opposing normals can cancel out, those point straight up
+        const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        if (length > 1e-6f)
+        {
+          normal[0] /= length;
+          normal[1] /= length;
+          normal[2] /= length;
+        }
+        else
+        {
+          normal[0] = 0.0f;
+          normal[1] = 0.0f;
+          normal[2] = 1.0f;
+        }
+        for (int c = 0; c < 4; c++)
+        {
+          const float value = (c == 3) ? normal[c] : normal[c] * 0.5f + 0.5f;
+          row[x * 4 + c] = static_cast<BYTE>(std::min<float>(std::max<float>(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+      }
+    });
+    above.swap(current);
+  }
+}
+} // namespace
+
+UINT16 MipChain::LevelCount(UINT64 width, UINT height)
+{
+  UINT64 size = std::max<UINT64>(width, height);
+  UINT16 levels = 1;
+  while (size > 1)
+  {
+    size >>= 1;
+    levels++;
+  }
+  return levels;
+}
+
+std::vector<MipChain::Level> MipChain::Layout(const D3D12_RESOURCE_DESC& desc)
+{
+  const int bits_per_pixel = TextureLoader::GetBitsPerPixel(desc.Format);
+  const UINT block_bytes = BlockCompression::BlockBytes(desc.Format);
+  std::vector<Level> levels(std::max<UINT16>(desc.MipLevels, 1));
+
+  size_t offset = 0;
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    Level& level = levels[i];
+    level.offset = offset;
+    level.width = static_cast<UINT>(std::max<UINT64>(desc.Width >> i, 1));
+    level.height = std::max<UINT>(desc.Height >> i, 1);
+    if (block_bytes != 0)
+    {
+      //block compressed rows are rows of 4x4 blocks, partial blocks are padded
+      level.bytes_per_row = static_cast<int>((level.width + 3) / 4 * block_bytes);
+      level.size = size_t(level.bytes_per_row) * ((level.height + 3) / 4);
+    }
+    else
+    {
+      level.bytes_per_row = static_cast<int>(level.width) * bits_per_pixel / 8;
+      level.size = size_t(level.bytes_per_row) * level.height;
+    }
+    offset += level.size;
+  }
+  return levels;
+}
+
+AssetLoader::ImageData MipChain::Generate(AssetLoader::ImageData base, Filter filter, ThreadPool& pool)
+{
+  const DXGI_FORMAT format = base.desc.Format;
+  const bool is_float = format == DXGI_FORMAT_R32G32B32A32_FLOAT;
+  if ((format != DXGI_FORMAT_R8G8B8A8_UNORM && !is_float) || base.desc.MipLevels > 1)
+  {
+    return base;
+  }
+
+  D3D12_RESOURCE_DESC desc = base.desc;
+  desc.MipLevels = LevelCount(desc.Width, desc.Height);
+  if (desc.MipLevels == 1)
+  {
+    return base;
+  }
+  const std::vector<Level> levels = Layout(desc);
+  const size_t total_size = levels.back().offset + levels.back().size;
+
+  AssetLoader::ImageData chain;
+  chain.texels = std::unique_ptr<BYTE, AssetLoader::TexelDeleter>(static_cast<BYTE*>(TexelPool::Shared().Allocate(total_size)),
+                                                                  AssetLoader::TexelDeleter{ &TexelPool::Shared() });
+  if (!chain.texels)
+  {
+    throw std::bad_alloc();
+  }
+  chain.size = static_cast<int>(total_size);
+  chain.bytes_per_row = levels[0].bytes_per_row;
+  chain.desc = desc;
+
+  BYTE* texels = chain.texels.get();
+  memcpy(texels, base.texels.get(), levels[0].size);
+  base.texels.reset();
+
+  if (filter == Filter::Normal && !is_float)
+  {
+    GenerateNormalLevels(texels, levels, pool);
+    return chain;
+  }
+
+  //sRGB colors are averaged as linear light, alpha weights the colors it covers
+  const bool srgb = filter == Filter::Srgb && !is_float;
+  for (size_t i = 1; i < levels.size(); i++)
+  {
+    ResizeLevel(texels + levels[i - 1].offset, levels[i - 1], texels + levels[i].offset, levels[i],
+                is_float ? STBIR_TYPE_FLOAT : STBIR_TYPE_UINT8,
+                srgb ? STBIR_COLORSPACE_SRGB : STBIR_COLORSPACE_LINEAR,
+                srgb ? 3 : STBIR_ALPHA_CHANNEL_NONE, pool);
+  }
+  return chain;
+}
+
+float MipChain::ConeLod(const glm::vec3 positions[3], const glm::vec2 uvs[3], UINT width, UINT height, UINT levels,
+                        float cone_width, const glm::vec3& ray_direction, const glm::vec3& normal)
+{
+  //both areas are doubled, only their ratio matters
+  const glm::vec2 uv_edge1 = uvs[1] - uvs[0];
+  const glm::vec2 uv_edge2 = uvs[2] - uvs[0];
+  const float texel_area = float(width) * float(height) * std::abs(uv_edge1.x * uv_edge2.y - uv_edge2.x * uv_edge1.y);
+  const float world_area = glm::length(glm::cross(positions[1] - positions[0], positions[2] - positions[0]));
+  if (texel_area <= 0.0f || world_area <= 0.0f || cone_width <= 0.0f || levels <= 1)
+  {
+    return 0.0f;
+  }
+
+  const float cosine = std::max<float>(std::abs(glm::dot(glm::normalize(ray_direction), glm::normalize(normal))), kMinConeCosine);
+  const float lod = 0.5f * std::log2(texel_area / world_area) + std::log2(cone_width / cosine);
+  return std::min<float>(std::max<float>(lod, 0.0f), float(levels - 1));
+}
+
+glm::vec4 MipChain::Sample(const AssetLoader::ImageData& image, glm::vec2 uv, float lod)
+{
+  const std::vector<Level> levels = Layout(image.desc);
+  const bool is_float = image.desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT;
+
+  auto fetch = [&](const Level& level)
+  {
+    const float u = uv.x - std::floor(uv.x);
+    const float v = uv.y - std::floor(uv.y);
+    const UINT x = std::min<UINT>(static_cast<UINT>(u * level.width), level.width - 1);
+    const UINT y = std::min<UINT>(static_cast<UINT>(v * level.height), level.height - 1);
+    const BYTE* texel = image.texels.get() + level.offset + size_t(y) * level.bytes_per_row;
+    if (is_float)
+    {
+      glm::vec4 value;
+      memcpy(&value, texel + size_t(x) * sizeof(value), sizeof(value));
+      return value;
+    }
+    texel += size_t(x) * 4;
+    return glm::vec4(texel[0], texel[1], texel[2], texel[3]) / 255.0f;
+  };
+
+  lod = std::min<float>(std::max<float>(lod, 0.0f), float(levels.size() - 1));
+  const size_t fine = static_cast<size_t>(lod);
+  const size_t coarse = std::min<size_t>(fine + 1, levels.size() - 1);
+  return glm::mix(fetch(levels[fine]), fetch(levels[coarse]), lod - float(fine));
+}
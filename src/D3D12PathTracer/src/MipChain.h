@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+
+#include "AssetLoader.h"
+
+class ThreadPool;
+
+// Load time mip chains for decoded images and the ray cone level selection the
+// shader uses to pick from them. Levels are stored tightly packed one after the
+// other in ImageData::texels, level 0 first; desc.MipLevels says how many.
+namespace MipChain {
+
+enum class Filter {
+  Srgb, // color: averaged in linear space, stored back as sRGB
+  Linear, // data and hdr images: averaged as stored
+  Normal // tangent space normal maps: vectors averaged and renormalized
+};
+
+struct Level {
+  size_t offset = 0; // into texels
+  UINT width = 0;
+  UINT height = 0;
+  int bytes_per_row = 0; // a row of 4x4 blocks for BC formats
+  size_t size = 0;
+};
+
+// full chain down to 1x1
+UINT16 LevelCount(UINT64 width, UINT height);
+// where every level of desc lives in a packed chain
+std::vector<Level> Layout(const D3D12_RESOURCE_DESC& desc);
+
+// Adds the full chain below base's only level, each level box filtered from the
+// one above with stb_image_resize (wrapping at the edges, like the sampler).
+// Rows of a level are split across the pool, so concurrent calls from pool tasks
+// (one per texture) share it. RGBA8 and RGBA32F are filtered, other formats and
+// images that already have mips come back unchanged.
+AssetLoader::ImageData Generate(AssetLoader::ImageData base, Filter filter, ThreadPool& pool);
+
+// Texture LOD of a ray cone hit, as TextureLod in Raytracing.hlsl (Ray Tracing
+// Gems ch. 20): the triangle's texel to world area ratio, scaled by the cone
+// width at the hit and the incidence angle. Clamped to [0, levels - 1].
+float ConeLod(const glm::vec3 positions[3], const glm::vec2 uvs[3], UINT width, UINT height, UINT levels,
+              float cone_width, const glm::vec3& ray_direction, const glm::vec3& normal);
+// Point sample with wrapping inside a level, linear between the two nearest
+// levels, like the scene sampler. Values as the shader reads them: RGBA8 in
+// [0, 1] without sRGB decoding, RGBA32F as stored.
+glm::vec4 Sample(const AssetLoader::ImageData& image, glm::vec2 uv, float lod);
+
+} // namespace MipChain
@@ -3,20 +3,107 @@
 #include "Model.h"
 #include "DXSample.h"
 #include "Utilities.h"
+#include "IndexBuffer.h"
+#include "SceneGraph.h"
 #include <glm/glm/glm.hpp>
 #include <glm/glm/gtc/type_ptr.hpp>
 
 using namespace ModelLoading;
 
+void Model::PackCpuVertices()
+{
+  if (vertices_vec.empty())
+  {
+    return;
+  }
+
+  packed_bounds = VertexPacking::ComputeBounds(vertices_vec.data(), vertices_vec.size());
+  packed_vertices_vec.resize(vertices_vec.size());
+  VertexPacking::Encode(vertices_vec.data(), vertices_vec.size(), packed_bounds, packed_vertices_vec.data());
+
+  std::vector<Vertex>().swap(vertices_vec);
+}
+
+std::vector<Vertex> Model::GetCpuVertices() const
+{
+  if (!vertices_vec.empty() || packed_vertices_vec.empty())
+  {
+    return vertices_vec;
+  }
+
+  std::vector<Vertex> decoded(packed_vertices_vec.size());
+  VertexPacking::Decode(packed_vertices_vec.data(), packed_vertices_vec.size(), packed_bounds, decoded.data());
+  return decoded;
+}
+
+void Model::AllocateDynamicBuffers(ID3D12Device* device, UINT frame_count)
+{
+  is_dynamic = true;
+  frame_vertices.resize(frame_count);
+  frame_tangents.resize(frame_count);
+  mapped_vertices.resize(frame_count);
+  mapped_tangents.resize(frame_count);
+  for (UINT frame = 0; frame < frame_count; frame++)
+  {
+    AllocateUploadBuffer(device, vertices_vec.data(), vertices_vec.size() * sizeof(Vertex), &frame_vertices[frame].resource,
+                         utilityCore::stringAndId(L"Skinned Vertices", id).c_str());
+    AllocateUploadBuffer(device, tangents_vec.data(), tangents_vec.size() * sizeof(XMFLOAT4), &frame_tangents[frame].resource,
+                         utilityCore::stringAndId(L"Skinned Tangents", id).c_str());
+
+    //upload heaps can stay mapped for the lifetime of the resource
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(frame_vertices[frame].resource->Map(0, &readRange, reinterpret_cast<void**>(&mapped_vertices[frame])));
+    ThrowIfFailed(frame_tangents[frame].resource->Map(0, &readRange, reinterpret_cast<void**>(&mapped_tangents[frame])));
+  }
+}
+
+void Model::RecordDynamicCopy(ID3D12GraphicsCommandList* commandList, UINT frame)
+{
+  //same state AllocateBuffersOnGpu leaves the default heap buffers in
+  const D3D12_RESOURCE_STATES read_state = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
+  D3D12_RESOURCE_BARRIER barriers[] = {
+    CD3DX12_RESOURCE_BARRIER::Transition(vertices.resource.Get(), read_state, D3D12_RESOURCE_STATE_COPY_DEST),
+    CD3DX12_RESOURCE_BARRIER::Transition(tangents.resource.Get(), read_state, D3D12_RESOURCE_STATE_COPY_DEST),
+  };
+  commandList->ResourceBarrier(ARRAYSIZE(barriers), barriers);
+
+  commandList->CopyBufferRegion(vertices.resource.Get(), 0, frame_vertices[frame].resource.Get(), 0, verticesCount * sizeof(Vertex));
+  commandList->CopyBufferRegion(tangents.resource.Get(), 0, frame_tangents[frame].resource.Get(), 0, verticesCount * sizeof(XMFLOAT4));
+
+  for (D3D12_RESOURCE_BARRIER& barrier : barriers)
+  {
+    std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+  }
+  commandList->ResourceBarrier(ARRAYSIZE(barriers), barriers);
+}
+
+D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC Model::GetBottomLevelRefitDesc(UINT frame)
+{
+  D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC refitDesc = GetBottomLevelBuildDesc();
+  refitDesc.Inputs.Flags |= D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_PERFORM_UPDATE;
+  refitDesc.SourceAccelerationStructureData = refitDesc.DestAccelerationStructureData;
+
+  //an update may read its vertices from another address, so it doesn't wait for the copy
+  refit_geometry_desc = GetGeomDesc();
+  refit_geometry_desc.Triangles.VertexBuffer.StartAddress = frame_vertices[frame].resource->GetGPUVirtualAddress();
+  refitDesc.Inputs.pGeometryDescs = &refit_geometry_desc;
+  return refitDesc;
+}
+
+UINT Model::IndexSize() const
+{
+  return IndexBuffer::FormatSize(index_format);
+}
+
 D3D12_RAYTRACING_GEOMETRY_DESC& Model::GetGeomDesc()
 {
   
     geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
     geometryDesc.Triangles.IndexBuffer =
         indices.resource->GetGPUVirtualAddress();
-    geometryDesc.Triangles.IndexCount =
-        static_cast<UINT>(indices.resource->GetDesc().Width) / sizeof(Index);
-    geometryDesc.Triangles.IndexFormat = DXGI_FORMAT_R32_UINT;
+    //16 bit buffers may be padded, so the count comes from the model
+    geometryDesc.Triangles.IndexCount = static_cast<UINT>(indicesCount);
+    geometryDesc.Triangles.IndexFormat = index_format;
     geometryDesc.Triangles.Transform3x4 = 0;
     geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
     geometryDesc.Triangles.VertexCount =
@@ -36,7 +123,8 @@ D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& Model::GetBottomLevelBuildDe
       D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS &bottomLevelInputs =
           bottom_level_build_desc.Inputs;
       bottomLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-      bottomLevelInputs.Flags =
+      bottomLevelInputs.Flags = is_dynamic ?
+          D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_ALLOW_UPDATE :
 		  D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
       bottomLevelInputs.NumDescs = 1; // WATCHOUT
       bottomLevelInputs.Type =
@@ -79,8 +167,9 @@ ComPtr<ID3D12Resource> Model::GetBottomLevelScratchAS(bool is_fallback, ComPtr<I
     D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO&
         bottomLevelPrebuildInfo =
             GetPreBuild(is_fallback, m_fallbackDevice, m_dxrDevice);
+    //refits reuse the build scratch
     AllocateUAVBuffer(
-        device.Get(), bottomLevelPrebuildInfo.ScratchDataSizeInBytes,
+        device.Get(), std::max<UINT64>(bottomLevelPrebuildInfo.ScratchDataSizeInBytes, bottomLevelPrebuildInfo.UpdateScratchDataSizeInBytes),
         &scratchResource, D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
         utilityCore::stringAndId(L"ScratchResource", id).c_str());
     is_scratchResource_allocated = true;
@@ -136,24 +225,15 @@ void Model::FinalizeAS()
 }
 
 FLOAT* SceneObject::getTransform3x4() {
-	if (!transformBuilt) {
-		transformBuilt = true;
-		const float *matrix = (const float*)glm::value_ptr(utilityCore::buildTransformationMatrix(translation, rotation, scale));
-
-		transform[0][0] = matrix[0];
-		transform[0][1] = matrix[4];
-		transform[0][2] = matrix[8];
-		transform[0][3] = matrix[12];
-
-		transform[1][0] = matrix[1];
-		transform[1][1] = matrix[5];
-		transform[1][2] = matrix[9];
-		transform[1][3] = matrix[13];
-
-		transform[2][0] = matrix[2];
-		transform[2][1] = matrix[6];
-		transform[2][2] = matrix[10];
-		transform[2][3] = matrix[14];
-	}
 	return &transform[0][0];
 }
+
+glm::mat4 SceneObject::LocalTransform() const {
+	return utilityCore::buildTransformationMatrix(translation, rotation, scale);
+}
+
+void SceneObject::SetWorld(const glm::mat4& new_world, UINT32 version) {
+	world = new_world;
+	transform_version = version;
+	SceneGraph::ToTransform3x4(world, transform);
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include "DescriptorAllocator.h"
 #include "DirectXRaytracingHelper.h"
 #include "Utilities.h"
+#include "VertexPacking.h"
 #include "shaders/RayTracingHlslCompat.h"
 #include <glm/glm/glm.hpp>
 
@@ -16,10 +18,11 @@ struct Texture {
   UINT sampler_offset = 0;
 
   bool was_loaded_from_gltf = false;
+  int cache_handle = -1; // entry in Scene::texture_cache, -1 if the texels didn't come from a file
 
   D3DBuffer texBuffer;
-  ID3D12Resource *textureBufferUploadHeap;
   D3D12_RESOURCE_DESC textureDesc;
+  DescriptorAllocator::Handle descriptor; // texBuffer's view, its slot is the shader's texture index
 };
 
 // Holds a pointer to each type of texture
@@ -37,12 +40,14 @@ struct MaterialResource
   bool was_loaded_from_gltf = false;
 
   D3DBuffer d3d12_material_resource;
+  DescriptorAllocator::Handle descriptor;
 };
 
 struct InfoResource
 {
   Info info;
   D3DBuffer d3d12_resource;
+  DescriptorAllocator::Handle descriptor; // also the object's InstanceID
 };
 
 // Holds the vertex and index buffer (triangulated) for a loaded model
@@ -52,10 +57,43 @@ struct Model {
 
   D3DBuffer indices;
   D3DBuffer vertices;
+  D3DBuffer tangents; // float4 per vertex, see TangentFrames
+  DescriptorAllocator::Handle descriptor; // one slot for the vertex, index and tangent views
+  //format of the gpu index buffer, indices_vec is always 32 bit
+  DXGI_FORMAT index_format = DXGI_FORMAT_R32_UINT;
+  UINT IndexSize() const;
 
   //ImGUI stuff
   std::vector<Vertex> vertices_vec;
   std::vector<Index> indices_vec;
+  std::vector<XMFLOAT4> tangents_vec;
+
+  //opt-in compact cpu copy, replaces vertices_vec once the model is on the gpu
+  std::vector<VertexPacking::PackedVertex> packed_vertices_vec;
+  VertexPacking::Bounds packed_bounds;
+  void PackCpuVertices();
+  //the cpu vertices whichever form they are kept in
+  std::vector<Vertex> GetCpuVertices() const;
+  //generated LODs: lod_ids[i] is the model for level i + 1, which points back with lod_base
+  std::vector<int> lod_ids;
+  int lod_base = -1;
+  //skinned models are skinned into one persistently mapped upload buffer per frame in flight,
+  //so the cpu never writes what an earlier frame still reads. The frame's buffer is copied to
+  //the default heap vertices and tangents the shaders read, and the BLAS, built to allow
+  //updates, is refit from it in place
+  bool is_dynamic = false;
+  std::vector<D3DBuffer> frame_vertices;
+  std::vector<D3DBuffer> frame_tangents;
+  std::vector<Vertex*> mapped_vertices;
+  std::vector<XMFLOAT4*> mapped_tangents;
+  bool needs_refit = false;
+  // frame_count buffers of each, call after vertices and tangents are uploaded
+  void AllocateDynamicBuffers(ID3D12Device* device, UINT frame_count);
+  // copies frame's skinned vertices and tangents over vertices and tangents
+  void RecordDynamicCopy(ID3D12GraphicsCommandList* commandList, UINT frame);
+  // refit of the built BLAS from frame's skinned vertices
+  D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC GetBottomLevelRefitDesc(UINT frame);
+  D3D12_RAYTRACING_GEOMETRY_DESC refit_geometry_desc{};
   //line vertex buffer is on
   int vertex_line = 0;
   int indices_line = 0;
@@ -106,6 +144,7 @@ struct Model {
 // Holds pointers to a model, textures, and a material
 class SceneObject {
 public:
+  // world transform as of the last Scene::UpdateTransforms
   FLOAT *getTransform3x4();
 
   int id;
@@ -116,14 +155,25 @@ public:
   MaterialResource *material = nullptr;
   InfoResource info_resource{};
 
-  glm::vec3 translation; // parsed transform values
+  // lod_level picks a level of the model's LOD chain; lod_distance > 0 picks it from the
+  // camera distance instead, full detail up to lod_distance and one level less per doubling
+  int lod_level = 0;
+  float lod_distance = 0.0f;
+  bool UsesLod() const { return lod_level > 0 || lod_distance > 0.0f; }
+
+  glm::vec3 translation; // parsed transform values, relative to the parent node
   glm::vec3 rotation;
   glm::vec3 scale;
+  glm::mat4 LocalTransform() const;
 
-  bool transformBuilt = false;
+  int node = -1; // in Scene::scene_graph, created on the first update if unset
+  UINT32 transform_version = 0; // graph version the world transform was copied at
+  bool transformBuilt = false; // cleared when translation/rotation/scale change
+  glm::mat4 world{ 1.0f };
+  void SetWorld(const glm::mat4& new_world, UINT32 version);
 
 private:
-  FLOAT transform[3][4]; // instance desc transform
+  FLOAT transform[3][4]{}; // instance desc transform
 };
 
 struct Camera {
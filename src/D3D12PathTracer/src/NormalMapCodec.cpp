@@ -0,0 +1,152 @@
+#include "stdafx.h"
+#include "NormalMapCodec.h"
+#include "MipChain.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace {
+// normal of a source texel, stored as v * 0.5 + 0.5 per channel
+glm::vec3 SourceNormal(const BYTE* texel, DXGI_FORMAT format)
+{
+  glm::vec3 stored;
+  switch (format)
+  {
+  case DXGI_FORMAT_R8G8B8A8_UNORM:
+    stored = glm::vec3(texel[0], texel[1], texel[2]) / 255.0f;
+    break;
+  case DXGI_FORMAT_B8G8R8A8_UNORM:
+    stored = glm::vec3(texel[2], texel[1], texel[0]) / 255.0f;
+    break;
+  default:
+    memcpy(&stored, texel, sizeof(stored));
+    break;
+  }
+
+  const glm::vec3 normal = stored * 2.0f - 1.0f;
+  const float length = glm::length(normal);
+  return length > 1e-6f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+}
+
+float AngleDegrees(const glm::vec3& a, const glm::vec3& b)
+{
+  return glm::degrees(std::acos(std::min<float>(std::max<float>(glm::dot(a, b), -1.0f), 1.0f)));
+}
+} // namespace
+
+void NormalMapCodec::EncodeTexel(const glm::vec3& normal, INT8 out[2])
+{
+  glm::vec3 direction = glm::normalize(normal);
+  //below the surface the closest direction a rebuilt z can give is on the horizon
+  const float horizontal = std::sqrt(direction.x * direction.x + direction.y * direction.y);
+  if (direction.z < 0.0f && horizontal > 1e-6f)
+  {
+    direction = glm::vec3(direction.x / horizontal, direction.y / horizontal, 0.0f);
+  }
+  const float x = std::floor(direction.x * 127.0f);
+  const float y = std::floor(direction.y * 127.0f);
+
+  //rounding each channel on its own can push x^2 + y^2 past 1 and flatten z
+  float best_cosine = -2.0f;
+  for (int i = 0; i < 4; i++)
+  {
+    const INT8 candidate[2] = {
+      static_cast<INT8>(std::min<float>(std::max<float>(x + (i & 1), -127.0f), 127.0f)),
+      static_cast<INT8>(std::min<float>(std::max<float>(y + (i >> 1), -127.0f), 127.0f))
+    };
+    const float cosine = glm::dot(DecodeTexel(candidate), direction);
+    if (cosine > best_cosine)
+    {
+      best_cosine = cosine;
+      out[0] = candidate[0];
+      out[1] = candidate[1];
+    }
+  }
+}
+
+glm::vec3 NormalMapCodec::DecodeTexel(const INT8 xy[2])
+{
+  //-128 and -127 both mean -1 in snorm
+  const float x = std::max<float>(xy[0] / 127.0f, -1.0f);
+  const float y = std::max<float>(xy[1] / 127.0f, -1.0f);
+  const float z = std::sqrt(std::max<float>(1.0f - x * x - y * y, 0.0f));
+  return glm::normalize(glm::vec3(x, y, z));
+}
+
+AssetLoader::ImageData NormalMapCodec::Encode(const AssetLoader::ImageData& chain, ThreadPool& pool)
+{
+  const DXGI_FORMAT format = chain.desc.Format;
+  if (format != DXGI_FORMAT_R8G8B8A8_UNORM && format != DXGI_FORMAT_B8G8R8A8_UNORM && format != DXGI_FORMAT_R32G32B32A32_FLOAT)
+  {
+    throw std::runtime_error("unsupported normal map format");
+  }
+  const size_t source_texel_bytes = format == DXGI_FORMAT_R32G32B32A32_FLOAT ? 16 : 4;
+
+  const std::vector<MipChain::Level> source_levels = MipChain::Layout(chain.desc);
+  D3D12_RESOURCE_DESC desc = chain.desc;
+  desc.Format = kFormat;
+  const std::vector<MipChain::Level> levels = MipChain::Layout(desc);
+  const size_t total_size = levels.back().offset + levels.back().size;
+
+  AssetLoader::ImageData encoded;
+  encoded.texels = std::unique_ptr<BYTE, AssetLoader::TexelDeleter>(static_cast<BYTE*>(TexelPool::Shared().Allocate(total_size)),
+                                                                    AssetLoader::TexelDeleter{ &TexelPool::Shared() });
+  if (!encoded.texels)
+  {
+    throw std::bad_alloc();
+  }
+  encoded.size = static_cast<int>(total_size);
+  encoded.bytes_per_row = levels[0].bytes_per_row;
+  encoded.desc = desc;
+
+  //rows of every level in one range
+  std::vector<size_t> first_row(levels.size() + 1, 0);
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    first_row[i + 1] = first_row[i] + levels[i].height;
+  }
+  pool.ParallelFor(first_row.back(), [&](size_t row)
+  {
+    const size_t level = std::upper_bound(first_row.begin(), first_row.end(), row) - first_row.begin() - 1;
+    const size_t y = row - first_row[level];
+    const BYTE* source = chain.texels.get() + source_levels[level].offset + y * source_levels[level].bytes_per_row;
+    INT8* target = reinterpret_cast<INT8*>(encoded.texels.get() + levels[level].offset + y * levels[level].bytes_per_row);
+    for (UINT x = 0; x < levels[level].width; x++)
+    {
+      EncodeTexel(SourceNormal(source + x * source_texel_bytes, format), target + x * 2);
+    }
+  });
+  return encoded;
+}
+
+NormalMapCodec::AngularError NormalMapCodec::MeasureError(const AssetLoader::ImageData& source, const AssetLoader::ImageData& encoded)
+{
+  if (encoded.desc.Format != kFormat || source.desc.Width != encoded.desc.Width ||
+      source.desc.Height != encoded.desc.Height || source.desc.MipLevels != encoded.desc.MipLevels)
+  {
+    throw std::runtime_error("normal maps to compare don't match");
+  }
+  const size_t source_texel_bytes = source.desc.Format == DXGI_FORMAT_R32G32B32A32_FLOAT ? 16 : 4;
+  const std::vector<MipChain::Level> source_levels = MipChain::Layout(source.desc);
+  const std::vector<MipChain::Level> levels = MipChain::Layout(encoded.desc);
+
+  AngularError error;
+  double sum = 0.0;
+  for (size_t level = 0; level < levels.size(); level++)
+  {
+    for (UINT y = 0; y < levels[level].height; y++)
+    {
+      const BYTE* a = source.texels.get() + source_levels[level].offset + size_t(y) * source_levels[level].bytes_per_row;
+      const INT8* b = reinterpret_cast<const INT8*>(encoded.texels.get() + levels[level].offset + size_t(y) * levels[level].bytes_per_row);
+      for (UINT x = 0; x < levels[level].width; x++)
+      {
+        const double angle = AngleDegrees(SourceNormal(a + x * source_texel_bytes, source.desc.Format), DecodeTexel(b + x * 2));
+        sum += angle;
+        error.max_degrees = std::max<double>(error.max_degrees, angle);
+        error.texels++;
+      }
+    }
+  }
+  error.mean_degrees = error.texels > 0 ? sum / error.texels : 0.0;
+  return error;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+
+#include "AssetLoader.h"
+
+class ThreadPool;
+
+// Tangent space normal maps stored as two signed channels. Only x and y are
+// kept, the closest hit shader rebuilds z = sqrt(1 - x^2 - y^2), which always
+// points away from the surface as tangent space normals do. Half the memory
+// of RGBA8, and BC5 compresses the same two channels further.
+namespace NormalMapCodec {
+
+constexpr DXGI_FORMAT kFormat = DXGI_FORMAT_R8G8_SNORM;
+
+// x and y of normal as snorm8, whichever of the four nearest pairs rebuilds
+// closest to its direction; normals below the surface go to the horizon
+void EncodeTexel(const glm::vec3& normal, INT8 out[2]);
+// unit normal with z rebuilt, as the shader does it
+glm::vec3 DecodeTexel(const INT8 xy[2]);
+
+// Every level of a normal map chain (RGBA8, BGRA8 or RGBA32F, in [0, 1] for
+// [-1, 1]) as kFormat, rows spread across the pool. Throws for other formats.
+AssetLoader::ImageData Encode(const AssetLoader::ImageData& chain, ThreadPool& pool);
+
+struct AngularError {
+  double mean_degrees = 0.0;
+  double max_degrees = 0.0;
+  size_t texels = 0;
+};
+// Angle between the normals of source and of its Encode output, over every
+// level. encoded can also be a BC5 chain brought back by BlockCompression::Decompress.
+AngularError MeasureError(const AssetLoader::ImageData& source, const AssetLoader::ImageData& encoded);
+
+} // namespace NormalMapCodec
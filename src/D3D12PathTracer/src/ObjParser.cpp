@@ -0,0 +1,440 @@
+#include "stdafx.h"
+#include "ObjParser.h"
+#include "MappedFile.h"
+#include "SceneReader.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include "include/tiny_obj_loader.h"
+
+#include <charconv>
+#include <chrono>
+#include <filesystem>
+
+namespace
+{
+  // below this there's not enough work in a chunk to be worth a task
+  constexpr size_t kMinChunkSize = 256 * 1024;
+
+  // zero based indices of one face corner, -1 when the attribute is missing
+  struct Corner
+  {
+    int position;
+    int texcoord;
+    int normal;
+  };
+
+  // set when the corner used a negative (relative) index, which is only
+  // relative to the chunk until the chunk's base offsets are known
+  enum : UINT8
+  {
+    kRelativePosition = 1,
+    kRelativeTexcoord = 2,
+    kRelativeNormal = 4
+  };
+
+  struct Chunk
+  {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+
+    std::vector<float> positions; // xyz
+    std::vector<float> normals; // xyz
+    std::vector<float> texcoords; // uv
+    std::vector<Corner> corners;
+    std::vector<UINT8> relative; // per corner
+    std::vector<UINT32> face_sizes;
+    size_t triangle_count = 0;
+
+    // offsets of this chunk in the merged arrays
+    int position_base = 0;
+    int normal_base = 0;
+    int texcoord_base = 0;
+    size_t vertex_base = 0;
+  };
+
+  inline bool IsSpace(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  inline const char* SkipSpaces(const char* p, const char* end)
+  {
+    while (p != end && IsSpace(*p))
+    {
+      ++p;
+    }
+    return p;
+  }
+
+  inline const char* SkipLine(const char* p, const char* end)
+  {
+    while (p != end && *p++ != '\n')
+    {
+    }
+    return p;
+  }
+
+  inline const char* TokenEnd(const char* p, const char* end)
+  {
+    while (p != end && !IsSpace(*p) && *p != '\n')
+    {
+      ++p;
+    }
+    return p;
+  }
+
+  // missing components read as 0
+  void ReadFloats(const char*& p, const char* end, float* values, int count, std::vector<float>& out)
+  {
+    for (int i = 0; i < count; i++)
+    {
+      p = SkipSpaces(p, end);
+      const char* token_end = TokenEnd(p, end);
+      values[i] = token_end != p ? SceneReader::ToFloat(std::string_view(p, token_end - p)) : 0.0f;
+      p = token_end;
+    }
+    out.insert(out.end(), values, values + count);
+  }
+
+  // one "v", "v/vt", "v//vn" or "v/vt/vn" group, false at the end of the line
+  bool ReadCorner(const char*& p, const char* end, Chunk& chunk)
+  {
+    p = SkipSpaces(p, end);
+    if (p == end || *p == '\n')
+    {
+      return false;
+    }
+
+    int values[3] = { 0, 0, 0 };
+    for (int k = 0; k < 3; k++)
+    {
+      if (p != end && *p != '/' && !IsSpace(*p) && *p != '\n')
+      {
+        if (*p == '+')
+        {
+          ++p;
+        }
+        auto result = std::from_chars(p, end, values[k]);
+        if (result.ec != std::errc())
+        {
+          throw std::runtime_error("malformed face in OBJ file");
+        }
+        p = result.ptr;
+      }
+      if (p == end || *p != '/')
+      {
+        break;
+      }
+      ++p;
+    }
+    p = TokenEnd(p, end);
+
+    const int counts[3] = {
+      static_cast<int>(chunk.positions.size() / 3),
+      static_cast<int>(chunk.texcoords.size() / 2),
+      static_cast<int>(chunk.normals.size() / 3)
+    };
+    const UINT8 relative_flags[3] = { kRelativePosition, kRelativeTexcoord, kRelativeNormal };
+
+    int resolved[3];
+    UINT8 relative = 0;
+    for (int k = 0; k < 3; k++)
+    {
+      if (values[k] > 0)
+      {
+        resolved[k] = values[k] - 1;
+      }
+      else if (values[k] < 0)
+      {
+        resolved[k] = counts[k] + values[k];
+        relative |= relative_flags[k];
+      }
+      else
+      {
+        resolved[k] = -1;
+      }
+    }
+
+    if (values[0] == 0)
+    {
+      throw std::runtime_error("face without a position index in OBJ file");
+    }
+
+    chunk.corners.push_back({ resolved[0], resolved[1], resolved[2] });
+    chunk.relative.push_back(relative);
+    return true;
+  }
+
+  void ParseChunk(Chunk& chunk)
+  {
+    const char* p = chunk.begin;
+    const char* end = chunk.end;
+    float values[3];
+
+    while (p != end)
+    {
+      p = SkipSpaces(p, end);
+      if (p == end)
+      {
+        break;
+      }
+
+      const char next = p + 1 != end ? p[1] : '\n';
+      const char after_next = p + 1 != end && p + 2 != end ? p[2] : '\n';
+      if (*p == 'v' && IsSpace(next))
+      {
+        p += 1;
+        ReadFloats(p, end, values, 3, chunk.positions);
+      }
+      else if (*p == 'v' && next == 'n' && IsSpace(after_next))
+      {
+        p += 2;
+        ReadFloats(p, end, values, 3, chunk.normals);
+      }
+      else if (*p == 'v' && next == 't' && IsSpace(after_next))
+      {
+        p += 2;
+        ReadFloats(p, end, values, 2, chunk.texcoords);
+      }
+      else if (*p == 'f' && IsSpace(next))
+      {
+        p += 1;
+        const size_t first_corner = chunk.corners.size();
+        while (ReadCorner(p, end, chunk))
+        {
+        }
+
+        const size_t face_size = chunk.corners.size() - first_corner;
+        if (face_size >= 3)
+        {
+          chunk.face_sizes.push_back(static_cast<UINT32>(face_size));
+          chunk.triangle_count += face_size - 2;
+        }
+        else
+        {
+          //points and lines have no triangles
+          chunk.corners.resize(first_corner);
+          chunk.relative.resize(first_corner);
+        }
+      }
+
+      p = SkipLine(p, end);
+    }
+  }
+
+  std::vector<Chunk> SplitChunks(const char* data, size_t size, size_t max_chunks)
+  {
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(max_chunks, size / kMinChunkSize));
+
+    std::vector<Chunk> chunks(chunk_count);
+    const char* end = data + size;
+    const char* begin = data;
+    for (size_t i = 0; i < chunk_count; i++)
+    {
+      //every chunk but the last one ends right after a newline
+      const char* chunk_end = i + 1 == chunk_count ? end : SkipLine(std::max<const char*>(begin, data + size * (i + 1) / chunk_count), end);
+      chunks[i].begin = begin;
+      chunks[i].end = chunk_end;
+      begin = chunk_end;
+    }
+    return chunks;
+  }
+}
+
+ObjParser::Mesh ObjParser::Parse(const std::string& path, ThreadPool& pool, Stats* stats)
+{
+  auto parse_start = std::chrono::high_resolution_clock::now();
+
+  MappedFile file;
+  if (!file.Open(path))
+  {
+    throw std::runtime_error("failed to open OBJ file " + path);
+  }
+
+  std::vector<Chunk> chunks = SplitChunks(file.Data(), file.Size(), pool.Size() * 4);
+  pool.ParallelFor(chunks.size(), [&chunks](size_t i) { ParseChunk(chunks[i]); });
+
+  //merge the attribute arrays in file order
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  size_t vertex_count = 0;
+  for (Chunk& chunk : chunks)
+  {
+    chunk.position_base = static_cast<int>(positions.size() / 3);
+    chunk.normal_base = static_cast<int>(normals.size() / 3);
+    chunk.texcoord_base = static_cast<int>(texcoords.size() / 2);
+    chunk.vertex_base = vertex_count;
+
+    positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+    normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+    texcoords.insert(texcoords.end(), chunk.texcoords.begin(), chunk.texcoords.end());
+    vertex_count += chunk.triangle_count * 3;
+  }
+
+  Mesh mesh;
+  mesh.vertices.resize(vertex_count);
+  mesh.indices.resize(vertex_count);
+
+  const int position_count = static_cast<int>(positions.size() / 3);
+  const int normal_count = static_cast<int>(normals.size() / 3);
+  const int texcoord_count = static_cast<int>(texcoords.size() / 2);
+
+  //every chunk writes its own range of the output, so the triangles can be built in parallel too
+  pool.ParallelFor(chunks.size(), [&](size_t c)
+  {
+    const Chunk& chunk = chunks[c];
+
+    auto make_vertex = [&](size_t corner_index)
+    {
+      Corner corner = chunk.corners[corner_index];
+      UINT8 relative = chunk.relative[corner_index];
+
+      //positive indices are already absolute, relative ones still need the chunk's base
+      if (relative & kRelativePosition) corner.position += chunk.position_base;
+      if (relative & kRelativeTexcoord) corner.texcoord += chunk.texcoord_base;
+      if (relative & kRelativeNormal) corner.normal += chunk.normal_base;
+
+      if (corner.position < 0 || corner.position >= position_count ||
+          corner.texcoord >= texcoord_count || corner.normal >= normal_count ||
+          ((relative & kRelativeTexcoord) && corner.texcoord < 0) || ((relative & kRelativeNormal) && corner.normal < 0))
+      {
+        throw std::runtime_error("OBJ face references a vertex that doesn't exist");
+      }
+
+      Vertex vertex{};
+      vertex.position = XMFLOAT3(&positions[corner.position * 3]);
+      if (corner.normal >= 0)
+      {
+        vertex.normal = XMFLOAT3(&normals[corner.normal * 3]);
+      }
+      if (corner.texcoord >= 0)
+      {
+        vertex.texCoord = XMFLOAT2(texcoords[corner.texcoord * 2], 1 - texcoords[corner.texcoord * 2 + 1]);
+      }
+      return vertex;
+    };
+
+    size_t out = chunk.vertex_base;
+    size_t face_start = 0;
+    for (UINT32 face_size : chunk.face_sizes)
+    {
+      //fan triangulation, same as tinyobj
+      for (UINT32 t = 1; t + 1 < face_size; t++)
+      {
+        const size_t triangle[3] = { face_start, face_start + t, face_start + t + 1 };
+        for (size_t corner : triangle)
+        {
+          mesh.vertices[out] = make_vertex(corner);
+          mesh.indices[out] = static_cast<Index>(out);
+          out++;
+        }
+      }
+      face_start += face_size;
+    }
+  });
+
+  if (stats != nullptr)
+  {
+    stats->bytes = file.Size();
+    stats->chunks = chunks.size();
+    stats->triangles = vertex_count / 3;
+    stats->milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - parse_start).count();
+  }
+
+  return mesh;
+}
+
+ObjParser::BenchmarkResult ObjParser::Benchmark(const std::string& path, ThreadPool& pool)
+{
+  BenchmarkResult result;
+  Parse(path, pool);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  Stats stats;
+  Parse(path, pool, &stats);
+  auto end = std::chrono::high_resolution_clock::now();
+  result.bytes = stats.bytes;
+  result.triangles = stats.triangles;
+  result.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  //materials aren't read by Parse, so tinyobj gets no base path to find them in
+  start = std::chrono::high_resolution_clock::now();
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str());
+  end = std::chrono::high_resolution_clock::now();
+  result.tinyobj_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+  for (const tinyobj::shape_t& shape : shapes)
+  {
+    result.tinyobj_triangles += shape.mesh.num_face_vertices.size();
+  }
+
+  start = std::chrono::high_resolution_clock::now();
+  objl::Loader loader;
+  loader.LoadFile(path);
+  end = std::chrono::high_resolution_clock::now();
+  result.objl_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+  result.objl_triangles = loader.LoadedIndices.size() / 3;
+  return result;
+}
+
+std::vector<std::string> ObjParser::ShippedModels()
+{
+  std::vector<std::string> files;
+  for (const char* directory : { "src/objects", "src/scenes" })
+  {
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(directory))
+    {
+      if (entry.is_regular_file() && entry.path().extension() == ".obj")
+      {
+        files.push_back(entry.path().generic_string());
+      }
+    }
+  }
+  return files;
+}
+
+int ObjParser::RunBenchmark(const std::vector<std::string>& paths)
+{
+  const std::vector<std::string> files = paths.empty() ? ShippedModels() : paths;
+
+  std::wstringstream wstr;
+  auto rates = [&wstr](size_t bytes, size_t triangles, double milliseconds)
+  {
+    const double seconds = std::max<double>(milliseconds, 0.001) / 1000.0;
+    wstr << bytes / (1024.0 * 1024.0) / seconds << L" MB/s, " << triangles / seconds / 1e6 << L" M triangles/s";
+  };
+
+  BenchmarkResult total;
+  for (const std::string& file : files)
+  {
+    const BenchmarkResult result = Benchmark(file, ThreadPool::Shared());
+    wstr << L"objbench: " << file.c_str() << L", " << result.triangles << L" triangles\n  ObjParser ";
+    rates(result.bytes, result.triangles, result.milliseconds);
+    wstr << L"\n  tinyobj   ";
+    rates(result.bytes, result.triangles, result.tinyobj_milliseconds);
+    wstr << L"\n  objl      ";
+    rates(result.bytes, result.triangles, result.objl_milliseconds);
+    wstr << L"\n";
+    if (result.tinyobj_triangles != result.triangles || result.objl_triangles != result.triangles)
+    {
+      wstr << L"  triangle counts differ: tinyobj " << result.tinyobj_triangles << L", objl " << result.objl_triangles << L"\n";
+    }
+
+    total.bytes += result.bytes;
+    total.triangles += result.triangles;
+    total.milliseconds += result.milliseconds;
+    total.tinyobj_milliseconds += result.tinyobj_milliseconds;
+    total.objl_milliseconds += result.objl_milliseconds;
+    total.tinyobj_triangles += result.tinyobj_triangles;
+    total.objl_triangles += result.objl_triangles;
+  }
+  wstr << L"objbench: " << files.size() << L" files, " << total.bytes / (1024.0 * 1024.0) << L" MB, ObjParser "
+       << total.tinyobj_milliseconds / total.milliseconds << L"x tinyobj, " << total.objl_milliseconds / total.milliseconds
+       << L"x objl\n";
+  utilityCore::report(wstr.str());
+  return total.tinyobj_triangles == total.triangles ? 0 : 1;
+}
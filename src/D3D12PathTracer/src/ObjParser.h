@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+class ThreadPool;
+
+// OBJ reader for the model import path. The file is mapped, split into
+// newline aligned chunks and the chunks are parsed in parallel; results are
+// merged in file order so the output doesn't depend on the thread count.
+// Only v/vn/vt/f records are read, faces are fan triangulated and every
+// triangle corner gets its own vertex (welding is left to MeshOptimizer).
+namespace ObjParser {
+
+struct Mesh
+{
+  std::vector<Vertex> vertices;
+  std::vector<Index> indices;
+};
+
+struct Stats
+{
+  size_t bytes = 0;
+  size_t chunks = 0;
+  size_t triangles = 0;
+  double milliseconds = 0.0;
+};
+
+// Throws std::runtime_error if the file can't be read or references
+// vertices that don't exist.
+Mesh Parse(const std::string& path, ThreadPool& pool, Stats* stats = nullptr);
+
+struct BenchmarkResult
+{
+  size_t bytes = 0;
+  size_t triangles = 0;
+  double milliseconds = 0.0; // Parse on the pool
+  double tinyobj_milliseconds = 0.0; // tinyobj::LoadObj, what DecodeObj used before
+  double objl_milliseconds = 0.0; // objl::Loader, what MeshLoader uses
+  size_t tinyobj_triangles = 0; // fans polygons like Parse, so this should match
+  size_t objl_triangles = 0; // ear clips polygons, which can differ on ngons
+};
+// Times the three readers on path after one untimed Parse to warm the file cache
+BenchmarkResult Benchmark(const std::string& path, ThreadPool& pool);
+// Every .obj below src/objects and src/scenes, the default file list of the benchmarks
+std::vector<std::string> ShippedModels();
+// -objbench [files...]: runs Benchmark on the files, ShippedModels() by default, and prints MB/s and triangles/s; no window or device is created.
+// Returns 1 if tinyobj reads a different triangle count than Parse
+int RunBenchmark(const std::vector<std::string>& paths);
+} // namespace ObjParser
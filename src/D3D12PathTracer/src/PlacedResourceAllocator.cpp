@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "PlacedResourceAllocator.h"
+
+namespace {
+D3D12_HEAP_TYPE HeapType(UINT32 pool)
+{
+  return pool == PlacedResourceAllocator::UploadBuffers ? D3D12_HEAP_TYPE_UPLOAD : D3D12_HEAP_TYPE_DEFAULT;
+}
+
+D3D12_HEAP_FLAGS HeapFlags(UINT32 pool)
+{
+  return pool == PlacedResourceAllocator::DefaultTextures ? D3D12_HEAP_FLAG_ALLOW_ONLY_NON_RT_DS_TEXTURES : D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS;
+}
+} // namespace
+
+PlacedResourceAllocator::PlacedResourceAllocator(ID3D12Device* device, UINT64 page_size)
+  : device(device), suballocator(PoolCount, page_size, HeapCallbacks())
+{
+}
+
+PlacedResourceAllocator::~PlacedResourceAllocator()
+{
+  Reset();
+}
+
+HeapSuballocator::Callbacks PlacedResourceAllocator::HeapCallbacks()
+{
+  HeapSuballocator::Callbacks callbacks;
+  callbacks.create_page = [this](UINT32 pool, UINT32 page, UINT64 size)
+  {
+    D3D12_HEAP_DESC heap_desc = {};
+    heap_desc.SizeInBytes = size;
+    heap_desc.Properties = CD3DX12_HEAP_PROPERTIES(HeapType(pool));
+    heap_desc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    heap_desc.Flags = HeapFlags(pool);
+
+    ComPtr<ID3D12Heap> heap;
+    ThrowIfFailed(device->CreateHeap(&heap_desc, IID_PPV_ARGS(&heap)));
+    heap->SetName((std::wstring(PoolName(pool)) + L" Heap " + std::to_wstring(page)).c_str());
+    if (page >= heaps[pool].size())
+    {
+      heaps[pool].resize(page + 1);
+    }
+    heaps[pool][page] = heap;
+  };
+  callbacks.release_page = [this](UINT32 pool, UINT32 page)
+  {
+    heaps[pool][page].Reset();
+  };
+  return callbacks;
+}
+
+const wchar_t* PlacedResourceAllocator::PoolName(UINT32 pool)
+{
+  switch (pool)
+  {
+  case DefaultBuffers: return L"Buffer";
+  case DefaultTextures: return L"Texture";
+  case UploadBuffers: return L"Upload";
+  default: return L"?";
+  }
+}
+
+void PlacedResourceAllocator::CreateResource(HeapSuballocator::Category category, D3D12_HEAP_TYPE heap_type, const D3D12_RESOURCE_DESC& desc,
+                                             D3D12_RESOURCE_STATES initial_state, ID3D12Resource** resource)
+{
+  UINT32 pool;
+  D3D12_RESOURCE_DESC placed_desc = desc;
+  D3D12_RESOURCE_ALLOCATION_INFO info;
+  if (desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER)
+  {
+    pool = heap_type == D3D12_HEAP_TYPE_UPLOAD ? UploadBuffers : DefaultBuffers;
+    info = device->GetResourceAllocationInfo(0, 1, &placed_desc);
+  }
+  else
+  {
+    if (heap_type != D3D12_HEAP_TYPE_DEFAULT)
+    {
+      throw std::invalid_argument("placed textures live in default heaps only");
+    }
+    pool = DefaultTextures;
+    //small textures may take 4KB alignment, D3D12 says so by handing it back
+    placed_desc.Alignment = D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT;
+    info = device->GetResourceAllocationInfo(0, 1, &placed_desc);
+    if (info.Alignment != D3D12_SMALL_RESOURCE_PLACEMENT_ALIGNMENT)
+    {
+      placed_desc.Alignment = 0;
+      info = device->GetResourceAllocationInfo(0, 1, &placed_desc);
+    }
+  }
+
+  const HeapSuballocator::Allocation allocation = suballocator.Allocate(pool, category, info.SizeInBytes, info.Alignment);
+  const HRESULT result = device->CreatePlacedResource(heaps[pool][allocation.page].Get(), allocation.range.offset, &placed_desc,
+                                                      initial_state, nullptr, IID_PPV_ARGS(resource));
+  if (FAILED(result))
+  {
+    suballocator.Free(allocation);
+    ThrowIfFailed(result);
+  }
+}
+
+void PlacedResourceAllocator::Reset()
+{
+  suballocator.Reset();
+  for (auto& pool_heaps : heaps)
+  {
+    pool_heaps.clear();
+  }
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "HeapSuballocator.h"
+
+// Scene resources as placed resources in a few large heaps, laid out by
+// HeapSuballocator. Heaps only hold buffers or only textures, which every
+// resource heap tier allows; textures ask for the 4KB small resource
+// alignment when D3D12 grants it, so small ones stop taking a 64KB slot each.
+// Resources aren't freed one by one: the scene releases all of its resources
+// and Reset drops every heap at once.
+class PlacedResourceAllocator {
+public:
+  enum Pool : UINT32 {
+    DefaultBuffers,
+    DefaultTextures,
+    UploadBuffers, // CPU written constants
+    PoolCount
+  };
+
+  explicit PlacedResourceAllocator(ID3D12Device* device, UINT64 page_size = 64ull << 20);
+  ~PlacedResourceAllocator();
+
+  PlacedResourceAllocator(const PlacedResourceAllocator&) = delete;
+  PlacedResourceAllocator& operator=(const PlacedResourceAllocator&) = delete;
+
+  // Placed resource for desc, in default memory or upload memory when
+  // heap_type says so. category is only for the statistics.
+  void CreateResource(HeapSuballocator::Category category, D3D12_HEAP_TYPE heap_type, const D3D12_RESOURCE_DESC& desc,
+                      D3D12_RESOURCE_STATES initial_state, ID3D12Resource** resource);
+
+  // every resource created so far has to be released before this
+  void Reset();
+
+  // planning defragmentation and the statistics
+  HeapSuballocator& Suballocator() { return suballocator; }
+  static const wchar_t* PoolName(UINT32 pool);
+
+private:
+  // backs suballocator pages with ID3D12Heaps in heaps
+  HeapSuballocator::Callbacks HeapCallbacks();
+
+  ID3D12Device* device;
+  std::vector<ComPtr<ID3D12Heap>> heaps[PoolCount]; // built before suballocator, which fills it
+  HeapSuballocator suballocator;
+};
@@ -1,93 +1,148 @@
 #include "stdafx.h"
 #include "Scene.h"
 #include "Utilities.h"
+#include <chrono>
 #include <cstring>
+#include <tuple>
 #include <glm/glm/gtc/matrix_inverse.hpp>
 #include <glm/glm/gtx/string_cast.hpp>
 #include "include/tiny_obj_loader.h"
 #include "DirectXRaytracingHelper.h"
 #include "D3D12RaytracingSimpleLighting.h"
 #include "TextureLoader.h"
+#include "TextureDiskCache.h"
+#include "BlockCompression.h"
+#include "NormalMapCodec.h"
+#include "IndexBuffer.h"
+#include "MeshSimplifier.h"
+#include "TangentFrames.h"
+#include "ThreadPool.h"
+#include "UploadRing.h"
 
 #define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #define STBI_MSC_SECURE_CRT
+//the json.hpp it brings in derives from std::iterator, deprecated in C++17
+#pragma warning(push)
+#pragma warning(disable : 4996)
 #include "tiny_gltf.h"
+#pragma warning(pop)
 #include <glm/glm/gtc/type_ptr.inl>
 
 using namespace tinyobj;
 using namespace std;
 
-void Scene::AllocateBufferOnGpu(void *pData, UINT64 width, ID3D12Resource **ppResource, std::wstring resource_name, CD3DX12_RESOURCE_DESC* resource_desc_ptr)
+Scene::BufferUpload::BufferUpload(void *pData, UINT64 width, ID3D12Resource **ppResource, std::wstring resource_name, const D3D12_RESOURCE_DESC* resource_desc_ptr)
+  : pData(pData), width(width), ppResource(ppResource), resource_name(std::move(resource_name))
 {
-  CD3DX12_RESOURCE_DESC resource_desc;
   if (resource_desc_ptr == nullptr)
   {
-    resource_desc = CD3DX12_RESOURCE_DESC::Buffer(width);    
+    resource_desc = CD3DX12_RESOURCE_DESC::Buffer(width);
   }
   else
   {
-    resource_desc = *resource_desc_ptr;
+    resource_desc = CD3DX12_RESOURCE_DESC(*resource_desc_ptr);
   }
+  category = resource_desc.Dimension == D3D12_RESOURCE_DIMENSION_BUFFER ? HeapSuballocator::Category::Vertices : HeapSuballocator::Category::Textures;
+}
 
-  auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
-  auto device = programState->GetDeviceResources()->GetD3DDevice();
-  ThrowIfFailed(device->CreateCommittedResource(
-    &defaultHeapProperties,
-    D3D12_HEAP_FLAG_NONE,
-    &resource_desc,
-    D3D12_RESOURCE_STATE_COPY_DEST,
-    nullptr,
-    IID_PPV_ARGS(ppResource)));
-
-  (*ppResource)->SetName(std::wstring(L"Default Heap " + resource_name).c_str());
-
-  UINT64 textureUploadBufferSize;
-  // this function gets the size an upload buffer needs to be to upload a texture to the gpu.
-  // each row must be 256 byte aligned except for the last row, which can just be the size in bytes of the row
-  // eg. textureUploadBufferSize = ((((width * numBytesPerPixel) + 255) & ~255) * (height - 1)) + (width * numBytesPerPixel);
-  //textureUploadBufferSize = (((imageBytesPerRow + 255) & ~255) * (textureDesc.Height - 1)) + imageBytesPerRow;
-  device->GetCopyableFootprints(&resource_desc, 0, 1, 0, nullptr, nullptr, nullptr, &textureUploadBufferSize);
-
-  ID3D12Resource* textureBufferUploadHeap = programState->GetTextureBufferUploadHeap();
-  // now we create an upload heap to upload our texture to the GPU
-  ThrowIfFailed(device->CreateCommittedResource(
-    &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), // upload heap
-    D3D12_HEAP_FLAG_NONE, // no flags
-    &CD3DX12_RESOURCE_DESC::Buffer(textureUploadBufferSize),
-    // resource description for a buffer (storing the image data in this heap just to copy to the default heap)
-    D3D12_RESOURCE_STATE_GENERIC_READ, // We will copy the contents from this heap to the default heap above
-    nullptr,
-    IID_PPV_ARGS(&textureBufferUploadHeap)));
-
-  textureBufferUploadHeap->SetName(std::wstring(L"Upload Heap " + resource_name).c_str());
-
-  // store vertex buffer in upload heap
-  D3D12_SUBRESOURCE_DATA textureData = {};
-  textureData.pData = pData; // pointer to our image data
-  textureData.RowPitch = width; // size of all our triangle vertex data
-  textureData.SlicePitch = width * resource_desc.Height; // also the size of our triangle vertex data    
+Scene::BufferUpload Scene::MakeTextureUpload(const BYTE* texels, const D3D12_RESOURCE_DESC& desc, ID3D12Resource **ppResource, std::wstring resource_name)
+{
+  const std::vector<MipChain::Level> levels = MipChain::Layout(desc);
+  BufferUpload upload(const_cast<BYTE*>(texels), levels[0].bytes_per_row, ppResource, std::move(resource_name), &desc);
+  for (const MipChain::Level& level : levels)
+  {
+    D3D12_SUBRESOURCE_DATA data = {};
+    data.pData = texels + level.offset;
+    data.RowPitch = level.bytes_per_row;
+    data.SlicePitch = level.size;
+    upload.subresources.push_back(data);
+  }
+  return upload;
+}
+
+void Scene::AllocateBufferOnGpu(void *pData, UINT64 width, ID3D12Resource **ppResource, std::wstring resource_name, CD3DX12_RESOURCE_DESC* resource_desc_ptr)
+{
+  AllocateBuffersOnGpu({ BufferUpload(pData, width, ppResource, std::move(resource_name), resource_desc_ptr) });
+}
+
+void Scene::AllocateBuffersOnGpu(const std::vector<BufferUpload>& uploads)
+{
+  if (uploads.empty())
+  {
+    return;
+  }
 
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
   auto commandList = programState->GetDeviceResources()->GetCommandList();
-  auto commandAllocator = programState->GetDeviceResources()->GetCommandAllocator();
+  UploadRing& ring = programState->GetUploadRing();
+  PlacedResourceAllocator& placed_resources = programState->GetPlacedResources();
+
+  ring.Begin();
+
+  for (const BufferUpload& upload : uploads)
+  {
+    const CD3DX12_RESOURCE_DESC& resource_desc = upload.resource_desc;
+    ID3D12Resource** ppResource = upload.ppResource;
+
+    placed_resources.CreateResource(upload.category, D3D12_HEAP_TYPE_DEFAULT, resource_desc, D3D12_RESOURCE_STATE_COPY_DEST, ppResource);
+
+    (*ppResource)->SetName(std::wstring(L"Default Heap " + upload.resource_name).c_str());
+
+    UINT64 textureUploadBufferSize;
+    // this function gets the size an upload buffer needs to be to upload a texture to the gpu.
+    // each row must be 256 byte aligned except for the last row, which can just be the size in bytes of the row
+    // eg. textureUploadBufferSize = ((((width * numBytesPerPixel) + 255) & ~255) * (height - 1)) + (width * numBytesPerPixel);
+    //textureUploadBufferSize = (((imageBytesPerRow + 255) & ~255) * (textureDesc.Height - 1)) + imageBytesPerRow;
+    const UINT subresource_count = upload.subresources.empty() ? 1 : static_cast<UINT>(upload.subresources.size());
+    device->GetCopyableFootprints(&resource_desc, 0, subresource_count, 0, nullptr, nullptr, nullptr, &textureUploadBufferSize);
+
+    // staged in the upload ring, the source data is copied in right away so nothing has to wait for the GPU here
+    ID3D12Resource* uploadSource = programState->GetUploadRingResource();
+    UINT64 uploadOffset = 0;
+    if (ring.Fits(textureUploadBufferSize))
+    {
+      uploadOffset = ring.Allocate(textureUploadBufferSize, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT).offset;
+    }
+    else
+    {
+      //bigger than the whole ring, gets an upload heap of its own that lives until the batch retires
+      ComPtr<ID3D12Resource> textureBufferUploadHeap;
+      ThrowIfFailed(device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD), // upload heap
+        D3D12_HEAP_FLAG_NONE, // no flags
+        &CD3DX12_RESOURCE_DESC::Buffer(textureUploadBufferSize),
+        D3D12_RESOURCE_STATE_GENERIC_READ, // We will copy the contents from this heap to the default heap above
+        nullptr,
+        IID_PPV_ARGS(&textureBufferUploadHeap)));
+      textureBufferUploadHeap->SetName(std::wstring(L"Upload Heap " + upload.resource_name).c_str());
 
-  commandList->Reset(commandAllocator, nullptr);
+      uploadSource = textureBufferUploadHeap.Get();
+      ring.HoldUntilRetired(std::shared_ptr<void>(textureBufferUploadHeap.Detach(), [](void* heap)
+      {
+        static_cast<ID3D12Resource*>(heap)->Release();
+      }));
+    }
 
-  // Reset the command list for the acceleration structure construction.
-  UpdateSubresources(commandList, *ppResource, textureBufferUploadHeap, 0, 0, 1, &textureData);
+    // store vertex buffer in upload heap
+    D3D12_SUBRESOURCE_DATA textureData = {};
+    textureData.pData = upload.pData; // pointer to our image data
+    textureData.RowPitch = upload.width; // size of all our triangle vertex data
+    textureData.SlicePitch = upload.width * resource_desc.Height; // also the size of our triangle vertex data
 
-  // transition the texture default heap to a pixel shader resource (we will be sampling from this heap in the pixel shader to get the color of pixels)
-  commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(*ppResource, D3D12_RESOURCE_STATE_COPY_DEST,
-                                                                        D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
-                                                                        D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+    UpdateSubresources(commandList, *ppResource, uploadSource, uploadOffset, 0, subresource_count,
+                       upload.subresources.empty() ? &textureData : upload.subresources.data());
 
-  // Kick off texture uploading
-  programState->GetDeviceResources()->ExecuteCommandList();
+    // transition the texture default heap to a pixel shader resource (we will be sampling from this heap in the pixel shader to get the color of pixels)
+    commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(*ppResource, D3D12_RESOURCE_STATE_COPY_DEST,
+                                                                          D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE |
+                                                                          D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+  }
 
-  // Wait for GPU to finish as the locally created temporary GPU resources will get released once we go out of scope.
-  programState->GetDeviceResources()->WaitForGpu();
-};
+  // Kick off uploading. Work submitted later runs after these copies on the same queue, so only the ring
+  // waits, and only once it needs the space back.
+  ring.Submit();
+}
 
 void OuputAndReset(std::wstringstream& stream)
 {
@@ -101,17 +156,27 @@ void OuputAndReset(std::wstringstream& stream)
 
 
 Scene::Scene(string filename, D3D12RaytracingSimpleLighting* programState) : programState(programState) {
+        compress_textures = programState->compress_textures;
 
-        if (filename.find(".gltf") != std::string::npos)
+        if (AssetLoader::IsGltfPath(filename))
         {
           ParseGLTF(filename);
         }
+        else if (filename.find(".rtxpack") != std::string::npos)
+        {
+          ParseBundle(filename);
+        }
         else
         {
           ParseScene(filename);
         }
 }
 
+// resources go with their members; the GPU has to be done with them
+Scene::~Scene()
+{
+}
+
 void Scene::ParseScene(std::string filename)
 {
   std::wstringstream wstr;
@@ -121,100 +186,242 @@ void Scene::ParseScene(std::string filename)
   wstr << L"------------------------------------------------------------------------------\n";
   OuputAndReset(wstr);
 
-  char* fname = (char*)filename.c_str();
-  fp_in.open(fname);
-  if (!fp_in.is_open()) {
+  auto parse_start = std::chrono::high_resolution_clock::now();
+  if (!reader.Open(filename)) {
     wstr << L"Error reading from file - aborting!\n";
     wstr << L"------------------------------------------------------------------------------\n";
     OuputAndReset(wstr);
     throw;
   }
-  while (fp_in.good()) {
-    string line;
-    utilityCore::safeGetline(fp_in, line);
-    if (!line.empty()) {
-      vector<string> tokens = utilityCore::tokenizeString(line);
+
+  std::vector<std::string_view> tokens;
+  while (reader.NextLine(tokens)) {
+    if (!tokens.empty()) {
       std::string name{};
       if (tokens.size() == 3)
       {
-        name = tokens[2];
+        name = std::string(tokens[2]);
       }
-      if (strcmp(tokens[0].c_str(), "MATERIAL") == 0) {
-
+      if (tokens[0] == "MATERIAL") {
         loadMaterial(tokens[1], name);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "MODEL") == 0) {
+      else if (tokens[0] == "MODEL") {
         loadModel(tokens[1]);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "DIFFUSE_TEXTURE") == 0) {
+      else if (tokens[0] == "DIFFUSE_TEXTURE") {
         loadDiffuseTexture(tokens[1]);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "NORMAL_TEXTURE") == 0) {
+      else if (tokens[0] == "NORMAL_TEXTURE") {
         loadNormalTexture(tokens[1]);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "OBJECT") == 0) {
+      else if (tokens[0] == "OBJECT") {
         loadObject(tokens[1], name);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "GLTF") == 0) {
-        ParseGLTF(tokens[1], false);
+      else if (tokens[0] == "GLTF") {
+        pending_gltfs.emplace_back(tokens[1]);
         std::cout << " " << endl;
       }
-      else if (strcmp(tokens[0].c_str(), "CAMERA") == 0) {
+      else if (tokens[0] == "PACK_VERTICES") {
+        pack_cpu_vertices = true;
+      }
+      else if (tokens[0] == "LOD_CHAIN") {
+        lod_ratios.clear();
+        for (size_t i = 1; i < tokens.size(); i++) {
+          lod_ratios.push_back(SceneReader::ToFloat(tokens[i]));
+        }
+      }
+      else if (tokens[0] == "CAMERA") {
         loadCamera();
         programState->UpdateCameraMatrices();
       }
     }
   }
 
-  wstr << L"Done loading the scene file!\n";
+  LoadPendingAssets();
+  BuildLodChains();
+  SelectLods(camera.eye);
+  if (pack_cpu_vertices)
+  {
+    PackCpuVertices();
+  }
+
+  auto parse_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - parse_start);
+  wstr << L"Done loading the scene file in " << parse_time.count() << L" ms!\n";
   wstr << L"------------------------------------------------------------------------------\n";
   OuputAndReset(wstr);
 }
 
 
-template <typename Callback>
-void Scene::RecurseGLTF(tinygltf::Model& model, tinygltf::Node& node, Callback callback)
+void Scene::ParseBundle(std::string filename)
 {
-  if (node.mesh != -1)
+  std::wstringstream wstr;
+  wstr << L"\n";
+  wstr << L"------------------------------------------------------------------------------\n";
+  wstr << L"Reading scene bundle from " << filename.c_str() << L"\n";
+  wstr << L"------------------------------------------------------------------------------\n";
+  OuputAndReset(wstr);
+
+  auto load_start = std::chrono::high_resolution_clock::now();
+  if (!bundle.Open(filename))
   {
-    callback(model, node);
+    wstr << L"Error reading scene bundle (missing, corrupt or wrong version) - aborting!\n";
+    wstr << L"------------------------------------------------------------------------------\n";
+    OuputAndReset(wstr);
+    throw std::runtime_error("failed to load scene bundle " + filename);
   }
-  for (size_t i = 0; i < node.children.size(); i++)
+
+  const SceneBundle::Header& header = bundle.GetHeader();
+
+  //models, uploaded straight from the mapping
+  for (UINT32 i = 0; i < header.model_count; i++)
   {
-    RecurseGLTF(model, model.nodes[node.children[i]], callback);
+    const SceneBundle::ModelRecord& record = bundle.Models()[i];
+
+    ModelLoading::Model new_model;
+    new_model.id = record.id;
+    new_model.name = bundle.String(record.name);
+    new_model.verticesCount = record.vertex_count;
+    new_model.indicesCount = record.index_count;
+
+    new_model.tangents_vec.resize(record.vertex_count);
+    TangentFrames::Generate(bundle.Vertices(record), record.vertex_count, bundle.Indices(record), record.index_count, new_model.tangents_vec.data());
+
+    AllocateBuffersOnGpu({
+      MakeIndexUpload(new_model, bundle.Indices(record), record.index_count, record.vertex_count, utilityCore::stringAndId(L"Vertices", record.id)),
+      BufferUpload(const_cast<Vertex*>(bundle.Vertices(record)), record.vertex_count * sizeof(Vertex), &new_model.vertices.resource,
+                   utilityCore::stringAndId(L"Indices", record.id)),
+      MakeTangentUpload(new_model, utilityCore::stringAndId(L"Tangents", record.id))
+    });
+
+    modelMap.insert({record.id, std::move(new_model)});
   }
-}
 
+  //textures
+  auto load_textures = [&](const SceneBundle::TextureRecord* records, UINT32 count, std::map<int, ModelLoading::Texture>& texture_map, const std::wstring& resource_name)
+  {
+    for (UINT32 i = 0; i < count; i++)
+    {
+      const SceneBundle::TextureRecord& record = records[i];
+
+      ModelLoading::Texture new_texture;
+      new_texture.id = record.id;
+      new_texture.name = bundle.String(record.name);
+      new_texture.was_loaded_from_gltf = record.was_loaded_from_gltf != 0;
+      new_texture.textureDesc = CD3DX12_RESOURCE_DESC::Tex2D(static_cast<DXGI_FORMAT>(record.format), record.width, record.height, 1,
+                                                             static_cast<UINT16>(record.mip_levels));
+
+      std::vector<BYTE> placeholder;
+      const BYTE* texels = bundle.Texels(record);
+      if (record.texel_size == 0)
+      {
+        placeholder.resize(UINT64(record.row_pitch) * record.height);
+        texels = placeholder.data();
+      }
 
-void Scene::ParseGLTF(std::string filename, bool make_light)
-{
-  tinygltf::Model model;
-  tinygltf::TinyGLTF loader;
-  std::string err;
-  std::string warn;
+      AllocateBuffersOnGpu({ MakeTextureUpload(texels, new_texture.textureDesc, &new_texture.texBuffer.resource, utilityCore::stringAndId(resource_name, record.id)) });
+      texture_map.insert({record.id, std::move(new_texture)});
+    }
+  };
+  load_textures(bundle.DiffuseTextures(), header.diffuse_texture_count, diffuseTextureMap, L"Diffuse Texture");
+  load_textures(bundle.NormalTextures(), header.normal_texture_count, normalTextureMap, L"Normal Texture");
 
-  bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, filename);
-  if (!warn.empty())
+  //materials
+  for (UINT32 i = 0; i < header.material_count; i++)
   {
-    printf("Warn: %s\n", warn.c_str());
+    const SceneBundle::MaterialRecord& record = bundle.Materials()[i];
+
+    ModelLoading::MaterialResource new_material{};
+    new_material.id = record.id;
+    new_material.name = bundle.String(record.name);
+    new_material.was_loaded_from_gltf = record.was_loaded_from_gltf != 0;
+    new_material.material = record.material;
+    materialMap.insert({record.id, std::move(new_material)});
   }
 
-  if (!err.empty())
+  //objects, linked once all maps are filled
+  auto find = [](auto& map, INT32 id) -> decltype(&map.begin()->second)
+  {
+    auto it = map.find(id);
+    return it == map.end() ? nullptr : &it->second;
+  };
+
+  for (UINT32 i = 0; i < header.object_count; i++)
   {
-    printf("Err: %s\n", err.c_str());
+    const SceneBundle::ObjectRecord& record = bundle.Objects()[i];
+
+    ModelLoading::SceneObject new_object{};
+    new_object.id = record.id;
+    new_object.name = bundle.String(record.name);
+    new_object.model = find(modelMap, record.model_id);
+    new_object.textures.albedoTex = find(diffuseTextureMap, record.diffuse_texture_id);
+    new_object.textures.normalTex = find(normalTextureMap, record.normal_texture_id);
+    new_object.material = find(materialMap, record.material_id);
+    new_object.translation = glm::vec3(record.translation[0], record.translation[1], record.translation[2]);
+    new_object.rotation = glm::vec3(record.rotation[0], record.rotation[1], record.rotation[2]);
+    new_object.scale = glm::vec3(record.scale[0], record.scale[1], record.scale[2]);
+
+    //the hierarchy above the object is baked into one parent node
+    glm::mat4 parent_transform(1.0f);
+    for (int r = 0; r < 3; r++)
+    {
+      for (int c = 0; c < 4; c++)
+      {
+        parent_transform[c][r] = record.parent_transform[r][c];
+      }
+    }
+    if (parent_transform != glm::mat4(1.0f))
+    {
+      new_object.node = scene_graph.AddNode(scene_graph.AddNode(SceneGraph::kRoot, parent_transform));
+    }
+    objects.emplace_back(std::move(new_object));
   }
 
-  if (!ret)
+  //camera
+  const SceneBundle::CameraRecord& bundle_camera = header.camera;
+  camera.fov = bundle_camera.fov;
+  camera.maxDepth = bundle_camera.max_depth;
+  camera.eye = XMVectorSet(bundle_camera.eye[0], bundle_camera.eye[1], bundle_camera.eye[2], 0.0f);
+  camera.lookat = XMVectorSet(bundle_camera.lookat[0], bundle_camera.lookat[1], bundle_camera.lookat[2], 0.0f);
+  camera.up = XMVectorSet(bundle_camera.up[0], bundle_camera.up[1], bundle_camera.up[2], 0.0f);
+  programState->UpdateCameraMatrices();
+
+  auto load_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - load_start);
+  wstr << L"Done loading the scene bundle in " << load_time.count() << L" ms!\n";
+  wstr << L"------------------------------------------------------------------------------\n";
+  OuputAndReset(wstr);
+}
+
+template <typename Callback>
+void Scene::RecurseGLTF(tinygltf::Model& model, int node_index, int parent, std::vector<int>& graph_nodes, Callback callback)
+{
+  //mesh-less nodes get a graph node too, their transform still applies to the children (and joints move skins)
+  tinygltf::Node& node = model.nodes[node_index];
+  int graph_node = scene_graph.AddNode(parent, AssetLoader::GltfNodeTransform(node));
+  graph_nodes[node_index] = graph_node;
+  if (node.mesh != -1)
+  {
+    callback(model, node_index, graph_node);
+  }
+  for (size_t i = 0; i < node.children.size(); i++)
   {
-    printf("Failed to parse glTF\n");
-    exit(-1);
+    RecurseGLTF(model, node.children[i], graph_node, graph_nodes, callback);
   }
+}
+
+
+void Scene::ParseGLTF(std::string filename, bool make_light)
+{
+  tinygltf::Model model = AssetLoader::DecodeGltf(filename);
+  ParseGLTF(filename, model, make_light);
+}
 
+void Scene::ParseGLTF(std::string filename, tinygltf::Model& model, bool make_light)
+{
   int model_id = 0;
   int diffuse_texture_id = 0;
   int normal_texture_id = 0;
@@ -242,226 +449,226 @@ void Scene::ParseGLTF(std::string filename, bool make_light)
     object_id = objects.size();
   }
 
-  const tinygltf::Scene &scene = model.scenes[model.defaultScene];
-  for (size_t i = 0; i < scene.nodes.size(); ++i) 
+  //textures and materials are shared by every primitive using them
+  auto import_texture = [&](int texture_index, std::map<int, int>& imported, bool normal) -> ModelLoading::Texture*
   {
-    RecurseGLTF(model, model.nodes[scene.nodes[i]], [&](tinygltf::Model &model, tinygltf::Node& node)
+    if (texture_index < 0 || texture_index >= static_cast<int>(model.textures.size()))
     {
-      const tinygltf::Mesh &mesh = model.meshes[node.mesh];
-      
-      for (size_t i = 0; i < mesh.primitives.size(); ++i)
-      {
-        const tinygltf::Primitive& primitive = mesh.primitives[i];
-        tinygltf::Accessor& indexAccessor = model.accessors[primitive.indices];
+      return nullptr;
+    }
+    const tinygltf::Texture& texture = model.textures[texture_index];
+    auto& texture_map = normal ? normalTextureMap : diffuseTextureMap;
+
+    auto found = imported.find(texture.source);
+    if (found != imported.end())
+    {
+      return found->second < 0 ? nullptr : &texture_map[found->second];
+    }
+
+    const tinygltf::Image& image = model.images[texture.source];
+    if (image.uri.empty() || tinygltf::IsDataURI(image.uri))
+    {
+      OutputDebugStringW(L"Skipping a texture embedded in the glTF, only image files are loaded\n");
+      imported[texture.source] = -1;
+      return nullptr;
+    }
+
+    //get path to image
+    std::filesystem::path file_path(filename);
+    std::filesystem::path parent_path = file_path.parent_path();
+    auto image_path = parent_path.append(image.uri).string();
+
+    //allocate texture
+    int& texture_id = normal ? normal_texture_id : diffuse_texture_id;
+    ModelLoading::Texture new_texture;
+    new_texture.id = texture_id;
+    new_texture.name = image_path;
+    new_texture.was_loaded_from_gltf = true;
+
+    if (normal)
+    {
+      LoadNormalTextureHelper(image_path, texture_id, new_texture);
+    }
+    else
+    {
+      LoadDiffuseTextureHelper(image_path, texture_id, new_texture);
+    }
+    imported[texture.source] = texture_id;
+    return &texture_map[texture_id++];
+  };
 
-        std::vector<unsigned char> vertex_data;
-        std::vector<unsigned char> indices_data;
-        std::vector<unsigned char> texture_data;
-        std::vector<unsigned char> normal_data;
+  struct ImportedMaterial
+  {
+    ModelLoading::MaterialResource* material;
+    ModelLoading::TextureBundle textures;
+  };
+  std::map<int, ImportedMaterial> imported_materials;
+  std::map<int, int> imported_diffuse_textures;
+  std::map<int, int> imported_normal_textures;
+
+  auto import_material = [&](int material_index) -> const ImportedMaterial&
+  {
+    auto found = imported_materials.find(material_index);
+    if (found != imported_materials.end())
+    {
+      return found->second;
+    }
 
-        int vertex_stride = 0;
-        int indices_stride = 0;
-        int texture_stride = 0;
-        int normal_stride = 0;
+    //parse material TODO parse rest, for now, only get emittance
+    ImportedMaterial imported{};
+    ModelLoading::MaterialResource material_resource{};
+    material_resource.was_loaded_from_gltf = true;
+    material_resource.id = material_id;
 
-        //parse indices
-        const tinygltf::BufferView& buffer_view = model.bufferViews[primitive.indices];
-        const tinygltf::Buffer& buffer = model.buffers[buffer_view.buffer];
-        indices_stride = indexAccessor.ByteStride(buffer_view);
-        indices_data = std::vector<unsigned char>(buffer.data.begin() + buffer_view.byteOffset, buffer.data.begin() + buffer_view.byteOffset + buffer_view.byteLength);
+    if (material_index >= 0)
+    {
+      const tinygltf::Material& material = model.materials[material_index];
+      material_resource.name = material.name;
 
-        for (auto& attrib : primitive.attributes)
+      for (const auto& value : material.values)
+      {
+        //diffuse texture
+        if (value.first == "baseColorTexture")
         {
-          tinygltf::Accessor accessor = model.accessors[attrib.second];
-          int byteStride = accessor.ByteStride(model.bufferViews[accessor.bufferView]);
+          imported.textures.albedoTex = import_texture(value.second.TextureIndex(), imported_diffuse_textures, false);
+        }
+      }
 
-          int size = 1;
-          if (accessor.type != TINYGLTF_TYPE_SCALAR)
+      for (const auto& value : material.additionalValues)
+      {
+        if (value.first == "normalTexture")
+        {
+          imported.textures.normalTex = import_texture(value.second.TextureIndex(), imported_normal_textures, true);
+        }
+        else if (value.first == "emissiveFactor")
+        {
+          if (!value.second.number_array.empty())
           {
-            size = accessor.type;
+            material_resource.material.emittance = 1.0f;
           }
+        }
+      }
+    }
 
-          const tinygltf::BufferView& buffer_view = model.bufferViews[accessor.bufferView];
-          const tinygltf::Buffer& buffer = model.buffers[buffer_view.buffer];
+    //add material to map
+    materialMap.insert({material_id, std::move(material_resource)});
+    imported.material = &materialMap[material_id++];
+    return imported_materials.emplace(material_index, imported).first->second;
+  };
+
+  AnimatedGltf animated;
+  animated.name = filename;
+  animated.clips = Animation::LoadClips(model);
+  animated.skins = Skinning::LoadSkins(model);
+  animated.graph_nodes.assign(model.nodes.size(), -1);
+  for (const tinygltf::Node& node : model.nodes)
+  {
+    animated.poses.push_back(Animation::RestPose(node));
+  }
 
-          if (attrib.first == "POSITION")
-          {
-            vertex_data = std::vector<unsigned char>(buffer.data.begin() + buffer_view.byteOffset, buffer.data.begin() + buffer_view.byteOffset + buffer_view.byteLength);
-            vertex_stride = byteStride;
-          }
-          else if (attrib.first == "NORMAL")
-          {
-            normal_data = std::vector<unsigned char>(buffer.data.begin() + buffer_view.byteOffset, buffer.data.begin() + buffer_view.byteOffset + buffer_view.byteLength);
-            normal_stride = byteStride;
-          }
-          else if (attrib.first == "TEXCOORD_0")
-          {
-            texture_data = std::vector<unsigned char>(buffer.data.begin() + buffer_view.byteOffset, buffer.data.begin() + buffer_view.byteOffset + buffer_view.byteLength);
-            texture_stride = byteStride;
-          }
+  //every (mesh, primitive) becomes one model, and so one BLAS, however many nodes draw it.
+  //Skinned nodes deform the mesh their own way, they get a model per (mesh, primitive, graph node)
+  AssetLoader::GltfInstances instances = AssetLoader::DecodeGltfInstances(model);
+  std::vector<int> instance_model_ids(instances.models.size(), -1);
+  std::vector<BufferUpload> uploads;
+  size_t instance_count = 0;
+
+  const tinygltf::Scene &scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+  for (size_t i = 0; i < scene.nodes.size(); ++i) 
+  {
+    RecurseGLTF(model, scene.nodes[i], SceneGraph::kRoot, animated.graph_nodes, [&](tinygltf::Model &model, int node_index, int graph_node)
+    {
+      const tinygltf::Node& node = model.nodes[node_index];
+      const tinygltf::Mesh &mesh = model.meshes[node.mesh];
+      const std::vector<int>& node_models = instances.node_models[node_index];
+      
+      for (size_t i = 0; i < node_models.size(); ++i)
+      {
+        const tinygltf::Primitive& primitive = mesh.primitives[i];
+        if (node_models[i] < 0)
+        {
+          continue;
         }
 
-        //now make vertices
-        std::vector<Vertex> vertices;
-        for (int i = 0; i < vertex_data.size() / vertex_stride; i++)
+        int& instance_model_id = instance_model_ids[node_models[i]];
+        if (instance_model_id < 0)
         {
-          Vertex v;
-          float x = *((float *)&vertex_data[i * vertex_stride]);
-          float y = *((float *)&vertex_data[i * vertex_stride + 4]);
-          float z = *((float *)&vertex_data[i * vertex_stride + 8]);
-          v.position = {x, y, z};
-          //memcpy(&v.position, &vertex_data[i * vertex_stride], vertex_stride);
-          if (texture_stride != 0 && i * texture_stride < texture_data.size())
+          AssetLoader::ModelData& data = instances.models[node_models[i]].data;
+
+          //allocate model
+          ModelLoading::Model& new_model = modelMap[model_id];
+          new_model.id = model_id;
+          new_model.name = filename;
+          new_model.indicesCount = data.indices.size();
+          new_model.verticesCount = data.vertices.size();
+          new_model.vertices_vec = std::move(data.vertices);
+          new_model.indices_vec = std::move(data.indices);
+          new_model.tangents_vec = std::move(data.tangents);
+
+          std::vector<Skinning::Influences> influences;
+          if (instances.models[node_models[i]].skinned_node >= 0)
           {
-            memcpy(&v.texCoord, &texture_data[i * texture_stride], texture_stride);
+            influences = Skinning::LoadInfluences(model, primitive, animated.skins[node.skin]);
           }
-          if (normal_stride != 0)
+          if (!influences.empty())
           {
-            memcpy(&v.normal, &normal_data[i * normal_stride], normal_stride);
+            //uploaded like any model, the per frame skinning buffers are made once it is up
+            SkinnedModel skinned_model;
+            skinned_model.model_id = model_id;
+            skinned_model.skin = node.skin;
+            skinned_model.mesh_graph_node = graph_node;
+            skinned_model.bind_vertices = new_model.vertices_vec;
+            skinned_model.bind_tangents = new_model.tangents_vec;
+            skinned_model.influences = std::move(influences);
+            animated.skinned_models.push_back(std::move(skinned_model));
           }
-
-          vertices.emplace_back(std::move(v));
-        }
-
-        std::vector<Index> indices;
-        for (int i = 0; i < indices_data.size() / indices_stride; i++)
-        {
-          Index index{};
-          memcpy(&index, &indices_data[i * indices_stride], indices_stride);
-          indices.emplace_back(index);
+          StageGeometry(new_model, uploads);
+          instance_model_id = model_id++;
         }
 
-        //allocate model
-        ModelLoading::Model new_model;
-        new_model.id = model_id;
-        new_model.name = filename;
-        new_model.indicesCount = indices.size();
-        new_model.verticesCount = vertices.size();
-
-        AllocateBufferOnGpu(indices.data(), indices.size() * sizeof(Index), &new_model.indices.resource, utilityCore::stringAndId(L"Vertices", model_id));
-        AllocateBufferOnGpu(vertices.data(), vertices.size() * sizeof(Vertex), &new_model.vertices.resource, utilityCore::stringAndId(L"Indices", model_id));
-        modelMap.insert({model_id++, std::move(new_model)});
-
         //allocate object as well
         ModelLoading::SceneObject new_object{};
         new_object.id = object_id++;
         new_object.name = mesh.name + ":" + filename;
-        new_object.info_resource.info.model_offset = model_id - 1;
+        new_object.info_resource.info.model_offset = instance_model_id;
         new_object.info_resource.info.texture_offset = -1;
         new_object.info_resource.info.texture_normal_offset = -1;
         new_object.info_resource.info.material_offset = -1;
         new_object.model = &modelMap[new_object.info_resource.info.model_offset];
 
-        //default scale to 1.0...
+        //the node carries the glTF transform, the object's own transform starts as identity
         new_object.scale = glm::vec3(1.0f);
-
-        if (!node.translation.empty())
-        {
-          new_object.translation = { node.translation[0], node.translation[1], node.translation[2] };
-        }
-        if (!node.rotation.empty())
-        {
-          new_object.rotation = { node.rotation[0], node.rotation[1], node.rotation[2] };
-          new_object.rotation = glm::degrees(new_object.rotation);
-        }
-        if (!node.scale.empty())
-        {
-          new_object.scale = { node.scale[0], node.scale[1], node.scale[2] };
-        }
-        if (!node.matrix.empty())
-        {
-          //TODO decompose to trans, rot, scale
-          //std::vector<float> matrix_data = std::vector<float>(std::begin(node.matrix), std::end(node.matrix));
-          //memcpy(new_object.getTransform3x4(), matrix_data.data(), 12 * sizeof(float));
-        }
-
-        //parse material TODO parse rest, for now, only get emittance
-        tinygltf::Accessor& material_accessor = model.accessors[primitive.material];
-        ModelLoading::MaterialResource material_resource{};
-        material_resource.was_loaded_from_gltf = true;
-        material_resource.id = material_id;
-        material_resource.name = material_accessor.name;
-        
-        const tinygltf::Material material = model.materials[primitive.material];
-        for (const auto& value : material.values)
-        {
-          //diffuse texture
-          if (value.first == "baseColorTexture")
-          {
-            //iterating through gltf...
-            const tinygltf::Parameter& parameter = value.second;
-            int texture_index = parameter.TextureIndex();
-            
-            const tinygltf::Texture& texture = model.textures[texture_index];
-            const tinygltf::Image& image = model.images[texture.source];
-
-            std::experimental::filesystem::path file_path(filename);
-            std::experimental::filesystem::path parent_path = file_path.parent_path();
-            auto image_path = parent_path.append(image.uri).string();
-
-            std::wstring wimage_path = utilityCore::string2wstring(image_path);
-
-            //allocate texture
-            ModelLoading::Texture new_texture;
-            new_texture.id = diffuse_texture_id;
-            new_texture.name = image_path;
-            new_texture.was_loaded_from_gltf = true;
-
-            LoadDiffuseTextureHelper(image_path, diffuse_texture_id++, new_texture);
-
-            //make sure object points to this
-            new_object.textures.albedoTex = &diffuseTextureMap[diffuse_texture_id - 1];
-          }
-        }
-
-        for (const auto& value : material.additionalValues)
-        {
-          //diffuse texture
-          if (value.first == "normalTexture")
-          {
-            //iterating through gltf...
-            const tinygltf::Parameter& parameter = value.second;
-            int texture_index = parameter.TextureIndex();
-            
-            const tinygltf::Texture& texture = model.textures[texture_index];
-            const tinygltf::Image& image = model.images[texture.source];
-
-            //get path to image
-            std::experimental::filesystem::path file_path(filename);
-            std::experimental::filesystem::path parent_path = file_path.parent_path();
-            auto image_path = parent_path.append(image.uri).string();
-
-            //allocate texture
-            ModelLoading::Texture new_texture;
-            new_texture.id = normal_texture_id;
-            new_texture.name = image_path;
-            new_texture.was_loaded_from_gltf = true;
-
-            LoadNormalTextureHelper(image_path, normal_texture_id++, new_texture);
-
-            //make sure object points to this
-            new_object.textures.normalTex = &normalTextureMap[normal_texture_id - 1];
-          } 
-          else if (value.first == "emissiveFactor")
-          {
-            if (!value.second.number_array.empty())
-            {
-              material_resource.material.emittance = 1.0f;
-            }
-          }
-        }
-
-        //add material to map
-        materialMap.insert({material_id++, std::move(material_resource)});
+        new_object.node = scene_graph.AddNode(graph_node);
 
         //make object point to material
-        new_object.material = &materialMap[material_id - 1];
+        const ImportedMaterial& material = import_material(primitive.material);
+        new_object.material = material.material;
+        new_object.textures = material.textures;
 
         //add object
         objects.emplace_back(std::move(new_object));
+        instance_count++;
       }
     });
   }
+  AllocateBuffersOnGpu(uploads);
+
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
+  for (SkinnedModel& skinned_model : animated.skinned_models)
+  {
+    modelMap[skinned_model.model_id].AllocateDynamicBuffers(device, programState->GetDeviceResources()->GetBackBufferCount());
+  }
+
+  std::wstringstream wstr;
+  wstr << L"glTF " << filename.c_str() << L": " << instances.models.size() << L" models (one BLAS each) for " << instance_count << L" instances\n";
+  if (!animated.clips.empty() || !animated.skinned_models.empty())
+  {
+    wstr << L"glTF " << filename.c_str() << L": " << animated.clips.size() << L" animations, " << animated.skinned_models.size() << L" skinned models\n";
+    animated.clip = animated.clips.empty() ? -1 : 0;
+    animated_gltfs.push_back(std::move(animated));
+  }
+  OuputAndReset(wstr);
+  LogTextureCacheStats();
 
   //make sure that textures, normals have at least one entry
   if (diffuseTextureMap.empty())
@@ -571,10 +778,16 @@ void Scene::ParseGLTF(std::string filename, bool make_light)
     new_model.indicesCount = indices.size();
     new_model.verticesCount = vertices.size();
 
-    AllocateBufferOnGpu(indices.data(), indices.size() * sizeof(Index), &new_model.indices.resource,
-                        utilityCore::stringAndId(L"Vertices", model_id));
-    AllocateBufferOnGpu(vertices.data(), vertices.size() * sizeof(Vertex), &new_model.vertices.resource,
-                        utilityCore::stringAndId(L"Indices", model_id));
+    //no texcoords, so the tangents are just perpendicular to the normals
+    new_model.tangents_vec = TangentFrames::Generate(vertices, indices);
+
+    AllocateBuffersOnGpu({
+      MakeIndexUpload(new_model, indices.data(), indices.size(), vertices.size(), utilityCore::stringAndId(L"Vertices", model_id)),
+      BufferUpload(vertices.data(), vertices.size() * sizeof(Vertex), &new_model.vertices.resource, utilityCore::stringAndId(L"Indices", model_id)),
+      MakeTangentUpload(new_model, utilityCore::stringAndId(L"Tangents", model_id))
+    });
+    new_model.vertices_vec = std::move(vertices);
+    new_model.indices_vec = std::move(indices);
     modelMap.insert({model_id++, std::move(new_model)});
 
     //allocate object as well
@@ -587,7 +800,8 @@ void Scene::ParseGLTF(std::string filename, bool make_light)
     new_object.model = &modelMap[new_object.info_resource.info.model_offset];
 
     //default scale to 1.0...
-    new_object.translation = glm::vec3(0.0f, -5.0f, 2.0f) + objects[0].translation;
+    UpdateTransforms();
+    new_object.translation = glm::vec3(0.0f, -5.0f, 2.0f) + glm::vec3(objects[0].world[3]);
     new_object.scale = glm::vec3(7.5f, 0.25f, 7.5f);
 
     ModelLoading::MaterialResource material_resource{};
@@ -607,8 +821,8 @@ void Scene::ParseGLTF(std::string filename, bool make_light)
   }
 }
 
-int Scene::loadObject(string objectid, std::string name) {
-	int id = atoi(objectid.c_str());
+int Scene::loadObject(std::string_view objectid, std::string name) {
+	int id = SceneReader::ToInt(objectid);
 
 	std::wstringstream wstr;
 	wstr << L"Loading OBJECT " << id << L"\n";
@@ -617,18 +831,16 @@ int Scene::loadObject(string objectid, std::string name) {
 	ModelLoading::SceneObject newObject;
         newObject.name = name;
 
-	string line;
+	std::vector<std::string_view> tokens;
 
 	// LOAD MODEL (MUST EXIST)
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
+		if (reader.NextLine(tokens) && !tokens.empty()) {
 			wstr << L"----------------------------------------\n";
 			wstr << L"Linking model...\n";
 			OuputAndReset(wstr);
 
-			vector<string> tokens = utilityCore::tokenizeString(line);
-			int modelId = atoi(tokens[1].c_str());
+			int modelId = SceneReader::ToInt(tokens[1]);
 			newObject.model = &(modelMap.find(modelId)->second);
 		}
 	}
@@ -641,10 +853,8 @@ int Scene::loadObject(string objectid, std::string name) {
 		newObject.textures = texUsed;
 
 		// albedo tex
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-			int texId = atoi(tokens[1].c_str());
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			int texId = SceneReader::ToInt(tokens[1]);
 			if (texId != -1) {
 				wstr << L"----------------------------------------\n";
 				wstr << L"Linking albedo texture...\n";
@@ -654,10 +864,8 @@ int Scene::loadObject(string objectid, std::string name) {
 		}
 
 		// normal tex
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-			int texId = atoi(tokens[1].c_str());
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			int texId = SceneReader::ToInt(tokens[1]);
 			if (texId != -1) {
 				wstr << L"----------------------------------------\n";
 				wstr << L"Linking normal texture...\n";
@@ -669,10 +877,8 @@ int Scene::loadObject(string objectid, std::string name) {
 	
 	// LOAD MATERIAL IF EXISTS
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-			int matId = atoi(tokens[1].c_str());
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			int matId = SceneReader::ToInt(tokens[1]);
 			if (matId != -1) {
 				wstr << L"----------------------------------------\n";
 				wstr << L"Linking material...\n";
@@ -682,174 +888,821 @@ int Scene::loadObject(string objectid, std::string name) {
 		}
 	}
 
-	// LOAD TRANSFORM (MUST EXIST)
-	{
-		wstr << L"----------------------------------------\n";
-		wstr << L"Loading transform...\n";
-		OuputAndReset(wstr);
-		utilityCore::safeGetline(fp_in, line);
-		while (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
+	// LOAD TRANSFORM (MUST EXIST)
+	{
+		wstr << L"----------------------------------------\n";
+		wstr << L"Loading transform...\n";
+		OuputAndReset(wstr);
+		while (reader.NextLine(tokens) && !tokens.empty()) {
+			if (tokens[0] == "trans") {
+				glm::vec3 t(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
+				newObject.translation = t;
+			}
+			else if (tokens[0] == "rotat") {
+				glm::vec3 r(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
+				newObject.rotation = r;
+			}
+			else if (tokens[0] == "scale") {
+				glm::vec3 s(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
+				newObject.scale = s;
+			}
+			else if (tokens[0] == "lod" && tokens.size() > 1) {
+				if (tokens[1] == "auto") {
+					newObject.lod_distance = tokens.size() > 2 ? SceneReader::ToFloat(tokens[2]) : 10.0f;
+				}
+				else {
+					newObject.lod_level = SceneReader::ToInt(tokens[1]);
+				}
+			}
+		}
+	}
+
+	newObject.id = id;
+	objects.push_back(newObject);
+
+	wstr << L"----------------------------------------\n";
+	wstr << L"Done loading OBJECT " << id << L" !\n";
+	wstr << L"------------------------------------------------------------------------------\n";
+	OuputAndReset(wstr);
+
+	return 1;
+}
+
+void Scene::StageModel(AssetLoader::ModelData&& data, int id, ModelLoading::Model& model, std::vector<BufferUpload>& uploads)
+{
+  const MeshOptimizer::WeldStats& weld = data.weld_stats;
+  if (weld.vertices_before > 0)
+  {
+    std::wstringstream wstr;
+    wstr << L"MODEL " << id << L" welded " << weld.vertices_before << L" -> " << weld.vertices_after << L" vertices, "
+         << weld.bytes_before << L" -> " << weld.bytes_after << L" bytes\n";
+
+    const MeshOptimizer::CacheStats& before = data.cache_before;
+    const MeshOptimizer::CacheStats& after = data.cache_after;
+    wstr << L"MODEL " << id << L" " << MeshOptimizer::ToString(data.triangle_order) << L" order: acmr "
+         << before.acmr << L" -> " << after.acmr << L", index line misses/tri "
+         << before.index_line_misses << L" -> " << after.index_line_misses << L", vertex line misses/tri "
+         << before.vertex_line_misses << L" -> " << after.vertex_line_misses << L"\n";
+    OuputAndReset(wstr);
+  }
+
+  model.id = id;
+  model.verticesCount = data.vertices.size();
+  model.indicesCount = data.indices.size();
+
+  //the model keeps the cpu copy, so the upload can point straight into it
+  model.vertices_vec = std::move(data.vertices);
+  model.indices_vec = std::move(data.indices);
+  model.tangents_vec = std::move(data.tangents);
+
+  StageGeometry(model, uploads);
+}
+
+void Scene::StageGeometry(ModelLoading::Model& model, std::vector<BufferUpload>& uploads)
+{
+  uploads.push_back(MakeIndexUpload(model, model.indices_vec.data(), model.indices_vec.size(), model.vertices_vec.size(),
+                                    utilityCore::stringAndId(L"Vertices", model.id)));
+  uploads.emplace_back(model.vertices_vec.data(), model.vertices_vec.size() * sizeof(Vertex), &model.vertices.resource,
+                       utilityCore::stringAndId(L"Indices", model.id));
+  uploads.push_back(MakeTangentUpload(model, utilityCore::stringAndId(L"Tangents", model.id)));
+}
+
+Scene::BufferUpload Scene::MakeTangentUpload(ModelLoading::Model& model, std::wstring resource_name)
+{
+  if (model.tangents_vec.size() != static_cast<size_t>(model.verticesCount))
+  {
+    throw std::runtime_error("model tangents don't match its vertices");
+  }
+  return BufferUpload(model.tangents_vec.data(), model.tangents_vec.size() * sizeof(XMFLOAT4), &model.tangents.resource, std::move(resource_name));
+}
+
+Scene::BufferUpload Scene::MakeIndexUpload(ModelLoading::Model& model, const Index* indices, size_t count, size_t vertex_count, std::wstring resource_name)
+{
+  model.index_format = IndexBuffer::ChooseFormat(vertex_count);
+  if (model.index_format == DXGI_FORMAT_R32_UINT)
+  {
+    //same layout as the source, no copy needed
+    BufferUpload upload(const_cast<Index*>(indices), count * sizeof(Index), &model.indices.resource, std::move(resource_name));
+    upload.category = HeapSuballocator::Category::Indices;
+    return upload;
+  }
+
+  auto packed = std::make_shared<const std::vector<BYTE>>(IndexBuffer::Pack(indices, count, model.index_format));
+
+#ifdef _DEBUG
+  for (size_t t = 0; t < count / 3; t++)
+  {
+    XMUINT3 triangle = IndexBuffer::FetchTriangle(packed->data(), model.index_format, t);
+    if (triangle.x != indices[t * 3] || triangle.y != indices[t * 3 + 1] || triangle.z != indices[t * 3 + 2])
+    {
+      throw std::runtime_error("16 bit index buffer doesn't match its source");
+    }
+  }
+#endif
+
+  std::wstringstream wstr;
+  wstr << L"MODEL " << model.id << L" 16 bit indices: " << count * sizeof(Index) << L" -> " << packed->size() << L" bytes\n";
+  OuputAndReset(wstr);
+
+  BufferUpload upload(const_cast<BYTE*>(packed->data()), packed->size(), &model.indices.resource, std::move(resource_name));
+  upload.owned_data = std::move(packed);
+  upload.category = HeapSuballocator::Category::Indices;
+  return upload;
+}
+
+void Scene::StageTexture(TextureCache::Handle handle, const std::wstring& resource_name, std::vector<BufferUpload>& uploads)
+{
+  TextureCache::Entry& entry = texture_cache.Get(handle);
+  const AssetLoader::ImageData& image = *entry.image;
+  uploads.push_back(MakeTextureUpload(image.texels.get(), image.desc, &entry.resource, utilityCore::stringAndId(resource_name, handle)));
+}
+
+void Scene::BindCachedTexture(TextureCache::Handle handle, int id, ModelLoading::Texture& texture)
+{
+  const TextureCache::Entry& entry = texture_cache.Get(handle);
+  texture.id = id;
+  texture.cache_handle = handle;
+  texture.textureDesc = entry.image->desc;
+  texture.texBuffer.resource = entry.resource;
+}
+
+void Scene::LogTextureCacheStats()
+{
+  const TextureCache::Stats& stats = texture_cache.GetStats();
+  std::wstringstream wstr;
+  wstr << L"Texture cache: " << texture_cache.Size() << L" images, " << stats.misses << L" decoded, "
+       << stats.path_hits << L" path hits, " << stats.content_hits << L" content hits, "
+       << stats.bytes_hashed / (1024.0 * 1024.0) << L" MB hashed\n";
+
+  const TextureDiskCache::Stats disk_stats = TextureDiskCache::Shared().GetStats();
+  wstr << L"Texture disk cache (" << TextureDiskCache::Shared().Directory().c_str() << L"): " << disk_stats.hits << L" hits, "
+       << disk_stats.misses << L" misses, " << disk_stats.stale << L" stale, " << disk_stats.writes << L" written ("
+       << disk_stats.failed_writes << L" failed), " << disk_stats.bytes_read / (1024.0 * 1024.0) << L" MB read, "
+       << disk_stats.bytes_written / (1024.0 * 1024.0) << L" MB written\n";
+
+  const UploadRing::Stats upload_stats = programState->GetUploadRing().GetStats();
+  wstr << L"Upload ring: " << upload_stats.submissions << L" submissions, " << upload_stats.stalls << L" waits for space, "
+       << upload_stats.wraps << L" wraps, " << upload_stats.bytes_allocated / (1024.0 * 1024.0) << L" MB staged, "
+       << upload_stats.peak_used / (1024.0 * 1024.0) << L" MB peak\n";
+  OuputAndReset(wstr);
+}
+
+void Scene::LogHeapStats()
+{
+  HeapSuballocator& heaps = programState->GetPlacedResources().Suballocator();
+  std::wstringstream wstr;
+  for (size_t i = 0; i < static_cast<size_t>(HeapSuballocator::Category::Count); i++)
+  {
+    const HeapSuballocator::Category category = static_cast<HeapSuballocator::Category>(i);
+    const HeapSuballocator::CategoryStats stats = heaps.GetStats(category);
+    wstr << L"Heap " << HeapSuballocator::Name(category) << L": " << stats.allocations << L" resources, "
+         << stats.requested_bytes / (1024.0 * 1024.0) << L" MB in " << stats.reserved_bytes / (1024.0 * 1024.0) << L" MB placed, "
+         << stats.peak_reserved_bytes / (1024.0 * 1024.0) << L" MB peak\n";
+  }
+  for (UINT32 pool = 0; pool < heaps.PoolCount(); pool++)
+  {
+    const HeapSuballocator::PoolStats stats = heaps.GetPoolStats(pool);
+    wstr << L"Heap pool " << PlacedResourceAllocator::PoolName(pool) << L": " << stats.pages << L" heaps (" << stats.dedicated_pages
+         << L" dedicated), " << stats.used_bytes / (1024.0 * 1024.0) << L" of " << stats.page_bytes / (1024.0 * 1024.0)
+         << L" MB used, largest free block " << stats.largest_free_block / (1024.0 * 1024.0) << L" MB\n";
+  }
+  OuputAndReset(wstr);
+}
+
+void Scene::LoadModelHelper(std::string path, int id, ModelLoading::Model& model)
+{
+  std::vector<BufferUpload> uploads;
+  StageModel(AssetLoader::DecodeObj(path), id, model, uploads);
+
+  //now on gpu
+  AllocateBuffersOnGpu(uploads);
+
+  std::pair<int, ModelLoading::Model> pair(id, model);
+  modelMap.insert(pair);
+}
+
+void Scene::LoadDiffuseTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture)
+{
+  LoadTextureHelper(path, id, newTexture, L"Diffuse Texture", MipChain::Filter::Srgb);
+  diffuseTextureMap.insert({ id, newTexture });
+}
+
+void Scene::LoadNormalTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture)
+{
+  LoadTextureHelper(path, id, newTexture, L"Normal Texture", MipChain::Filter::Normal);
+  normalTextureMap.insert({ id, newTexture });
+}
+
+void Scene::LoadTextureHelper(const std::string& path, int id, ModelLoading::Texture& texture, const std::wstring& resource_name, MipChain::Filter filter)
+{
+  bool miss = false;
+  TextureCache::Handle handle = texture_cache.Acquire(path, TextureCache::Recipe(filter, compress_textures), &miss);
+  if (miss)
+  {
+    try
+    {
+      texture_cache.SetImage(handle, std::make_shared<const AssetLoader::ImageData>(PrepareTexture(path, texture_cache.Get(handle).content_hash, filter, ThreadPool::Shared())));
+    }
+    catch (...)
+    {
+      texture_cache.Release(handle);
+      throw;
+    }
+
+    std::vector<BufferUpload> uploads;
+    StageTexture(handle, resource_name, uploads);
+    AllocateBuffersOnGpu(uploads);
+  }
+  BindCachedTexture(handle, id, texture);
+}
+
+AssetLoader::ImageData Scene::PrepareTexture(const std::string& path, UINT64 content_hash, MipChain::Filter filter, ThreadPool& pool) const
+{
+  //everything that changes the texels made from a file is part of the recipe
+  const TextureDiskCache::Key key = TextureDiskCache::MakeKey(path, TextureCache::Recipe(filter, compress_textures), content_hash);
+  AssetLoader::ImageData cached;
+  if (TextureDiskCache::Shared().Load(key, &cached))
+  {
+    return cached;
+  }
+
+  AssetLoader::ImageData chain = MipChain::Generate(AssetLoader::DecodeImage(path), filter, pool);
+  //one line per texture, written in one go since this runs on the pool
+  std::wstringstream wstr;
+  if (filter == MipChain::Filter::Normal)
+  {
+    AssetLoader::ImageData encoded = NormalMapCodec::Encode(chain, pool);
+    const NormalMapCodec::AngularError error = NormalMapCodec::MeasureError(chain, encoded);
+    wstr << L"Normal map " << path.c_str() << L" to two channels: " << chain.size / (1024.0 * 1024.0) << L" MB -> "
+         << encoded.size / (1024.0 * 1024.0) << L" MB, " << error.mean_degrees << L" degrees mean error, "
+         << error.max_degrees << L" max\n";
+    OuputAndReset(wstr);
+    chain = std::move(encoded);
+  }
+
+  const BlockCompression::Codec codec = compress_textures ? BlockCompression::ChooseCodec(chain, filter) : BlockCompression::Codec::None;
+  if (codec == BlockCompression::Codec::None)
+  {
+    TextureDiskCache::Shared().Store(key, chain);
+    return chain;
+  }
+
+  BlockCompression::Stats stats;
+  AssetLoader::ImageData compressed = BlockCompression::Compress(chain, codec, pool, &stats);
+  wstr << L"Compressed " << path.c_str() << L" to " << BlockCompression::Name(stats.codec) << L": "
+       << stats.source_bytes / (1024.0 * 1024.0) << L" MB -> " << stats.compressed_bytes / (1024.0 * 1024.0)
+       << L" MB, " << (stats.source_bytes - stats.compressed_bytes) / (1024.0 * 1024.0) << L" MB saved, PSNR "
+       << stats.psnr << L" dB\n";
+  OuputAndReset(wstr);
+  TextureDiskCache::Shared().Store(key, compressed);
+  return compressed;
+}
+
+void Scene::PackCpuVertices()
+{
+  std::wstringstream wstr;
+  size_t bytes_before = 0;
+  size_t bytes_after = 0;
+  for (auto& pair : modelMap)
+  {
+    ModelLoading::Model& model = pair.second;
+    if (model.vertices_vec.empty())
+    {
+      continue;
+    }
+
+    std::vector<Vertex> original = model.vertices_vec;
+    model.PackCpuVertices();
+
+    VertexPacking::PackingError error = VertexPacking::MeasureError(original, model.packed_vertices_vec, model.packed_bounds);
+    const size_t before = original.size() * sizeof(Vertex);
+    const size_t after = model.packed_vertices_vec.size() * sizeof(VertexPacking::PackedVertex);
+    bytes_before += before;
+    bytes_after += after;
+
+    wstr << L"MODEL " << pair.first << L" packed " << before << L" -> " << after << L" bytes, max error: position "
+         << error.position << L", normal " << error.normal_degrees << L" deg, uv " << error.texcoord << L"\n";
+    OuputAndReset(wstr);
+  }
+
+  wstr << L"Packed cpu vertices: " << bytes_before << L" -> " << bytes_after << L" bytes\n";
+  OuputAndReset(wstr);
+}
+
+void Scene::BuildLodChains()
+{
+  std::vector<ModelLoading::Model*> sources;
+  for (const auto& object : objects)
+  {
+    ModelLoading::Model* model = object.model;
+    if (object.UsesLod() && model != nullptr && model->lod_base < 0 && model->lod_ids.empty() &&
+        std::find(sources.begin(), sources.end(), model) == sources.end())
+    {
+      sources.push_back(model);
+    }
+  }
+
+  if (sources.empty() || lod_ratios.empty())
+  {
+    return;
+  }
+
+  std::wstringstream wstr;
+  auto build_start = std::chrono::high_resolution_clock::now();
+
+  //simplification and the error measurements are all cpu work, one model per task
+  std::vector<std::vector<MeshSimplifier::Level>> chains(sources.size());
+  std::vector<std::vector<std::vector<XMFLOAT4>>> chain_tangents(sources.size());
+  ThreadPool::Shared().ParallelFor(sources.size(), [&](size_t i)
+  {
+    const ModelLoading::Model& source = *sources[i];
+    chains[i] = MeshSimplifier::BuildLodChain(source.GetCpuVertices(), source.indices_vec, lod_ratios);
+    for (const MeshSimplifier::Level& level : chains[i])
+    {
+      chain_tangents[i].push_back(TangentFrames::Generate(level.vertices, level.indices));
+    }
+  });
+
+  //levels go after every existing model so the ids stay contiguous
+  int next_id = modelMap.empty() ? 0 : modelMap.rbegin()->first + 1;
+  std::vector<BufferUpload> uploads;
+  for (size_t i = 0; i < sources.size(); i++)
+  {
+    ModelLoading::Model& source = *sources[i];
+    const VertexPacking::Bounds bounds = source.vertices_vec.empty() ? source.packed_bounds
+                                       : VertexPacking::ComputeBounds(source.vertices_vec.data(), source.vertices_vec.size());
+    const float diagonal = sqrtf(bounds.extent.x * bounds.extent.x + bounds.extent.y * bounds.extent.y + bounds.extent.z * bounds.extent.z);
+
+    for (size_t l = 0; l < chains[i].size(); l++)
+    {
+      MeshSimplifier::Level& level = chains[i][l];
+
+      wstr << L"MODEL " << source.id << L" LOD " << l + 1 << L": " << source.indices_vec.size() / 3 << L" -> "
+           << level.indices.size() / 3 << L" triangles (asked " << level.triangle_ratio * 100.0f << L"%), "
+           << level.vertices.size() << L" vertices, hausdorff " << level.hausdorff_distance;
+      if (diagonal > 0.0f)
+      {
+        wstr << L" (" << level.hausdorff_distance / diagonal * 100.0f << L"% of the bounds diagonal)";
+      }
+      wstr << L"\n";
+      OuputAndReset(wstr);
+
+      ModelLoading::Model& lod = modelMap[next_id];
+      lod.id = next_id;
+      lod.name = source.name + " lod" + std::to_string(l + 1);
+      lod.lod_base = source.id;
+      lod.verticesCount = static_cast<int>(level.vertices.size());
+      lod.indicesCount = static_cast<int>(level.indices.size());
+      lod.vertices_vec = std::move(level.vertices);
+      lod.indices_vec = std::move(level.indices);
+      lod.tangents_vec = std::move(chain_tangents[i][l]);
+      StageGeometry(lod, uploads);
+
+      source.lod_ids.push_back(next_id++);
+    }
+  }
+  AllocateBuffersOnGpu(uploads);
+
+  auto build_time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - build_start);
+  wstr << L"Built LOD chains for " << sources.size() << L" models in " << build_time.count() << L" ms\n";
+  OuputAndReset(wstr);
+}
+
+bool Scene::SelectLods(XMVECTOR eye, std::vector<size_t>* changed_objects)
+{
+  UpdateTransforms();
+
+  XMFLOAT3 eye_position;
+  XMStoreFloat3(&eye_position, eye);
+
+  bool changed = false;
+  for (size_t i = 0; i < objects.size(); i++)
+  {
+    ModelLoading::SceneObject& object = objects[i];
+    if (!object.UsesLod() || object.model == nullptr)
+    {
+      continue;
+    }
+
+    ModelLoading::Model* base = object.model->lod_base >= 0 ? &modelMap[object.model->lod_base] : object.model;
+
+    int level = object.lod_level;
+    if (object.lod_distance > 0.0f)
+    {
+      const float distance = glm::length(glm::vec3(object.world[3]) - glm::vec3(eye_position.x, eye_position.y, eye_position.z));
+      level = distance <= object.lod_distance ? 0 : static_cast<int>(floorf(log2f(distance / object.lod_distance))) + 1;
+    }
+    level = std::min<int>(std::max<int>(level, 0), static_cast<int>(base->lod_ids.size()));
+
+    ModelLoading::Model* selected = level == 0 ? base : &modelMap[base->lod_ids[level - 1]];
+    if (selected != object.model)
+    {
+      object.model = selected;
+      object.info_resource.info.model_offset = selected->descriptor.slot;
+      object.info_resource.info.index_size = selected->IndexSize();
+      changed = true;
+      if (changed_objects != nullptr)
+      {
+        changed_objects->push_back(i);
+      }
+    }
+  }
+  return changed;
+}
+
+void Scene::UpdateTransforms()
+{
+  for (auto& object : objects)
+  {
+    if (object.node < 0)
+    {
+      object.node = scene_graph.AddNode(SceneGraph::kRoot, object.LocalTransform());
+    }
+    else if (!object.transformBuilt)
+    {
+      scene_graph.SetLocal(object.node, object.LocalTransform());
+    }
+    object.transformBuilt = true;
+  }
+
+  scene_graph.Update();
+
+  for (auto& object : objects)
+  {
+    const UINT32 version = scene_graph.Version(object.node);
+    if (object.transform_version != version)
+    {
+      object.SetWorld(scene_graph.World(object.node), version);
+    }
+  }
+}
 
-			if (strcmp(tokens[0].c_str(), "trans") == 0) {
-				glm::vec3 t(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
-				newObject.translation = t;
-			}
-			else if (strcmp(tokens[0].c_str(), "rotat") == 0) {
-				glm::vec3 r(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
-				newObject.rotation = r;
-			}
-			else if (strcmp(tokens[0].c_str(), "scale") == 0) {
-				glm::vec3 s(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
-				newObject.scale = s;
-			}
+void Scene::UpdateAnimations(float time, UINT frame)
+{
+  for (AnimatedGltf& animated : animated_gltfs)
+  {
+    if (animated.clip < 0 || animated.clip >= static_cast<int>(animated.clips.size()))
+    {
+      continue;
+    }
 
-			utilityCore::safeGetline(fp_in, line);
-		}
-	}
+    const Animation::Clip& clip = animated.clips[animated.clip];
+    Animation::Sample(clip, time, animated.poses);
+    for (const Animation::Channel& channel : clip.channels)
+    {
+      const int graph_node = animated.graph_nodes[channel.node];
+      if (graph_node >= 0)
+      {
+        scene_graph.SetLocal(graph_node, animated.poses[channel.node].Matrix());
+      }
+    }
+  }
 
-	newObject.id = id;
-	objects.push_back(newObject);
+  //the shaders take normals to world space with the instance transform, so moved objects
+  //only need their instance descs rewritten
+  UpdateTransforms();
 
-	wstr << L"----------------------------------------\n";
-	wstr << L"Done loading OBJECT " << id << L" !\n";
-	wstr << L"------------------------------------------------------------------------------\n";
-	OuputAndReset(wstr);
+  std::vector<XMMATRIX> joint_matrices;
+  for (AnimatedGltf& animated : animated_gltfs)
+  {
+    for (SkinnedModel& skinned_model : animated.skinned_models)
+    {
+      //versions only grow, so the newest one tells whether any joint moved
+      const Skinning::Skin& skin = animated.skins[skinned_model.skin];
+      UINT32 version = scene_graph.Version(skinned_model.mesh_graph_node);
+      for (int joint : skin.joints)
+      {
+        if (animated.graph_nodes[joint] >= 0)
+        {
+          version = std::max<UINT32>(version, scene_graph.Version(animated.graph_nodes[joint]));
+        }
+      }
+      if (version == skinned_model.skinned_version)
+      {
+        continue;
+      }
 
-	return 1;
+      ModelLoading::Model& model = modelMap[skinned_model.model_id];
+      Skinning::ComputeJointMatrices(skin, scene_graph, animated.graph_nodes, skinned_model.mesh_graph_node, joint_matrices);
+      Skinning::SkinVertices(skinned_model.bind_vertices.data(), skinned_model.bind_tangents.data(), skinned_model.influences.data(),
+                             skinned_model.influences.size(), joint_matrices, model.mapped_vertices[frame], model.mapped_tangents[frame], ThreadPool::Shared());
+      skinned_model.skinned_version = version;
+      model.needs_refit = true;
+    }
+  }
 }
 
-void Scene::LoadModelHelper(std::string path, int id, ModelLoading::Model& model)
+void Scene::RecordAnimationRefits(UINT frame, bool is_fallback, ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice,
+    ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst, ComPtr<ID3D12GraphicsCommandList5> rtxCmdList)
 {
-  // load mesh here
-  std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
-
-  tinyobj::attrib_t attrib;
-  std::string err;
-  bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, path.c_str());
+  auto commandList = programState->GetDeviceResources()->GetCommandList();
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
 
-  std::vector<Index> indices;
-  std::vector<Vertex> vertices;
+  WriteInstanceTransforms(is_fallback);
 
-  if (!ret)
+  if (is_fallback)
   {
-    throw std::runtime_error("failed to load Object!");
+    ID3D12DescriptorHeap *pDescriptorHeaps[] = { programState->GetDescriptorHeap().Get() };
+    fbCmdLst->SetDescriptorHeaps(ARRAYSIZE(pDescriptorHeaps), pDescriptorHeaps);
   }
-  else
+
+  //only the skinned BLASes are touched, and they are refit in place rather than rebuilt
+  for (auto& model_pair : modelMap)
   {
-    // loop over shapes
-    int finalIdx = 0;
-    for (unsigned int s = 0; s < shapes.size(); s++)
+    ModelLoading::Model &model = model_pair.second;
+    if (!model.needs_refit)
     {
-      size_t index_offset = 0;
-      // loop over  faces
-      for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++)
-      {
-        int fv = shapes[s].mesh.num_face_vertices[f];
-        std::vector<float>& positions = attrib.vertices;
-        std::vector<float>& normals = attrib.normals;
-        std::vector<float>& texcoords = attrib.texcoords;
-
-        // loop over vertices in face, might be > 3
-        for (size_t v = 0; v < fv; v++)
-        {
-          tinyobj::index_t index = shapes[s].mesh.indices[v + index_offset];
+      continue;
+    }
 
-          Vertex vert;
-          vert.position = XMFLOAT3(positions[index.vertex_index * 3], positions[index.vertex_index * 3 + 1],
-                                   positions[index.vertex_index * 3 + 2]);
-          if (index.normal_index != -1)
-          {
-            vert.normal = XMFLOAT3(normals[index.normal_index * 3], normals[index.normal_index * 3 + 1],
-                                   normals[index.normal_index * 3 + 2]);
-          }
+    model.RecordDynamicCopy(commandList, frame);
+    D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC refitDesc = model.GetBottomLevelRefitDesc(frame);
+    if (is_fallback)
+    {
+      fbCmdLst->BuildRaytracingAccelerationStructure(&refitDesc, 0, nullptr);
+    }
+    else
+    {
+      rtxCmdList->BuildRaytracingAccelerationStructure(&refitDesc, 0, nullptr);
+    }
+    commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(model.GetBottomAS(is_fallback, device, m_fallbackDevice, m_dxrDevice).Get()));
+    model.needs_refit = false;
+  }
 
-          if (index.texcoord_index != -1)
-          {
-            vert.texCoord = XMFLOAT2(texcoords[index.texcoord_index * 2], 1 - texcoords[index.texcoord_index * 2 + 1]);
-          }
-          vertices.push_back(vert);
-          indices.push_back((Index)(finalIdx + index_offset + v));
-        }
+  //the top level is small, rebuilding it is cheaper than keeping it refittable
+  RecordTopLevelBuild(is_fallback, fbCmdLst, rtxCmdList);
+}
 
-        index_offset += fv;
-      }
-      finalIdx += index_offset;
-    }
+void Scene::RecordTopLevelBuild(bool is_fallback, ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst, ComPtr<ID3D12GraphicsCommandList5> rtxCmdList)
+{
+  auto commandList = programState->GetDeviceResources()->GetCommandList();
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
 
-    Vertex* vPtr = vertices.data();
-    Index* iPtr = indices.data();
-    auto device = programState->GetDeviceResources()->GetD3DDevice();
+  //the descs go to this frame's upload buffer, the ones earlier frames build from may still be read
+  const UINT frame = programState->GetDeviceResources()->GetCurrentFrameIndex();
+  frame_instance_descs.resize(programState->GetDeviceResources()->GetBackBufferCount());
+  ComPtr<ID3D12Resource>& frame_descs = frame_instance_descs[frame];
+  if (!frame_descs || frame_descs->GetDesc().Width < instance_desc_data.size())
+  {
+    frame_descs.Reset();
+    AllocateUploadBuffer(device, instance_desc_data.data(), instance_desc_data.size(), &frame_descs,
+                         utilityCore::stringAndId(L"InstanceDescs", static_cast<int>(frame)).c_str());
+  }
+  else
+  {
+    BYTE* mapped_descs;
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed(frame_descs->Map(0, &readRange, reinterpret_cast<void**>(&mapped_descs)));
+    memcpy(mapped_descs, instance_desc_data.data(), instance_desc_data.size());
+    frame_descs->Unmap(0, nullptr);
+  }
+  GetTopLevelDesc().Inputs.InstanceDescs = frame_descs->GetGPUVirtualAddress();
 
-    //now on gpu
-    AllocateBufferOnGpu(iPtr, indices.size() * sizeof(Index), &model.indices.resource,
-                        utilityCore::stringAndId(L"Vertices", id));
-    AllocateBufferOnGpu(vPtr, vertices.size() * sizeof(Vertex), &model.vertices.resource,
-                        utilityCore::stringAndId(L"Indices", id));
+  if (is_fallback)
+  {
+    fbCmdLst->BuildRaytracingAccelerationStructure(&GetTopLevelDesc(), 0, nullptr);
+  }
+  else
+  {
+    rtxCmdList->BuildRaytracingAccelerationStructure(&GetTopLevelDesc(), 0, nullptr);
+  }
+  commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(m_topLevelAccelerationStructure.Get()));
+}
 
-    model.verticesCount = vertices.size();
-    model.indicesCount = indices.size();
+void Scene::RecordBottomLevelBuild(ModelLoading::Model& model, bool is_fallback, ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice,
+    ComPtr<ID3D12Device5> m_dxrDevice, ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst, ComPtr<ID3D12GraphicsCommandList5> rtxCmdList)
+{
+  auto commandList = programState->GetDeviceResources()->GetCommandList();
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
 
-    model.vertices_vec = std::move(vertices);
-    model.indices_vec = std::move(indices);
+  //same steps as BuildAccelerationStructures takes for every model
+  model.GetGeomDesc();
+  model.GetBottomLevelBuildDesc();
+  model.GetPreBuild(is_fallback, m_fallbackDevice, m_dxrDevice);
+  model.GetBottomLevelScratchAS(is_fallback, device, m_fallbackDevice, m_dxrDevice);
+  model.GetBottomAS(is_fallback, device, m_fallbackDevice, m_dxrDevice);
+  model.FinalizeAS();
 
-    model.id = id;
-    std::pair<int, ModelLoading::Model> pair(id, model);
-    modelMap.insert(pair);
+  if (is_fallback)
+  {
+    fbCmdLst->BuildRaytracingAccelerationStructure(&model.GetBottomLevelBuildDesc(), 0, nullptr);
+  }
+  else
+  {
+    rtxCmdList->BuildRaytracingAccelerationStructure(&model.GetBottomLevelBuildDesc(), 0, nullptr);
   }
+  commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(model.GetBottomAS(is_fallback, device, m_fallbackDevice, m_dxrDevice).Get()));
 }
 
-void Scene::LoadDiffuseTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture)
+void Scene::WriteInstanceDesc(size_t object, bool is_fallback, ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice, ComPtr<ID3D12Device5> m_dxrDevice)
 {
-  // Load the image from file
-  D3D12_RESOURCE_DESC& textureDesc = newTexture.textureDesc;
-  int imageBytesPerRow;
-  BYTE* imageData;
+  ModelLoading::SceneObject& obj = objects[object];
+  ModelLoading::Model* model = obj.model;
+  if (model == nullptr)
+  {
+    return;
+  }
 
-  wstring wpath = utilityCore::string2wstring(path);
-  int imageSize = TextureLoader::LoadImageDataFromFile(&imageData, textureDesc, wpath.c_str(), imageBytesPerRow);
+  //same order as GetInstanceDescriptors, objects without a model have no desc
+  size_t desc_index = 0;
+  for (size_t i = 0; i < object; i++)
+  {
+    desc_index += objects[i].model != nullptr ? 1 : 0;
+  }
 
-  // make sure we have data
-  if (imageSize <= 0)
+  auto device = programState->GetDeviceResources()->GetD3DDevice();
+  BYTE* descs = instance_desc_data.data();
+  if (is_fallback)
+  {
+    D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC instanceDesc = {};
+    memcpy(instanceDesc.Transform, obj.getTransform3x4(), 12 * sizeof(FLOAT));
+    instanceDesc.InstanceMask = 0xFF;
+    instanceDesc.InstanceID = obj.info_resource.descriptor.slot; // the shader reads infos[InstanceID()]
+    UINT numBufferElements = static_cast<UINT>(model->GetPreBuild(is_fallback, m_fallbackDevice, m_dxrDevice).ResultDataMaxSizeInBytes) / sizeof(UINT32);
+    instanceDesc.AccelerationStructure = model->GetFallBackWrappedPoint(programState, is_fallback, m_fallbackDevice, m_dxrDevice, numBufferElements);
+    memcpy(descs + desc_index * sizeof(instanceDesc), &instanceDesc, sizeof(instanceDesc));
+  }
+  else
   {
-    return throw std::exception("Image size < 0");
+    D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
+    memcpy(instanceDesc.Transform, obj.getTransform3x4(), 12 * sizeof(FLOAT));
+    instanceDesc.InstanceMask = 0xFF;
+    instanceDesc.InstanceID = obj.info_resource.descriptor.slot; // the shader reads infos[InstanceID()]
+    instanceDesc.AccelerationStructure = model->GetBottomAS(is_fallback, device, m_fallbackDevice, m_dxrDevice)->GetGPUVirtualAddress();
+    memcpy(descs + desc_index * sizeof(instanceDesc), &instanceDesc, sizeof(instanceDesc));
   }
+}
 
-  AllocateBufferOnGpu(imageData, imageBytesPerRow, &(newTexture.texBuffer.resource), utilityCore::stringAndId(L"Diffuse Texture", id), &CD3DX12_RESOURCE_DESC(textureDesc));
-  ::free(imageData);
+UINT Scene::InstanceCount() const
+{
+  return static_cast<UINT>(std::count_if(objects.begin(), objects.end(),
+                                         [](const ModelLoading::SceneObject& object) { return object.model != nullptr; }));
+}
 
-  newTexture.id = id;
-  std::pair<int, ModelLoading::Texture> pair(id, newTexture);
-  diffuseTextureMap.insert(pair);
+void Scene::ResetTopLevel()
+{
+  top_level_build_desc_allocated = false;
+  top_level_prebuild_info_allocated = false;
+  scratchResource.Reset();
+  m_topLevelAccelerationStructure.Reset();
+  instanceDescs.Reset();
+  instance_desc_data.clear();
 }
 
-void Scene::LoadNormalTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture)
+void Scene::WriteInstanceTransforms(bool is_fallback)
+{
+  const size_t stride = is_fallback ? sizeof(D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC) : sizeof(D3D12_RAYTRACING_INSTANCE_DESC);
+  const size_t offset = is_fallback ? offsetof(D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC, Transform) : offsetof(D3D12_RAYTRACING_INSTANCE_DESC, Transform);
+
+  BYTE* descs = instance_desc_data.data();
+
+  //same order as GetInstanceDescriptors, objects without a model have no desc
+  size_t desc_index = 0;
+  for (ModelLoading::SceneObject& object : objects)
+  {
+    if (object.model == nullptr)
+    {
+      continue;
+    }
+    memcpy(descs + desc_index * stride + offset, object.getTransform3x4(), 12 * sizeof(FLOAT));
+    desc_index++;
+  }
+}
+
+void Scene::UploadObjectInfo(ModelLoading::SceneObject& object)
 {
-  // Load the image from file
-  D3D12_RESOURCE_DESC& textureDesc = newTexture.textureDesc;
-  int imageBytesPerRow;
-  BYTE* imageData;
+  ModelLoading::InfoResource& info_resource = object.info_resource;
+  CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
+  Info *mapped_data;
+  ThrowIfFailed(info_resource.d3d12_resource.resource->Map(0, &readRange, reinterpret_cast<void**>(&mapped_data)));
+  memcpy(mapped_data, &info_resource.info, sizeof(Info));
+  info_resource.d3d12_resource.resource->Unmap(0, &readRange);
+}
+
+void Scene::LoadPendingAssets()
+{
+  std::wstringstream wstr;
+  auto decode_start = std::chrono::high_resolution_clock::now();
+
+  ThreadPool& pool = ThreadPool::Shared();
+
+  //kick off every decode before waiting on any of them
+  std::vector<std::future<AssetLoader::ModelData>> models;
+  for (const AssetRequest& request : pending_models)
+  {
+    models.emplace_back(pool.Submit([path = request.path]() { return AssetLoader::DecodeObj(path); }));
+  }
+
+  //only the first reference to an image and recipe is decoded, the cache hands out the rest
+  std::vector<TextureCache::Handle> diffuse_handles;
+  std::vector<TextureCache::Handle> normal_handles;
+  std::vector<TextureCache::Handle> decode_handles;
+  std::vector<std::future<AssetLoader::ImageData>> image_futures;
+  auto acquire_images = [&](const std::vector<AssetRequest>& requests, MipChain::Filter filter, std::vector<TextureCache::Handle>& handles)
+  {
+    const UINT32 recipe = TextureCache::Recipe(filter, compress_textures);
+    for (const AssetRequest& request : requests)
+    {
+      bool miss = false;
+      handles.push_back(texture_cache.Acquire(request.path, recipe, &miss));
+      if (miss)
+      {
+        decode_handles.push_back(handles.back());
+        const UINT64 content_hash = texture_cache.Get(handles.back()).content_hash;
+        image_futures.emplace_back(pool.Submit([this, path = request.path, content_hash, filter, &pool]()
+        {
+          return PrepareTexture(path, content_hash, filter, pool);
+        }));
+      }
+    }
+  };
+
+  std::vector<std::future<tinygltf::Model>> gltfs;
+  std::vector<BufferUpload> uploads;
+  std::chrono::high_resolution_clock::time_point upload_start;
+  std::chrono::high_resolution_clock::time_point upload_end;
+  try
+  {
+    acquire_images(pending_diffuse_textures, MipChain::Filter::Srgb, diffuse_handles);
+    acquire_images(pending_normal_textures, MipChain::Filter::Normal, normal_handles);
+
+    for (const std::string& path : pending_gltfs)
+    {
+      gltfs.emplace_back(pool.Submit([path]() { return AssetLoader::DecodeGltf(path); }));
+    }
+
+    for (size_t i = 0; i < models.size(); i++)
+    {
+      const AssetRequest& request = pending_models[i];
+      StageModel(models[i].get(), request.id, modelMap[request.id], uploads);
+    }
+    //the cache keeps the decoded images alive until (and after) the batch is submitted
+    for (size_t i = 0; i < image_futures.size(); i++)
+    {
+      texture_cache.SetImage(decode_handles[i], std::make_shared<const AssetLoader::ImageData>(image_futures[i].get()));
+      StageTexture(decode_handles[i], L"Texture", uploads);
+    }
+
+    upload_start = std::chrono::high_resolution_clock::now();
+    AllocateBuffersOnGpu(uploads);
+    upload_end = std::chrono::high_resolution_clock::now();
+  }
+  catch (...)
+  {
+    //nothing is bound yet, so the batch's references go back; entries only it used are dropped
+    for (TextureCache::Handle handle : diffuse_handles)
+    {
+      texture_cache.Release(handle);
+    }
+    for (TextureCache::Handle handle : normal_handles)
+    {
+      texture_cache.Release(handle);
+    }
+    throw;
+  }
 
-  wstring wpath = utilityCore::string2wstring(path);
-  int imageSize = TextureLoader::LoadImageDataFromFile(&imageData, textureDesc, wpath.c_str(), imageBytesPerRow);
+  for (size_t i = 0; i < diffuse_handles.size(); i++)
+  {
+    const AssetRequest& request = pending_diffuse_textures[i];
+    BindCachedTexture(diffuse_handles[i], request.id, diffuseTextureMap[request.id]);
+  }
+  for (size_t i = 0; i < normal_handles.size(); i++)
+  {
+    const AssetRequest& request = pending_normal_textures[i];
+    BindCachedTexture(normal_handles[i], request.id, normalTextureMap[request.id]);
+  }
 
-  // make sure we have data
-  if (imageSize <= 0)
+  //gltf files bring their own ids, so they go in after every explicitly numbered asset
+  for (size_t i = 0; i < gltfs.size(); i++)
   {
-    return throw std::exception("Image size < 0");
+    tinygltf::Model model = gltfs[i].get();
+    ParseGLTF(pending_gltfs[i], model, false);
   }
 
-  AllocateBufferOnGpu(imageData, imageBytesPerRow, &(newTexture.texBuffer.resource), utilityCore::stringAndId(L"Normal Texture", id), &CD3DX12_RESOURCE_DESC(textureDesc));
-  ::free(imageData);
+  wstr << L"Decoded " << pending_models.size() << L" models, " << image_futures.size() << L" of "
+       << pending_diffuse_textures.size() + pending_normal_textures.size() << L" textures and "
+       << pending_gltfs.size() << L" glTF files on " << pool.Size() << L" threads in "
+       << std::chrono::duration<double, std::milli>(upload_start - decode_start).count() << L" ms, uploaded "
+       << uploads.size() << L" buffers in "
+       << std::chrono::duration<double, std::milli>(upload_end - upload_start).count() << L" ms\n";
+  OuputAndReset(wstr);
+  LogTextureCacheStats();
+
+  //decoder scratch buffers only pay off within a batch, keep just the live texels
+  const TexelPool::Stats texel_stats = TexelPool::Shared().GetStats();
+  wstr << L"Texel pool: " << texel_stats.reuses << L" of " << texel_stats.allocations << L" allocations reused, "
+       << texel_stats.peak_retained_bytes / (1024.0 * 1024.0) << L" MB peak retained\n";
+  OuputAndReset(wstr);
+  TexelPool::Shared().Trim();
 
-  newTexture.id = id;
-  std::pair<int, ModelLoading::Texture> pair(id, newTexture);
-  normalTextureMap.insert(pair);
+  pending_models.clear();
+  pending_diffuse_textures.clear();
+  pending_normal_textures.clear();
+  pending_gltfs.clear();
 }
 
-int Scene::loadModel(string modelid) {
-	int id = atoi(modelid.c_str());
+int Scene::loadModel(std::string_view modelid) {
+	int id = SceneReader::ToInt(modelid);
 
 	std::wstringstream wstr;
 	wstr << L"Loading MODEL " << id << L"\n";
@@ -858,25 +1711,25 @@ int Scene::loadModel(string modelid) {
 
 	ModelLoading::Model newModel;
 
-	string line;
+	std::vector<std::string_view> tokens;
 
-	//load model type
-	utilityCore::safeGetline(fp_in, line);
-	if (!line.empty() && fp_in.good()) {
-		vector<string> tokens = utilityCore::tokenizeString(line);
-                newModel.name = tokens[1];
-                LoadModelHelper(tokens[1], id, newModel);
+	//load model type, decoded later with the rest of the assets
+	if (reader.NextLine(tokens) && !tokens.empty()) {
+                newModel.id = id;
+                newModel.name = std::string(tokens[1]);
+                pending_models.push_back({id, newModel.name});
+                modelMap.insert({id, std::move(newModel)});
         }
 
-	wstr << L"Done loading MODEL " << id << L" !\n";
+	wstr << L"Queued MODEL " << id << L" !\n";
 	wstr << L"------------------------------------------------------------------------------\n";
 	OuputAndReset(wstr);
 
 	return 1;
 }
 
-int Scene::loadDiffuseTexture(string texid) {
-	int id = atoi(texid.c_str());
+int Scene::loadDiffuseTexture(std::string_view texid) {
+	int id = SceneReader::ToInt(texid);
 
 	std::wstringstream wstr;
 	wstr << L"Loading TEXTURE " << id << L"\n";
@@ -885,25 +1738,24 @@ int Scene::loadDiffuseTexture(string texid) {
 
 	ModelLoading::Texture newTexture;
 
-	string line;
-
-	//load texture
-	utilityCore::safeGetline(fp_in, line);
-	if (!line.empty() && fp_in.good()) {
-		vector<string> tokens = utilityCore::tokenizeString(line);
-                newTexture.name = tokens[1];
+	std::vector<std::string_view> tokens;
 
-                LoadDiffuseTextureHelper(tokens[1], id, newTexture);
+	//load texture, decoded later with the rest of the assets
+	if (reader.NextLine(tokens) && !tokens.empty()) {
+                newTexture.id = id;
+                newTexture.name = std::string(tokens[1]);
+                pending_diffuse_textures.push_back({id, newTexture.name});
+                diffuseTextureMap.insert({id, std::move(newTexture)});
 	}
 
-	wstr << L"Done loading TEXTURE " << id << L" !\n";
+	wstr << L"Queued TEXTURE " << id << L" !\n";
 	wstr << L"------------------------------------------------------------------------------\n";
 	OuputAndReset(wstr);
 	return 1;
 }
 
-int Scene::loadNormalTexture(string texid) {
-	int id = atoi(texid.c_str());
+int Scene::loadNormalTexture(std::string_view texid) {
+	int id = SceneReader::ToInt(texid);
 
 	std::wstringstream wstr;
 	wstr << L"Loading NORMAL TEXTURE " << id << L"\n";
@@ -912,25 +1764,24 @@ int Scene::loadNormalTexture(string texid) {
 
 	ModelLoading::Texture newTexture;
 
-	string line;
+	std::vector<std::string_view> tokens;
 
-	//load texture
-	utilityCore::safeGetline(fp_in, line);
-	if (!line.empty() && fp_in.good()) {
-		vector<string> tokens = utilityCore::tokenizeString(line);
-                newTexture.name = tokens[1];
-
-                LoadNormalTextureHelper(tokens[1], id, newTexture);
+	//load texture, decoded later with the rest of the assets
+	if (reader.NextLine(tokens) && !tokens.empty()) {
+                newTexture.id = id;
+                newTexture.name = std::string(tokens[1]);
+                pending_normal_textures.push_back({id, newTexture.name});
+                normalTextureMap.insert({id, std::move(newTexture)});
 	}
 
-	wstr << L"Done loading NORMAL TEXTURE " << id << L" !\n";
+	wstr << L"Queued NORMAL TEXTURE " << id << L" !\n";
 	wstr << L"------------------------------------------------------------------------------\n";
 	OuputAndReset(wstr);
 	return 1;
 }
 
-int Scene::loadMaterial(string matid, std::string name) {
-	int id = atoi(matid.c_str());
+int Scene::loadMaterial(std::string_view matid, std::string name) {
+	int id = SceneReader::ToInt(matid);
 
 	std::wstringstream wstr;
 	wstr << L"Loading MATERIAL " << id << L"\n";
@@ -939,68 +1790,50 @@ int Scene::loadMaterial(string matid, std::string name) {
 
 	ModelLoading::MaterialResource newMat;
         newMat.name = name;
-	string line;
+	std::vector<std::string_view> tokens;
 
 	// LOAD RGB
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			newMat.material.diffuse = XMFLOAT3(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			newMat.material.diffuse = XMFLOAT3(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
 		}
 	}
 
 	// LOAD SPEC
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			newMat.material.specular = XMFLOAT3(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			newMat.material.specular = XMFLOAT3(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
 		}
 	}
 
 	// LOAD SPECEX
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			float exp(atof(tokens[1].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			float exp(SceneReader::ToFloat(tokens[1]));
 			newMat.material.specularExp = exp;
 		}
 	}
 
 	// LOAD REFL
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			float refl(atof(tokens[1].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			float refl(SceneReader::ToFloat(tokens[1]));
 			newMat.material.reflectiveness = refl;
 		}
 	}
 
 	// LOAD REFR
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			float refr(atof(tokens[1].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			float refr(SceneReader::ToFloat(tokens[1]));
 			newMat.material.refractiveness = refr;
 		}
 	}
 
         // LOAD ETA
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			float eta(atof(tokens[1].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			float eta(SceneReader::ToFloat(tokens[1]));
 			newMat.material.eta = eta;
 		}
 	}
@@ -1008,11 +1841,8 @@ int Scene::loadMaterial(string matid, std::string name) {
 
 	// LOAD EMITTANCE
 	{
-		utilityCore::safeGetline(fp_in, line);
-		if (!line.empty() && fp_in.good()) {
-			vector<string> tokens = utilityCore::tokenizeString(line);
-
-			float emit(atof(tokens[1].c_str()));
+		if (reader.NextLine(tokens) && !tokens.empty()) {
+			float emit(SceneReader::ToFloat(tokens[1]));
 			newMat.material.emittance = emit;
 		}
 	}
@@ -1036,28 +1866,29 @@ int Scene::loadCamera() {
 	ModelLoading::Camera newCam;
 
 	// load static properties
+	std::vector<std::string_view> tokens;
 	for (int i = 0; i < 5; i++) {
-		string line;
-		utilityCore::safeGetline(fp_in, line);
-		vector<string> tokens = utilityCore::tokenizeString(line);
-                if (strcmp(tokens[0].c_str(), "fov") == 0) {
-                        newCam.fov = atof(tokens[1].c_str());
+		if (!reader.NextLine(tokens) || tokens.empty()) {
+			continue;
 		}
-		else if (strcmp(tokens[0].c_str(), "depth") == 0) {
-			newCam.maxDepth = atoi(tokens[1].c_str());
+                if (tokens[0] == "fov") {
+                        newCam.fov = SceneReader::ToFloat(tokens[1]);
 		}
-                else if (strcmp(tokens[0].c_str(), "eye") == 0) {
-                        glm::vec3 eye(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
+		else if (tokens[0] == "depth") {
+			newCam.maxDepth = SceneReader::ToInt(tokens[1]);
+		}
+                else if (tokens[0] == "eye") {
+                        glm::vec3 eye(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
                         XMFLOAT3 xm_eye(eye.x, eye.y, eye.z);
                         newCam.eye = XMLoadFloat3(&xm_eye);
                 }
-                else if (strcmp(tokens[0].c_str(), "lookat") == 0) {
-                        glm::vec3 look_at(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
+                else if (tokens[0] == "lookat") {
+                        glm::vec3 look_at(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
                         XMFLOAT3 xm_look_at(look_at.x, look_at.y, look_at.z);
                         newCam.lookat = XMLoadFloat3(&xm_look_at);
                 }
-                else if (strcmp(tokens[0].c_str(), "up") == 0) {
-                        glm::vec3 up(atof(tokens[1].c_str()), atof(tokens[2].c_str()), atof(tokens[3].c_str()));
+                else if (tokens[0] == "up") {
+                        glm::vec3 up(SceneReader::ToFloat(tokens[1]), SceneReader::ToFloat(tokens[2]), SceneReader::ToFloat(tokens[3]));
                         XMFLOAT3 xm_up(up.x, up.y, up.z);
                         newCam.up = XMLoadFloat3(&xm_up);
                 }
@@ -1080,7 +1911,7 @@ D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& Scene::GetTopLevelDesc()
     topLevelInputs.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
     topLevelInputs.Flags =
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-    topLevelInputs.NumDescs = objects.size();
+    topLevelInputs.NumDescs = InstanceCount(); // objects without a model have no instance desc
     topLevelInputs.pGeometryDescs = nullptr;
     topLevelInputs.Type =
         D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
@@ -1150,6 +1981,7 @@ ComPtr<ID3D12Resource> Scene::GetInstanceDescriptors(
     ComPtr<ID3D12Device5> m_dxrDevice) {
   
     auto device = programState->GetDeviceResources()->GetD3DDevice();
+    UpdateTransforms();
     if (is_fallback)
     {
       std::vector<D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC> instanceDescArray;
@@ -1162,7 +1994,7 @@ ComPtr<ID3D12Resource> Scene::GetInstanceDescriptors(
         memcpy(instanceDesc.Transform, obj.getTransform3x4(), 12 * sizeof(FLOAT));
 		
         instanceDesc.InstanceMask = 0xFF;
-        instanceDesc.InstanceID = i; // TODO MAKE SURE THIS MATCHES THE ONE BELOW (FOR ACTUAL RAYTRACING)
+        instanceDesc.InstanceID = obj.info_resource.descriptor.slot; // the shader reads infos[InstanceID()]
         //instanceDesc.InstanceContributionToHitGroupIndex = 0;
 
         if (model != nullptr)
@@ -1178,6 +2010,8 @@ ComPtr<ID3D12Resource> Scene::GetInstanceDescriptors(
       AllocateUploadBuffer(device, instanceDescArray.data(),
                            sizeof(D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC) * instanceDescArray.size(),
                            &instanceDescs, L"InstanceDescs");
+      instance_desc_data.assign(reinterpret_cast<const BYTE*>(instanceDescArray.data()),
+                                reinterpret_cast<const BYTE*>(instanceDescArray.data() + instanceDescArray.size()));
 
       //programState->GetDeviceResources()->ExecuteCommandList();
       //programState->GetDeviceResources()->GetCommandList()->Reset(programState->GetDeviceResources()->GetCommandAllocator(), nullptr);
@@ -1193,7 +2027,7 @@ ComPtr<ID3D12Resource> Scene::GetInstanceDescriptors(
 
         memcpy(instanceDesc.Transform, obj.getTransform3x4(), 12 * sizeof(FLOAT));
         instanceDesc.InstanceMask = 0xFF;
-        instanceDesc.InstanceID = i; // TODO MAKE SURE THIS MATCHES THE ONE BELOW (FOR ACTUAL RAYTRACING)
+        instanceDesc.InstanceID = obj.info_resource.descriptor.slot; // the shader reads infos[InstanceID()]
         //instanceDesc.InstanceContributionToHitGroupIndex = 0;
         if (model != nullptr)
         {
@@ -1211,6 +2045,8 @@ ComPtr<ID3D12Resource> Scene::GetInstanceDescriptors(
       AllocateUploadBuffer(device, instanceDescArray.data(),
                            sizeof(D3D12_RAYTRACING_INSTANCE_DESC) * instanceDescArray.size(),
                            &instanceDescs, L"InstanceDescs");
+      instance_desc_data.assign(reinterpret_cast<const BYTE*>(instanceDescArray.data()),
+                                reinterpret_cast<const BYTE*>(instanceDescArray.data() + instanceDescArray.size()));
     }
     return instanceDescs;
 }
@@ -1220,7 +2056,7 @@ WRAPPED_GPU_POINTER Scene::GetWrappedGPUPointer(bool is_fallback, ComPtr<ID3D12R
   
     UINT numBufferElements =
         static_cast<UINT>(GetTopLevelPrebuildInfo(is_fallback, m_fallbackDevice, m_dxrDevice).ResultDataMaxSizeInBytes) / sizeof(UINT32);
-        return programState->CreateFallbackWrappedPointer(m_topLevelAccelerationStructure.Get(), numBufferElements); 
+        return programState->CreateFallbackWrappedPointer(m_topLevelAccelerationStructure.Get(), numBufferElements, &top_level_descriptor_index);
 }
 
 void Scene::FinalizeAS()
@@ -1232,6 +2068,11 @@ void Scene::FinalizeAS()
       model.FinalizeAS();
     }
 
+    FinalizeTopLevel();
+  }
+
+void Scene::FinalizeTopLevel()
+{
     auto& topLevelBuildDesc = GetTopLevelDesc();
     topLevelBuildDesc.DestAccelerationStructureData =
         m_topLevelAccelerationStructure->GetGPUVirtualAddress();
@@ -1276,173 +2117,169 @@ void Scene::FinalizeAS()
 void Scene::AllocateResourcesInDescriptorHeap()
 {
   auto device = programState->GetDeviceResources()->GetD3DDevice();
+  DescriptorAllocator& descriptors = programState->GetDescriptorAllocator();
 
-  for (auto& model_pair : modelMap)
-  {
-    auto& newModel = model_pair.second;
-    programState->CreateBufferSRV(&newModel.vertices, newModel.verticesCount, sizeof(Vertex));
-  }
+  UpdateTransforms();
 
+  //slots stay with their element, only new ones claim one; the views are rewritten as resources may have been replaced
   for (auto& model_pair : modelMap)
   {
     auto& newModel = model_pair.second;
-    programState->CreateBufferSRV(&newModel.indices, newModel.indicesCount * sizeof(Index) / 4, 0);
+    if (!descriptors.IsLive(newModel.descriptor))
+    {
+      newModel.descriptor = descriptors.Allocate(D3D12RaytracingSimpleLighting::ModelDescriptors);
+    }
+    programState->CreateBufferSRV(&newModel.vertices, newModel.verticesCount, sizeof(Vertex),
+                                  descriptors.Index(newModel.descriptor, D3D12RaytracingSimpleLighting::VertexTable));
+    //raw view, counted in dwords of the (padded) buffer whatever the index format
+    programState->CreateBufferSRV(&newModel.indices, static_cast<UINT>(newModel.indices.resource->GetDesc().Width / 4), 0,
+                                  descriptors.Index(newModel.descriptor, D3D12RaytracingSimpleLighting::IndexTable));
+    programState->CreateBufferSRV(&newModel.tangents, newModel.verticesCount, sizeof(XMFLOAT4),
+                                  descriptors.Index(newModel.descriptor, D3D12RaytracingSimpleLighting::TangentTable));
   }
 
-  for (auto& object : objects)
+  for (auto& material_pair : materialMap)
   {
-    ModelLoading::InfoResource& info_resource = object.info_resource;
-
-    //DEFAULT TO NEGATIVE
-    memset(&info_resource.info, -1, sizeof(info_resource.info));
-    info_resource.info.diffuse_sampler_offset = 0;
-    info_resource.info.normal_sampler_offset = 0;
+    int material_id = material_pair.first;
+    ModelLoading::MaterialResource& material = material_pair.second;
 
-    if(object.model != nullptr)
-    {
-      info_resource.info.model_offset = object.model->id;
-    }
+    // Allocate one constant buffer per frame, since it gets updated every frame.
+    size_t cbSize = (sizeof(Material) + 255 ) & ~255; //align to 256 for CBV
+    const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
 
-    if (object.textures.albedoTex != nullptr)
-    {
-      info_resource.info.texture_offset = object.textures.albedoTex->id;
-      info_resource.info.diffuse_sampler_offset = object.textures.albedoTex->sampler_offset;
-    }
-    
-    if (object.textures.normalTex != nullptr)
+    if (!material.d3d12_material_resource.resource)
     {
-      info_resource.info.texture_normal_offset = object.textures.normalTex->id;
-      info_resource.info.normal_sampler_offset = object.textures.normalTex->sampler_offset;
+      programState->GetPlacedResources().CreateResource(HeapSuballocator::Category::Materials, D3D12_HEAP_TYPE_UPLOAD, constantBufferDesc,
+                                                        D3D12_RESOURCE_STATE_GENERIC_READ, &material.d3d12_material_resource.resource);
+      material.d3d12_material_resource.resource->SetName(
+          utilityCore::stringAndId(L"Material ", material_id).c_str());
     }
 
-    if (object.material != nullptr)
+    if (!descriptors.IsLive(material.descriptor))
     {
-      info_resource.info.material_offset = object.material->id;
+      material.descriptor = descriptors.Allocate(D3D12RaytracingSimpleLighting::MaterialDescriptors);
     }
-
-    XMVECTOR rotation_vector = XMLoadFloat3(&XMFLOAT3((object.rotation.x), (object.rotation.y), (object.rotation.z)));
-    XMMATRIX rotation = XMMatrixRotationRollPitchYawFromVector(rotation_vector);
-    XMMATRIX scale = XMMatrixScaling(object.scale.x, object.scale.y, object.scale.z);
-
-	glm::mat4 transformCol = utilityCore::buildTransformationMatrix(glm::vec4(0,0,0,1), object.rotation, object.scale);
-	glm::mat4 transformRow = glm::transpose(transformCol);
-
-	float* mat = glm::value_ptr(transformRow);
-
-	info_resource.info.rotation_scale_matrix = XMMATRIX(mat);
-
-    // Create the constant buffer memory and map the CPU and GPU addresses
-    const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-
-    // Allocate one constant buffer per frame, since it gets updated every frame.
-    size_t cbSize = (sizeof(Info) + 255 ) & ~255; //align to 256 for CBV
-    const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
-
-    ThrowIfFailed(device->CreateCommittedResource(
-        &uploadHeapProperties,
-        D3D12_HEAP_FLAG_NONE,
-        &constantBufferDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&info_resource.d3d12_resource.resource)));
-
-    info_resource.d3d12_resource.resource->SetName(
-        utilityCore::stringAndId(L"InfoResourceObject ", object.id).c_str());
-
-    UINT descriptorIndex = programState->AllocateDescriptor(&info_resource.d3d12_resource.cpuDescriptorHandle);
-    info_resource.d3d12_resource.gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(programState->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, *programState->GetDescriptorSize());
+    UINT descriptorIndex = descriptors.Index(material.descriptor);
+    material.d3d12_material_resource.cpuDescriptorHandle = programState->GetCpuDescriptor(descriptorIndex);
+    material.d3d12_material_resource.gpuDescriptorHandle = programState->GetGpuDescriptor(descriptorIndex);
 
     // create SRV descriptor
     D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-    cbvDesc.BufferLocation = info_resource.d3d12_resource.resource->GetGPUVirtualAddress();
+    cbvDesc.BufferLocation = material.d3d12_material_resource.resource->GetGPUVirtualAddress();
     cbvDesc.SizeInBytes = cbSize;
 
-    device->CreateConstantBufferView(&cbvDesc, info_resource.d3d12_resource.cpuDescriptorHandle);
+    device->CreateConstantBufferView(&cbvDesc, material.d3d12_material_resource.cpuDescriptorHandle);
 
     // Map the constant buffer and cache its heap pointers.
     // We don't unmap this until the app closes. Keeping buffer mapped for the lifetime of the resource is okay.
     CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-    Info *mapped_data;
-    ThrowIfFailed(info_resource.d3d12_resource.resource->Map(0, &readRange, reinterpret_cast<void**>(&mapped_data)));
-    memcpy(mapped_data, &info_resource.info, sizeof(Info));
-    info_resource.d3d12_resource.resource->Unmap(0, &readRange);
+    Material *material_mapped_data;
+    ThrowIfFailed(material.d3d12_material_resource.resource->Map(0, &readRange, reinterpret_cast<void**>(&material_mapped_data)));
+    memcpy(material_mapped_data, &material.material, sizeof(Material));
+    material.d3d12_material_resource.resource->Unmap(0, &readRange);
+
   }
 
-  for (auto& material_pair : materialMap)
+  //allocate GPU memory for textures into diffuse/normals
+  auto create_texture_views = [&](std::map<int, ModelLoading::Texture>& textures, UINT32 category)
   {
-    int material_id = material_pair.first;
-    ModelLoading::MaterialResource& material = material_pair.second;
+    for (auto& texture_pair : textures)
+    {
+      auto &newTexture = texture_pair.second;
+      if (!descriptors.IsLive(newTexture.descriptor))
+      {
+        newTexture.descriptor = descriptors.Allocate(category);
+      }
+      UINT descriptorIndex = descriptors.Index(newTexture.descriptor);
+      newTexture.texBuffer.cpuDescriptorHandle = programState->GetCpuDescriptor(descriptorIndex);
+
+      // create SRV descriptor
+      D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+      srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+      srvDesc.Format = newTexture.textureDesc.Format;
+      srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+      srvDesc.Texture2D.MipLevels = newTexture.textureDesc.MipLevels;
+      device->CreateShaderResourceView(newTexture.texBuffer.resource.Get(), &srvDesc, newTexture.texBuffer.cpuDescriptorHandle);
+
+      // used to bind to the root signature
+      newTexture.texBuffer.gpuDescriptorHandle = programState->GetGpuDescriptor(descriptorIndex);
+    }
+  };
+  create_texture_views(diffuseTextureMap, D3D12RaytracingSimpleLighting::DiffuseTextureDescriptors);
+  create_texture_views(normalTextureMap, D3D12RaytracingSimpleLighting::NormalTextureDescriptors);
 
-    // Create the constant buffer memory and map the CPU and GPU addresses
-    const D3D12_HEAP_PROPERTIES uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+  //objects last, their infos point at the slots above
+  for (auto& object : objects)
+  {
+    ModelLoading::InfoResource& info_resource = object.info_resource;
 
+    // Create the constant buffer memory and map the CPU and GPU addresses
     // Allocate one constant buffer per frame, since it gets updated every frame.
-    size_t cbSize = (sizeof(Material) + 255 ) & ~255; //align to 256 for CBV
+    size_t cbSize = (sizeof(Info) + 255 ) & ~255; //align to 256 for CBV
     const D3D12_RESOURCE_DESC constantBufferDesc = CD3DX12_RESOURCE_DESC::Buffer(cbSize);
 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &uploadHeapProperties,
-        D3D12_HEAP_FLAG_NONE,
-        &constantBufferDesc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&material.d3d12_material_resource.resource)));
-    material.d3d12_material_resource.resource->SetName(
-        utilityCore::stringAndId(L"Material ", material_id).c_str());
+    //kept across rebuilds, placed resources only go back to their heap with the scene
+    if (!info_resource.d3d12_resource.resource)
+    {
+      programState->GetPlacedResources().CreateResource(HeapSuballocator::Category::Infos, D3D12_HEAP_TYPE_UPLOAD, constantBufferDesc,
+                                                        D3D12_RESOURCE_STATE_GENERIC_READ, &info_resource.d3d12_resource.resource);
+      info_resource.d3d12_resource.resource->SetName(
+          utilityCore::stringAndId(L"InfoResourceObject ", object.id).c_str());
+    }
 
-    UINT descriptorIndex = programState->AllocateDescriptor(&material.d3d12_material_resource.cpuDescriptorHandle);
-    material.d3d12_material_resource.gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(programState->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, *programState->GetDescriptorSize());
+    if (!descriptors.IsLive(info_resource.descriptor))
+    {
+      info_resource.descriptor = descriptors.Allocate(D3D12RaytracingSimpleLighting::ObjectDescriptors);
+    }
+    UINT descriptorIndex = descriptors.Index(info_resource.descriptor);
+    info_resource.d3d12_resource.cpuDescriptorHandle = programState->GetCpuDescriptor(descriptorIndex);
+    info_resource.d3d12_resource.gpuDescriptorHandle = programState->GetGpuDescriptor(descriptorIndex);
 
     // create SRV descriptor
     D3D12_CONSTANT_BUFFER_VIEW_DESC cbvDesc = {};
-    cbvDesc.BufferLocation = material.d3d12_material_resource.resource->GetGPUVirtualAddress();
+    cbvDesc.BufferLocation = info_resource.d3d12_resource.resource->GetGPUVirtualAddress();
     cbvDesc.SizeInBytes = cbSize;
 
-    device->CreateConstantBufferView(&cbvDesc, material.d3d12_material_resource.cpuDescriptorHandle);
-
-    // Map the constant buffer and cache its heap pointers.
-    // We don't unmap this until the app closes. Keeping buffer mapped for the lifetime of the resource is okay.
-    CD3DX12_RANGE readRange(0, 0);        // We do not intend to read from this resource on the CPU.
-    Material *material_mapped_data;
-    ThrowIfFailed(material.d3d12_material_resource.resource->Map(0, &readRange, reinterpret_cast<void**>(&material_mapped_data)));
-    memcpy(material_mapped_data, &material.material, sizeof(Material));
-    material.d3d12_material_resource.resource->Unmap(0, &readRange);
+    device->CreateConstantBufferView(&cbvDesc, info_resource.d3d12_resource.cpuDescriptorHandle);
 
+    WriteObjectInfo(object);
   }
 
-  //allocate GPU memory for textures into diffuse/normals
-  for (auto& texture_pair : diffuseTextureMap)
-  {
-    auto &newTexture = texture_pair.second;
-    UINT descriptorIndex = programState->AllocateDescriptor(&newTexture.texBuffer.cpuDescriptorHandle);
+  LogHeapStats();
+}
 
-    // create SRV descriptor
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = newTexture.textureDesc.Format;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MipLevels = 1;
-    device->CreateShaderResourceView(newTexture.texBuffer.resource.Get(), &srvDesc, newTexture.texBuffer.cpuDescriptorHandle);
+void Scene::WriteObjectInfo(ModelLoading::SceneObject& object)
+{
+  ModelLoading::InfoResource& info_resource = object.info_resource;
+
+  //DEFAULT TO NEGATIVE
+  memset(&info_resource.info, -1, sizeof(info_resource.info));
+  info_resource.info.diffuse_sampler_offset = 0;
+  info_resource.info.normal_sampler_offset = 0;
 
-    // used to bind to the root signature
-    newTexture.texBuffer.gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(programState->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, *programState->GetDescriptorSize());
+  //offsets are descriptor slots, which is how the shader indexes its arrays
+  if (object.model != nullptr)
+  {
+    info_resource.info.model_offset = object.model->descriptor.slot;
+    info_resource.info.index_size = object.model->IndexSize();
   }
 
-  for (auto& texture_pair : normalTextureMap)
+  if (object.textures.albedoTex != nullptr)
   {
-    auto &newTexture = texture_pair.second;
-    UINT descriptorIndex = programState->AllocateDescriptor(&newTexture.texBuffer.cpuDescriptorHandle);
+    info_resource.info.texture_offset = object.textures.albedoTex->descriptor.slot;
+    info_resource.info.diffuse_sampler_offset = object.textures.albedoTex->sampler_offset;
+  }
 
-    // create SRV descriptor
-    D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-    srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-    srvDesc.Format = newTexture.textureDesc.Format;
-    srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-    srvDesc.Texture2D.MipLevels = 1;
-    device->CreateShaderResourceView(newTexture.texBuffer.resource.Get(), &srvDesc, newTexture.texBuffer.cpuDescriptorHandle);
+  if (object.textures.normalTex != nullptr)
+  {
+    info_resource.info.texture_normal_offset = object.textures.normalTex->descriptor.slot;
+    info_resource.info.normal_sampler_offset = object.textures.normalTex->sampler_offset;
+  }
 
-    // used to bind to the root signature
-    newTexture.texBuffer.gpuDescriptorHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(programState->GetDescriptorHeap()->GetGPUDescriptorHandleForHeapStart(), descriptorIndex, *programState->GetDescriptorSize());
+  if (object.material != nullptr)
+  {
+    info_resource.info.material_offset = object.material->descriptor.slot;
   }
 
+  UploadObjectInfo(object);
 }
@@ -6,7 +6,16 @@
 #include <sstream>
 #include <vector>
 
+#include "Animation.h"
+#include "AssetLoader.h"
+#include "HeapSuballocator.h"
+#include "MipChain.h"
 #include "Model.h"
+#include "SceneBundle.h"
+#include "SceneGraph.h"
+#include "SceneReader.h"
+#include "Skinning.h"
+#include "TextureCache.h"
 
 using namespace std;
 
@@ -14,25 +23,105 @@ class D3D12RaytracingSimpleLighting;
 
 class Scene {
 public:
-  ifstream fp_in;
+  SceneReader reader;
+  SceneBundle::Reader bundle;
+
+  // One resource to create and fill, pData has to stay alive until the upload is submitted
+  struct BufferUpload {
+    BufferUpload(void *pData, UINT64 width, ID3D12Resource **ppResource, std::wstring resource_name, const D3D12_RESOURCE_DESC* resource_desc_ptr = nullptr);
+
+    void *pData;
+    UINT64 width;
+    ID3D12Resource **ppResource;
+    std::wstring resource_name;
+    CD3DX12_RESOURCE_DESC resource_desc;
+    //set when pData points into a buffer made just for this upload
+    std::shared_ptr<const std::vector<BYTE>> owned_data;
+    //every mip level of a texture, pData and width are the only subresource when empty
+    std::vector<D3D12_SUBRESOURCE_DATA> subresources;
+    //what the heap statistics count it as, textures or vertices unless set
+    HeapSuballocator::Category category;
+  };
+
+  // upload of a decoded image and all of its mip levels
+  static BufferUpload MakeTextureUpload(const BYTE* texels, const D3D12_RESOURCE_DESC& desc, ID3D12Resource **ppResource, std::wstring resource_name);
+
+  // index buffer upload in the narrowest format for the model's vertex count, sets model.index_format
+  BufferUpload MakeIndexUpload(ModelLoading::Model& model, const Index* indices, size_t count, size_t vertex_count, std::wstring resource_name);
+  // tangent stream upload, pointing into model.tangents_vec
+  BufferUpload MakeTangentUpload(ModelLoading::Model& model, std::wstring resource_name);
 
   void AllocateBufferOnGpu(void *pData, UINT64 width, ID3D12Resource **ppResource, std::wstring resource_name, CD3DX12_RESOURCE_DESC* resource_desc_ptr = nullptr);
+  // records all uploads into one batch of the program's UploadRing and submits it without waiting
+  void AllocateBuffersOnGpu(const std::vector<BufferUpload>& uploads);
 
+  // adds a graph node below parent for every glTF node (recorded in graph_nodes), calls back for the ones with a mesh
   template<typename Callback>
-  void RecurseGLTF(tinygltf::Model &model, tinygltf::Node &node, Callback callback);
+  void RecurseGLTF(tinygltf::Model &model, int node_index, int parent, std::vector<int>& graph_nodes, Callback callback);
   void ParseGLTF(std::string filename, bool make_light = true);
+  void ParseGLTF(std::string filename, tinygltf::Model& model, bool make_light = true);
   void ParseScene(std::string filename);
+  void ParseBundle(std::string filename);
 
-  int loadMaterial(string materialid, std::string name = "");
-  int loadDiffuseTexture(string texid);
-  int loadNormalTexture(string texid);
-  int loadModel(string modelid);
-  int loadObject(string objectid, std::string name = "");
+  int loadMaterial(std::string_view materialid, std::string name = "");
+  int loadDiffuseTexture(std::string_view texid);
+  int loadNormalTexture(std::string_view texid);
+  int loadModel(std::string_view modelid);
+  int loadObject(std::string_view objectid, std::string name = "");
   int loadCamera();
 
   void LoadModelHelper(std::string path, int id, ModelLoading::Model& model);
   void LoadDiffuseTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture);
   void LoadNormalTextureHelper(std::string path, int id, ModelLoading::Texture& newTexture);
+  // decodes and uploads path unless the cache already has it, then points texture at the entry
+  void LoadTextureHelper(const std::string& path, int id, ModelLoading::Texture& texture, const std::wstring& resource_name, MipChain::Filter filter);
+  // Decoded texels of path with their mip chain, block compressed when compress_textures is set.
+  // Served from TextureDiskCache when it has them, stored there otherwise. content_hash is the
+  // source's TextureCache hash, 0 to have it computed. Safe on pool threads.
+  AssetLoader::ImageData PrepareTexture(const std::string& path, UINT64 content_hash, MipChain::Filter filter, ThreadPool& pool) const;
+
+  // BC1/BC3/BC5 instead of RGBA8 for textures read from files, copied from the program on construction
+  bool compress_textures = false;
+
+  // every texture read from a file goes through here, repeated references share the texels and resource
+  TextureCache texture_cache;
+
+  // Asset references collected while reading a scene file. They are decoded on a
+  // worker pool once the whole file has been read, then uploaded in one batch.
+  struct AssetRequest {
+    int id;
+    std::string path;
+  };
+  std::vector<AssetRequest> pending_models;
+  std::vector<AssetRequest> pending_diffuse_textures;
+  std::vector<AssetRequest> pending_normal_textures;
+  std::vector<std::string> pending_gltfs;
+  void LoadPendingAssets();
+
+  // PACK_VERTICES in the scene file: keep the cpu copy of every model in the 16 byte packed form
+  bool pack_cpu_vertices = false;
+  void PackCpuVertices();
+
+  // LOD_CHAIN in the scene file: triangle fractions of the generated levels. Chains are
+  // only built for models used by an OBJECT with a lod line, each level is a model of its own.
+  std::vector<float> lod_ratios{ 0.5f, 0.25f, 0.1f };
+  void BuildLodChains();
+  // points every LOD object at the level it asks for, true if any object changed model;
+  // their indices go to changed_objects
+  bool SelectLods(XMVECTOR eye, std::vector<size_t>* changed_objects = nullptr);
+
+  // move decoded data into the scene and queue its upload
+  void StageModel(AssetLoader::ModelData&& data, int id, ModelLoading::Model& model, std::vector<BufferUpload>& uploads);
+  // index, vertex and tangent uploads from the model's cpu copy
+  void StageGeometry(ModelLoading::Model& model, std::vector<BufferUpload>& uploads);
+  // upload of a cache entry's image into the entry's resource
+  void StageTexture(TextureCache::Handle handle, const std::wstring& resource_name, std::vector<BufferUpload>& uploads);
+  // once the entry is uploaded: texture takes over the cache reference, the resource and its description
+  void BindCachedTexture(TextureCache::Handle handle, int id, ModelLoading::Texture& texture);
+  // texture caches and the upload ring, all counts since they were created
+  void LogTextureCacheStats();
+  // what the scene takes up in the program's PlacedResourceAllocator
+  void LogHeapStats();
 
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC &GetTopLevelDesc();
 
@@ -68,15 +157,47 @@ public:
                   ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst,
                   ComPtr<ID3D12GraphicsCommandList5> rtxCmdList);
 
+  // Single pieces of the above for SceneChangeTracker, recorded on the open command list.
+  // objects with a model, each has an instance desc
+  UINT InstanceCount() const;
+  // forgets the top level and its instance descs, the next Get* makes them for the objects as they are
+  void ResetTopLevel();
+  // the top level's addresses in its build desc, FinalizeAS does it with the models'
+  void FinalizeTopLevel();
+  // creates model's bottom level and records its build
+  void RecordBottomLevelBuild(ModelLoading::Model& model, bool is_fallback,
+                              ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice,
+                              ComPtr<ID3D12Device5> m_dxrDevice,
+                              ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst,
+                              ComPtr<ID3D12GraphicsCommandList5> rtxCmdList);
+  // rebuilds the top level over the instance descs as they are, uploaded for the current frame
+  void RecordTopLevelBuild(bool is_fallback,
+                           ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst,
+                           ComPtr<ID3D12GraphicsCommandList5> rtxCmdList);
+  // rewrites the cpu instance desc of objects[object], if it has a model
+  void WriteInstanceDesc(size_t object, bool is_fallback,
+                         ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice,
+                         ComPtr<ID3D12Device5> m_dxrDevice);
+
+  // gives every model, object, material and texture without a descriptor slot
+  // one, rewrites all their views and the object infos
   void AllocateResourcesInDescriptorHeap();
+  // object's Info from the slots of what it points at, uploaded to its constant buffer
+  void WriteObjectInfo(ModelLoading::SceneObject& object);
 
   ComPtr<ID3D12Resource> m_topLevelAccelerationStructure;
   ComPtr<ID3D12Resource> scratchResource;
   ComPtr<ID3D12Resource> instanceDescs;
+  // what instanceDescs was made from, kept current by the writes after it; every top level
+  // rebuild uploads it to the frame's buffer so no frame in flight sees its descs change
+  std::vector<BYTE> instance_desc_data;
+  std::vector<ComPtr<ID3D12Resource>> frame_instance_descs;
   bool top_level_build_desc_allocated = false;
   D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC top_level_build_desc{};
   bool top_level_prebuild_info_allocated = false;
   D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO top_level_prebuild_info;
+  // descriptor of the top level's fallback wrapped pointer, reused when the top level is remade
+  UINT top_level_descriptor_index = UINT_MAX;
 
   Scene(string filename, D3D12RaytracingSimpleLighting *programState);
   ~Scene();
@@ -91,4 +212,49 @@ public:
   ModelLoading::Camera camera;
 
   vector<ModelLoading::SceneObject> objects;
+
+  // world transforms of every object; objects hang below their glTF node or the root
+  SceneGraph scene_graph;
+  // adds nodes for new objects, re-reads edited local transforms and copies out the
+  // world transforms that changed
+  void UpdateTransforms();
+
+  // A skinned glTF primitive, one model per skinned node. The bind pose stays on
+  // the cpu, the model's mapped buffers get the skinned vertices.
+  struct SkinnedModel {
+    int model_id;
+    int skin;
+    int mesh_graph_node;
+    UINT32 skinned_version = 0; // newest joint version the buffers were skinned at
+    std::vector<Vertex> bind_vertices;
+    std::vector<XMFLOAT4> bind_tangents;
+    std::vector<Skinning::Influences> influences;
+  };
+  // clips and skins of one imported glTF file
+  struct AnimatedGltf {
+    std::string name;
+    int clip = 0; // played clip, -1 holds the current pose
+    std::vector<Animation::Clip> clips;
+    std::vector<Animation::Pose> poses; // per glTF node
+    std::vector<int> graph_nodes; // glTF node -> scene graph node, -1 if not in the scene
+    std::vector<Skinning::Skin> skins;
+    std::vector<SkinnedModel> skinned_models;
+  };
+  std::vector<AnimatedGltf> animated_gltfs;
+  bool HasAnimations() const { return !animated_gltfs.empty(); }
+
+  // samples the clips at time, moves the animated nodes and skins the models whose joints
+  // moved into their buffers for frame, flagging them needs_refit. The GPU must be done
+  // with frame's buffers, which it is once the frame's fence has passed
+  void UpdateAnimations(float time, UINT frame);
+  // records the copies and refits of every flagged model and a TLAS rebuild on the open command list
+  void RecordAnimationRefits(UINT frame, bool is_fallback,
+                             ComPtr<ID3D12RaytracingFallbackDevice> m_fallbackDevice,
+                             ComPtr<ID3D12Device5> m_dxrDevice,
+                             ComPtr<ID3D12RaytracingFallbackCommandList> fbCmdLst,
+                             ComPtr<ID3D12GraphicsCommandList5> rtxCmdList);
+  // rewrites the transforms in the cpu instance descs
+  void WriteInstanceTransforms(bool is_fallback);
+  // copies object.info_resource.info to its constant buffer
+  void UploadObjectInfo(ModelLoading::SceneObject& object);
 };
@@ -0,0 +1,489 @@
+#include "stdafx.h"
+#include "SceneBundle.h"
+#include "AssetLoader.h"
+#include "BlockCompression.h"
+#include "MipChain.h"
+#include "Scene.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+
+using namespace SceneBundle;
+
+namespace
+{
+  UINT64 Align(UINT64 value, UINT64 alignment)
+  {
+    return (value + alignment - 1) & ~(alignment - 1);
+  }
+
+  void AddSceneTexture(Writer& writer, bool normal_map, const ModelLoading::Texture& texture, MipChain::Filter filter, const Scene& scene)
+  {
+    if (texture.name.empty())
+    {
+      writer.AddPlaceholderTexture(normal_map, texture.id, texture.name, texture.was_loaded_from_gltf, texture.textureDesc);
+      return;
+    }
+
+    //the cache still has the texels of everything loaded from a file
+    std::shared_ptr<const AssetLoader::ImageData> image;
+    if (texture.cache_handle != TextureCache::kNone)
+    {
+      image = scene.texture_cache.Get(texture.cache_handle).image;
+    }
+    if (!image)
+    {
+      image = std::make_shared<const AssetLoader::ImageData>(scene.PrepareTexture(texture.name, 0, filter, ThreadPool::Shared()));
+    }
+    writer.AddTexture(normal_map, texture.id, texture.name, texture.was_loaded_from_gltf, *image);
+  }
+
+  template<typename T>
+  void WriteArray(std::ofstream& file, const std::vector<T>& values)
+  {
+    file.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+  }
+
+  void StoreFloat3(float out[3], const XMVECTOR& vector)
+  {
+    XMFLOAT3 value;
+    XMStoreFloat3(&value, vector);
+    out[0] = value.x;
+    out[1] = value.y;
+    out[2] = value.z;
+  }
+}
+
+StringRef Writer::AddString(const std::string& string)
+{
+  StringRef ref{ static_cast<UINT32>(strings.size()), static_cast<UINT32>(string.size()) };
+  strings.insert(strings.end(), string.begin(), string.end());
+  return ref;
+}
+
+UINT64 Writer::AddPayload(const void* data, size_t size)
+{
+  UINT64 offset = Align(payload.size(), kPayloadAlignment);
+  payload.resize(offset + size);
+  if (size > 0)
+  {
+    memcpy(payload.data() + offset, data, size);
+  }
+  return offset;
+}
+
+void Writer::AddModel(INT32 id, const std::string& name, const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+{
+  ModelRecord record{};
+  record.id = id;
+  record.name = AddString(name);
+  record.vertex_count = static_cast<UINT32>(vertices.size());
+  record.index_count = static_cast<UINT32>(indices.size());
+  record.vertex_offset = AddPayload(vertices.data(), vertices.size() * sizeof(Vertex));
+  record.index_offset = AddPayload(indices.data(), indices.size() * sizeof(Index));
+  models.push_back(record);
+}
+
+void Writer::AddTexture(bool normal_map, INT32 id, const std::string& name, bool was_loaded_from_gltf, const AssetLoader::ImageData& image)
+{
+  TextureRecord record{};
+  record.id = id;
+  record.name = AddString(name);
+  record.was_loaded_from_gltf = was_loaded_from_gltf;
+  record.width = static_cast<UINT32>(image.desc.Width);
+  record.height = image.desc.Height;
+  record.format = image.desc.Format;
+  record.row_pitch = image.bytes_per_row;
+  record.mip_levels = image.desc.MipLevels;
+  record.texel_size = image.size;
+  record.texel_offset = AddPayload(image.texels.get(), image.size);
+  (normal_map ? normal_textures : diffuse_textures).push_back(record);
+}
+
+void Writer::AddPlaceholderTexture(bool normal_map, INT32 id, const std::string& name, bool was_loaded_from_gltf, const D3D12_RESOURCE_DESC& desc)
+{
+  //only the description is kept
+  TextureRecord record{};
+  record.id = id;
+  record.name = AddString(name);
+  record.was_loaded_from_gltf = was_loaded_from_gltf;
+  record.width = static_cast<UINT32>(desc.Width);
+  record.height = desc.Height;
+  record.format = desc.Format;
+  record.row_pitch = record.width * TextureLoader::GetBitsPerPixel(desc.Format) / 8;
+  record.mip_levels = 1;
+  (normal_map ? normal_textures : diffuse_textures).push_back(record);
+}
+
+void Writer::AddMaterial(INT32 id, const std::string& name, bool was_loaded_from_gltf, const Material& material)
+{
+  MaterialRecord record{};
+  record.id = id;
+  record.name = AddString(name);
+  record.was_loaded_from_gltf = was_loaded_from_gltf;
+  record.material = material;
+  materials.push_back(record);
+}
+
+void Writer::AddObject(const ObjectRecord& record, const std::string& name)
+{
+  objects.push_back(record);
+  objects.back().name = AddString(name);
+}
+
+bool Writer::Write(const std::string& path) const
+{
+  Header header{};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.model_count = static_cast<UINT32>(models.size());
+  header.diffuse_texture_count = static_cast<UINT32>(diffuse_textures.size());
+  header.normal_texture_count = static_cast<UINT32>(normal_textures.size());
+  header.material_count = static_cast<UINT32>(materials.size());
+  header.object_count = static_cast<UINT32>(objects.size());
+  header.camera = camera;
+
+  UINT64 offset = sizeof(Header);
+  header.models_offset = offset;
+  offset += models.size() * sizeof(ModelRecord);
+  header.diffuse_textures_offset = offset;
+  offset += diffuse_textures.size() * sizeof(TextureRecord);
+  header.normal_textures_offset = offset;
+  offset += normal_textures.size() * sizeof(TextureRecord);
+  header.materials_offset = offset;
+  offset += materials.size() * sizeof(MaterialRecord);
+  header.objects_offset = offset;
+  offset += objects.size() * sizeof(ObjectRecord);
+  header.strings_offset = offset;
+  header.strings_size = strings.size();
+  offset += strings.size();
+  header.payload_offset = Align(offset, kPayloadAlignment);
+  header.payload_size = payload.size();
+
+  std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!file)
+  {
+    return false;
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteArray(file, models);
+  WriteArray(file, diffuse_textures);
+  WriteArray(file, normal_textures);
+  WriteArray(file, materials);
+  WriteArray(file, objects);
+  WriteArray(file, strings);
+
+  const char padding[kPayloadAlignment] = {};
+  file.write(padding, header.payload_offset - offset);
+  WriteArray(file, payload);
+
+  return file.good();
+}
+
+bool SceneBundle::Write(const Scene& scene, const std::string& path)
+{
+  Writer writer;
+
+  for (const auto& pair : scene.modelMap)
+  {
+    const ModelLoading::Model& model = pair.second;
+    writer.AddModel(pair.first, model.name, model.GetCpuVertices(), model.indices_vec);
+  }
+
+  for (const auto& pair : scene.diffuseTextureMap)
+  {
+    AddSceneTexture(writer, false, pair.second, MipChain::Filter::Srgb, scene);
+  }
+
+  for (const auto& pair : scene.normalTextureMap)
+  {
+    AddSceneTexture(writer, true, pair.second, MipChain::Filter::Normal, scene);
+  }
+
+  for (const auto& pair : scene.materialMap)
+  {
+    const ModelLoading::MaterialResource& material = pair.second;
+    writer.AddMaterial(pair.first, material.name, material.was_loaded_from_gltf, material.material);
+  }
+
+  for (const auto& object : scene.objects)
+  {
+    ObjectRecord record{};
+    record.id = object.id;
+    record.model_id = object.model != nullptr ? object.model->id : -1;
+    record.diffuse_texture_id = object.textures.albedoTex != nullptr ? object.textures.albedoTex->id : -1;
+    record.normal_texture_id = object.textures.normalTex != nullptr ? object.textures.normalTex->id : -1;
+    record.material_id = object.material != nullptr ? object.material->id : -1;
+    memcpy(record.translation, &object.translation, sizeof(record.translation));
+    memcpy(record.rotation, &object.rotation, sizeof(record.rotation));
+    memcpy(record.scale, &object.scale, sizeof(record.scale));
+    const bool has_parent = object.node >= 0 && scene.scene_graph.Parent(object.node) != SceneGraph::kRoot;
+    SceneGraph::ToTransform3x4(has_parent ? scene.scene_graph.World(scene.scene_graph.Parent(object.node)) : glm::mat4(1.0f), record.parent_transform);
+    writer.AddObject(record, object.name);
+  }
+
+  CameraRecord camera{};
+  camera.fov = scene.camera.fov;
+  camera.max_depth = scene.camera.maxDepth;
+  StoreFloat3(camera.eye, scene.camera.eye);
+  StoreFloat3(camera.lookat, scene.camera.lookat);
+  StoreFloat3(camera.up, scene.camera.up);
+  writer.SetCamera(camera);
+
+  return writer.Write(path);
+}
+
+bool Reader::Open(const std::string& path)
+{
+  header = nullptr;
+  if (!file.Open(path) || file.Size() < sizeof(Header))
+  {
+    return false;
+  }
+
+  header = At<Header>(0);
+  if (!Validate())
+  {
+    header = nullptr;
+    file.Close();
+    return false;
+  }
+  return true;
+}
+
+bool Reader::Validate() const
+{
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->version != kVersion)
+  {
+    return false;
+  }
+
+  const UINT64 size = file.Size();
+  auto in_file = [size](UINT64 offset, UINT64 length)
+  {
+    return offset <= size && length <= size - offset;
+  };
+
+  if (!in_file(header->models_offset, UINT64(header->model_count) * sizeof(ModelRecord)) ||
+      !in_file(header->diffuse_textures_offset, UINT64(header->diffuse_texture_count) * sizeof(TextureRecord)) ||
+      !in_file(header->normal_textures_offset, UINT64(header->normal_texture_count) * sizeof(TextureRecord)) ||
+      !in_file(header->materials_offset, UINT64(header->material_count) * sizeof(MaterialRecord)) ||
+      !in_file(header->objects_offset, UINT64(header->object_count) * sizeof(ObjectRecord)) ||
+      !in_file(header->strings_offset, header->strings_size) ||
+      !in_file(header->payload_offset, header->payload_size))
+  {
+    return false;
+  }
+
+  auto in_payload = [this](UINT64 offset, UINT64 length)
+  {
+    return offset <= header->payload_size && length <= header->payload_size - offset;
+  };
+
+  for (UINT32 i = 0; i < header->model_count; i++)
+  {
+    const ModelRecord& record = Models()[i];
+    if (record.vertex_count == 0 || record.index_count == 0 || record.index_count % 3 != 0 ||
+        !in_payload(record.vertex_offset, UINT64(record.vertex_count) * sizeof(Vertex)) ||
+        !in_payload(record.index_offset, UINT64(record.index_count) * sizeof(Index)))
+    {
+      return false;
+    }
+    //the BLAS build and the shaders read vertices at these without checking
+    const Index* indices = Indices(record);
+    if (std::any_of(indices, indices + record.index_count, [&record](Index index) { return index >= record.vertex_count; }))
+    {
+      return false;
+    }
+  }
+
+  auto textures_valid = [&](const TextureRecord* textures, UINT32 count)
+  {
+    for (UINT32 i = 0; i < count; i++)
+    {
+      const TextureRecord& texture = textures[i];
+      const DXGI_FORMAT format = static_cast<DXGI_FORMAT>(texture.format);
+      if (texture.width == 0 || texture.height == 0 || !in_payload(texture.texel_offset, texture.texel_size) ||
+          (TextureLoader::GetBitsPerPixel(format) == 0 && BlockCompression::BlockBytes(format) == 0) ||
+          texture.mip_levels == 0 || texture.mip_levels > MipChain::LevelCount(texture.width, texture.height))
+      {
+        return false;
+      }
+      //placeholders are a single level of zeros, otherwise the upload reads every level from the payload
+      if (texture.texel_size == 0 && texture.mip_levels != 1)
+      {
+        return false;
+      }
+      if (texture.texel_size != 0)
+      {
+        const std::vector<MipChain::Level> levels = MipChain::Layout(
+          CD3DX12_RESOURCE_DESC::Tex2D(format, texture.width, texture.height, 1, static_cast<UINT16>(texture.mip_levels)));
+        if (texture.texel_size < levels.back().offset + levels.back().size)
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  return textures_valid(DiffuseTextures(), header->diffuse_texture_count) &&
+         textures_valid(NormalTextures(), header->normal_texture_count);
+}
+
+const ModelRecord* Reader::Models() const
+{
+  return At<ModelRecord>(header->models_offset);
+}
+
+const TextureRecord* Reader::DiffuseTextures() const
+{
+  return At<TextureRecord>(header->diffuse_textures_offset);
+}
+
+const TextureRecord* Reader::NormalTextures() const
+{
+  return At<TextureRecord>(header->normal_textures_offset);
+}
+
+const MaterialRecord* Reader::Materials() const
+{
+  return At<MaterialRecord>(header->materials_offset);
+}
+
+const ObjectRecord* Reader::Objects() const
+{
+  return At<ObjectRecord>(header->objects_offset);
+}
+
+const Vertex* Reader::Vertices(const ModelRecord& record) const
+{
+  return At<Vertex>(header->payload_offset + record.vertex_offset);
+}
+
+const Index* Reader::Indices(const ModelRecord& record) const
+{
+  return At<Index>(header->payload_offset + record.index_offset);
+}
+
+const BYTE* Reader::Texels(const TextureRecord& record) const
+{
+  return At<BYTE>(header->payload_offset + record.texel_offset);
+}
+
+std::string Reader::String(const StringRef& ref) const
+{
+  if (UINT64(ref.offset) + ref.length > header->strings_size)
+  {
+    return {};
+  }
+  return std::string(At<char>(header->strings_offset + ref.offset), ref.length);
+}
+
+BenchmarkResult SceneBundle::Benchmark(const std::string& scene_path, const std::string& bundle_path)
+{
+  AssetLoader::SceneAssets assets = AssetLoader::CollectSceneAssets(scene_path);
+  for (std::vector<std::string>* paths : { &assets.models, &assets.diffuse_textures, &assets.normal_textures })
+  {
+    paths->erase(std::remove_if(paths->begin(), paths->end(), [](const std::string& path) { return !std::filesystem::exists(path); }), paths->end());
+  }
+  //glTF files are decoded into many models; the .txt part of the scene is enough to compare
+  assets.gltfs.clear();
+
+  BenchmarkResult result;
+  {
+    const AssetLoader::DecodedAssets decoded = AssetLoader::DecodeSceneAssets(assets, ThreadPool::Shared());
+    Writer writer;
+    for (size_t i = 0; i < decoded.models.size(); i++)
+    {
+      writer.AddModel(static_cast<INT32>(i), assets.models[i], decoded.models[i].vertices, decoded.models[i].indices);
+    }
+    for (size_t i = 0; i < decoded.diffuse_textures.size(); i++)
+    {
+      writer.AddTexture(false, static_cast<INT32>(i), assets.diffuse_textures[i], false, decoded.diffuse_textures[i]);
+    }
+    for (size_t i = 0; i < decoded.normal_textures.size(); i++)
+    {
+      writer.AddTexture(true, static_cast<INT32>(i), assets.normal_textures[i], false, decoded.normal_textures[i]);
+    }
+    std::filesystem::create_directories(std::filesystem::path(bundle_path).parent_path());
+    if (!writer.Write(bundle_path))
+    {
+      throw std::runtime_error("failed to write " + bundle_path);
+    }
+    result.models = decoded.models.size();
+    result.textures = decoded.diffuse_textures.size() + decoded.normal_textures.size();
+    result.bundle_bytes = std::filesystem::file_size(bundle_path);
+  }
+
+  auto parse = [&assets]()
+  {
+    AssetLoader::DecodeSceneAssets(assets, ThreadPool::Shared());
+  };
+  std::vector<BYTE> staging;
+  auto open_bundle = [&bundle_path, &staging]()
+  {
+    Reader reader;
+    if (!reader.Open(bundle_path))
+    {
+      throw std::runtime_error("failed to open " + bundle_path);
+    }
+    auto copy = [&staging](const void* data, size_t size)
+    {
+      staging.resize(std::max<size_t>(staging.size(), size));
+      memcpy(staging.data(), data, size);
+    };
+    const Header& header = reader.GetHeader();
+    for (UINT32 i = 0; i < header.model_count; i++)
+    {
+      const ModelRecord& record = reader.Models()[i];
+      copy(reader.Vertices(record), record.vertex_count * sizeof(Vertex));
+      copy(reader.Indices(record), record.index_count * sizeof(Index));
+    }
+    for (UINT32 i = 0; i < header.diffuse_texture_count; i++)
+    {
+      copy(reader.Texels(reader.DiffuseTextures()[i]), static_cast<size_t>(reader.DiffuseTextures()[i].texel_size));
+    }
+    for (UINT32 i = 0; i < header.normal_texture_count; i++)
+    {
+      copy(reader.Texels(reader.NormalTextures()[i]), static_cast<size_t>(reader.NormalTextures()[i].texel_size));
+    }
+  };
+  auto time = [](const std::function<void()>& run)
+  {
+    run();
+    auto start = std::chrono::high_resolution_clock::now();
+    run();
+    auto end = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+  };
+  result.parse_milliseconds = time(parse);
+  result.bundle_milliseconds = time(open_bundle);
+  return result;
+}
+
+int SceneBundle::RunBenchmark(const std::vector<std::string>& scene_paths)
+{
+  std::vector<std::string> scenes = scene_paths;
+  if (scenes.empty())
+  {
+    scenes = { "src/scenes/coffee_demo/coffee_demo.txt", "src/scenes/cornell.txt" };
+  }
+
+  std::wstringstream wstr;
+  for (const std::string& scene : scenes)
+  {
+    const std::string bundle = "cache/bundlebench/" + std::filesystem::path(scene).stem().string() + ".rtxpack";
+    const BenchmarkResult result = Benchmark(scene, bundle);
+    wstr << L"bundlebench: " << scene.c_str() << L", " << result.models << L" models, " << result.textures << L" textures, "
+         << result.bundle_bytes / (1024.0 * 1024.0) << L" MB bundle: parse " << result.parse_milliseconds << L" ms, bundle "
+         << result.bundle_milliseconds << L" ms, " << result.parse_milliseconds / result.bundle_milliseconds << L"x faster\n";
+  }
+  utilityCore::report(wstr.str());
+  return 0;
+}
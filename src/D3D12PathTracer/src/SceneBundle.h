@@ -0,0 +1,183 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "shaders/RayTracingHlslCompat.h"
+
+class Scene;
+namespace AssetLoader { struct ImageData; }
+
+// Compiled scene bundle (.rtxpack). Holds everything ParseScene produces on the
+// CPU (final vertex/index arrays, decoded texels, materials, objects, camera) so a
+// launch only has to map the file and upload from it.
+//
+// Layout: Header | record tables | string table | payload (16 byte aligned blobs)
+namespace SceneBundle {
+
+constexpr char kMagic[8] = { 'R', 'T', 'X', 'P', 'A', 'C', 'K', '\0' };
+constexpr UINT32 kVersion = 4;
+constexpr UINT64 kPayloadAlignment = 16;
+
+struct StringRef
+{
+  UINT32 offset; // into the string table
+  UINT32 length;
+};
+
+struct ModelRecord
+{
+  INT32 id;
+  UINT32 vertex_count;
+  UINT32 index_count;
+  StringRef name;
+  UINT32 padding;
+  UINT64 vertex_offset; // into the payload
+  UINT64 index_offset;
+};
+
+struct TextureRecord
+{
+  INT32 id;
+  UINT32 width;
+  UINT32 height;
+  UINT32 row_pitch;
+  UINT32 format; // DXGI_FORMAT
+  StringRef name;
+  UINT32 was_loaded_from_gltf;
+  UINT32 mip_levels; // packed one after the other, as MipChain::Layout describes them
+  UINT64 texel_offset; // into the payload
+  UINT64 texel_size; // 0 for placeholder textures, uploaded as zeros
+};
+
+struct MaterialRecord
+{
+  INT32 id;
+  StringRef name;
+  UINT32 was_loaded_from_gltf;
+  Material material;
+};
+
+struct ObjectRecord
+{
+  INT32 id;
+  INT32 model_id; // -1 when unset
+  INT32 diffuse_texture_id;
+  INT32 normal_texture_id;
+  INT32 material_id;
+  StringRef name;
+  float translation[3];
+  float rotation[3];
+  float scale[3];
+  float parent_transform[3][4]; // world transform of the node the object hangs below, rows
+};
+
+struct CameraRecord
+{
+  float fov;
+  INT32 max_depth;
+  float eye[3];
+  float lookat[3];
+  float up[3];
+};
+
+struct Header
+{
+  char magic[8];
+  UINT32 version;
+  UINT32 model_count;
+  UINT32 diffuse_texture_count;
+  UINT32 normal_texture_count;
+  UINT32 material_count;
+  UINT32 object_count;
+  UINT64 models_offset;
+  UINT64 diffuse_textures_offset;
+  UINT64 normal_textures_offset;
+  UINT64 materials_offset;
+  UINT64 objects_offset;
+  UINT64 strings_offset;
+  UINT64 strings_size;
+  UINT64 payload_offset;
+  UINT64 payload_size;
+  CameraRecord camera;
+};
+
+// Lays out a bundle from records added one at a time; Write(const Scene&) goes
+// through it, and so can tests and benchmarks that have no Scene.
+class Writer {
+public:
+  void AddModel(INT32 id, const std::string& name, const std::vector<Vertex>& vertices, const std::vector<Index>& indices);
+  // a texture with its mip chain
+  void AddTexture(bool normal_map, INT32 id, const std::string& name, bool was_loaded_from_gltf, const AssetLoader::ImageData& image);
+  // a texture of desc's size the upload fills with zeros
+  void AddPlaceholderTexture(bool normal_map, INT32 id, const std::string& name, bool was_loaded_from_gltf, const D3D12_RESOURCE_DESC& desc);
+  void AddMaterial(INT32 id, const std::string& name, bool was_loaded_from_gltf, const Material& material);
+  // record.name is filled in from name
+  void AddObject(const ObjectRecord& record, const std::string& name);
+  void SetCamera(const CameraRecord& camera) { this->camera = camera; }
+
+  bool Write(const std::string& path) const;
+
+private:
+  StringRef AddString(const std::string& string);
+  UINT64 AddPayload(const void* data, size_t size);
+
+  std::vector<ModelRecord> models;
+  std::vector<TextureRecord> diffuse_textures;
+  std::vector<TextureRecord> normal_textures;
+  std::vector<MaterialRecord> materials;
+  std::vector<ObjectRecord> objects;
+  CameraRecord camera{};
+  std::vector<char> strings;
+  std::vector<char> payload;
+};
+
+// Writes the CPU side of a loaded scene. Texels are decoded again from each
+// texture's path since the scene only keeps the GPU copy.
+bool Write(const Scene& scene, const std::string& path);
+
+struct BenchmarkResult
+{
+  size_t models = 0;
+  size_t textures = 0;
+  UINT64 bundle_bytes = 0;
+  double parse_milliseconds = 0.0; // decoding the scene's files, the CPU part of ParseScene
+  double bundle_milliseconds = 0.0; // Reader::Open with its validation, then copying every blob out as the upload does
+};
+// Decodes the assets scene_path references, writes them to bundle_path and
+// times both ways of getting them into memory, each after an untimed pass
+BenchmarkResult Benchmark(const std::string& scene_path, const std::string& bundle_path);
+// -bundlebench [scenes...]: runs Benchmark on the scenes, coffee_demo and cornell by
+// default, with the bundles under cache/bundlebench; no window or device is created
+int RunBenchmark(const std::vector<std::string>& scene_paths);
+
+// Maps a bundle and hands out pointers straight into the mapping.
+// Everything returned stays valid for the lifetime of the reader.
+class Reader {
+public:
+  bool Open(const std::string& path);
+
+  const Header& GetHeader() const { return *header; }
+
+  const ModelRecord* Models() const;
+  const TextureRecord* DiffuseTextures() const;
+  const TextureRecord* NormalTextures() const;
+  const MaterialRecord* Materials() const;
+  const ObjectRecord* Objects() const;
+
+  const Vertex* Vertices(const ModelRecord& record) const;
+  const Index* Indices(const ModelRecord& record) const;
+  const BYTE* Texels(const TextureRecord& record) const;
+  std::string String(const StringRef& ref) const;
+
+private:
+  bool Validate() const;
+
+  template<typename T>
+  const T* At(UINT64 offset) const { return reinterpret_cast<const T*>(file.Data() + offset); }
+
+  MappedFile file;
+  const Header* header = nullptr;
+};
+} // namespace SceneBundle
@@ -0,0 +1,76 @@
+#include "stdafx.h"
+#include "SceneGraph.h"
+
+int SceneGraph::AddNode(int parent, const glm::mat4& local)
+{
+  if (parent != kRoot && (parent < 0 || parent >= static_cast<int>(nodes.size())))
+  {
+    throw std::runtime_error("scene graph parent doesn't exist");
+  }
+
+  Node node;
+  node.parent = parent;
+  node.dirty = true;
+  node.updated_in = 0;
+  node.local = local;
+  node.world = local;
+  nodes.push_back(node);
+
+  first_dirty = std::min<size_t>(first_dirty, nodes.size() - 1);
+  return static_cast<int>(nodes.size() - 1);
+}
+
+void SceneGraph::SetLocal(int node, const glm::mat4& local)
+{
+  nodes[node].local = local;
+  nodes[node].dirty = true;
+  first_dirty = std::min<size_t>(first_dirty, node);
+}
+
+void SceneGraph::Clear()
+{
+  nodes.clear();
+  first_dirty = 0;
+}
+
+size_t SceneGraph::Update()
+{
+  if (!IsDirty())
+  {
+    return 0;
+  }
+
+  //a node is recomputed when it was marked or its parent was recomputed in this pass,
+  //parents always come first so one sweep covers whole subtrees
+  pass++;
+  size_t recomputed = 0;
+  for (size_t i = first_dirty; i < nodes.size(); i++)
+  {
+    Node& node = nodes[i];
+    const bool parent_moved = node.parent != kRoot && nodes[node.parent].updated_in == pass;
+    if (!node.dirty && !parent_moved)
+    {
+      continue;
+    }
+
+    node.world = node.parent == kRoot ? node.local : nodes[node.parent].world * node.local;
+    node.dirty = false;
+    node.updated_in = pass;
+    recomputed++;
+  }
+
+  first_dirty = nodes.size();
+  return recomputed;
+}
+
+void SceneGraph::ToTransform3x4(const glm::mat4& world, FLOAT transform[3][4])
+{
+  //glm is column major, world[c][r]
+  for (int r = 0; r < 3; r++)
+  {
+    for (int c = 0; c < 4; c++)
+    {
+      transform[r][c] = world[c][r];
+    }
+  }
+}
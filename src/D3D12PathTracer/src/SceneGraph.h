@@ -0,0 +1,47 @@
+#pragma once
+
+#include <glm/glm/glm.hpp>
+#include <vector>
+
+// Flattened transform hierarchy. Nodes are stored parents first, so world
+// matrices are composed in a single forward pass. SetLocal only marks the node,
+// Update then recomputes the marked nodes and everything below them and leaves
+// the rest of the scene alone.
+class SceneGraph {
+public:
+  static constexpr int kRoot = -1;
+
+  // parent must already exist (or be kRoot)
+  int AddNode(int parent, const glm::mat4& local = glm::mat4(1.0f));
+  void SetLocal(int node, const glm::mat4& local);
+  void Clear();
+
+  const glm::mat4& Local(int node) const { return nodes[node].local; }
+  // as of the last Update
+  const glm::mat4& World(int node) const { return nodes[node].world; }
+  int Parent(int node) const { return nodes[node].parent; }
+  // changes whenever Update recomputes the node's world matrix, never 0
+  UINT32 Version(int node) const { return nodes[node].updated_in; }
+  size_t Size() const { return nodes.size(); }
+  bool IsDirty() const { return first_dirty < nodes.size(); }
+
+  // returns how many world matrices were recomputed
+  size_t Update();
+
+  // rows of the world matrix, the layout of D3D12_RAYTRACING_INSTANCE_DESC::Transform
+  static void ToTransform3x4(const glm::mat4& world, FLOAT transform[3][4]);
+
+private:
+  struct Node
+  {
+    int parent;
+    bool dirty;
+    UINT32 updated_in;
+    glm::mat4 local;
+    glm::mat4 world;
+  };
+
+  std::vector<Node> nodes;
+  size_t first_dirty = 0; // no node before this one is dirty
+  UINT32 pass = 0;
+};
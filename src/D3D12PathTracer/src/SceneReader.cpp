@@ -0,0 +1,265 @@
+#include "stdafx.h"
+#include "SceneReader.h"
+
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+
+#include "Utilities.h"
+
+namespace
+{
+  inline bool IsSpace(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\v' || c == '\f';
+  }
+
+  inline std::string_view SkipPlus(std::string_view token)
+  {
+    if (!token.empty() && token.front() == '+')
+    {
+      token.remove_prefix(1);
+    }
+    return token;
+  }
+
+  struct ReadTotals {
+    size_t lines = 0;
+    size_t tokens = 0;
+    double sum = 0.0;
+  };
+
+  //the reader ParseScene had before the mapping: a string per line and per token
+  ReadTotals ReadWithStream(const std::string& filename)
+  {
+    ReadTotals totals;
+    std::ifstream file(filename);
+    std::string line;
+    while (file.good())
+    {
+      utilityCore::safeGetline(file, line);
+      totals.lines++;
+      std::vector<std::string> tokens = utilityCore::tokenizeString(line);
+      totals.tokens += tokens.size();
+      for (size_t i = 1; i < tokens.size(); i++)
+      {
+        totals.sum += static_cast<float>(atof(tokens[i].c_str()));
+      }
+    }
+    return totals;
+  }
+
+  ReadTotals ReadWithMapping(const std::string& filename)
+  {
+    ReadTotals totals;
+    SceneReader reader;
+    if (!reader.Open(filename))
+    {
+      throw std::runtime_error("scenebench: can't open " + filename);
+    }
+    std::vector<std::string_view> tokens;
+    while (reader.NextLine(tokens))
+    {
+      totals.lines++;
+      totals.tokens += tokens.size();
+      for (size_t i = 1; i < tokens.size(); i++)
+      {
+        totals.sum += SceneReader::ToFloat(tokens[i]);
+      }
+    }
+    return totals;
+  }
+}
+
+bool SceneReader::Open(const std::string& filename)
+{
+  if (!file.Open(filename))
+  {
+    good = false;
+    return false;
+  }
+
+  cursor = file.Data();
+  end = file.Data() + file.Size();
+  good = true;
+  return true;
+}
+
+bool SceneReader::NextLine(std::vector<std::string_view>& tokens)
+{
+  tokens.clear();
+
+  if (cursor == end)
+  {
+    good = false;
+    return false;
+  }
+
+  const char* token_start = nullptr;
+  while (cursor != end)
+  {
+    const char c = *cursor;
+    if (c == '\n' || c == '\r')
+    {
+      break;
+    }
+
+    if (IsSpace(c))
+    {
+      if (token_start != nullptr)
+      {
+        tokens.emplace_back(token_start, cursor - token_start);
+        token_start = nullptr;
+      }
+    }
+    else if (token_start == nullptr)
+    {
+      token_start = cursor;
+    }
+    ++cursor;
+  }
+
+  if (token_start != nullptr)
+  {
+    tokens.emplace_back(token_start, cursor - token_start);
+  }
+
+  //consume the line ending, \n, \r or \r\n
+  if (cursor != end)
+  {
+    if (*cursor++ == '\r' && cursor != end && *cursor == '\n')
+    {
+      ++cursor;
+    }
+  }
+
+  return true;
+}
+
+float SceneReader::ToFloat(std::string_view token)
+{
+  token = SkipPlus(token);
+
+  float value = 0.0f;
+#if defined(__cpp_lib_to_chars)
+  if (std::from_chars(token.data(), token.data() + token.size(), value).ec != std::errc())
+  {
+    return 0.0f;
+  }
+#else
+  //floating point from_chars is not available on this toolset, tokens are short enough to copy
+  char buffer[64];
+  const size_t length = std::min<size_t>(token.size(), sizeof(buffer) - 1);
+  memcpy(buffer, token.data(), length);
+  buffer[length] = '\0';
+  value = strtof(buffer, nullptr);
+#endif
+  return value;
+}
+
+int SceneReader::ToInt(std::string_view token)
+{
+  token = SkipPlus(token);
+
+  int value = 0;
+  if (std::from_chars(token.data(), token.data() + token.size(), value).ec != std::errc())
+  {
+    return 0;
+  }
+  return value;
+}
+
+SceneReader::BenchmarkResult SceneReader::Benchmark(const std::string& filename)
+{
+  //first pass untimed, so neither reader pays for reading the file from disk
+  ReadWithMapping(filename);
+
+  BenchmarkResult result;
+  result.bytes = std::filesystem::file_size(filename);
+
+  auto start = std::chrono::high_resolution_clock::now();
+  const ReadTotals stream = ReadWithStream(filename);
+  auto end = std::chrono::high_resolution_clock::now();
+  result.stream_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  start = std::chrono::high_resolution_clock::now();
+  const ReadTotals mapped = ReadWithMapping(filename);
+  end = std::chrono::high_resolution_clock::now();
+  result.mapped_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  //safeGetline also reports the empty line after a trailing newline
+  result.lines = mapped.lines;
+  result.tokens = mapped.tokens;
+  result.same_values = stream.tokens == mapped.tokens &&
+    std::abs(stream.sum - mapped.sum) <= 1e-6 * std::max<double>(1.0, std::abs(stream.sum));
+  return result;
+}
+
+void SceneReader::WriteSyntheticScene(const std::string& filename, size_t object_count)
+{
+  const std::filesystem::path parent = std::filesystem::path(filename).parent_path();
+  if (!parent.empty())
+  {
+    std::filesystem::create_directories(parent);
+  }
+
+  std::ofstream file(filename, std::ios::trunc);
+  const char* models[] = { "src/objects/crate.obj", "src/objects/sphere.obj", "src/objects/chromie.obj", "src/objects/Cerberus.obj" };
+  for (int i = 0; i < 4; i++)
+  {
+    file << "MODEL " << i << "\npath " << models[i] << "\n\n";
+  }
+  for (int i = 0; i < 8; i++)
+  {
+    file << "MATERIAL " << i << "\nRGB         " << 0.1f * (i + 1) << " .5 .25\nSPECRGB     0 0 0\nSPECEX      0\n"
+         << "REFL        0\nREFR        0\nREFRIOR     1.5\nEMITTANCE   " << (i == 0 ? 5 : 0) << "\n\n";
+  }
+  for (size_t i = 0; i < object_count; i++)
+  {
+    //a grid of objects with varied transforms, so the numbers aren't all the same few tokens
+    file << "OBJECT " << i << "\nmodel " << i % 4 << "\nalbedo_tex -1\nnormal_tex -1\nmaterial " << i % 8 << "\n"
+         << "trans       " << static_cast<float>(i % 317) * 0.25f << " " << static_cast<float>(i / 317) * -0.5f << " " << (i % 7) * 1.125f << "\n"
+         << "rotat       0 " << (i * 37) % 360 << " 0\n"
+         << "scale       " << 0.5f + (i % 5) * 0.1f << " " << 0.5f + (i % 5) * 0.1f << " " << 0.5f + (i % 5) * 0.1f << "\n\n";
+  }
+  file << "CAMERA\nRES         800 800\nFOVY        45\nITERATIONS  5000\nDEPTH       8\nFILE        synthetic\n"
+       << "EYE         0.0 5 10.5\nLOOKAT      0 5 0\nUP          0 1 0\n";
+}
+
+int SceneReader::RunBenchmark(const std::vector<std::string>& filenames)
+{
+  std::vector<std::string> scenes = filenames;
+  if (scenes.empty())
+  {
+    std::error_code error;
+    for (std::filesystem::recursive_directory_iterator it("src/scenes", error), end; !error && it != end; it.increment(error))
+    {
+      if (it->is_regular_file() && it->path().extension() == ".txt")
+      {
+        scenes.push_back(it->path().string());
+      }
+    }
+    std::sort(scenes.begin(), scenes.end());
+    scenes.push_back("cache/scenebench/synthetic_100k.txt");
+    WriteSyntheticScene(scenes.back(), 100000);
+  }
+
+  std::wstringstream wstr;
+  bool all_same = true;
+  for (const std::string& scene : scenes)
+  {
+    const BenchmarkResult result = Benchmark(scene);
+    const double megabytes = result.bytes / (1024.0 * 1024.0);
+    wstr << L"scenebench: " << scene.c_str() << L", " << result.lines << L" lines, " << result.tokens << L" tokens, "
+         << megabytes << L" MB: stream " << result.stream_milliseconds << L" ms, mapped " << result.mapped_milliseconds
+         << L" ms (" << megabytes / (result.mapped_milliseconds / 1000.0) << L" MB/s), speedup "
+         << result.stream_milliseconds / result.mapped_milliseconds << L"x"
+         << (result.same_values ? L"" : L", READERS DISAGREE") << L"\n";
+    all_same = all_same && result.same_values;
+  }
+  utilityCore::report(wstr.str());
+  return all_same ? 0 : 1;
+}
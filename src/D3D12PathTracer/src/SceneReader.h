@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "MappedFile.h"
+
+// Line/token reader for the .txt scene format. The file is memory mapped and
+// tokens are views into the mapping, so no strings are built while parsing.
+class SceneReader {
+public:
+  bool Open(const std::string& filename);
+  bool IsOpen() const { return file.IsOpen(); }
+
+  // false once the end of the file has been reached
+  bool Good() const { return good; }
+
+  // Splits the next line into whitespace separated tokens.
+  // Returns false if there was no line left to read.
+  bool NextLine(std::vector<std::string_view>& tokens);
+
+  // atof/atoi replacements: invalid input yields 0
+  static float ToFloat(std::string_view token);
+  static int ToInt(std::string_view token);
+
+  struct BenchmarkResult {
+    UINT64 bytes = 0;
+    size_t lines = 0;
+    size_t tokens = 0;
+    double stream_milliseconds = 0.0; // ifstream, safeGetline, tokenizeString and atof, as ParseScene read before
+    double mapped_milliseconds = 0.0; // Open, NextLine and ToFloat
+    bool same_values = false; // both readers saw the same tokens and numbers
+  };
+  // Reads filename with both readers after one untimed pass, converting every
+  // token after a line's keyword to a number the way the load* functions do
+  static BenchmarkResult Benchmark(const std::string& filename);
+  // scene text with object_count OBJECT blocks over a few models and materials
+  static void WriteSyntheticScene(const std::string& filename, size_t object_count);
+  // -scenebench [scenes...]: runs Benchmark on the scenes, by default every .txt below
+  // src/scenes and a synthetic 100k object scene, no window or device is created
+  static int RunBenchmark(const std::vector<std::string>& filenames);
+
+private:
+  MappedFile file;
+  const char* cursor = nullptr;
+  const char* end = nullptr;
+  bool good = false;
+};
@@ -0,0 +1,291 @@
+#include "stdafx.h"
+#include "SceneUpdates.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace {
+const size_t kNoObject = SIZE_MAX;
+
+template <typename T>
+void SortUnique(std::vector<T>& values)
+{
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+} // namespace
+
+void RecordingSceneUpdateBackend::RebuildAll()
+{
+  calls.push_back("RebuildAll");
+}
+
+void RecordingSceneUpdateBackend::Begin()
+{
+  calls.push_back("Begin");
+}
+
+void RecordingSceneUpdateBackend::Submit()
+{
+  calls.push_back("Submit");
+}
+
+void RecordingSceneUpdateBackend::UpdateDescriptors()
+{
+  calls.push_back("UpdateDescriptors");
+}
+
+void RecordingSceneUpdateBackend::BuildBottomLevel(int model)
+{
+  bottom_levels.insert(model);
+  calls.push_back("BuildBottomLevel " + std::to_string(model));
+}
+
+void RecordingSceneUpdateBackend::RebuildInstances()
+{
+  calls.push_back("RebuildInstances");
+}
+
+void RecordingSceneUpdateBackend::WriteInstanceDesc(size_t object)
+{
+  calls.push_back("WriteInstanceDesc " + std::to_string(object));
+}
+
+void RecordingSceneUpdateBackend::UpdateTopLevel()
+{
+  calls.push_back("UpdateTopLevel");
+}
+
+void RecordingSceneUpdateBackend::WriteObjectInfo(size_t object)
+{
+  calls.push_back("WriteObjectInfo " + std::to_string(object));
+}
+
+bool SceneUpdatePlan::IsEmpty() const
+{
+  return !rebuild_all && !descriptors && bottom_levels.empty() && !instances && instance_descs.empty() && !top_level && infos.empty();
+}
+
+std::wstring SceneUpdatePlan::Describe() const
+{
+  std::wstringstream wstr;
+  if (rebuild_all)
+  {
+    wstr << L"full rebuild";
+    return wstr.str();
+  }
+  wstr << (descriptors ? L"descriptors, " : L"") << bottom_levels.size() << L" bottom levels, ";
+  if (instances)
+  {
+    wstr << L"instances remade, ";
+  }
+  else
+  {
+    wstr << instance_descs.size() << L" instance descs, " << (top_level ? L"top level, " : L"");
+  }
+  wstr << infos.size() << L" infos";
+  return wstr.str();
+}
+
+const wchar_t* SceneChangeTracker::Name(Change change)
+{
+  switch (change)
+  {
+  case Change::Transform: return L"transform";
+  case Change::Material: return L"material";
+  case Change::Texture: return L"texture";
+  case Change::Model: return L"model";
+  case Change::Added: return L"added";
+  case Change::Removed: return L"removed";
+  case Change::Resources: return L"resources";
+  case Change::Everything: return L"everything";
+  default: return L"?";
+  }
+}
+
+void SceneChangeTracker::Record(Change change, size_t object, bool had_model, int model)
+{
+  edits.push_back({ change, object, had_model, model });
+}
+
+void SceneChangeTracker::TransformChanged(size_t object)
+{
+  Record(Change::Transform, object);
+}
+
+void SceneChangeTracker::MaterialChanged(size_t object)
+{
+  Record(Change::Material, object);
+}
+
+void SceneChangeTracker::TextureChanged(size_t object)
+{
+  Record(Change::Texture, object);
+}
+
+void SceneChangeTracker::ModelChanged(size_t object, bool had_model, int model)
+{
+  Record(Change::Model, object, had_model, model);
+}
+
+void SceneChangeTracker::ObjectAdded(size_t object, int model)
+{
+  Record(Change::Added, object, false, model);
+}
+
+void SceneChangeTracker::ObjectRemoved(size_t object, bool had_model)
+{
+  //whatever was recorded for the object goes with it
+  std::vector<Edit> kept;
+  kept.reserve(edits.size() + 1);
+  for (Edit edit : edits)
+  {
+    if (edit.object == object)
+    {
+      continue;
+    }
+    if (edit.object != kNoObject && edit.object > object)
+    {
+      edit.object--;
+    }
+    kept.push_back(edit);
+  }
+  edits.swap(kept);
+  Record(Change::Removed, object, had_model);
+}
+
+void SceneChangeTracker::ResourcesChanged()
+{
+  Record(Change::Resources, kNoObject);
+}
+
+void SceneChangeTracker::EverythingChanged()
+{
+  Record(Change::Everything, kNoObject);
+}
+
+size_t SceneChangeTracker::Count(Change change) const
+{
+  return std::count_if(edits.begin(), edits.end(), [change](const Edit& edit) { return edit.change == change; });
+}
+
+SceneUpdatePlan SceneChangeTracker::Plan(const SceneUpdateBackend& backend) const
+{
+  SceneUpdatePlan plan;
+  auto need_bottom_level = [&](int model)
+  {
+    if (model >= 0 && !backend.HasBottomLevel(model))
+    {
+      plan.bottom_levels.push_back(model);
+    }
+  };
+
+  for (const Edit& edit : edits)
+  {
+    switch (edit.change)
+    {
+    case Change::Transform:
+      //the info carries the normal matrix
+      plan.instance_descs.push_back(edit.object);
+      plan.top_level = true;
+      plan.infos.push_back(edit.object);
+      break;
+    case Change::Material:
+    case Change::Texture:
+      plan.infos.push_back(edit.object);
+      break;
+    case Change::Model:
+      plan.infos.push_back(edit.object);
+      need_bottom_level(edit.model);
+      //objects without a model have no instance, gaining or losing one reshapes the list
+      if (edit.had_model != (edit.model >= 0))
+      {
+        plan.instances = true;
+      }
+      else if (edit.model >= 0)
+      {
+        plan.instance_descs.push_back(edit.object);
+        plan.top_level = true;
+      }
+      break;
+    case Change::Added:
+      plan.descriptors = true;
+      need_bottom_level(edit.model);
+      plan.instances |= edit.model >= 0;
+      break;
+    case Change::Removed:
+      plan.instances |= edit.had_model;
+      break;
+    case Change::Resources:
+      plan.descriptors = true;
+      break;
+    case Change::Everything:
+      plan.rebuild_all = true;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (plan.rebuild_all)
+  {
+    SceneUpdatePlan full;
+    full.rebuild_all = true;
+    return full;
+  }
+  if (plan.instances)
+  {
+    plan.instance_descs.clear();
+    plan.top_level = false;
+  }
+  if (plan.descriptors)
+  {
+    plan.infos.clear();
+  }
+  SortUnique(plan.bottom_levels);
+  SortUnique(plan.instance_descs);
+  SortUnique(plan.infos);
+  return plan;
+}
+
+void SceneChangeTracker::Apply(const SceneUpdatePlan& plan, SceneUpdateBackend& backend)
+{
+  if (plan.IsEmpty())
+  {
+    return;
+  }
+  if (plan.rebuild_all)
+  {
+    backend.RebuildAll();
+    return;
+  }
+
+  backend.Begin();
+  //descriptors first, new objects need their info slot for an InstanceID, and
+  //bottom levels before the instance descs that point at them
+  if (plan.descriptors)
+  {
+    backend.UpdateDescriptors();
+  }
+  for (int model : plan.bottom_levels)
+  {
+    backend.BuildBottomLevel(model);
+  }
+  if (plan.instances)
+  {
+    backend.RebuildInstances();
+  }
+  for (size_t object : plan.instance_descs)
+  {
+    backend.WriteInstanceDesc(object);
+  }
+  if (plan.top_level)
+  {
+    backend.UpdateTopLevel();
+  }
+  for (size_t object : plan.infos)
+  {
+    backend.WriteObjectInfo(object);
+  }
+  backend.Submit();
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+// What the GPU side of the scene does for a SceneUpdatePlan. The D3D12
+// backend (D3D12SceneUpdateBackend.h) works on the program's scene;
+// RecordingSceneUpdateBackend stands in for it without a GPU and writes the
+// calls down, to check plans.
+class SceneUpdateBackend {
+public:
+  virtual ~SceneUpdateBackend() = default;
+
+  // whether model's bottom level acceleration structure is built
+  virtual bool HasBottomLevel(int model) const = 0;
+
+  // everything RebuildScene does, on its own submissions
+  virtual void RebuildAll() = 0;
+
+  // opens a batch once the GPU is done with the scene, the calls below go into it
+  virtual void Begin() = 0;
+  // runs the batch and waits for it
+  virtual void Submit() = 0;
+  // views and infos of every element, new ones get their slots
+  virtual void UpdateDescriptors() = 0;
+  virtual void BuildBottomLevel(int model) = 0;
+  // a new instance desc buffer and top level, for when instances came or went
+  virtual void RebuildInstances() = 0;
+  // transform and bottom level of object's instance desc, nothing for objects without a model
+  virtual void WriteInstanceDesc(size_t object) = 0;
+  // top level rebuilt over the instance descs as they are
+  virtual void UpdateTopLevel() = 0;
+  virtual void WriteObjectInfo(size_t object) = 0;
+};
+
+// Nothing but a log of the calls and the models with a bottom level
+class RecordingSceneUpdateBackend : public SceneUpdateBackend {
+public:
+  bool HasBottomLevel(int model) const override { return bottom_levels.count(model) != 0; }
+  void RebuildAll() override;
+  void Begin() override;
+  void Submit() override;
+  void UpdateDescriptors() override;
+  void BuildBottomLevel(int model) override;
+  void RebuildInstances() override;
+  void WriteInstanceDesc(size_t object) override;
+  void UpdateTopLevel() override;
+  void WriteObjectInfo(size_t object) override;
+
+  // "BuildBottomLevel 3", one per call
+  std::vector<std::string> calls;
+  std::set<int> bottom_levels;
+};
+
+// The least work that brings the GPU side up to date with a set of edits
+struct SceneUpdatePlan {
+  bool rebuild_all = false; // everything else is then left empty
+  bool descriptors = false; // rewrites every info too, infos is then left empty
+  std::vector<int> bottom_levels; // models to build one for
+  bool instances = false; // instance descs and top level remade, instance_descs and top_level are then left empty
+  std::vector<size_t> instance_descs;
+  bool top_level = false;
+  std::vector<size_t> infos;
+
+  bool IsEmpty() const;
+  // one line for the log
+  std::wstring Describe() const;
+};
+
+// Edits to the scene since the GPU side last caught up, by object index.
+// Each edit is classed by what it touches: a transform, the material or
+// texture binding (infos only), the model (instance desc, maybe a new bottom
+// level), objects coming and going (the instance list) or the scene's
+// resources (descriptors). Plan turns them into a SceneUpdatePlan, Apply
+// carries one out on a backend, so an edit costs a few small writes and a top
+// level build instead of a RebuildScene.
+class SceneChangeTracker {
+public:
+  enum class Change {
+    Transform,
+    Material,
+    Texture, // diffuse or normal map or their sampler
+    Model,
+    Added,
+    Removed,
+    Resources, // models, textures or materials loaded or removed
+    Everything,
+    Count
+  };
+  static const wchar_t* Name(Change change);
+
+  void TransformChanged(size_t object);
+  void MaterialChanged(size_t object);
+  void TextureChanged(size_t object);
+  // model -1 for none
+  void ModelChanged(size_t object, bool had_model, int model);
+  void ObjectAdded(size_t object, int model);
+  // the objects after it move down one, as do the edits recorded for them
+  void ObjectRemoved(size_t object, bool had_model);
+  void ResourcesChanged();
+  void EverythingChanged();
+
+  bool HasChanges() const { return !edits.empty(); }
+  // edits of kind change since the last Clear
+  size_t Count(Change change) const;
+  SceneUpdatePlan Plan(const SceneUpdateBackend& backend) const;
+  void Clear() { edits.clear(); }
+
+  static void Apply(const SceneUpdatePlan& plan, SceneUpdateBackend& backend);
+
+private:
+  struct Edit {
+    Change change;
+    size_t object;
+    bool had_model;
+    int model;
+  };
+  void Record(Change change, size_t object, bool had_model = false, int model = -1);
+
+  std::vector<Edit> edits;
+};
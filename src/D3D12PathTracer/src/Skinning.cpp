@@ -0,0 +1,370 @@
+#include "stdafx.h"
+#include "Skinning.h"
+#include "Animation.h"
+#include "AssetLoader.h"
+#include "GltfAccessor.h"
+#include "SceneGraph.h"
+#include "ThreadPool.h"
+#include "Utilities.h"
+#include <chrono>
+#include <glm/glm/gtc/matrix_inverse.hpp>
+#include <glm/glm/gtc/matrix_transform.hpp>
+#include <glm/glm/gtc/type_ptr.hpp>
+
+namespace
+{
+  //vertices per pool task, small enough to balance, big enough to not drown in scheduling
+  constexpr size_t kChunkSize = 2048;
+  //D3D12RaytracingSimpleLighting::FrameCount, the skinned buffers the benchmark rotates through
+  constexpr size_t kFramesInFlight = 3;
+
+  inline XMMATRIX ToXMMatrix(const glm::mat4& m)
+  {
+    //glm columns are DirectXMath rows (row vectors on the left)
+    return XMMATRIX(glm::value_ptr(m));
+  }
+}
+
+std::vector<Skinning::Skin> Skinning::LoadSkins(const tinygltf::Model& model)
+{
+  std::vector<Skin> skins;
+  skins.reserve(model.skins.size());
+
+  for (const tinygltf::Skin& gltf_skin : model.skins)
+  {
+    Skin skin;
+    skin.joints = gltf_skin.joints;
+    for (int joint : skin.joints)
+    {
+      if (joint < 0 || joint >= static_cast<int>(model.nodes.size()))
+      {
+        throw std::runtime_error("glTF skin joint doesn't exist");
+      }
+    }
+
+    //without inverse bind matrices the joints are already in bind space
+    skin.inverse_bind.assign(skin.joints.size(), glm::mat4(1.0f));
+    if (gltf_skin.inverseBindMatrices >= 0)
+    {
+      const GltfAccessor::View matrices(model, gltf_skin.inverseBindMatrices);
+      if (matrices.Count() < skin.joints.size() || matrices.Components() != 16)
+      {
+        throw std::runtime_error("glTF skin has too few inverse bind matrices");
+      }
+      for (size_t j = 0; j < skin.joints.size(); j++)
+      {
+        for (int i = 0; i < 16; i++)
+        {
+          skin.inverse_bind[j][i / 4][i % 4] = matrices.Component(j, i);
+        }
+      }
+    }
+
+    skins.push_back(std::move(skin));
+  }
+  return skins;
+}
+
+std::vector<Skinning::Influences> Skinning::LoadInfluences(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const Skin& skin)
+{
+  std::vector<Influences> influences;
+  const GltfAccessor::View joints = GltfAccessor::FindAttribute(model, primitive, "JOINTS_0");
+  const GltfAccessor::View weights = GltfAccessor::FindAttribute(model, primitive, "WEIGHTS_0");
+  const GltfAccessor::View positions = GltfAccessor::FindAttribute(model, primitive, "POSITION");
+  if (joints.Empty() || weights.Empty())
+  {
+    return influences;
+  }
+  if (joints.Count() != positions.Count() || weights.Count() != positions.Count())
+  {
+    throw std::runtime_error("glTF skin attributes don't match the vertex count");
+  }
+
+  influences.resize(positions.Count());
+  for (size_t v = 0; v < influences.size(); v++)
+  {
+    Influences& influence = influences[v];
+    float total = 0.0f;
+    for (int i = 0; i < 4; i++)
+    {
+      const float joint = joints.Component(v, i);
+      influence.weights[i] = weights.Component(v, i);
+      influence.joints[i] = static_cast<UINT16>(joint);
+      if (influence.weights[i] > 0.0f && joint >= skin.joints.size())
+      {
+        throw std::runtime_error("glTF vertex is skinned to a joint the skin doesn't have");
+      }
+      if (joint >= skin.joints.size())
+      {
+        //unused slot, keep it in range so skinning doesn't have to check
+        influence.joints[i] = 0;
+        influence.weights[i] = 0.0f;
+      }
+      total += influence.weights[i];
+    }
+
+    //exporters quantize weights, renormalize so the vertex doesn't shrink
+    if (total > 0.0f)
+    {
+      for (int i = 0; i < 4; i++)
+      {
+        influence.weights[i] /= total;
+      }
+    }
+    else
+    {
+      //the spec doesn't allow it, follow the first joint rather than collapse to the origin
+      influence.weights[0] = 1.0f;
+    }
+  }
+  return influences;
+}
+
+void Skinning::ComputeJointMatrices(const Skin& skin, const SceneGraph& graph, const std::vector<int>& graph_nodes, int mesh_graph_node,
+                                    std::vector<XMMATRIX>& joint_matrices)
+{
+  const glm::mat4 mesh_to_world_inverse = glm::inverse(graph.World(mesh_graph_node));
+
+  joint_matrices.resize(skin.joints.size());
+  for (size_t j = 0; j < skin.joints.size(); j++)
+  {
+    const int joint_node = graph_nodes[skin.joints[j]];
+    const glm::mat4 joint = mesh_to_world_inverse * graph.World(joint_node) * skin.inverse_bind[j];
+    joint_matrices[j] = ToXMMatrix(joint);
+  }
+}
+
+void Skinning::SkinVertices(const Vertex* bind_vertices, const XMFLOAT4* bind_tangents, const Influences* influences, size_t count,
+                            const std::vector<XMMATRIX>& joint_matrices, Vertex* out_vertices, XMFLOAT4* out_tangents, ThreadPool& pool)
+{
+  if (count == 0 || joint_matrices.empty())
+  {
+    return;
+  }
+
+  const XMMATRIX* joints = joint_matrices.data();
+  const size_t chunks = (count + kChunkSize - 1) / kChunkSize;
+  pool.ParallelFor(chunks, [&](size_t chunk)
+  {
+    const size_t begin = chunk * kChunkSize;
+    const size_t end = std::min<size_t>(begin + kChunkSize, count);
+    for (size_t v = begin; v < end; v++)
+    {
+      const Influences& influence = influences[v];
+
+      //weighted sum of the joint matrices, one multiply-add per row
+      XMMATRIX blended;
+      const XMVECTOR w0 = XMVectorReplicate(influence.weights[0]);
+      const XMMATRIX& j0 = joints[influence.joints[0]];
+      blended.r[0] = XMVectorMultiply(j0.r[0], w0);
+      blended.r[1] = XMVectorMultiply(j0.r[1], w0);
+      blended.r[2] = XMVectorMultiply(j0.r[2], w0);
+      blended.r[3] = XMVectorMultiply(j0.r[3], w0);
+      for (int i = 1; i < 4; i++)
+      {
+        if (influence.weights[i] == 0.0f)
+        {
+          continue;
+        }
+        const XMVECTOR w = XMVectorReplicate(influence.weights[i]);
+        const XMMATRIX& j = joints[influence.joints[i]];
+        blended.r[0] = XMVectorMultiplyAdd(j.r[0], w, blended.r[0]);
+        blended.r[1] = XMVectorMultiplyAdd(j.r[1], w, blended.r[1]);
+        blended.r[2] = XMVectorMultiplyAdd(j.r[2], w, blended.r[2]);
+        blended.r[3] = XMVectorMultiplyAdd(j.r[3], w, blended.r[3]);
+      }
+
+      const Vertex& in = bind_vertices[v];
+      Vertex& out = out_vertices[v];
+      XMStoreFloat3(&out.position, XMVector3Transform(XMLoadFloat3(&in.position), blended));
+      //joints carry no shear worth an inverse transpose, renormalizing is enough
+      XMStoreFloat3(&out.normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&in.normal), blended)));
+      out.texCoord = in.texCoord;
+
+      const XMVECTOR tangent = XMLoadFloat4(&bind_tangents[v]);
+      const XMVECTOR skinned_tangent = XMVector3Normalize(XMVector3TransformNormal(tangent, blended));
+      XMStoreFloat4(&out_tangents[v], XMVectorSelect(tangent, skinned_tangent, g_XMSelect1110));
+    }
+  });
+}
+
+Skinning::BenchmarkResult Skinning::Benchmark(const std::string& path, size_t instances, size_t frames, ThreadPool& pool)
+{
+  tinygltf::Model model = AssetLoader::DecodeGltf(path);
+  const std::vector<Animation::Clip> clips = Animation::LoadClips(model);
+  const std::vector<Skin> skins = LoadSkins(model);
+  if (clips.empty() || clips[0].duration <= 0.0f)
+  {
+    throw std::runtime_error("glTF has no animation to play");
+  }
+  const Animation::Clip& clip = clips[0];
+
+  //the skinned primitives, bind pose and influences are shared by every instance like ParseGLTF reads them
+  struct Primitive
+  {
+    int node;
+    std::vector<Vertex> bind_vertices;
+    std::vector<XMFLOAT4> bind_tangents;
+    std::vector<Influences> influences;
+  };
+  std::vector<Primitive> primitives;
+  AssetLoader::GltfInstances gltf_instances = AssetLoader::DecodeGltfInstances(model);
+  for (AssetLoader::GltfModel& gltf_model : gltf_instances.models)
+  {
+    if (gltf_model.skinned_node < 0)
+    {
+      continue;
+    }
+    const tinygltf::Node& node = model.nodes[gltf_model.skinned_node];
+    Primitive primitive;
+    primitive.node = gltf_model.skinned_node;
+    primitive.influences = LoadInfluences(model, model.meshes[gltf_model.mesh].primitives[gltf_model.primitive], skins[node.skin]);
+    if (primitive.influences.empty())
+    {
+      continue;
+    }
+    primitive.bind_vertices = std::move(gltf_model.data.vertices);
+    primitive.bind_tangents = std::move(gltf_model.data.tangents);
+    primitives.push_back(std::move(primitive));
+  }
+  if (primitives.empty())
+  {
+    throw std::runtime_error("glTF has no skinned primitive");
+  }
+
+  //every instance gets its own copy of the node tree below a root on a grid, as if the file were loaded instances times
+  const int scene_index = model.defaultScene >= 0 ? model.defaultScene : 0;
+  SceneGraph graph;
+  std::vector<std::vector<int>> graph_nodes(instances, std::vector<int>(model.nodes.size(), -1));
+  std::vector<std::vector<Animation::Pose>> poses(instances);
+  for (size_t instance = 0; instance < instances; instance++)
+  {
+    const glm::vec3 offset(float(instance % 32) * 2.0f, 0.0f, float(instance / 32) * 2.0f);
+    const int root = graph.AddNode(SceneGraph::kRoot, glm::translate(glm::mat4(1.0f), offset));
+    std::vector<int>& nodes = graph_nodes[instance];
+    std::vector<std::pair<int, int>> stack; // glTF node, parent graph node
+    for (int node : model.scenes[scene_index].nodes)
+    {
+      stack.emplace_back(node, root);
+    }
+    while (!stack.empty())
+    {
+      const std::pair<int, int> top = stack.back();
+      stack.pop_back();
+      const tinygltf::Node& node = model.nodes[top.first];
+      nodes[top.first] = graph.AddNode(top.second, AssetLoader::GltfNodeTransform(node));
+      for (int child : node.children)
+      {
+        stack.emplace_back(child, nodes[top.first]);
+      }
+    }
+
+    for (const tinygltf::Node& node : model.nodes)
+    {
+      poses[instance].push_back(Animation::RestPose(node));
+    }
+  }
+  graph.Update();
+
+  //one output per instance, primitive and frame in flight, the upload buffers of the skinned models
+  BenchmarkResult result;
+  result.instances = instances;
+  for (const Primitive& primitive : primitives)
+  {
+    result.skinned_vertices += primitive.bind_vertices.size();
+  }
+  result.refit_bytes = instances * result.skinned_vertices * (sizeof(Vertex) + sizeof(XMFLOAT4));
+  std::vector<std::vector<Vertex>> out_vertices(kFramesInFlight * instances * primitives.size());
+  std::vector<std::vector<XMFLOAT4>> out_tangents(out_vertices.size());
+  for (size_t i = 0; i < out_vertices.size(); i++)
+  {
+    out_vertices[i].resize(primitives[i % primitives.size()].bind_vertices.size());
+    out_tangents[i].resize(out_vertices[i].size());
+  }
+
+  std::vector<XMMATRIX> joint_matrices;
+  auto play = [&](size_t frame)
+  {
+    auto start = std::chrono::high_resolution_clock::now();
+    const float time = float(frame) / 60.0f;
+    for (size_t instance = 0; instance < instances; instance++)
+    {
+      //phases spread over the clip so the instances don't all hold the same pose
+      Animation::Sample(clip, time + clip.duration * float(instance) / float(instances), poses[instance]);
+      for (const Animation::Channel& channel : clip.channels)
+      {
+        const int graph_node = graph_nodes[instance][channel.node];
+        if (graph_node >= 0)
+        {
+          graph.SetLocal(graph_node, poses[instance][channel.node].Matrix());
+        }
+      }
+    }
+    graph.Update();
+    auto skinned = std::chrono::high_resolution_clock::now();
+    result.graph_milliseconds += std::chrono::duration<double, std::milli>(skinned - start).count();
+
+    const size_t buffer = frame % kFramesInFlight;
+    for (size_t instance = 0; instance < instances; instance++)
+    {
+      for (size_t p = 0; p < primitives.size(); p++)
+      {
+        const Primitive& primitive = primitives[p];
+        const Skin& skin = skins[model.nodes[primitive.node].skin];
+        const size_t out = (buffer * instances + instance) * primitives.size() + p;
+        ComputeJointMatrices(skin, graph, graph_nodes[instance], graph_nodes[instance][primitive.node], joint_matrices);
+        SkinVertices(primitive.bind_vertices.data(), primitive.bind_tangents.data(), primitive.influences.data(), primitive.influences.size(),
+                     joint_matrices, out_vertices[out].data(), out_tangents[out].data(), pool);
+      }
+    }
+    result.skin_milliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - skinned).count();
+  };
+
+  //one untimed frame to touch every buffer
+  play(0);
+  result.graph_milliseconds = result.skin_milliseconds = 0.0;
+  for (size_t frame = 1; frame <= frames; frame++)
+  {
+    play(frame);
+  }
+  result.frames = frames;
+  result.milliseconds = result.graph_milliseconds + result.skin_milliseconds;
+  result.frames_per_second = result.milliseconds > 0.0 ? 1000.0 * double(frames) / result.milliseconds : 0.0;
+  return result;
+}
+
+std::string Skinning::BenchmarkModel()
+{
+  return "src/gltf/CesiumMan/glTF/CesiumMan.gltf";
+}
+
+int Skinning::RunBenchmark(const std::vector<std::string>& paths)
+{
+  const std::vector<std::string> files = paths.empty() ? std::vector<std::string>{ BenchmarkModel() } : paths;
+  const size_t instances = 1000;
+  const size_t frames = 60;
+
+  std::wstringstream wstr;
+  size_t failed = 0;
+  for (const std::string& file : files)
+  {
+    BenchmarkResult result;
+    try
+    {
+      result = Benchmark(file, instances, frames, ThreadPool::Shared());
+    }
+    catch (const std::exception& e)
+    {
+      wstr << L"skinbench: " << file.c_str() << L" failed: " << e.what() << L"\n";
+      failed++;
+      continue;
+    }
+
+    wstr << L"skinbench: " << file.c_str() << L", " << result.instances << L" instances of " << result.skinned_vertices << L" skinned vertices, "
+         << result.frames << L" frames in " << result.milliseconds << L" ms (graph " << result.graph_milliseconds << L" ms, skinning "
+         << result.skin_milliseconds << L" ms), " << result.frames_per_second << L" frames/s, "
+         << double(result.refit_bytes) / (1024.0 * 1024.0) << L" MB copied and refit from per frame\n";
+  }
+  utilityCore::report(wstr.str());
+  return failed == 0 ? 0 : 1;
+}
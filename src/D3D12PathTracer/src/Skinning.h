@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm/glm.hpp>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+class SceneGraph;
+class ThreadPool;
+
+// Linear blend skinning on the CPU. Each vertex is moved by up to four joints:
+// the weighted sum of their joint matrices is built with DirectXMath and
+// applied to the bind pose position, normal and tangent. Vertices are split in
+// chunks over a ThreadPool, the output goes straight into (mapped) buffers.
+namespace Skinning {
+
+struct Influences {
+  UINT16 joints[4];
+  float weights[4]; // renormalized to sum to 1
+};
+
+struct Skin {
+  std::vector<int> joints; // glTF nodes
+  std::vector<glm::mat4> inverse_bind;
+};
+
+std::vector<Skin> LoadSkins(const tinygltf::Model& model);
+
+// JOINTS_0 / WEIGHTS_0 of a primitive, empty if it has none.
+// Throws if a vertex names a joint the skin doesn't have.
+std::vector<Influences> LoadInfluences(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const Skin& skin);
+
+// joint matrices in the space of the mesh node: inverse(mesh world) * joint world * inverse bind.
+// graph_nodes maps glTF nodes to their scene graph node, world matrices are as of the last Update
+void ComputeJointMatrices(const Skin& skin, const SceneGraph& graph, const std::vector<int>& graph_nodes, int mesh_graph_node,
+                          std::vector<XMMATRIX>& joint_matrices);
+
+// skins count vertices; out_tangents keeps the handedness in w
+void SkinVertices(const Vertex* bind_vertices, const XMFLOAT4* bind_tangents, const Influences* influences, size_t count,
+                  const std::vector<XMMATRIX>& joint_matrices, Vertex* out_vertices, XMFLOAT4* out_tangents, ThreadPool& pool);
+
+struct BenchmarkResult
+{
+  size_t instances = 0;
+  size_t skinned_vertices = 0; // per instance
+  size_t frames = 0;
+  double milliseconds = 0.0; // all frames
+  double graph_milliseconds = 0.0; // sampling the clip and updating the scene graph
+  double skin_milliseconds = 0.0; // joint matrices and SkinVertices
+  double frames_per_second = 0.0;
+  size_t refit_bytes = 0; // skinned vertices and tangents a frame copies and refits from
+};
+// Plays the first clip of the glTF at path on instances copies of its default scene, each with its own
+// joints, phase and skinned models, for frames frames: what Scene::UpdateAnimations does every animated
+// frame, skinning into one buffer per frame in flight. The GPU copies and refits are only counted in bytes
+BenchmarkResult Benchmark(const std::string& path, size_t instances, size_t frames, ThreadPool& pool);
+// The model -skinbench plays by default
+std::string BenchmarkModel();
+// -skinbench [files...]: runs Benchmark on the files, BenchmarkModel() by default, at 1000 instances and prints
+// frames/s; no window or device is created. Returns 1 if a file fails to load or has no clip or skinned primitive
+int RunBenchmark(const std::vector<std::string>& paths);
+} // namespace Skinning
@@ -0,0 +1,130 @@
+#include "stdafx.h"
+#include "TangentFrames.h"
+
+using namespace DirectX;
+
+namespace
+{
+  // below this the triangle's texcoords don't span an area
+  constexpr float kMinTexcoordArea = 1e-12f;
+
+  // component of v perpendicular to the unit (or zero) vector n
+  inline XMVECTOR RejectFrom(FXMVECTOR v, FXMVECTOR n)
+  {
+    return XMVectorSubtract(v, XMVectorMultiply(n, XMVector3Dot(n, v)));
+  }
+
+  // any unit vector perpendicular to n
+  inline XMVECTOR AnyPerpendicular(FXMVECTOR n)
+  {
+    XMVECTOR axis = fabsf(XMVectorGetX(n)) < 0.9f ? g_XMIdentityR0 : g_XMIdentityR1;
+    XMVECTOR perpendicular = RejectFrom(axis, n);
+    return XMVector3Equal(perpendicular, XMVectorZero()) ? g_XMIdentityR0 : XMVector3Normalize(perpendicular);
+  }
+
+  // angle between the two edges leaving a corner
+  inline float CornerAngle(FXMVECTOR corner, FXMVECTOR next, FXMVECTOR previous)
+  {
+    XMVECTOR a = XMVector3Normalize(XMVectorSubtract(next, corner));
+    XMVECTOR b = XMVector3Normalize(XMVectorSubtract(previous, corner));
+    return XMVectorGetX(XMVector3AngleBetweenNormals(a, b));
+  }
+}
+
+void TangentFrames::Generate(const Vertex* vertices, size_t vertex_count, const Index* indices, size_t index_count, XMFLOAT4* tangents)
+{
+  std::vector<XMFLOAT3> tangent_sums(vertex_count, XMFLOAT3(0.0f, 0.0f, 0.0f));
+  std::vector<XMFLOAT3> bitangent_sums(vertex_count, XMFLOAT3(0.0f, 0.0f, 0.0f));
+
+  std::vector<XMVECTOR> normals(vertex_count);
+  for (size_t i = 0; i < vertex_count; i++)
+  {
+    XMVECTOR normal = XMLoadFloat3(&vertices[i].normal);
+    normals[i] = XMVector3Equal(normal, XMVectorZero()) ? normal : XMVector3Normalize(normal);
+  }
+
+  for (size_t t = 0; t + 2 < index_count; t += 3)
+  {
+    const Index corners[3] = { indices[t], indices[t + 1], indices[t + 2] };
+    if (corners[0] >= vertex_count || corners[1] >= vertex_count || corners[2] >= vertex_count)
+    {
+      throw std::runtime_error("triangle references a vertex that doesn't exist");
+    }
+
+    XMVECTOR positions[3];
+    XMFLOAT2 texcoords[3];
+    for (int k = 0; k < 3; k++)
+    {
+      positions[k] = XMLoadFloat3(&vertices[corners[k]].position);
+      //flip v so the bitangent points up the image
+      texcoords[k] = XMFLOAT2(vertices[corners[k]].texCoord.x, -vertices[corners[k]].texCoord.y);
+    }
+
+    const XMVECTOR edge1 = XMVectorSubtract(positions[1], positions[0]);
+    const XMVECTOR edge2 = XMVectorSubtract(positions[2], positions[0]);
+    const float du1 = texcoords[1].x - texcoords[0].x;
+    const float dv1 = texcoords[1].y - texcoords[0].y;
+    const float du2 = texcoords[2].x - texcoords[0].x;
+    const float dv2 = texcoords[2].y - texcoords[0].y;
+
+    //zero area triangles have no meaningful corner angles
+    const float determinant = du1 * dv2 - du2 * dv1;
+    if (fabsf(determinant) < kMinTexcoordArea || XMVector3Equal(XMVector3Cross(edge1, edge2), XMVectorZero()))
+    {
+      continue;
+    }
+
+    //only the directions matter, the magnitudes are dropped per corner below
+    const XMVECTOR face_tangent = XMVectorScale(XMVectorSubtract(XMVectorScale(edge1, dv2), XMVectorScale(edge2, dv1)), 1.0f / determinant);
+    const XMVECTOR face_bitangent = XMVectorScale(XMVectorSubtract(XMVectorScale(edge2, du1), XMVectorScale(edge1, du2)), 1.0f / determinant);
+
+    for (int k = 0; k < 3; k++)
+    {
+      const Index vertex = corners[k];
+      const float angle = CornerAngle(positions[k], positions[(k + 1) % 3], positions[(k + 2) % 3]);
+      if (!(angle > 0.0f))
+      {
+        continue;
+      }
+
+      XMVECTOR tangent = RejectFrom(face_tangent, normals[vertex]);
+      XMVECTOR bitangent = RejectFrom(face_bitangent, normals[vertex]);
+      if (!XMVector3Equal(tangent, XMVectorZero()))
+      {
+        tangent = XMVectorScale(XMVector3Normalize(tangent), angle);
+        XMStoreFloat3(&tangent_sums[vertex], XMVectorAdd(XMLoadFloat3(&tangent_sums[vertex]), tangent));
+      }
+      if (!XMVector3Equal(bitangent, XMVectorZero()))
+      {
+        bitangent = XMVectorScale(XMVector3Normalize(bitangent), angle);
+        XMStoreFloat3(&bitangent_sums[vertex], XMVectorAdd(XMLoadFloat3(&bitangent_sums[vertex]), bitangent));
+      }
+    }
+  }
+
+  for (size_t i = 0; i < vertex_count; i++)
+  {
+    const XMVECTOR normal = normals[i];
+    XMVECTOR tangent = RejectFrom(XMLoadFloat3(&tangent_sums[i]), normal);
+    const XMVECTOR bitangent = XMLoadFloat3(&bitangent_sums[i]);
+
+    if (XMVectorGetX(XMVector3LengthSq(tangent)) < kMinTexcoordArea)
+    {
+      tangent = AnyPerpendicular(normal);
+    }
+    else
+    {
+      tangent = XMVector3Normalize(tangent);
+    }
+
+    const float handedness = XMVectorGetX(XMVector3Dot(XMVector3Cross(normal, tangent), bitangent)) < 0.0f ? -1.0f : 1.0f;
+    XMStoreFloat4(&tangents[i], XMVectorSetW(tangent, handedness));
+  }
+}
+
+std::vector<XMFLOAT4> TangentFrames::Generate(const std::vector<Vertex>& vertices, const std::vector<Index>& indices)
+{
+  std::vector<XMFLOAT4> tangents(vertices.size());
+  Generate(vertices.data(), vertices.size(), indices.data(), indices.size(), tangents.data());
+  return tangents;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <vector>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+// Per-vertex tangent frames for normal mapping, generated once at import and
+// stored in a stream next to the vertex buffer (one float4 per vertex).
+// Follows the MikkTSpace scheme: every triangle's texture space tangent and
+// bitangent are projected into the tangent plane of each corner's normal,
+// weighted by the corner angle and summed per vertex. xyz is the unit
+// tangent, w the handedness so that bitangent = cross(normal, tangent) * w.
+// The bitangent points up the image (towards decreasing v), the convention
+// of OpenGL style (green up) normal maps used by OBJ and glTF assets.
+// Unlike the reference implementation vertices aren't split where the
+// handedness changes; welding already keeps mirrored UV seams apart.
+namespace TangentFrames {
+
+// tangents must hold vertex_count entries. Vertices not used by any triangle
+// with valid texcoords get an arbitrary tangent perpendicular to their normal.
+void Generate(const Vertex* vertices, size_t vertex_count, const Index* indices, size_t index_count, XMFLOAT4* tangents);
+
+std::vector<XMFLOAT4> Generate(const std::vector<Vertex>& vertices, const std::vector<Index>& indices);
+} // namespace TangentFrames
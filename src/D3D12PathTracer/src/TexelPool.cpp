@@ -0,0 +1,172 @@
+#include "stdafx.h"
+#include "TexelPool.h"
+
+namespace {
+// keeps the blocks 16 byte aligned for the SSE paths of the decoders
+constexpr size_t kHeaderSize = 16;
+constexpr size_t kSmallestClass = 64;
+// up to 256TB, past that Allocate fails
+constexpr size_t kClassCount = (48 - 6) * 4 + 1;
+
+size_t& HeaderOf(void* raw)
+{
+  return *static_cast<size_t*>(raw);
+}
+
+void* RawOf(const void* block)
+{
+  return const_cast<BYTE*>(static_cast<const BYTE*>(block) - kHeaderSize);
+}
+} // namespace
+
+TexelPool::TexelPool(size_t max_retained_bytes)
+  : max_retained_bytes(max_retained_bytes), free_lists(kClassCount)
+{
+}
+
+TexelPool::~TexelPool()
+{
+  Trim();
+}
+
+TexelPool& TexelPool::Shared()
+{
+  static TexelPool pool;
+  return pool;
+}
+
+size_t TexelPool::ClassOf(size_t size)
+{
+  if (size <= kSmallestClass)
+  {
+    return 0;
+  }
+
+  //class 0 is 64 bytes, then 80, 96, 112, 128, 160, ... four steps per power of two
+  const size_t last = size - 1;
+  size_t bit = 0;
+  while ((last >> bit) > 1)
+  {
+    bit++;
+  }
+  const size_t step = (last >> (bit - 2)) & 3;
+  return (bit - 6) * 4 + step + 1;
+}
+
+size_t TexelPool::ClassSize(size_t size_class)
+{
+  if (size_class == 0)
+  {
+    return kSmallestClass;
+  }
+  const size_t bit = (size_class - 1) / 4 + 6;
+  const size_t step = (size_class - 1) % 4;
+  return (5 + step) << (bit - 2);
+}
+
+size_t TexelPool::Capacity(const void* block)
+{
+  return ClassSize(HeaderOf(RawOf(block)));
+}
+
+void* TexelPool::Allocate(size_t size)
+{
+  const size_t size_class = ClassOf(size);
+  if (size_class >= kClassCount)
+  {
+    return nullptr;
+  }
+
+  void* raw = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.allocations++;
+    std::vector<void*>& free_list = free_lists[size_class];
+    if (!free_list.empty())
+    {
+      raw = free_list.back();
+      free_list.pop_back();
+      stats.reuses++;
+      stats.retained_bytes -= ClassSize(size_class);
+    }
+  }
+
+  if (raw == nullptr)
+  {
+    raw = ::malloc(kHeaderSize + ClassSize(size_class));
+    if (raw == nullptr)
+    {
+      return nullptr;
+    }
+    HeaderOf(raw) = size_class;
+  }
+  return static_cast<BYTE*>(raw) + kHeaderSize;
+}
+
+void* TexelPool::Reallocate(void* block, size_t size)
+{
+  if (block == nullptr)
+  {
+    return Allocate(size);
+  }
+
+  const size_t capacity = Capacity(block);
+  if (size <= capacity)
+  {
+    return block;
+  }
+
+  void* grown = Allocate(size);
+  if (grown != nullptr)
+  {
+    memcpy(grown, block, capacity);
+    Free(block);
+  }
+  return grown;
+}
+
+void TexelPool::Free(void* block)
+{
+  if (block == nullptr)
+  {
+    return;
+  }
+
+  void* raw = RawOf(block);
+  const size_t size_class = HeaderOf(raw);
+  const size_t bytes = ClassSize(size_class);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stats.retained_bytes + bytes <= max_retained_bytes)
+    {
+      free_lists[size_class].push_back(raw);
+      stats.retained_bytes += bytes;
+      stats.peak_retained_bytes = std::max<size_t>(stats.peak_retained_bytes, stats.retained_bytes);
+      return;
+    }
+  }
+  ::free(raw);
+}
+
+void TexelPool::Trim()
+{
+  std::vector<std::vector<void*>> released(kClassCount);
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    released.swap(free_lists);
+    stats.retained_bytes = 0;
+  }
+  for (auto& free_list : released)
+  {
+    for (void* raw : free_list)
+    {
+      ::free(raw);
+    }
+  }
+}
+
+TexelPool::Stats TexelPool::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
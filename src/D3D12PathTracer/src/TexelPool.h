@@ -0,0 +1,52 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+// Recycles the buffers images are decoded into. Sizes are rounded up to one of
+// four classes per power of two (at most 25% slack) and released blocks wait on
+// a free list for the next request of their class, so a batch of similar
+// textures stops going to the heap after the first few. Each block records its
+// class in a small header in front of it, which is what lets stb_image's
+// malloc/realloc/free go through the pool. Thread safe.
+class TexelPool {
+public:
+  struct Stats {
+    size_t allocations = 0;
+    size_t reuses = 0; // allocations served from a free list
+    size_t retained_bytes = 0; // sitting on free lists right now
+    size_t peak_retained_bytes = 0;
+  };
+
+  // blocks released while retained_bytes is over the limit go back to the heap
+  explicit TexelPool(size_t max_retained_bytes = 256 << 20);
+  ~TexelPool();
+
+  TexelPool(const TexelPool&) = delete;
+  TexelPool& operator=(const TexelPool&) = delete;
+
+  // nullptr if the heap is exhausted, like malloc
+  void* Allocate(size_t size);
+  // grows in place while the size still fits the block's class
+  void* Reallocate(void* block, size_t size);
+  // nullptr is ignored
+  void Free(void* block);
+  // usable bytes of a block from Allocate
+  static size_t Capacity(const void* block);
+
+  // hands every block on the free lists back to the heap
+  void Trim();
+  Stats GetStats() const;
+
+  // Process wide pool, also backs stb_image
+  static TexelPool& Shared();
+
+  static size_t ClassOf(size_t size);
+  static size_t ClassSize(size_t size_class);
+
+private:
+  size_t max_retained_bytes;
+  std::vector<std::vector<void*>> free_lists; // raw allocations (header included) per class
+  Stats stats;
+  mutable std::mutex mutex;
+};
@@ -0,0 +1,157 @@
+#include "stdafx.h"
+#include "TextureCache.h"
+#include "MappedFile.h"
+
+UINT32 TextureCache::Recipe(MipChain::Filter filter, bool compressed)
+{
+  return static_cast<UINT32>(filter) | (compressed ? 0x100u : 0u);
+}
+
+TextureCache::Handle TextureCache::Acquire(const std::string& path, UINT32 recipe, bool* miss)
+{
+  const std::string resolved = ResolvePath(path);
+
+  auto named = by_path.find({ resolved, recipe });
+  if (named != by_path.end())
+  {
+    entries[named->second].refs++;
+    stats.path_hits++;
+    if (miss != nullptr)
+    {
+      *miss = false;
+    }
+    return named->second;
+  }
+
+  //the file may be known under another recipe, then it needn't be hashed again
+  UINT64 hash = 0;
+  size_t file_size = 0;
+  auto other_recipe = by_path.lower_bound({ resolved, 0 });
+  if (other_recipe != by_path.end() && other_recipe->first.first == resolved)
+  {
+    const Entry& other = entries[other_recipe->second];
+    hash = other.content_hash;
+    file_size = other.file_size;
+  }
+  else
+  {
+    MappedFile file(resolved);
+    if (!file.IsOpen())
+    {
+      throw std::runtime_error("can't open texture " + path);
+    }
+    hash = HashBytes(file.Data(), file.Size());
+    file_size = file.Size();
+    stats.bytes_hashed += file.Size();
+  }
+
+  //same bytes under another name, the size guards against hash collisions
+  auto candidates = by_content.equal_range(hash);
+  for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+  {
+    Entry& entry = entries[candidate->second];
+    if (entry.recipe == recipe && entry.file_size == file_size)
+    {
+      entry.refs++;
+      by_path[{ resolved, recipe }] = candidate->second;
+      stats.content_hits++;
+      if (miss != nullptr)
+      {
+        *miss = false;
+      }
+      return candidate->second;
+    }
+  }
+
+  const Handle handle = next_handle++;
+  Entry& entry = entries[handle];
+  entry.path = resolved;
+  entry.recipe = recipe;
+  entry.content_hash = hash;
+  entry.file_size = file_size;
+  entry.refs = 1;
+  by_path[{ resolved, recipe }] = handle;
+  by_content.emplace(hash, handle);
+  stats.misses++;
+  if (miss != nullptr)
+  {
+    *miss = true;
+  }
+  return handle;
+}
+
+void TextureCache::SetImage(Handle handle, std::shared_ptr<const AssetLoader::ImageData> image)
+{
+  entries.at(handle).image = std::move(image);
+}
+
+void TextureCache::Release(Handle handle)
+{
+  if (handle == kNone)
+  {
+    return;
+  }
+
+  auto found = entries.find(handle);
+  if (found == entries.end())
+  {
+    throw std::runtime_error("texture cache entry released too often");
+  }
+  stats.releases++;
+  if (--found->second.refs > 0)
+  {
+    return;
+  }
+
+  //forget every name the entry was found under
+  for (auto name = by_path.begin(); name != by_path.end();)
+  {
+    name = name->second == handle ? by_path.erase(name) : std::next(name);
+  }
+  auto candidates = by_content.equal_range(found->second.content_hash);
+  for (auto candidate = candidates.first; candidate != candidates.second; ++candidate)
+  {
+    if (candidate->second == handle)
+    {
+      by_content.erase(candidate);
+      break;
+    }
+  }
+  entries.erase(found);
+}
+
+std::string TextureCache::ResolvePath(const std::string& path)
+{
+  std::error_code error;
+  std::filesystem::path resolved = std::filesystem::weakly_canonical(std::filesystem::path(path), error);
+  if (error)
+  {
+    resolved = std::filesystem::absolute(std::filesystem::path(path), error).lexically_normal();
+  }
+  return resolved.generic_string();
+}
+
+UINT64 TextureCache::HashBytes(const void* data, size_t size)
+{
+  const BYTE* bytes = static_cast<const BYTE*>(data);
+  UINT64 hash = 14695981039346656037ull;
+
+  size_t i = 0;
+  for (; i + sizeof(UINT64) <= size; i += sizeof(UINT64))
+  {
+    UINT64 word;
+    memcpy(&word, bytes + i, sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211ull;
+  }
+  for (; i < size; i++)
+  {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
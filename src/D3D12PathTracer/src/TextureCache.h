@@ -0,0 +1,70 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "AssetLoader.h"
+#include "MipChain.h"
+
+// Decoded images and their GPU textures shared by every texture slot that
+// references the same file with the same recipe, the way TextureDiskCache
+// keys its entries: a diffuse and a normal slot of one file get their own.
+// A path is first looked up by its resolved (canonical) name; an unknown name
+// is hashed and matched by content, so copies of a file under other names are
+// found as well. Entries are reference counted, the last Release drops the
+// texels and the resource.
+class TextureCache {
+public:
+  using Handle = int;
+  static constexpr Handle kNone = -1;
+
+  struct Entry {
+    std::string path; // resolved path of the first reference
+    UINT32 recipe = 0;
+    UINT64 content_hash = 0;
+    size_t file_size = 0;
+    // empty until the caller decoded the image after a miss
+    std::shared_ptr<const AssetLoader::ImageData> image;
+    // created by whoever uploads the image, shared by every texture using the entry
+    ComPtr<ID3D12Resource> resource;
+    int refs = 0;
+  };
+
+  struct Stats {
+    size_t path_hits = 0;
+    size_t content_hits = 0;
+    size_t misses = 0;
+    size_t releases = 0;
+    size_t bytes_hashed = 0;
+  };
+
+  // how texels are made from a file: the mip filter and whether they are block compressed
+  static UINT32 Recipe(MipChain::Filter filter, bool compressed);
+
+  // Takes one reference to the entry for path and recipe. On a miss the entry is
+  // new and has no image yet, the caller decodes the file and hands it to SetImage.
+  // Throws if the file can't be read.
+  Handle Acquire(const std::string& path, UINT32 recipe, bool* miss = nullptr);
+  void SetImage(Handle handle, std::shared_ptr<const AssetLoader::ImageData> image);
+  // kNone is ignored
+  void Release(Handle handle);
+
+  Entry& Get(Handle handle) { return entries.at(handle); }
+  const Entry& Get(Handle handle) const { return entries.at(handle); }
+  size_t Size() const { return entries.size(); }
+  const Stats& GetStats() const { return stats; }
+
+  static std::string ResolvePath(const std::string& path);
+  // 64 bit FNV-1a over the bytes, word at a time
+  static UINT64 HashBytes(const void* data, size_t size);
+
+private:
+  std::map<Handle, Entry> entries; // nodes are stable, uploads can target Entry::resource
+  // resolved path and recipe, ordered so the other recipes of a path are next to it
+  std::map<std::pair<std::string, UINT32>, Handle> by_path;
+  std::unordered_multimap<UINT64, Handle> by_content;
+  Handle next_handle = 0;
+  Stats stats;
+};
@@ -0,0 +1,276 @@
+#include "stdafx.h"
+#include "TextureDiskCache.h"
+#include "BlockCompression.h"
+#include "ImageDecoder.h"
+#include "MappedFile.h"
+#include "MipChain.h"
+#include "TextureCache.h"
+#include "TextureLoader.h"
+#include "ThreadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <thread>
+
+namespace {
+constexpr char kMagic[8] = { 'R', 'T', 'X', 'T', 'E', 'X', 'C', '\0' };
+// bump when the header or the way texels are made changes, old entries then read as stale
+constexpr UINT32 kVersion = 2;
+constexpr UINT64 kTexelAlignment = 16;
+
+struct EntryHeader
+{
+  char magic[8];
+  UINT32 version;
+  UINT32 recipe;
+  UINT64 modified;
+  UINT64 file_size;
+  UINT64 content_hash;
+  UINT32 width;
+  UINT32 height;
+  UINT32 format; // DXGI_FORMAT
+  UINT32 mip_levels;
+  INT32 bytes_per_row;
+  UINT32 path_length; // the source path follows the header
+  UINT64 texel_size; // the texels follow the path, aligned to kTexelAlignment
+};
+
+UINT64 TexelOffset(UINT32 path_length)
+{
+  return (sizeof(EntryHeader) + path_length + kTexelAlignment - 1) & ~(kTexelAlignment - 1);
+}
+
+// what the header says has to add up before any texel is copied
+bool IsConsistent(const EntryHeader& header, size_t file_size)
+{
+  const DXGI_FORMAT format = static_cast<DXGI_FORMAT>(header.format);
+  if ((TextureLoader::GetBitsPerPixel(format) == 0 && BlockCompression::BlockBytes(format) == 0) ||
+      header.width == 0 || header.height == 0 || header.mip_levels == 0 ||
+      header.mip_levels > MipChain::LevelCount(header.width, header.height) ||
+      header.texel_size > static_cast<UINT64>(INT_MAX) ||
+      TexelOffset(header.path_length) + header.texel_size > file_size)
+  {
+    return false;
+  }
+
+  D3D12_RESOURCE_DESC desc = TextureLoader::DescribeTexture2D(header.width, header.height, format);
+  desc.MipLevels = static_cast<UINT16>(header.mip_levels);
+  const std::vector<MipChain::Level> levels = MipChain::Layout(desc);
+  return levels.back().offset + levels.back().size == header.texel_size && levels[0].bytes_per_row == header.bytes_per_row;
+}
+} // namespace
+
+TextureDiskCache::TextureDiskCache(std::string directory)
+  : directory(std::move(directory))
+{
+}
+
+TextureDiskCache& TextureDiskCache::Shared()
+{
+  static TextureDiskCache cache("cache/textures");
+  return cache;
+}
+
+TextureDiskCache::Key TextureDiskCache::MakeKey(const std::string& path, UINT32 recipe, UINT64 content_hash)
+{
+  Key key;
+  key.path = TextureCache::ResolvePath(path);
+  key.recipe = recipe;
+
+  std::error_code time_error;
+  std::error_code size_error;
+  key.modified = static_cast<UINT64>(std::filesystem::last_write_time(key.path, time_error).time_since_epoch().count());
+  key.file_size = std::filesystem::file_size(key.path, size_error);
+  if (time_error || size_error)
+  {
+    throw std::runtime_error("can't read texture " + path);
+  }
+
+  key.content_hash = content_hash;
+  if (key.content_hash == 0)
+  {
+    MappedFile file(key.path);
+    if (!file.IsOpen())
+    {
+      throw std::runtime_error("can't read texture " + path);
+    }
+    key.content_hash = TextureCache::HashBytes(file.Data(), file.Size());
+  }
+  return key;
+}
+
+std::string TextureDiskCache::EntryPath(const Key& key) const
+{
+  //one entry per source and recipe, the rest of the key lives in the header
+  std::string name = key.path;
+  name.append(reinterpret_cast<const char*>(&key.recipe), sizeof(key.recipe));
+  char file_name[32];
+  snprintf(file_name, sizeof(file_name), "%016llx.texels", static_cast<unsigned long long>(TextureCache::HashBytes(name.data(), name.size())));
+  return directory + "/" + file_name;
+}
+
+bool TextureDiskCache::Load(const Key& key, AssetLoader::ImageData* image)
+{
+  MappedFile file(EntryPath(key));
+  if (!file.IsOpen())
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.misses++;
+    return false;
+  }
+
+  EntryHeader header;
+  bool valid = file.Size() >= sizeof(header);
+  if (valid)
+  {
+    memcpy(&header, file.Data(), sizeof(header));
+    valid = memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion &&
+            header.recipe == key.recipe && header.modified == key.modified &&
+            header.file_size == key.file_size && header.content_hash == key.content_hash &&
+            header.path_length == key.path.size() && IsConsistent(header, file.Size()) &&
+            memcmp(file.Data() + sizeof(header), key.path.data(), key.path.size()) == 0;
+  }
+  if (!valid)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stats.stale++;
+    return false;
+  }
+
+  AssetLoader::ImageData loaded;
+  loaded.texels = std::unique_ptr<BYTE, AssetLoader::TexelDeleter>(static_cast<BYTE*>(TexelPool::Shared().Allocate(header.texel_size)),
+                                                                   AssetLoader::TexelDeleter{ &TexelPool::Shared() });
+  if (!loaded.texels)
+  {
+    throw std::bad_alloc();
+  }
+  memcpy(loaded.texels.get(), file.Data() + TexelOffset(header.path_length), header.texel_size);
+  loaded.size = static_cast<int>(header.texel_size);
+  loaded.bytes_per_row = header.bytes_per_row;
+  loaded.desc = TextureLoader::DescribeTexture2D(header.width, header.height, static_cast<DXGI_FORMAT>(header.format));
+  loaded.desc.MipLevels = static_cast<UINT16>(header.mip_levels);
+  *image = std::move(loaded);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  stats.hits++;
+  stats.bytes_read += file.Size();
+  return true;
+}
+
+bool TextureDiskCache::Store(const Key& key, const AssetLoader::ImageData& image)
+{
+  EntryHeader header = {};
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.recipe = key.recipe;
+  header.modified = key.modified;
+  header.file_size = key.file_size;
+  header.content_hash = key.content_hash;
+  header.width = static_cast<UINT32>(image.desc.Width);
+  header.height = image.desc.Height;
+  header.format = image.desc.Format;
+  header.mip_levels = std::max<UINT16>(image.desc.MipLevels, 1);
+  header.bytes_per_row = image.bytes_per_row;
+  header.path_length = static_cast<UINT32>(key.path.size());
+  header.texel_size = static_cast<UINT64>(image.size);
+
+  const std::string entry_path = EntryPath(key);
+  //unique per thread, two writers of one entry each finish their own file and the last rename wins
+  const std::string temporary_path = entry_path + ".tmp" + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+
+  bool written = false;
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (file)
+    {
+      const char padding[kTexelAlignment] = {};
+      file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+      file.write(key.path.data(), key.path.size());
+      file.write(padding, TexelOffset(header.path_length) - sizeof(header) - key.path.size());
+      file.write(reinterpret_cast<const char*>(image.texels.get()), image.size);
+      written = file.good();
+    }
+  }
+  if (written)
+  {
+    std::filesystem::rename(temporary_path, entry_path, error);
+    written = !error;
+  }
+  if (!written)
+  {
+    std::filesystem::remove(temporary_path, error);
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (written)
+  {
+    stats.writes++;
+    stats.bytes_written += TexelOffset(header.path_length) + header.texel_size;
+  }
+  else
+  {
+    stats.failed_writes++;
+  }
+  return written;
+}
+
+TextureDiskCache::Stats TextureDiskCache::GetStats() const
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  return stats;
+}
+
+TextureDiskCache::BenchmarkResult TextureDiskCache::Benchmark(const std::vector<std::string>& paths, const std::string& directory)
+{
+  std::error_code error;
+  std::filesystem::remove_all(directory, error);
+  TextureDiskCache cache(directory);
+  ThreadPool& pool = ThreadPool::Shared();
+
+  BenchmarkResult result;
+  result.images = paths.size();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::future<void>> stores;
+  for (const std::string& path : paths)
+  {
+    stores.emplace_back(pool.Submit([&cache, &pool, path]()
+    {
+      const Key key = MakeKey(path, 0);
+      cache.Store(key, MipChain::Generate(ImageDecoder::Decode(path), MipChain::Filter::Srgb, pool));
+    }));
+  }
+  for (auto& store : stores)
+  {
+    store.get();
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  result.cold_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  start = std::chrono::high_resolution_clock::now();
+  std::vector<std::future<bool>> loads;
+  for (const std::string& path : paths)
+  {
+    loads.emplace_back(pool.Submit([&cache, path]()
+    {
+      AssetLoader::ImageData image;
+      return cache.Load(MakeKey(path, 0), &image);
+    }));
+  }
+  for (auto& load : loads)
+  {
+    if (!load.get())
+    {
+      throw std::runtime_error("texture disk cache missed an entry it just stored");
+    }
+  }
+  end = std::chrono::high_resolution_clock::now();
+  result.warm_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+  result.entry_bytes = cache.GetStats().bytes_read;
+
+  std::filesystem::remove_all(directory, error);
+  return result;
+}
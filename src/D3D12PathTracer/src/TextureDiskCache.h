@@ -0,0 +1,67 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "AssetLoader.h"
+
+// Finished texels (mip chain, block compressed or not) kept on disk between
+// runs, so warm starts skip decoding. One file per source path and recipe: a
+// header naming the source's path, last write time, size and content hash,
+// then the texels exactly as ImageData holds them. An entry whose header
+// doesn't match the source any more is stale and gets overwritten by the next
+// Store. Load and Store can run on any thread.
+class TextureDiskCache {
+public:
+  struct Key {
+    std::string path; // resolved, see TextureCache::ResolvePath
+    UINT64 modified = 0; // last write time of the source
+    UINT64 file_size = 0;
+    UINT64 content_hash = 0; // TextureCache::HashBytes of the source
+    UINT32 recipe = 0; // how the texels were made from the source, opaque to the cache
+  };
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0; // no entry yet
+    size_t stale = 0; // entry for an older source or recipe, or unreadable
+    size_t writes = 0;
+    size_t failed_writes = 0;
+    UINT64 bytes_read = 0;
+    UINT64 bytes_written = 0;
+  };
+
+  explicit TextureDiskCache(std::string directory);
+
+  // cache/textures below the working directory
+  static TextureDiskCache& Shared();
+
+  // Key of the file at path as it is now, content_hash is computed when 0.
+  // Throws if the file can't be read.
+  static Key MakeKey(const std::string& path, UINT32 recipe, UINT64 content_hash = 0);
+
+  // texels stored for key, false when there are none or they are stale
+  bool Load(const Key& key, AssetLoader::ImageData* image);
+  // writes through a temporary file, so readers never see half an entry
+  bool Store(const Key& key, const AssetLoader::ImageData& image);
+
+  std::string EntryPath(const Key& key) const;
+  const std::string& Directory() const { return directory; }
+  Stats GetStats() const;
+
+  struct BenchmarkResult {
+    size_t images = 0;
+    double cold_milliseconds = 0.0; // decode, mips and Store into an empty cache
+    double warm_milliseconds = 0.0; // Load of the same entries
+    UINT64 entry_bytes = 0;
+  };
+  // Cold and warm start over paths on the pool, in a scratch cache at directory
+  // that is emptied first and removed afterwards
+  static BenchmarkResult Benchmark(const std::vector<std::string>& paths, const std::string& directory);
+
+private:
+  std::string directory;
+  mutable std::mutex mutex;
+  Stats stats;
+};
@@ -90,16 +90,42 @@ int GetDXGIFormatBitsPerPixel(DXGI_FORMAT& dxgiFormat)
 	else if (dxgiFormat == DXGI_FORMAT_R32_FLOAT) return 32;
 	else if (dxgiFormat == DXGI_FORMAT_R16_FLOAT) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R16_UNORM) return 16;
+	else if (dxgiFormat == DXGI_FORMAT_R8G8_SNORM) return 16;
 	else if (dxgiFormat == DXGI_FORMAT_R8_UNORM) return 8;
 	else if (dxgiFormat == DXGI_FORMAT_A8_UNORM) return 8;
+
+	return 0;
+}
+
+int TextureLoader::GetBitsPerPixel(DXGI_FORMAT format)
+{
+	return GetDXGIFormatBitsPerPixel(format);
+}
+
+D3D12_RESOURCE_DESC TextureLoader::DescribeTexture2D(UINT width, UINT height, DXGI_FORMAT format)
+{
+	D3D12_RESOURCE_DESC resourceDescription = {};
+	resourceDescription.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+	resourceDescription.Alignment = 0; // may be 0, 4KB, 64KB, or 4MB. 0 will let runtime decide between 64KB and 4MB (4MB for multi-sampled textures)
+	resourceDescription.Width = width; // width of the texture
+	resourceDescription.Height = height; // height of the texture
+	resourceDescription.DepthOrArraySize = 1; // if 3d image, depth of 3d image. Otherwise an array of 1D or 2D textures (we only have one image, so we set 1)
+	resourceDescription.MipLevels = 1; // Number of mipmaps. We are not generating mipmaps for this texture, so we have only one level
+	resourceDescription.Format = format; // This is the dxgi format of the image (format of the pixels)
+	resourceDescription.SampleDesc.Count = 1; // This is the number of samples per pixel, we just want 1 sample
+	resourceDescription.SampleDesc.Quality = 0; // The quality level of the samples. Higher is better quality, but worse performance
+	resourceDescription.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN; // The arrangement of the pixels. Setting to unknown lets the driver choose the most efficient one
+	resourceDescription.Flags = D3D12_RESOURCE_FLAG_NONE; // no flags
+	return resourceDescription;
 }
 
 int TextureLoader::LoadImageDataFromFile(BYTE** imageData, D3D12_RESOURCE_DESC& resourceDescription, LPCWSTR filename, int &bytesPerRow)
 {
 	HRESULT hr;
 
-	// we only need one instance of the imaging factory to create decoders and frames
-	static IWICImagingFactory *wicFactory;
+	// we only need one instance of the imaging factory per thread to create decoders and frames,
+	// images are decoded on the asset loader's worker threads as well as the main thread
+	thread_local IWICImagingFactory *wicFactory;
 
 	// reset decoder, frame and converter since these will be different for each image we load
 	IWICBitmapDecoder *wicDecoder = NULL;
@@ -110,7 +136,7 @@ int TextureLoader::LoadImageDataFromFile(BYTE** imageData, D3D12_RESOURCE_DESC&
 
 	if (wicFactory == NULL)
 	{
-		// Initialize the COM library
+		// Initialize the COM library for this thread
 		CoInitialize(NULL);
 
 		// create the WIC factory
@@ -202,18 +228,7 @@ int TextureLoader::LoadImageDataFromFile(BYTE** imageData, D3D12_RESOURCE_DESC&
 
 
 	// now describe the texture with the information we have obtained from the image
-	resourceDescription = {};
-	resourceDescription.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	resourceDescription.Alignment = 0; // may be 0, 4KB, 64KB, or 4MB. 0 will let runtime decide between 64KB and 4MB (4MB for multi-sampled textures)
-	resourceDescription.Width = textureWidth; // width of the texture
-	resourceDescription.Height = textureHeight; // height of the texture
-	resourceDescription.DepthOrArraySize = 1; // if 3d image, depth of 3d image. Otherwise an array of 1D or 2D textures (we only have one image, so we set 1)
-	resourceDescription.MipLevels = 1; // Number of mipmaps. We are not generating mipmaps for this texture, so we have only one level
-	resourceDescription.Format = dxgiFormat; // This is the dxgi format of the image (format of the pixels)
-	resourceDescription.SampleDesc.Count = 1; // This is the number of samples per pixel, we just want 1 sample
-	resourceDescription.SampleDesc.Quality = 0; // The quality level of the samples. Higher is better quality, but worse performance
-	resourceDescription.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN; // The arrangement of the pixels. Setting to unknown lets the driver choose the most efficient one
-	resourceDescription.Flags = D3D12_RESOURCE_FLAG_NONE; // no flags
+	resourceDescription = DescribeTexture2D(textureWidth, textureHeight, dxgiFormat);
 
         wicDecoder->Release();
 	// return the size of the image. remember to delete the image once your done with it (in this tutorial once its uploaded to the gpu)
@@ -6,5 +6,11 @@ class TextureLoader {
 public:
 	// load and decode image from file
 	static int LoadImageDataFromFile(BYTE** imageData, D3D12_RESOURCE_DESC& resourceDescription, LPCWSTR filename, int &bytesPerRow);
+
+	// number of bits per pixel for the formats LoadImageDataFromFile produces
+	static int GetBitsPerPixel(DXGI_FORMAT format);
+
+	// single mip, single sample 2D texture, as every loader describes its images
+	static D3D12_RESOURCE_DESC DescribeTexture2D(UINT width, UINT height, DXGI_FORMAT format);
 };
 
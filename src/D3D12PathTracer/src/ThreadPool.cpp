@@ -0,0 +1,125 @@
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t thread_count)
+{
+  thread_count = std::max<size_t>(thread_count, 1);
+  workers.reserve(thread_count);
+  for (size_t i = 0; i < thread_count; i++)
+  {
+    workers.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wake.notify_all();
+
+  for (auto& worker : workers)
+  {
+    worker.join();
+  }
+}
+
+size_t ThreadPool::DefaultThreadCount()
+{
+  //hardware_concurrency may report 0 when it can't tell
+  return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+{
+  if (count == 0)
+  {
+    return;
+  }
+
+  //shared with the helper tasks, which may only get to run after this call has returned
+  struct State
+  {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::exception_ptr error;
+  };
+  auto state = std::make_shared<State>();
+
+  auto work = [state, count](const std::function<void(size_t)>& body)
+  {
+    for (size_t i = state->next++; i < count; i = state->next++)
+    {
+      try
+      {
+        body(i);
+      }
+      catch (...)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error)
+        {
+          state->error = std::current_exception();
+        }
+      }
+
+      if (++state->done == count)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->finished.notify_all();
+      }
+    }
+  };
+
+  //the body is copied for the helpers, the caller's reference may be gone by the time they run
+  auto shared_body = std::make_shared<std::function<void(size_t)>>(body);
+  const size_t helpers = std::min<size_t>(workers.size(), count - 1);
+  for (size_t i = 0; i < helpers; i++)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([work, shared_body]() { work(*shared_body); });
+    }
+    wake.notify_one();
+  }
+
+  work(body);
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->finished.wait(lock, [&state, count]() { return state->done == count; });
+  if (state->error)
+  {
+    std::rethrow_exception(state->error);
+  }
+}
+
+void ThreadPool::WorkerLoop()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [this]() { return stopping || !tasks.empty(); });
+
+      //drain the queue before stopping so no future is left without a value
+      if (tasks.empty())
+      {
+        return;
+      }
+
+      task = std::move(tasks.front());
+      tasks.pop();
+    }
+    task();
+  }
+}
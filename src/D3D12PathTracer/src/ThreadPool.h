@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Fixed size pool of worker threads for CPU side work (asset decoding etc.).
+// Tasks must not block on other tasks of the same pool.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t thread_count = DefaultThreadCount());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // Queues a task, exceptions thrown by it are rethrown from the future
+  template<typename F>
+  auto Submit(F&& task) -> std::future<decltype(task())>
+  {
+    using Result = decltype(task());
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([packaged]() { (*packaged)(); });
+    }
+    wake.notify_one();
+    return future;
+  }
+
+  // Runs body(0..count-1) across the pool. The calling thread works on the
+  // range as well, so this is safe to call from inside a pool task.
+  void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+  size_t Size() const { return workers.size(); }
+
+  static size_t DefaultThreadCount();
+
+  // Process wide pool for loading work, created on first use
+  static ThreadPool& Shared();
+
+private:
+  void WorkerLoop();
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+};
@@ -0,0 +1,371 @@
+#include "stdafx.h"
+#include "TlsfAllocator.h"
+
+#include <algorithm>
+
+namespace {
+UINT32 FloorLog2(UINT64 value)
+{
+  UINT32 log = 0;
+  while (value >>= 1)
+  {
+    log++;
+  }
+  return log;
+}
+
+UINT32 LowestBit(UINT64 value)
+{
+  UINT32 bit = 0;
+  while ((value & 1) == 0)
+  {
+    value >>= 1;
+    bit++;
+  }
+  return bit;
+}
+
+UINT64 AlignUp(UINT64 value, UINT64 alignment)
+{
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+} // namespace
+
+TlsfAllocator::TlsfAllocator(UINT64 size)
+  : size(size / kGranularity * kGranularity)
+{
+  if (this->size == 0)
+  {
+    throw std::invalid_argument("TLSF range smaller than its granularity");
+  }
+  for (auto& heads : free_heads)
+  {
+    std::fill(std::begin(heads), std::end(heads), kNoBlock);
+  }
+  first_block = NewBlock(0, this->size);
+  InsertFree(first_block);
+}
+
+void TlsfAllocator::MappingInsert(UINT64 size, UINT32* first, UINT32* second)
+{
+  const UINT64 units = size / kGranularity;
+  if (units < kSecondLevelCount)
+  {
+    //the first class counts single units
+    *first = 0;
+    *second = static_cast<UINT32>(units);
+  }
+  else
+  {
+    const UINT32 log = FloorLog2(units);
+    *first = log - kSecondLevelBits + 1;
+    *second = static_cast<UINT32>(units >> (log - kSecondLevelBits)) - kSecondLevelCount;
+  }
+}
+
+void TlsfAllocator::MappingSearch(UINT64 size, UINT32* first, UINT32* second)
+{
+  UINT64 units = size / kGranularity;
+  if (units >= kSecondLevelCount)
+  {
+    //round up to the next class boundary, any block there is big enough
+    units += (1ull << (FloorLog2(units) - kSecondLevelBits)) - 1;
+  }
+  MappingInsert(units * kGranularity, first, second);
+}
+
+UINT32 TlsfAllocator::NewBlock(UINT64 offset, UINT64 size)
+{
+  Block block = { offset, size, 0, kNoBlock, kNoBlock, kNoBlock, kNoBlock, false };
+  if (!unused_blocks.empty())
+  {
+    const UINT32 index = unused_blocks.back();
+    unused_blocks.pop_back();
+    blocks[index] = block;
+    return index;
+  }
+  blocks.push_back(block);
+  return static_cast<UINT32>(blocks.size() - 1);
+}
+
+void TlsfAllocator::InsertFree(UINT32 index)
+{
+  UINT32 first, second;
+  MappingInsert(blocks[index].size, &first, &second);
+  Block& block = blocks[index];
+  block.free = true;
+  block.prev_free = kNoBlock;
+  block.next_free = free_heads[first][second];
+  if (block.next_free != kNoBlock)
+  {
+    blocks[block.next_free].prev_free = index;
+  }
+  free_heads[first][second] = index;
+  first_level_bitmap |= 1ull << first;
+  second_level_bitmap[first] |= 1u << second;
+}
+
+void TlsfAllocator::RemoveFree(UINT32 index)
+{
+  UINT32 first, second;
+  MappingInsert(blocks[index].size, &first, &second);
+  Block& block = blocks[index];
+  if (block.prev_free != kNoBlock)
+  {
+    blocks[block.prev_free].next_free = block.next_free;
+  }
+  else
+  {
+    free_heads[first][second] = block.next_free;
+  }
+  if (block.next_free != kNoBlock)
+  {
+    blocks[block.next_free].prev_free = block.prev_free;
+  }
+  if (free_heads[first][second] == kNoBlock)
+  {
+    second_level_bitmap[first] &= ~(1u << second);
+    if (second_level_bitmap[first] == 0)
+    {
+      first_level_bitmap &= ~(1ull << first);
+    }
+  }
+  block.free = false;
+}
+
+UINT32 TlsfAllocator::FindFree(UINT32 first, UINT32 second) const
+{
+  if (first >= kFirstLevelCount)
+  {
+    return kNoBlock;
+  }
+  UINT32 second_map = second_level_bitmap[first] & (~0u << second);
+  if (second_map == 0)
+  {
+    const UINT64 first_map = first + 1 < kFirstLevelCount ? first_level_bitmap & (~0ull << (first + 1)) : 0;
+    if (first_map == 0)
+    {
+      return kNoBlock;
+    }
+    first = LowestBit(first_map);
+    second_map = second_level_bitmap[first];
+  }
+  return free_heads[first][LowestBit(second_map)];
+}
+
+UINT32 TlsfAllocator::FindFitting(UINT64 size, UINT64 alignment, UINT32 last_first, UINT32 last_second) const
+{
+  UINT32 first, second;
+  MappingInsert(size, &first, &second);
+  UINT32 budget = kFittingBudget;
+  while (first < kFirstLevelCount && (first < last_first || (first == last_first && second < last_second)))
+  {
+    for (UINT32 index = free_heads[first][second]; index != kNoBlock && budget > 0; index = blocks[index].next_free, budget--)
+    {
+      if (AlignUp(blocks[index].offset, alignment) + size <= blocks[index].offset + blocks[index].size)
+      {
+        return index;
+      }
+    }
+    if (++second == kSecondLevelCount)
+    {
+      second = 0;
+      first++;
+    }
+  }
+  return kNoBlock;
+}
+
+void TlsfAllocator::Split(UINT32 index, UINT64 size)
+{
+  const UINT32 rest = NewBlock(blocks[index].offset + size, blocks[index].size - size);
+  blocks[index].size = size;
+  blocks[rest].prev_physical = index;
+  blocks[rest].next_physical = blocks[index].next_physical;
+  if (blocks[rest].next_physical != kNoBlock)
+  {
+    blocks[blocks[rest].next_physical].prev_physical = rest;
+  }
+  blocks[index].next_physical = rest;
+  InsertFree(rest);
+}
+
+void TlsfAllocator::Absorb(UINT32 index)
+{
+  const UINT32 next = blocks[index].next_physical;
+  blocks[index].size += blocks[next].size;
+  blocks[index].next_physical = blocks[next].next_physical;
+  if (blocks[index].next_physical != kNoBlock)
+  {
+    blocks[blocks[index].next_physical].prev_physical = index;
+  }
+  //not allocated any more, a stale Free of it throws
+  blocks[next].free = true;
+  unused_blocks.push_back(next);
+}
+
+TlsfAllocator::Allocation TlsfAllocator::Allocate(UINT64 size, UINT64 alignment, UINT64 user)
+{
+  alignment = std::max<UINT64>(alignment, kGranularity);
+  size = AlignUp(std::max<UINT64>(size, 1), kGranularity);
+  if (size > this->size)
+  {
+    return Allocation();
+  }
+
+  //a free block this big holds size wherever its start falls
+  UINT32 first, second;
+  MappingSearch(size + alignment - kGranularity, &first, &second);
+  UINT32 index = FindFree(first, second);
+  if (index == kNoBlock)
+  {
+    index = FindFitting(size, alignment, first, second);
+    if (index == kNoBlock)
+    {
+      return Allocation();
+    }
+  }
+  RemoveFree(index);
+
+  const UINT64 padding = AlignUp(blocks[index].offset, alignment) - blocks[index].offset;
+  if (padding > 0)
+  {
+    //the padding stays free in front, its physical predecessor is in use as free blocks are always merged
+    Split(index, padding);
+    const UINT32 aligned = blocks[index].next_physical;
+    RemoveFree(aligned);
+    InsertFree(index);
+    index = aligned;
+  }
+  if (blocks[index].size > size)
+  {
+    Split(index, size);
+  }
+
+  blocks[index].user = user;
+  used_bytes += size;
+  allocation_count++;
+
+  Allocation allocation;
+  allocation.offset = blocks[index].offset;
+  allocation.size = size;
+  allocation.block = index;
+  allocation.user = user;
+  return allocation;
+}
+
+void TlsfAllocator::Free(const Allocation& allocation)
+{
+  UINT32 index = allocation.block;
+  if (index >= blocks.size() || blocks[index].free || blocks[index].offset != allocation.offset)
+  {
+    throw std::logic_error("freeing a TLSF block that isn't allocated");
+  }
+  used_bytes -= blocks[index].size;
+  allocation_count--;
+
+  const UINT32 next = blocks[index].next_physical;
+  if (next != kNoBlock && blocks[next].free)
+  {
+    RemoveFree(next);
+    Absorb(index);
+  }
+  const UINT32 prev = blocks[index].prev_physical;
+  if (prev != kNoBlock && blocks[prev].free)
+  {
+    RemoveFree(prev);
+    Absorb(prev);
+    index = prev;
+  }
+  InsertFree(index);
+}
+
+UINT64 TlsfAllocator::LargestFreeBlock() const
+{
+  if (first_level_bitmap == 0)
+  {
+    return 0;
+  }
+  const UINT32 first = FloorLog2(first_level_bitmap);
+  const UINT32 second = FloorLog2(second_level_bitmap[first]);
+  UINT64 largest = 0;
+  for (UINT32 index = free_heads[first][second]; index != kNoBlock; index = blocks[index].next_free)
+  {
+    largest = std::max<UINT64>(largest, blocks[index].size);
+  }
+  return largest;
+}
+
+std::vector<TlsfAllocator::Allocation> TlsfAllocator::Allocations() const
+{
+  std::vector<Allocation> allocations;
+  allocations.reserve(allocation_count);
+  for (UINT32 index = first_block; index != kNoBlock; index = blocks[index].next_physical)
+  {
+    if (!blocks[index].free)
+    {
+      Allocation allocation;
+      allocation.offset = blocks[index].offset;
+      allocation.size = blocks[index].size;
+      allocation.block = index;
+      allocation.user = blocks[index].user;
+      allocations.push_back(allocation);
+    }
+  }
+  return allocations;
+}
+
+bool TlsfAllocator::Validate() const
+{
+  //physical blocks tile the range, no two free ones touch
+  UINT64 offset = 0;
+  UINT64 used = 0;
+  size_t free_blocks = 0;
+  UINT32 prev = kNoBlock;
+  for (UINT32 index = first_block; index != kNoBlock; index = blocks[index].next_physical)
+  {
+    const Block& block = blocks[index];
+    if (block.offset != offset || block.size == 0 || block.size % kGranularity != 0 || block.prev_physical != prev ||
+        (block.free && prev != kNoBlock && blocks[prev].free))
+    {
+      return false;
+    }
+    offset += block.size;
+    used += block.free ? 0 : block.size;
+    free_blocks += block.free ? 1 : 0;
+    prev = index;
+  }
+  if (offset != size || used != used_bytes)
+  {
+    return false;
+  }
+
+  //every free block is on the list of its class, lists are set in the bitmaps
+  size_t listed = 0;
+  for (UINT32 first = 0; first < kFirstLevelCount; first++)
+  {
+    for (UINT32 second = 0; second < kSecondLevelCount; second++)
+    {
+      const bool has_blocks = free_heads[first][second] != kNoBlock;
+      if (has_blocks != ((second_level_bitmap[first] >> second) & 1))
+      {
+        return false;
+      }
+      for (UINT32 index = free_heads[first][second]; index != kNoBlock; index = blocks[index].next_free)
+      {
+        UINT32 block_first, block_second;
+        MappingInsert(blocks[index].size, &block_first, &block_second);
+        if (!blocks[index].free || block_first != first || block_second != second)
+        {
+          return false;
+        }
+        listed++;
+      }
+    }
+    if ((second_level_bitmap[first] != 0) != ((first_level_bitmap >> first) & 1))
+    {
+      return false;
+    }
+  }
+  return listed == free_blocks;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+
+// Two level segregated fit allocator over the offsets of one range, in
+// constant time per call. Free blocks sit on lists by size class: the first
+// level is the power of two, the second splits it into 16 linear steps, and a
+// bitmap per level finds the next list with a block at least as big in a few
+// bit scans. Freed blocks merge with free neighbours right away. Hands out
+// offsets only, the memory itself is someone else's (a D3D12 heap for
+// HeapSuballocator). Not thread safe.
+class TlsfAllocator {
+public:
+  // sizes and offsets are multiples of this
+  static constexpr UINT64 kGranularity = 256;
+  static constexpr UINT32 kNoBlock = 0xffffffff;
+
+  struct Allocation {
+    UINT64 offset = 0;
+    UINT64 size = 0; // rounded up to kGranularity
+    UINT32 block = kNoBlock;
+    UINT64 user = 0; // stored with the block for the caller
+
+    bool IsValid() const { return block != kNoBlock; }
+  };
+
+  explicit TlsfAllocator(UINT64 size);
+
+  // size bytes at a multiple of alignment (a power of two), invalid when no
+  // free block is big enough
+  Allocation Allocate(UINT64 size, UINT64 alignment, UINT64 user = 0);
+  void Free(const Allocation& allocation);
+
+  UINT64 Size() const { return size; }
+  UINT64 UsedBytes() const { return used_bytes; }
+  size_t AllocationCount() const { return allocation_count; }
+  bool IsEmpty() const { return allocation_count == 0; }
+  UINT64 LargestFreeBlock() const;
+  // live allocations in address order
+  std::vector<Allocation> Allocations() const;
+  // whether blocks, free lists and bitmaps agree; for tests
+  bool Validate() const;
+
+private:
+  static constexpr UINT32 kSecondLevelBits = 4;
+  static constexpr UINT32 kSecondLevelCount = 1 << kSecondLevelBits;
+  static constexpr UINT32 kFirstLevelCount = 64;
+  static constexpr UINT32 kFittingBudget = 16;
+
+  struct Block {
+    UINT64 offset;
+    UINT64 size;
+    UINT64 user;
+    UINT32 prev_physical;
+    UINT32 next_physical;
+    UINT32 prev_free;
+    UINT32 next_free;
+    bool free;
+  };
+
+  // size class holding blocks of size
+  static void MappingInsert(UINT64 size, UINT32* first, UINT32* second);
+  // smallest size class whose every block holds size
+  static void MappingSearch(UINT64 size, UINT32* first, UINT32* second);
+
+  UINT32 NewBlock(UINT64 offset, UINT64 size);
+  void InsertFree(UINT32 block);
+  void RemoveFree(UINT32 block);
+  UINT32 FindFree(UINT32 first, UINT32 second) const;
+  // Slow path when no class is certain to hold size at alignment: walks the
+  // lists below (last_first, last_second) that might, like a whole page made
+  // for one allocation. Looks at no more than kFittingBudget blocks so a
+  // fragmented page fails fast.
+  UINT32 FindFitting(UINT64 size, UINT64 alignment, UINT32 last_first, UINT32 last_second) const;
+  // cuts the first size bytes off block, the rest becomes a free block after it
+  void Split(UINT32 block, UINT64 size);
+  // block absorbs the physical block after it
+  void Absorb(UINT32 block);
+
+  UINT64 size;
+  UINT64 used_bytes = 0;
+  size_t allocation_count = 0;
+  UINT32 first_block;
+  std::vector<Block> blocks;
+  std::vector<UINT32> unused_blocks; // indices into blocks to reuse
+  UINT64 first_level_bitmap = 0;
+  UINT32 second_level_bitmap[kFirstLevelCount] = {};
+  UINT32 free_heads[kFirstLevelCount][kSecondLevelCount];
+};
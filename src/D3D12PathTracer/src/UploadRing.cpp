@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "UploadRing.h"
+
+#include <algorithm>
+
+MemoryUploadBackend::MemoryUploadBackend(UINT64 capacity)
+  : memory(static_cast<size_t>(capacity))
+{
+}
+
+void MemoryUploadBackend::Begin()
+{
+  if (recording)
+  {
+    throw std::logic_error("upload batch opened twice");
+  }
+  recording = true;
+}
+
+UINT64 MemoryUploadBackend::Submit()
+{
+  if (!recording)
+  {
+    throw std::logic_error("no upload batch to submit");
+  }
+  recording = false;
+  return ++submitted;
+}
+
+void MemoryUploadBackend::WaitForFence(UINT64 value)
+{
+  if (value > submitted)
+  {
+    throw std::logic_error("waiting on an upload batch that was never submitted");
+  }
+  waits++;
+  completed = std::max<UINT64>(completed, value);
+}
+
+void MemoryUploadBackend::Complete(UINT64 value)
+{
+  completed = std::max<UINT64>(completed, std::min<UINT64>(value, submitted));
+}
+
+UploadRing::UploadRing(std::unique_ptr<UploadBackend> backend)
+  : backend(std::move(backend)), capacity(this->backend->Capacity())
+{
+}
+
+UploadRing::~UploadRing()
+{
+  //an open batch was never handed to the GPU, nothing reads it
+  if (!in_flight.empty())
+  {
+    backend->WaitForFence(in_flight.back().fence);
+  }
+}
+
+void UploadRing::Begin()
+{
+  if (open)
+  {
+    throw std::logic_error("upload batch already open");
+  }
+  backend->Begin();
+  open = true;
+}
+
+UploadRing::Allocation UploadRing::Allocate(UINT64 size, UINT64 alignment)
+{
+  if (!open)
+  {
+    throw std::logic_error("upload allocation outside of a batch");
+  }
+  if (!Fits(size))
+  {
+    throw std::runtime_error("upload larger than the ring");
+  }
+
+  Allocation allocation;
+  for (;;)
+  {
+    Retire();
+    if (TryAllocate(size, alignment, &allocation))
+    {
+      stats.bytes_allocated += size;
+      stats.peak_used = std::max<UINT64>(stats.peak_used, used);
+      return allocation;
+    }
+
+    if (!in_flight.empty())
+    {
+      //the oldest batch frees the space right after head
+      backend->WaitForFence(in_flight.front().fence);
+      stats.stalls++;
+    }
+    else
+    {
+      //the open batch fills the ring by itself, send it off and wait on it next time around
+      Submit();
+      Begin();
+    }
+  }
+}
+
+bool UploadRing::TryAllocate(UINT64 size, UINT64 alignment, Allocation* allocation)
+{
+  if (used == 0)
+  {
+    head = tail = 0;
+  }
+
+  UINT64 offset = (head + alignment - 1) & ~(alignment - 1);
+  if (used == 0 || head > tail)
+  {
+    //free space runs from head to the end, then from the start to tail
+    if (offset + size > capacity)
+    {
+      if (size > tail)
+      {
+        return false;
+      }
+      offset = 0;
+      stats.wraps++;
+    }
+  }
+  else if (offset + size > tail)
+  {
+    //free space runs from head to tail, none at all when head == tail
+    return false;
+  }
+
+  const UINT64 end = offset + size;
+  const UINT64 consumed = offset >= head ? end - head : capacity - head + end;
+  head = end == capacity ? 0 : end;
+  used += consumed;
+  open_bytes += consumed;
+
+  allocation->cpu = backend->Data() + offset;
+  allocation->offset = offset;
+  allocation->size = size;
+  return true;
+}
+
+void UploadRing::HoldUntilRetired(std::shared_ptr<void> object)
+{
+  open_held.emplace_back(std::move(object));
+}
+
+UINT64 UploadRing::Submit()
+{
+  if (!open)
+  {
+    throw std::logic_error("no upload batch to submit");
+  }
+  Batch batch;
+  batch.fence = backend->Submit();
+  batch.end = head;
+  batch.bytes = open_bytes;
+  batch.held = std::move(open_held);
+  open_held.clear();
+  in_flight.emplace_back(std::move(batch));
+  open_bytes = 0;
+  open = false;
+  stats.submissions++;
+  return in_flight.back().fence;
+}
+
+void UploadRing::WaitIdle()
+{
+  if (!in_flight.empty())
+  {
+    backend->WaitForFence(in_flight.back().fence);
+  }
+  Retire();
+}
+
+void UploadRing::Retire()
+{
+  const UINT64 completed = backend->CompletedFence();
+  while (!in_flight.empty() && in_flight.front().fence <= completed)
+  {
+    tail = in_flight.front().end;
+    used -= in_flight.front().bytes;
+    in_flight.pop_front();
+  }
+}
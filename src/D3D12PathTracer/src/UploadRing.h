@@ -0,0 +1,124 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Where UploadRing's bytes live and how batches reach the GPU. The D3D12
+// backend (D3D12UploadBackend.h) is one persistently mapped upload buffer and
+// a fence on the command queue; MemoryUploadBackend stands in for it without a
+// GPU, to check batching and wrap around.
+class UploadBackend {
+public:
+  virtual ~UploadBackend() = default;
+
+  virtual UINT64 Capacity() const = 0;
+  // CPU address of byte 0, the ring writes through it
+  virtual BYTE* Data() = 0;
+  // opens a batch for copies to be recorded into
+  virtual void Begin() = 0;
+  // submits the open batch, returns the fence value signalled once the GPU is done reading it
+  virtual UINT64 Submit() = 0;
+  virtual UINT64 CompletedFence() = 0;
+  virtual void WaitForFence(UINT64 value) = 0;
+};
+
+// Plain memory and a fence the caller moves forward, nothing completes on its own
+class MemoryUploadBackend : public UploadBackend {
+public:
+  explicit MemoryUploadBackend(UINT64 capacity);
+
+  UINT64 Capacity() const override { return memory.size(); }
+  BYTE* Data() override { return memory.data(); }
+  void Begin() override;
+  UINT64 Submit() override;
+  UINT64 CompletedFence() override { return completed; }
+  // the "GPU" catches up to value, throws for a value never submitted as that would hang
+  void WaitForFence(UINT64 value) override;
+
+  // finishes every batch up to value, as the GPU would in the background
+  void Complete(UINT64 value);
+  UINT64 SubmittedFence() const { return submitted; }
+  size_t Waits() const { return waits; }
+
+private:
+  std::vector<BYTE> memory;
+  UINT64 submitted = 0;
+  UINT64 completed = 0;
+  size_t waits = 0;
+  bool recording = false;
+};
+
+// Linear allocator over a backend's buffer for staging uploads. Allocations
+// go one after the other, wrapping to the start once the end is reached; each
+// batch between Begin and Submit takes the fence Submit returns, and its bytes
+// come back when that fence completes. Running out of space waits on the
+// oldest batch in flight, or submits the open one when it alone fills the
+// ring, so any number of uploads shares a handful of submissions and the CPU
+// only stalls when the GPU really is behind. Not thread safe, like the
+// command list it feeds.
+class UploadRing {
+public:
+  struct Allocation {
+    BYTE* cpu = nullptr;
+    UINT64 offset = 0; // from the start of the backend's buffer
+    UINT64 size = 0;
+  };
+
+  struct Stats {
+    size_t submissions = 0;
+    size_t stalls = 0; // waits on the GPU for space
+    size_t wraps = 0;
+    UINT64 bytes_allocated = 0;
+    UINT64 peak_used = 0;
+  };
+
+  explicit UploadRing(std::unique_ptr<UploadBackend> backend);
+  // waits for every batch, the GPU may still be reading the buffer
+  ~UploadRing();
+
+  UploadRing(const UploadRing&) = delete;
+  UploadRing& operator=(const UploadRing&) = delete;
+
+  void Begin();
+  // size bytes at a multiple of alignment (a power of two dividing the
+  // capacity), within the open batch. May submit and reopen the batch, so
+  // copies recorded so far go to the GPU. Throws when size exceeds the capacity.
+  Allocation Allocate(UINT64 size, UINT64 alignment);
+  // whether Allocate can ever serve size, larger uploads need their own buffer
+  bool Fits(UINT64 size) const { return size <= capacity; }
+  // keeps object (say such a buffer) alive until the open batch retires
+  void HoldUntilRetired(std::shared_ptr<void> object);
+  // closes the open batch, returns its fence value
+  UINT64 Submit();
+  // blocks until every submitted batch is done and the ring is empty
+  void WaitIdle();
+
+  bool IsOpen() const { return open; }
+  UINT64 Used() const { return used; }
+  UploadBackend& Backend() { return *backend; }
+  Stats GetStats() const { return stats; }
+
+private:
+  struct Batch {
+    UINT64 fence;
+    UINT64 end; // head when it was submitted
+    UINT64 bytes; // its allocations, alignment and wrap padding included
+    std::vector<std::shared_ptr<void>> held;
+  };
+
+  bool TryAllocate(UINT64 size, UINT64 alignment, Allocation* allocation);
+  // frees the space of every batch whose fence has completed
+  void Retire();
+
+  std::unique_ptr<UploadBackend> backend;
+  UINT64 capacity;
+  UINT64 head = 0; // next free byte
+  UINT64 tail = 0; // first byte still in use
+  UINT64 used = 0;
+  UINT64 open_bytes = 0;
+  bool open = false;
+  std::vector<std::shared_ptr<void>> open_held;
+  std::deque<Batch> in_flight;
+  Stats stats;
+};
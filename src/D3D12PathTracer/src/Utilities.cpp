@@ -123,4 +123,18 @@ std::istream& utilityCore::safeGetline(std::istream& is, std::string& t) {
 			t += (char)c;
 		}
 	}
-}
\ No newline at end of file
+}
+
+void utilityCore::report(const std::wstring& text)
+{
+	OutputDebugStringW(text.c_str());
+
+	//the app has no console of its own, print to the one it was started from if any
+	static const HANDLE console = AttachConsole(ATTACH_PARENT_PROCESS) ?
+		CreateFileW(L"CONOUT$", GENERIC_WRITE, FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, 0, nullptr) : INVALID_HANDLE_VALUE;
+	if (console != INVALID_HANDLE_VALUE)
+	{
+		DWORD written;
+		WriteConsoleW(console, text.c_str(), static_cast<DWORD>(text.size()), &written, nullptr);
+	}
+}
@@ -24,6 +24,8 @@ namespace utilityCore {
 	extern glm::mat4 buildTransformationMatrix(glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale);
 	extern std::string convertIntToString(int number);
 	extern std::istream& safeGetline(std::istream& is, std::string& t); //Thanks to http://stackoverflow.com/a/6089413
+	// debugger output, and the console the program was started from if any
+	void report(const std::wstring& text);
         inline std::wstring stringAndId(std::wstring s, int id)
         {
           return std::wstring(s + L" " + std::to_wstring(id));          
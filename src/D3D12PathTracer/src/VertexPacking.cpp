@@ -0,0 +1,259 @@
+#include "stdafx.h"
+#include "VertexPacking.h"
+#include "AssetLoader.h"
+#include "ObjParser.h"
+#include "Utilities.h"
+#include <chrono>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+  // +1 or -1 per component, +1 for zero
+  inline XMVECTOR SignNotZero(FXMVECTOR value)
+  {
+    return XMVectorSelect(g_XMOne, g_XMNegativeOne, XMVectorLess(value, XMVectorZero()));
+  }
+
+  // fold the lower hemisphere of the octahedron over the upper one
+  inline XMVECTOR OctahedronWrap(FXMVECTOR value)
+  {
+    XMVECTOR swapped = XMVectorSwizzle<1, 0, 2, 3>(value);
+    return XMVectorMultiply(XMVectorSubtract(g_XMOne, XMVectorAbs(swapped)), SignNotZero(value));
+  }
+
+  inline XMVECTOR OctahedronEncode(FXMVECTOR normal)
+  {
+    XMVECTOR l1_norm = XMVector3Dot(XMVectorAbs(normal), g_XMOne);
+    if (XMVector3Equal(l1_norm, XMVectorZero()))
+    {
+      return XMVectorZero();
+    }
+
+    XMVECTOR projected = XMVectorDivide(normal, l1_norm);
+    XMVECTOR lower_hemisphere = XMVectorLess(XMVectorSplatZ(projected), XMVectorZero());
+    return XMVectorSelect(projected, OctahedronWrap(projected), lower_hemisphere);
+  }
+
+  inline XMVECTOR OctahedronDecode(FXMVECTOR encoded)
+  {
+    //z = 1 - |x| - |y|, negative z means the xy were folded
+    XMVECTOR abs_encoded = XMVectorAbs(encoded);
+    XMVECTOR z = XMVectorSubtract(XMVectorSubtract(g_XMOne, XMVectorSplatX(abs_encoded)), XMVectorSplatY(abs_encoded));
+    XMVECTOR lower_hemisphere = XMVectorLess(z, XMVectorZero());
+    XMVECTOR xy = XMVectorSelect(encoded, OctahedronWrap(encoded), lower_hemisphere);
+
+    XMVECTOR normal = XMVectorSelect(xy, z, g_XMSelect0010);
+    return XMVector3Normalize(normal);
+  }
+
+  // 1 / extent, 0 for flat axes so they all encode to 0
+  inline XMVECTOR InverseExtent(const VertexPacking::Bounds& bounds)
+  {
+    XMVECTOR extent = XMLoadFloat3(&bounds.extent);
+    XMVECTOR flat = XMVectorLessOrEqual(extent, XMVectorZero());
+    return XMVectorSelect(XMVectorReciprocal(extent), XMVectorZero(), flat);
+  }
+}
+
+VertexPacking::Bounds VertexPacking::ComputeBounds(const Vertex* vertices, size_t count)
+{
+  Bounds bounds;
+  if (count == 0)
+  {
+    return bounds;
+  }
+
+  XMVECTOR lower = XMLoadFloat3(&vertices[0].position);
+  XMVECTOR upper = lower;
+  for (size_t i = 1; i < count; i++)
+  {
+    XMVECTOR position = XMLoadFloat3(&vertices[i].position);
+    lower = XMVectorMin(lower, position);
+    upper = XMVectorMax(upper, position);
+  }
+
+  XMStoreFloat3(&bounds.lower, lower);
+  XMStoreFloat3(&bounds.extent, XMVectorSubtract(upper, lower));
+  return bounds;
+}
+
+void VertexPacking::Encode(const Vertex* vertices, size_t count, const Bounds& bounds, PackedVertex* packed)
+{
+  const XMVECTOR lower = XMLoadFloat3(&bounds.lower);
+  const XMVECTOR inverse_extent = InverseExtent(bounds);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const Vertex& vertex = vertices[i];
+    PackedVertex& out = packed[i];
+
+    XMVECTOR position = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&vertex.position), lower), inverse_extent);
+    XMStoreUShortN4(&out.position, XMVectorSaturate(position));
+
+    XMStoreShortN2(&out.normal, OctahedronEncode(XMLoadFloat3(&vertex.normal)));
+    XMStoreHalf2(&out.texCoord, XMLoadFloat2(&vertex.texCoord));
+  }
+}
+
+void VertexPacking::Decode(const PackedVertex* packed, size_t count, const Bounds& bounds, Vertex* vertices)
+{
+  const XMVECTOR lower = XMLoadFloat3(&bounds.lower);
+  const XMVECTOR extent = XMLoadFloat3(&bounds.extent);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    const PackedVertex& in = packed[i];
+    Vertex& vertex = vertices[i];
+
+    XMStoreFloat3(&vertex.position, XMVectorMultiplyAdd(XMLoadUShortN4(&in.position), extent, lower));
+    XMStoreFloat3(&vertex.normal, OctahedronDecode(XMLoadShortN2(&in.normal)));
+    XMStoreFloat2(&vertex.texCoord, XMLoadHalf2(&in.texCoord));
+  }
+}
+
+VertexPacking::PackingError VertexPacking::MeasureError(const std::vector<Vertex>& vertices, const std::vector<PackedVertex>& packed, const Bounds& bounds)
+{
+  PackingError error;
+
+  std::vector<Vertex> decoded(packed.size());
+  Decode(packed.data(), packed.size(), bounds, decoded.data());
+
+  XMVECTOR position_error = XMVectorZero();
+  XMVECTOR texcoord_error = XMVectorZero();
+  float max_normal_angle = 0.0f;
+  for (size_t i = 0; i < vertices.size() && i < decoded.size(); i++)
+  {
+    position_error = XMVectorMax(position_error, XMVectorAbs(XMVectorSubtract(XMLoadFloat3(&vertices[i].position), XMLoadFloat3(&decoded[i].position))));
+    texcoord_error = XMVectorMax(texcoord_error, XMVectorAbs(XMVectorSubtract(XMLoadFloat2(&vertices[i].texCoord), XMLoadFloat2(&decoded[i].texCoord))));
+
+    XMVECTOR normal = XMLoadFloat3(&vertices[i].normal);
+    if (!XMVector3Equal(normal, XMVectorZero()))
+    {
+      //acos of the dot product can't resolve angles below ~0.02 degrees in fp32, atan2 can
+      normal = XMVector3Normalize(normal);
+      const XMVECTOR decoded_normal = XMLoadFloat3(&decoded[i].normal);
+      const float sin_angle = XMVectorGetX(XMVector3Length(XMVector3Cross(normal, decoded_normal)));
+      const float cos_angle = XMVectorGetX(XMVector3Dot(normal, decoded_normal));
+      max_normal_angle = std::max<float>(max_normal_angle, atan2f(sin_angle, cos_angle));
+    }
+  }
+
+  XMFLOAT3 max_position;
+  XMStoreFloat3(&max_position, position_error);
+  XMFLOAT2 max_texcoord;
+  XMStoreFloat2(&max_texcoord, texcoord_error);
+
+  error.position = std::max<float>(max_position.x, std::max<float>(max_position.y, max_position.z));
+  error.texcoord = std::max<float>(max_texcoord.x, max_texcoord.y);
+  error.normal_degrees = XMConvertToDegrees(max_normal_angle);
+  return error;
+}
+
+VertexPacking::PackingError VertexPacking::ErrorBound(const std::vector<Vertex>& vertices, const Bounds& bounds)
+{
+  PackingError bound;
+  bound.normal_degrees = kMaxNormalDegrees;
+
+  float max_texcoord = 0.0f;
+  for (const Vertex& vertex : vertices)
+  {
+    max_texcoord = std::max<float>(max_texcoord, std::max<float>(fabsf(vertex.texCoord.x), fabsf(vertex.texCoord.y)));
+  }
+  //half has 11 significant bits, below 2^-14 the step is a fixed 2^-24
+  bound.texcoord = max_texcoord * ldexpf(1.0f, -11) + ldexpf(1.0f, -25);
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    const float lower = (&bounds.lower.x)[axis];
+    const float extent = (&bounds.extent.x)[axis];
+    const float rounding = (fabsf(lower) + extent) * 4.0f * FLT_EPSILON;
+    bound.position = std::max<float>(bound.position, extent * 0.5f / 65535.0f + rounding);
+  }
+  return bound;
+}
+
+VertexPacking::BenchmarkResult VertexPacking::Benchmark(const std::vector<Vertex>& vertices)
+{
+  BenchmarkResult result;
+  result.vertices = vertices.size();
+  result.bytes_before = vertices.size() * sizeof(Vertex);
+  result.bytes_after = vertices.size() * sizeof(PackedVertex);
+
+  const Bounds bounds = ComputeBounds(vertices.data(), vertices.size());
+  std::vector<PackedVertex> packed(vertices.size());
+  auto start = std::chrono::high_resolution_clock::now();
+  Encode(vertices.data(), vertices.size(), bounds, packed.data());
+  auto end = std::chrono::high_resolution_clock::now();
+  result.encode_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  std::vector<Vertex> decoded(vertices.size());
+  start = std::chrono::high_resolution_clock::now();
+  Decode(packed.data(), packed.size(), bounds, decoded.data());
+  end = std::chrono::high_resolution_clock::now();
+  result.decode_milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+
+  result.error = MeasureError(vertices, packed, bounds);
+  result.bound = ErrorBound(vertices, bounds);
+  return result;
+}
+
+int VertexPacking::RunBenchmark(const std::vector<std::string>& paths)
+{
+  std::vector<std::string> files = paths;
+  if (files.empty())
+  {
+    files = ObjParser::ShippedModels();
+    for (const std::string& gltf : AssetLoader::ShippedGltfModels())
+    {
+      files.push_back(gltf);
+    }
+  }
+
+  std::wstringstream wstr;
+  size_t models = 0;
+  size_t bytes_before = 0;
+  size_t bytes_after = 0;
+  size_t past_bound = 0;
+  auto report = [&](const std::string& name, const std::vector<Vertex>& vertices)
+  {
+    const BenchmarkResult result = Benchmark(vertices);
+    const bool within = result.error.position <= result.bound.position && result.error.texcoord <= result.bound.texcoord &&
+                        result.error.normal_degrees <= result.bound.normal_degrees;
+    wstr << L"packbench: " << name.c_str() << L", " << result.vertices << L" vertices, " << result.bytes_before / 1024.0
+         << L" KB -> " << result.bytes_after / 1024.0 << L" KB, error position " << result.error.position << L" (bound "
+         << result.bound.position << L"), normal " << result.error.normal_degrees << L" deg, texcoord " << result.error.texcoord
+         << L" (bound " << result.bound.texcoord << L"), encode " << result.encode_milliseconds << L" ms, decode "
+         << result.decode_milliseconds << L" ms" << (within ? L"\n" : L", PAST BOUND\n");
+    models++;
+    bytes_before += result.bytes_before;
+    bytes_after += result.bytes_after;
+    past_bound += within ? 0 : 1;
+  };
+
+  for (const std::string& file : files)
+  {
+    if (!AssetLoader::IsGltfPath(file))
+    {
+      report(file, AssetLoader::DecodeObj(file, MeshOptimizer::TriangleOrder::File).vertices);
+      continue;
+    }
+    const tinygltf::Model gltf = AssetLoader::DecodeGltf(file);
+    for (size_t m = 0; m < gltf.meshes.size(); m++)
+    {
+      for (size_t p = 0; p < gltf.meshes[m].primitives.size(); p++)
+      {
+        const AssetLoader::ModelData data = AssetLoader::DecodeGltfPrimitive(gltf, gltf.meshes[m].primitives[p]);
+        if (!data.vertices.empty())
+        {
+          report(file + " mesh " + std::to_string(m) + " primitive " + std::to_string(p), data.vertices);
+        }
+      }
+    }
+  }
+  wstr << L"packbench: " << models << L" models, " << bytes_before / (1024.0 * 1024.0) << L" MB -> "
+       << bytes_after / (1024.0 * 1024.0) << L" MB, " << past_bound << L" past their error bound\n";
+  utilityCore::report(wstr.str());
+  return past_bound == 0 ? 0 : 1;
+}
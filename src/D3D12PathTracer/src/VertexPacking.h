@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <DirectXPackedVector.h>
+
+#include "shaders/RayTracingHlslCompat.h"
+
+// Compact 16 byte form of Vertex for the CPU side copy of a model:
+// position as unorm16 inside the mesh bounds, normal octahedral encoded into
+// two snorm16 and texcoord as two halfs. Encode/decode go through DirectXMath
+// so they use its SIMD paths.
+namespace VertexPacking {
+
+struct PackedVertex
+{
+  DirectX::PackedVector::XMUSHORTN4 position; // w unused
+  DirectX::PackedVector::XMSHORTN2 normal;
+  DirectX::PackedVector::XMHALF2 texCoord;
+};
+
+// Positions are stored relative to the mesh bounds
+struct Bounds
+{
+  XMFLOAT3 lower{ 0.0f, 0.0f, 0.0f };
+  XMFLOAT3 extent{ 0.0f, 0.0f, 0.0f };
+};
+
+// Largest difference between a mesh and its packed form
+struct PackingError
+{
+  float position = 0.0f; // world units, per component
+  float normal_degrees = 0.0f; // zero length normals are skipped
+  float texcoord = 0.0f;
+};
+
+// Octahedral snorm16 normals land within this angle of the unit input
+constexpr float kMaxNormalDegrees = 0.005f;
+
+Bounds ComputeBounds(const Vertex* vertices, size_t count);
+
+void Encode(const Vertex* vertices, size_t count, const Bounds& bounds, PackedVertex* packed);
+void Decode(const PackedVertex* packed, size_t count, const Bounds& bounds, Vertex* vertices);
+
+PackingError MeasureError(const std::vector<Vertex>& vertices, const std::vector<PackedVertex>& packed, const Bounds& bounds);
+// Largest error the format allows for these vertices: half a unorm16 step of the
+// bounds per position component, half an ulp of the largest texcoord as a half and
+// kMaxNormalDegrees, each with room for fp32 rounding in encode/decode
+PackingError ErrorBound(const std::vector<Vertex>& vertices, const Bounds& bounds);
+
+struct BenchmarkResult
+{
+  size_t vertices = 0;
+  size_t bytes_before = 0; // fp32 Vertex copy
+  size_t bytes_after = 0; // PackedVertex copy
+  PackingError error;
+  PackingError bound;
+  double encode_milliseconds = 0.0;
+  double decode_milliseconds = 0.0;
+};
+// Packs one model's vertices and measures the round trip against ErrorBound
+BenchmarkResult Benchmark(const std::vector<Vertex>& vertices);
+// -packbench [files...]: runs Benchmark on every model of the OBJ/glTF files,
+// ObjParser::ShippedModels and AssetLoader::ShippedGltfModels by default, and
+// prints the per model memory reduction and error. Returns 1 if any error is
+// past its bound; no window or device is created
+int RunBenchmark(const std::vector<std::string>& paths);
+} // namespace VertexPacking
@@ -14,6 +14,16 @@
 #include "DXSampleHelper.h"
 #include "Scene.h"
 #include "D3D12RaytracingSimpleLighting.h"
+#include "AssetLoader.h"
+#include "GltfAccessor.h"
+#include "ImageDecoder.h"
+#include "HeapSuballocator.h"
+#include "MeshOptimizer.h"
+#include "ObjParser.h"
+#include "SceneBundle.h"
+#include "SceneReader.h"
+#include "Skinning.h"
+#include "VertexPacking.h"
 
 HWND Win32Application::m_hwnd = nullptr;
 bool Win32Application::m_fullscreenMode = false;
@@ -28,6 +38,99 @@ int Win32Application::Run(DXSample* pSample, HINSTANCE hInstance, int nCmdShow)
         int argc;
         LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
 
+		// Headless texture decode benchmark: program.exe -decodebench [dirs...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-decodebench") == 0) {
+			std::vector<std::string> directories;
+			for (int i = 2; i < argc; i++) {
+				directories.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return ImageDecoder::RunBenchmark(directories);
+		}
+
+		// Headless scene file reader benchmark: program.exe -scenebench [scenes...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-scenebench") == 0) {
+			std::vector<std::string> scenes;
+			for (int i = 2; i < argc; i++) {
+				scenes.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return SceneReader::RunBenchmark(scenes);
+		}
+
+		// Headless bundle against text scene startup benchmark: program.exe -bundlebench [scenes...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-bundlebench") == 0) {
+			std::vector<std::string> scenes;
+			for (int i = 2; i < argc; i++) {
+				scenes.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return SceneBundle::RunBenchmark(scenes);
+		}
+
+		// Headless OBJ reader benchmark: program.exe -objbench [files...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-objbench") == 0) {
+			std::vector<std::string> files;
+			for (int i = 2; i < argc; i++) {
+				files.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return ObjParser::RunBenchmark(files);
+		}
+
+		// Headless mesh reorder cache simulation: program.exe -meshbench [files...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-meshbench") == 0) {
+			std::vector<std::string> files;
+			for (int i = 2; i < argc; i++) {
+				files.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return MeshOptimizer::RunBenchmark(files);
+		}
+
+		// Headless vertex packing memory/error report: program.exe -packbench [files...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-packbench") == 0) {
+			std::vector<std::string> files;
+			for (int i = 2; i < argc; i++) {
+				files.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return VertexPacking::RunBenchmark(files);
+		}
+
+		// Headless glTF load benchmark against the copying path: program.exe -gltfbench [files...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-gltfbench") == 0) {
+			std::vector<std::string> files;
+			for (int i = 2; i < argc; i++) {
+				files.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return GltfAccessor::RunBenchmark(files);
+		}
+
+		// Headless skinning benchmark of animated instances: program.exe -skinbench [files...]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-skinbench") == 0) {
+			std::vector<std::string> files;
+			for (int i = 2; i < argc; i++) {
+				files.push_back(std::string(CW2A(argv[i])));
+			}
+			LocalFree(argv);
+			return Skinning::RunBenchmark(files);
+		}
+
+		// Headless asset decode scaling benchmark: program.exe -loadbench [scene]
+		if (argc >= 2 && _wcsicmp(argv[1], L"-loadbench") == 0) {
+			std::string scene = argc >= 3 ? std::string(CW2A(argv[2])) : std::string();
+			LocalFree(argv);
+			return AssetLoader::RunBenchmark(scene);
+		}
+
+		// Headless heap sub-allocator benchmark: program.exe -heapbench
+		if (argc >= 2 && _wcsicmp(argv[1], L"-heapbench") == 0) {
+			LocalFree(argv);
+			return HeapSuballocator::RunBenchmark();
+		}
+
 		if (argc < 2) {
 			OutputDebugString(L"Application hit a problem: ");
 			OutputDebugString(L"Please provide arguments to the program: program.exe scenefile.txt");
@@ -64,9 +167,15 @@ int Win32Application::Run(DXSample* pSample, HINSTANCE hInstance, int nCmdShow)
 		
 		// Grab scene name
 		string sceneFile = CW2A(argv[1]);
-		LocalFree(argv);
 		D3D12RaytracingSimpleLighting* rayTracingProgram = dynamic_cast<D3D12RaytracingSimpleLighting*>(pSample);
 		rayTracingProgram->p_sceneFileName = sceneFile;
+		// program.exe scenefile.txt -compress: block compress textures from the start
+		for (int i = 2; i < argc; i++) {
+			if (_wcsicmp(argv[i], L"-compress") == 0) {
+				rayTracingProgram->compress_textures = true;
+			}
+		}
+		LocalFree(argv);
 		
 		// Initialize the sample. OnInit is defined in each child-implementation of DXSample.
 		pSample->OnInit();
@@ -71,7 +71,7 @@ struct Info
   UINT material_offset;
   UINT diffuse_sampler_offset;
   UINT normal_sampler_offset;
-  XMMATRIX rotation_scale_matrix;
+  UINT index_size; // bytes per index in the model's index buffer, 2 or 4
 };
 
 #endif // RAYTRACINGHLSLCOMPAT_H
\ No newline at end of file
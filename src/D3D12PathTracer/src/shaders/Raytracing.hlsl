@@ -28,6 +28,7 @@ ConstantBuffer<Material> materials[] : register(b0, space4);
 Texture2D text[] : register(t0, space5);
 Texture2D normal_text[] : register(t0, space6);
 SamplerState samplers[] : register(s0);
+StructuredBuffer<float4> Tangents[] : register(t0, space7); // xyz tangent, w handedness
 
 ConstantBuffer<SceneConstantBuffer> g_sceneCB : register(b0);
 ConstantBuffer<CubeConstantBuffer> g_cubeCB : register(b1);
@@ -42,6 +43,11 @@ static const float INV_PI = 0.3183098861837906715377675267450287240689f;
 static const float RED_WAVELENGTH_UM = 0.69f;
 static const float BLUE_WAVELENGTH_UM = 0.47f;
 static const float GREEN_WAVELENGTH_UM = 0.53f;
+// Ray cones (Ray Tracing Gems ch. 20): a diffuse bounce widens the cone by this
+// much per unit distance, so later hits read blurrier mips
+static const float DIFFUSE_CONE_SPREAD = 0.1f;
+// grazing hits would otherwise ask for an infinite footprint, same as MipChain.cpp
+static const float MIN_CONE_COSINE = 0.01f;
 
 static uint rng_state; // the current seed
 static const float png_01_convert = (1.0f / 4294967296.0f); // to convert into a 01 distribution
@@ -82,8 +88,40 @@ struct RayPayload
     float4 color;
 	float3 rayOrigin;
 	float3 rayDir;
+	float coneWidth; // cone width where the ray starts
+	float coneSpread; // growth of the width per unit distance
 };
 
+// Load the three indices of a triangle, index_size is 2 or 4 bytes.
+uint3 LoadTriangleIndices(uint model_offset, uint index_size, uint primitive)
+{
+	uint offsetBytes = primitive * 3 * index_size;
+	if (index_size == 4)
+	{
+		return Indices[model_offset].Load3(offsetBytes);
+	}
+
+	// Loads have to be 4 byte aligned, so read the two dwords that hold the
+	// three 16 bit indices and pick them out depending on the alignment.
+	const uint dwordAlignedOffset = offsetBytes & ~3;
+	const uint2 four16BitIndices = Indices[model_offset].Load2(dwordAlignedOffset);
+
+	uint3 indices;
+	if (dwordAlignedOffset == offsetBytes)
+	{
+		indices.x = four16BitIndices.x & 0xffff;
+		indices.y = (four16BitIndices.x >> 16) & 0xffff;
+		indices.z = four16BitIndices.y & 0xffff;
+	}
+	else
+	{
+		indices.x = (four16BitIndices.x >> 16) & 0xffff;
+		indices.y = four16BitIndices.y & 0xffff;
+		indices.z = (four16BitIndices.y >> 16) & 0xffff;
+	}
+	return indices;
+}
+
 // Retrieve hit world position.
 float3 HitWorldPosition()
 {
@@ -106,6 +144,26 @@ float2 HitAttribute2D(float2 vertexAttribute[3], BuiltInTriangleIntersectionAttr
 		attr.barycentrics.y * (vertexAttribute[2] - vertexAttribute[0]);
 }
 
+// Texture LOD for a ray cone hitting a triangle, edges are in world space.
+// MipChain::ConeLod is the CPU side of this.
+float TextureLod(Texture2D tex, float3 edge1, float3 edge2, float2 uvEdge1, float2 uvEdge2, float coneWidth, float3 rayDir, float3 normal)
+{
+	uint width, height, levels;
+	tex.GetDimensions(0, width, height, levels);
+
+	//both areas are doubled, only their ratio matters
+	float texelArea = width * height * abs(uvEdge1.x * uvEdge2.y - uvEdge2.x * uvEdge1.y);
+	float worldArea = length(cross(edge1, edge2));
+	if (texelArea <= 0.0f || worldArea <= 0.0f || coneWidth <= 0.0f || levels <= 1)
+	{
+		return 0.0f;
+	}
+
+	float cosine = max(abs(dot(normalize(rayDir), normalize(normal))), MIN_CONE_COSINE);
+	float lod = 0.5f * log2(texelArea / worldArea) + log2(coneWidth / cosine);
+	return clamp(lod, 0.0f, float(levels - 1));
+}
+
 // Taken from https://github.com/emily-vo/Project3-CUDA-Path-Tracer
 float EvaluateFresnelDielectric(float cosThetaI, float etaI, float etaT)
 {
@@ -199,6 +257,17 @@ inline void GenerateCameraRay(uint2 index, out float3 origin, out float3 directi
     }
 }
 
+// Angle one pixel covers at the center of the screen, the spread of primary ray cones.
+float PixelSpreadAngle()
+{
+    float2 pixel = 2.0f / DispatchRaysDimensions().xy;
+    float4 center = mul(float4(0, 0, 0, 1), g_sceneCB.projectionToWorld);
+    float4 above = mul(float4(0, pixel.y, 0, 1), g_sceneCB.projectionToWorld);
+    float3 centerDir = center.xyz / center.w - g_sceneCB.cameraPosition.xyz;
+    float3 aboveDir = above.xyz / above.w - g_sceneCB.cameraPosition.xyz;
+    return atan2(length(cross(centerDir, aboveDir)), dot(centerDir, aboveDir));
+}
+
 // Diffuse lighting calculation.
 float4 CalculateDiffuseLighting(float3 hitPosition, float3 normal)
 {
@@ -375,7 +444,7 @@ void RefractiveBounce(uint material_offset, float3 triangleNormal, float3 hitPos
 	payload.color = float4(color, hitType);
 }
 
-void DiffuseBounce(uint texture_offset, uint material_offset, uint sampler_offset, float emittance, float3 triangleNormal, float3 hitPosition, float hitType, float2 triangleUV, RayPayload payload)
+void DiffuseBounce(uint texture_offset, uint material_offset, uint sampler_offset, float emittance, float3 triangleNormal, float3 hitPosition, float hitType, float2 triangleUV, float lod, RayPayload payload)
 {
 	float3 newDir = CalculateRandomDirectionInHemisphere(triangleNormal);
 	payload.rayDir = newDir;
@@ -384,7 +453,7 @@ void DiffuseBounce(uint texture_offset, uint material_offset, uint sampler_offse
 	float3 color = BACKGROUND_COLOR.xyz;
 	if (texture_offset != NULL_OFFSET)
 	{
-		float3 tex = text[texture_offset].SampleLevel(samplers[sampler_offset], triangleUV, 0);
+		float3 tex = text[texture_offset].SampleLevel(samplers[sampler_offset], triangleUV, lod);
 		color = payload.color.rgb * tex.rgb;
 	}
 	else if (material_offset != NULL_OFFSET)
@@ -480,7 +549,7 @@ void MyRaygenShader()
     ray.TMax = 10000.0;
 
 	// Payload: color with w coord indicating type of hit, origin of the new ray, direction of new ray
-    RayPayload payload = { float4(INITIAL_COLOR.rgb, -1.0f), float3(0, 0, 0), float3(0, 0, 0)};
+    RayPayload payload = { float4(INITIAL_COLOR.rgb, -1.0f), float3(0, 0, 0), float3(0, 0, 0), 0.0f, PixelSpreadAngle() };
 
 
 	// for loop over path tracing depth
@@ -539,7 +608,8 @@ void MyClosestHitShader(inout RayPayload payload, in MyAttributes attr)
 	uint material_offset = infos[instanceId].material_offset;
 	uint diffuse_sampler_offset = infos[instanceId].diffuse_sampler_offset;
 	uint normal_sampler_offset = infos[instanceId].normal_sampler_offset;
-	float4x4 rotation_scale_matrix = infos[instanceId].rotation_scale_matrix;
+	uint index_size = infos[instanceId].index_size;
+	float3x3 rotation_scale_matrix = (float3x3)ObjectToWorld3x4(); //instance transform without translation, animation keeps it current
 
 	float eta = 0;
 	float reflectiveness = 0;
@@ -556,16 +626,10 @@ void MyClosestHitShader(inout RayPayload payload, in MyAttributes attr)
 		emittance = materials[material_offset].emittance;
 	}
 
-	// Get the base index of the triangle's first 16 bit index.
-	uint indexSizeInBytes = 4;
-	uint indicesPerTriangle = 3;
-	uint triangleIndexStride = indicesPerTriangle * indexSizeInBytes;
-	uint baseIndex = PrimitiveIndex() * triangleIndexStride;
-
         float hitType = emittance ? 1 : 0; // 1 is light, 0 is not
 
-	// Load up 3 16 bit indices for the triangle.
-	const uint3 indices = Indices[model_offset].Load3(baseIndex);
+	// Load up the 3 indices for the triangle.
+	const uint3 indices = LoadTriangleIndices(model_offset, index_size, PrimitiveIndex());
 
         float3 vertexPosition[3] = {
 		Vertices[model_offset][indices[0]].position,
@@ -594,43 +658,50 @@ void MyClosestHitShader(inout RayPayload payload, in MyAttributes attr)
 
         float2 triangleUV = HitAttribute2D(vertexUVs, attr);
 
+        //ray cone footprint at the hit picks the mip level of each texture
+        float coneWidth = payload.coneWidth + payload.coneSpread * RayTCurrent();
+        float3 worldEdge1 = mul(rotation_scale_matrix, vertexPosition[1] - vertexPosition[0]);
+        float3 worldEdge2 = mul(rotation_scale_matrix, vertexPosition[2] - vertexPosition[0]);
+        float3 faceNormal = cross(worldEdge1, worldEdge2);
+        float2 uvEdge1 = vertexUVs[1] - vertexUVs[0];
+        float2 uvEdge2 = vertexUVs[2] - vertexUVs[0];
+        float diffuseLod = 0.0f;
+        if (texture_offset != NULL_OFFSET)
+        {
+          diffuseLod = TextureLod(text[texture_offset], worldEdge1, worldEdge2, uvEdge1, uvEdge2, coneWidth, WorldRayDirection(), faceNormal);
+        }
+
         //if texture map, then sample that instead
         if (texture_normal_offset != NULL_OFFSET)
         {
-          triangleNormal = normal_text[texture_normal_offset].SampleLevel(samplers[normal_sampler_offset], triangleUV, 0);
-          triangleNormal.z = -triangleNormal.z;
-          triangleNormal = (triangleNormal * 2.0) - 1.0;
-          triangleNormal = mul(rotation_scale_matrix, float4(triangleNormal, 0.0f));
-          triangleNormal = normalize(triangleNormal);
-
-          float3 edge1 = vertexPosition[1] - vertexPosition[0];
-          float3 edge2 = vertexPosition[2] - vertexPosition[0];
-          float2 deltaUV1 = vertexUVs[1] - vertexUVs[0];
-          float2 deltaUV2 = vertexUVs[2] - vertexUVs[0];
-
-          float f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-
-          float3 tangent = {f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x),
-                            f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y),
-                            f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z)};
-
-          tangent = mul(rotation_scale_matrix, float4(tangent, 0.0f));
-
-          tangent = normalize(tangent - dot(tangent, triangleNormal) * triangleNormal);
+          float normalLod = TextureLod(normal_text[texture_normal_offset], worldEdge1, worldEdge2, uvEdge1, uvEdge2, coneWidth, WorldRayDirection(), faceNormal);
+          //normal maps are stored as signed x and y (NormalMapCodec.h), z is rebuilt
+          float2 mapXY = normal_text[texture_normal_offset].SampleLevel(samplers[normal_sampler_offset], triangleUV, normalLod).xy;
+          float3 mapNormal = float3(mapXY, sqrt(saturate(1.0 - dot(mapXY, mapXY))));
+
+          //tangent frames are precomputed per vertex at import (TangentFrames.cpp)
+          float4 vertexTangents[3] = {
+            Tangents[model_offset][indices[0]],
+            Tangents[model_offset][indices[1]],
+            Tangents[model_offset][indices[2]]
+          };
+          float3 tangentAttributes[3] = { vertexTangents[0].xyz, vertexTangents[1].xyz, vertexTangents[2].xyz };
+          float handedness = vertexTangents[0].w;
+
+          float3 normal = normalize(mul(rotation_scale_matrix, triangleNormal));
+          float3 tangent = mul(rotation_scale_matrix, HitAttribute(tangentAttributes, attr));
+          tangent = normalize(tangent - dot(tangent, normal) * normal);
 
           //Create the biTangent
-          float3 bitangent = cross(triangleNormal, tangent);
+          float3 bitangent = cross(normal, tangent) * handedness;
 
-          //Create the normal matrix
-          float3x3 TBN = float3x3(tangent, bitangent, triangleNormal);
-
-          //Convert normal from normal map to texture space
-          triangleNormal = normalize(mul(triangleNormal, TBN));
+          //Convert normal from normal map to world space
+          triangleNormal = normalize(mapNormal.x * tangent + mapNormal.y * bitangent + mapNormal.z * normal);
         } 
         else 
         {
           //multiply by rotation/scale matrix to correct the normals
-          triangleNormal = mul(rotation_scale_matrix, float4(triangleNormal, 1.0f)).xyz;
+          triangleNormal = mul(rotation_scale_matrix, triangleNormal);
           triangleNormal = normalize(triangleNormal);
         }
 
@@ -667,7 +738,7 @@ void MyClosestHitShader(inout RayPayload payload, in MyAttributes attr)
 		float3 color = BACKGROUND_COLOR.xyz;
 		if (texture_offset != NULL_OFFSET)
 		{
-			float3 tex = text[texture_offset].SampleLevel(samplers[diffuse_sampler_offset], triangleUV, 0);
+			float3 tex = text[texture_offset].SampleLevel(samplers[diffuse_sampler_offset], triangleUV, diffuseLod);
 			color = payload.color.rgb * tex.rgb;
 		}
 		else if (material_offset != NULL_OFFSET)
@@ -679,7 +750,14 @@ void MyClosestHitShader(inout RayPayload payload, in MyAttributes attr)
 	}
 	else // Do a diffuse bounce
 	{
-		DiffuseBounce(texture_offset, material_offset, diffuse_sampler_offset, emittance, triangleNormal, hitPosition, hitType, triangleUV, payload);
+		DiffuseBounce(texture_offset, material_offset, diffuse_sampler_offset, emittance, triangleNormal, hitPosition, hitType, triangleUV, diffuseLod, payload);
+	}
+
+	//the next ray starts with this width; mirrors and glass keep the spread, rough bounces widen it
+	payload.coneWidth = coneWidth;
+	if (reflectiveness <= 0.0f && refractiveness <= 0.0f)
+	{
+		payload.coneSpread += DIFFUSE_CONE_SPREAD;
 	}
 }
 